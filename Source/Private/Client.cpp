@@ -2,7 +2,7 @@
  * TCP用户系统 - 客户端实现
  * 
  * 文件结构:
- * 1. 网络连接管理 - TCP客户端连接建立、断开和错误处理
+ * 1. 网络连接管理 - TCP(或本机Unix域套接字、共享内存传输)连接建立、断开和错误处理
  * 2. 用户界面系统 - 分层界面设计(登录前/登录后)
  * 3. 消息通信 - 与服务器的可靠消息收发机制
  * 4. 业务流程控制 - 登录验证、用户操作流程管理
@@ -19,6 +19,7 @@
  */
 
 #include "../Public/TCP_System.h"
+#include "../Public/Shm_Transport.h"
 #include <iostream>
 #include <cstdlib>
 
@@ -41,9 +42,20 @@ void clearScreen() {
 class TCPUserClient {
 private:
     SOCKET clientSocket;       // 客户端套接字
-    std::string serverAddress; // 服务器地址
+    std::string serverAddress; // 服务器地址，以'/'开头时为Unix域套接字路径，以"shm:"开头时为共享内存握手路径
     int serverPort;           // 服务器端口
     bool connected;           // 连接状态标志
+#ifdef __linux__
+    ShmClient shmClient;      // 共享内存传输(已握手时代替clientSocket收发)
+#endif
+
+    bool usingShm() const {
+#ifdef __linux__
+        return shmClient.isConnected();
+#else
+        return false;
+#endif
+    }
 
 public:
     TCPUserClient(const std::string& addr = "127.0.0.1", int port = 8080) 
@@ -64,6 +76,18 @@ public:
         }
 #endif
 
+#ifndef _WIN32
+        // 本机服务器的Unix域套接字 - 不经过TCP协议栈，协议与TCP连接相同
+        if (!serverAddress.empty() && serverAddress[0] == '/') {
+            return connectLocal();
+        }
+#endif
+#ifdef __linux__
+        if (serverAddress.compare(0, 4, "shm:") == 0) {
+            return connectShm();
+        }
+#endif
+
         // 创建客户端套接字
         clientSocket = socket(AF_INET, SOCK_STREAM, 0);
         if (clientSocket == INVALID_SOCKET) {
@@ -108,6 +132,49 @@ public:
             return false;
         }
 
+        return onConnected();
+    }
+
+#ifndef _WIN32
+    // 连接本机服务器的Unix域套接字(服务器以--unix-socket启用)
+    bool connectLocal() {
+        sockaddr_un serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sun_family = AF_UNIX;
+        if (serverAddress.length() >= sizeof(serverAddr.sun_path)) {
+            std::cerr << "Unix域套接字路径过长" << std::endl;
+            return false;
+        }
+        strncpy(serverAddr.sun_path, serverAddress.c_str(), sizeof(serverAddr.sun_path) - 1);
+
+        clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (clientSocket == INVALID_SOCKET) {
+            std::cerr << "创建客户端套接字失败" << std::endl;
+            return false;
+        }
+        if (::connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+            std::cerr << "连接服务器失败" << std::endl;
+            closesocket(clientSocket);
+            clientSocket = INVALID_SOCKET;
+            return false;
+        }
+        return onConnected();
+    }
+#endif
+
+#ifdef __linux__
+    // 经共享内存传输连接本机服务器(服务器以--shm-socket启用)
+    bool connectShm() {
+        if (!shmClient.connect(serverAddress.substr(4))) {
+            std::cerr << "共享内存握手失败" << std::endl;
+            return false;
+        }
+        return onConnected();
+    }
+#endif
+
+    // 连接建立后接收服务器欢迎消息
+    bool onConnected() {
         connected = true;
         
         // 接收服务器欢迎消息
@@ -119,10 +186,13 @@ public:
 
     // 断开连接 - 优雅关闭连接并清理资源
     void disconnect() {
-        if (connected && clientSocket != INVALID_SOCKET) {
+        if (connected && (clientSocket != INVALID_SOCKET || usingShm())) {
             sendMessage("QUIT");  // 通知服务器客户端退出
             connected = false;
         }
+#ifdef __linux__
+        shmClient.close();
+#endif
         
         if (clientSocket != INVALID_SOCKET) {
             closesocket(clientSocket);
@@ -136,9 +206,15 @@ public:
 
     // 发送消息到服务器 - 确保消息完整发送
     bool sendMessage(const std::string& message) {
+        std::string fullMessage = message + "\n";  // 添加消息结束符
+#ifdef __linux__
+        if (connected && usingShm()) {
+            connected = shmClient.send(fullMessage.c_str(), fullMessage.length());
+            return connected;
+        }
+#endif
         if (!connected || clientSocket == INVALID_SOCKET) return false;
         
-        std::string fullMessage = message + "\n";  // 添加消息结束符
         int totalSent = 0;
         int messageLength = static_cast<int>(fullMessage.length());
         
@@ -154,15 +230,30 @@ public:
         return true;
     }
 
+    // 接收一段数据 - 共享内存传输时从响应环读取，timeoutMs为负数表示一直等待
+    int receiveChunk(char* buffer, size_t capacity, int timeoutMs) {
+#ifdef __linux__
+        if (usingShm()) {
+            int received = shmClient.receive(buffer, capacity, timeoutMs);
+            if (received < 0) {
+                connected = false;
+            }
+            return received;
+        }
+#endif
+        (void)timeoutMs;
+        return recv(clientSocket, buffer, static_cast<int>(capacity), 0);
+    }
+
     // 接收服务器消息 - 处理网络延迟和数据分片
     std::string receiveMessage() {
-        if (!connected || clientSocket == INVALID_SOCKET) return "";
+        if (!connected || (clientSocket == INVALID_SOCKET && !usingShm())) return "";
         
         char buffer[1024];
         std::string message;
         
         while (true) {
-            int received = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+            int received = receiveChunk(buffer, sizeof(buffer) - 1, -1);
             if (received <= 0) {
                 connected = false;
                 return "";
@@ -186,6 +277,17 @@ public:
 
     // 非阻塞接收消息 - 检查是否有待处理的消息
     std::string receiveMessageNonBlocking() {
+#ifdef __linux__
+        if (connected && usingShm()) {
+            char buffer[1024];
+            int received = receiveChunk(buffer, sizeof(buffer) - 1, 0);
+            if (received <= 0) {
+                return "";
+            }
+            std::string message(buffer, received);
+            return message.substr(0, message.find('\n'));
+        }
+#endif
         if (!connected || clientSocket == INVALID_SOCKET) return "";
         
         // 设置非阻塞模式
@@ -561,17 +663,24 @@ int main() {
     std::string serverAddr = "127.0.0.1";
     int serverPort = 8080;
     
+#ifdef _WIN32
     std::cout << "请输入服务器地址 (默认 127.0.0.1): ";
+#else
+    std::cout << "请输入服务器地址 (默认 127.0.0.1，本机Unix域套接字输入其路径，共享内存传输输入shm:路径): ";
+#endif
     std::string input;
     std::getline(std::cin, input);
     if (!input.empty()) {
         serverAddr = input;
     }
     
-    std::cout << "请输入服务器端口 (默认 8080): ";
-    std::getline(std::cin, input);
-    if (!input.empty()) {
-        serverPort = atoi(input.c_str());
+    // Unix域套接字路径与共享内存握手路径不需要端口
+    if (serverAddr[0] != '/' && serverAddr.compare(0, 4, "shm:") != 0) {
+        std::cout << "请输入服务器端口 (默认 8080): ";
+        std::getline(std::cin, input);
+        if (!input.empty()) {
+            serverPort = atoi(input.c_str());
+        }
     }
 
     // 创建客户端实例并启动
@@ -0,0 +1,380 @@
+/*
+ * TCP用户系统 - 文本数据文件并行加载实现
+ *
+ * 文件结构:
+ * 1. 分隔符查找 - 标量、SSE2与AVX2三种实现，启动时按CPU支持选择；转义与未转义格式各一组
+ * 2. 文件映射 - 只读映射整个文件
+ * 3. 分块解析 - 每个线程解析一块，规则与User::deserialize(有转义标记)或User::deserializeLegacy相同
+ * 4. 加载 - 切分、并行解析与按块顺序合并
+ */
+
+#include "../Public/Csv_Loader.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CSV_LOADER_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace {
+    // 每个解析线程至少分到的字节数 - 更小的文件减少线程数，线程创建开销不超过解析本身
+    const unsigned long long MIN_CHUNK_BYTES = 1024 * 1024;
+
+    // 从p开始查找第一个换行、逗号或(转义格式下的)反斜杠，没有时返回end；
+    // 未转义的早期文件中反斜杠是普通字节，只需查找换行与逗号
+    typedef const char* (*ScanFunction)(const char* p, const char* end);
+
+    template <bool ESCAPED>
+    const char* scanScalar(const char* p, const char* end) {
+        while (p < end && *p != '\n' && *p != ',' && (!ESCAPED || *p != '\\')) {
+            ++p;
+        }
+        return p;
+    }
+
+#ifdef CSV_LOADER_X86
+    template <bool ESCAPED>
+    __attribute__((target("sse2")))
+    const char* scanSse2(const char* p, const char* end) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        while (end - p >= 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(block, newline), _mm_cmpeq_epi8(block, comma));
+            if (ESCAPED) {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, backslash));
+            }
+            unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+            if (mask != 0) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 16;
+        }
+        return scanScalar<ESCAPED>(p, end);
+    }
+
+    template <bool ESCAPED>
+    __attribute__((target("avx2")))
+    const char* scanAvx2(const char* p, const char* end) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i comma = _mm256_set1_epi8(',');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        while (end - p >= 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(block, newline), _mm256_cmpeq_epi8(block, comma));
+            if (ESCAPED) {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, backslash));
+            }
+            unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(hit));
+            if (mask != 0) {
+                return p + __builtin_ctz(mask);
+            }
+            p += 32;
+        }
+        return scanScalar<ESCAPED>(p, end);
+    }
+#endif
+
+    template <bool ESCAPED>
+    ScanFunction selectScanner(const char*& name) {
+#ifdef CSV_LOADER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            name = "avx2";
+            return scanAvx2<ESCAPED>;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            name = "sse2";
+            return scanSse2<ESCAPED>;
+        }
+#endif
+        name = "scalar";
+        return scanScalar<ESCAPED>;
+    }
+
+    // 文件是否以转义标记行开头(标记行之后是换行或文件结束)，是时返回标记行之后的位置
+    const char* skipEscapedMarker(const char* data, const char* end) {
+        size_t length = sizeof(USER_FILE_ESCAPED_MARKER) - 1;
+        if (static_cast<size_t>(end - data) < length || memcmp(data, USER_FILE_ESCAPED_MARKER, length) != 0) {
+            return 0;
+        }
+        if (data + length == end) {
+            return end;
+        }
+        return data[length] == '\n' ? data + length + 1 : 0;
+    }
+
+    int onlineCpuCount() {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? static_cast<int>(info.dwNumberOfProcessors) : 1;
+#else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? static_cast<int>(count) : 1;
+#endif
+    }
+
+    // 只读映射整个文件 - 析构时解除
+    class FileView {
+    private:
+        const char* data;
+        size_t size;
+#ifdef _WIN32
+        HANDLE fileHandle;
+        HANDLE mapping;
+#endif
+
+        FileView(const FileView&);
+        FileView& operator=(const FileView&);
+
+    public:
+        FileView()
+            : data(0), size(0)
+#ifdef _WIN32
+            , fileHandle(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+        {}
+
+        ~FileView() {
+#ifdef _WIN32
+            if (data) {
+                UnmapViewOfFile(data);
+            }
+            if (mapping) {
+                CloseHandle(mapping);
+            }
+            if (fileHandle != INVALID_HANDLE_VALUE) {
+                CloseHandle(fileHandle);
+            }
+#else
+            if (data) {
+                munmap(const_cast<char*>(data), size);
+            }
+#endif
+        }
+
+        // 空文件打开成功但不映射(data为0、size为0)
+        bool open(const std::string& path) {
+#ifdef _WIN32
+            fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                     FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            LARGE_INTEGER fileSize;
+            if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize)) {
+                return false;
+            }
+            if (fileSize.QuadPart == 0) {
+                return true;
+            }
+            mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            data = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : 0;
+            size = data ? static_cast<size_t>(fileSize.QuadPart) : 0;
+            return data != 0;
+#else
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0) {
+                close(fd);
+                return false;
+            }
+            if (info.st_size == 0) {
+                close(fd);
+                return true;
+            }
+            void* mapped = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED) {
+                return false;
+            }
+#ifdef __linux__
+            madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);     // 各线程顺序读取，加大预读
+#endif
+            data = static_cast<const char*>(mapped);
+            size = static_cast<size_t>(info.st_size);
+            return true;
+#endif
+        }
+
+        const char* begin() const { return data; }
+        size_t length() const { return size; }
+    };
+
+    // 一个解析线程的输入与结果
+    struct ParseTask {
+        const char* begin;
+        const char* end;
+        ScanFunction scan;
+        std::vector<User> users;
+    };
+
+    // 解析一块 - 块以换行结束(最后一块可能不以换行结束)；转义与字段规则同User::deserialize，
+    // 未转义格式的查找函数不在反斜杠处停下，只按前两个逗号切分，结果同User::deserializeLegacy
+    void parseChunk(ParseTask& task) {
+        std::string fields[3];
+        size_t index = 0;
+        const char* end = task.end;
+        const char* lineStart = task.begin;
+        const char* p = task.begin;
+        while (p < end) {
+            const char* q = task.scan(p, end);
+            fields[index].append(p, static_cast<size_t>(q - p));
+            if (q == end) {
+                break;
+            }
+            if (*q == '\n') {
+                if (q > lineStart) {
+                    task.users.push_back(User(fields[0], fields[1]));
+                    task.users.back().setUserString(fields[2]);
+                }
+                fields[0].clear();
+                fields[1].clear();
+                fields[2].clear();
+                index = 0;
+                lineStart = q + 1;
+                p = q + 1;
+            } else if (*q == ',') {
+                if (index < 2) {
+                    ++index;
+                } else {
+                    fields[2] += ',';
+                }
+                p = q + 1;
+            } else if (q + 1 == end || q[1] == '\n') {
+                fields[index] += '\\';      // 行末的反斜杠按原样保留
+                p = q + 1;
+            } else {
+                char next = q[1];
+                if (next == 'n') {
+                    fields[index] += '\n';
+                } else if (next == 'r') {
+                    fields[index] += '\r';
+                } else if (next == '\\' || next == ',') {
+                    fields[index] += next;
+                } else {
+                    fields[index] += '\\';  // 未知转义按原样保留(兼容转义前写入的数据)
+                    fields[index] += next;
+                }
+                p = q + 2;
+            }
+        }
+        if (lineStart < end) {
+            task.users.push_back(User(fields[0], fields[1]));
+            task.users.back().setUserString(fields[2]);
+        }
+    }
+
+#ifdef _WIN32
+    DWORD WINAPI parseThreadProc(LPVOID param) {
+        parseChunk(*static_cast<ParseTask*>(param));
+        return 0;
+    }
+#else
+    void* parseThreadProc(void* param) {
+        parseChunk(*static_cast<ParseTask*>(param));
+        return NULL;
+    }
+#endif
+}
+
+// 加载 - 第0块由调用线程解析，其余各块各一个线程；线程创建失败的块由调用线程补做
+bool CsvUserLoader::load(const std::string& path, std::map<std::string, User>& users, CsvLoadStats& stats) {
+    FileView file;
+    if (!file.open(path)) {
+        return false;
+    }
+    stats.bytes = file.length();
+    if (file.length() == 0) {
+        return true;
+    }
+
+    unsigned long long startMs = TimerWheel::nowMs();
+    const char* data = file.begin();
+    const char* end = data + file.length();
+    const char* records = skipEscapedMarker(data, end);
+    stats.escaped = records != 0;
+    if (records) {
+        data = records;
+    }
+    ScanFunction scan = stats.escaped ? selectScanner<true>(stats.scanner) : selectScanner<false>(stats.scanner);
+    unsigned long long recordBytes = static_cast<unsigned long long>(end - data);
+    unsigned long long chunkLimit = recordBytes / MIN_CHUNK_BYTES;
+    int threadCount = onlineCpuCount();
+    if (static_cast<unsigned long long>(threadCount) > chunkLimit) {
+        threadCount = chunkLimit > 0 ? static_cast<int>(chunkLimit) : 1;
+    }
+
+    // 切分 - 每块的起点后移到上一个换行之后，块之间没有跨块的行
+    std::vector<ParseTask> tasks(static_cast<size_t>(threadCount));
+    const char* chunkStart = data;
+    for (int i = 0; i < threadCount; ++i) {
+        const char* chunkEnd = end;
+        if (i + 1 < threadCount) {
+            const char* cut = data + static_cast<size_t>(recordBytes * (i + 1) / threadCount);
+            if (cut < chunkStart) {
+                cut = chunkStart;
+            }
+            const void* newline = memchr(cut, '\n', static_cast<size_t>(end - cut));
+            chunkEnd = newline ? static_cast<const char*>(newline) + 1 : end;
+        }
+        tasks[i].begin = chunkStart;
+        tasks[i].end = chunkEnd;
+        tasks[i].scan = scan;
+        chunkStart = chunkEnd;
+    }
+
+#ifdef _WIN32
+    std::vector<HANDLE> threads(tasks.size(), NULL);
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        threads[i] = CreateThread(NULL, 0, parseThreadProc, &tasks[i], 0, NULL);
+    }
+#else
+    std::vector<pthread_t> threads(tasks.size());
+    std::vector<bool> started(tasks.size(), false);
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        started[i] = pthread_create(&threads[i], NULL, parseThreadProc, &tasks[i]) == 0;
+    }
+#endif
+    parseChunk(tasks[0]);
+    stats.threads = 1;
+    for (size_t i = 1; i < tasks.size(); ++i) {
+#ifdef _WIN32
+        if (threads[i]) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+            ++stats.threads;
+        } else {
+            parseChunk(tasks[i]);
+        }
+#else
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+            ++stats.threads;
+        } else {
+            parseChunk(tasks[i]);
+        }
+#endif
+    }
+    unsigned long long parsedMs = TimerWheel::nowMs();
+    stats.parseMs = parsedMs - startMs;
+
+    // 合并 - 按块的顺序插入，后出现的同一用户ID覆盖之前的；按用户ID顺序的文件每次都插在末尾
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        std::vector<User>& parsed = tasks[i].users;
+        for (size_t j = 0; j < parsed.size(); ++j) {
+            std::map<std::string, User>::iterator it =
+                users.insert(users.end(), std::make_pair(parsed[j].getUserId(), User()));
+            it->second = std::move(parsed[j]);
+        }
+        stats.records += parsed.size();
+        std::vector<User>().swap(parsed);
+    }
+    stats.mergeMs = TimerWheel::nowMs() - parsedMs;
+    return true;
+}
@@ -0,0 +1,519 @@
+/*
+ * TCP用户系统 - epoll事件循环实现
+ *
+ * 文件结构:
+ * 1. 生命周期管理 - epoll/eventfd创建、线程启动与停止
+ * 2. 连接接受 - 在本循环的监听套接字上批量accept4并注册到epoll
+ * 3. 事件处理 - 边缘触发读写，接收数据直接写入会话环形缓冲，分帧后交给服务器处理
+ *
+ * 技术实现:
+ * - 读事件循环recv直到EAGAIN，同一次读取中的多条消息依次处理
+ * - 写事件只负责冲刷会话的发送缓冲，发送缓冲由sendToSession填充
+ * - 启用命令执行线程时，关闭请求经closeRequests与eventfd转交循环线程
+ * - 会话被挤占或收到QUIT后标记为非活跃，本轮事件处理结束即关闭
+ * - 超时检查: 每个会话在时间轮中至多一个定时器，到期时按服务器的超时规则判定，
+ *   未超时(期间收到过数据或已登录)则按新的期限重新计时
+ * - 热重启移交: 排空期间不读取，会话已接收的数据在接收缓冲或内核中，随套接字一起交给新进程；
+ *   有命令在执行线程中的会话以短间隔重试
+ */
+
+#include "../Public/Event_Loop.h"
+#include "../Public/User_Shard.h"
+
+#ifdef __linux__
+
+#include <string.h>
+
+namespace {
+    const int MAX_EVENTS = 256;             // 单次epoll_wait最多处理的事件数
+    const int MAX_ACCEPTS = 64;             // 单次监听可读事件最多接受的连接数，避免饿死已有连接
+    const int HANDOFF_RETRY_MS = 10;        // 热重启移交时重试仍有命令在执行的会话的间隔
+}
+
+EventLoop::EventLoop(TCPUserSystemServer* owner, int index, SOCKET listener, SOCKET localListener)
+    : server(owner), loopIndex(index), epollFd(-1), wakeFd(-1), listenSocket(listener),
+      localListenSocket(localListener), running(false), draining(false), listenerRemoved(false),
+      handingOff(false), interruptHow(-1), shard(0), threadStarted(false), loopNowMs(TimerWheel::nowMs()) {}
+
+EventLoop::~EventLoop() {
+    stop();
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+}
+
+// 创建epoll实例与唤醒描述符，注册监听套接字后启动循环线程
+bool EventLoop::start() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        return false;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+        return false;
+    }
+
+    // 监听套接字以水平触发注册，单批未接受完的连接下一轮继续处理
+    int flags = fcntl(listenSocket, F_GETFL, 0);
+    if (flags < 0 || fcntl(listenSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = listenSocket;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &ev) < 0) {
+        return false;
+    }
+
+    // Unix域监听套接字由全部循环共同注册，EPOLLEXCLUSIVE避免每个新连接唤醒所有循环
+    if (localListenSocket != INVALID_SOCKET) {
+        flags = fcntl(localListenSocket, F_GETFL, 0);
+        if (flags < 0 || fcntl(localListenSocket, F_SETFL, flags | O_NONBLOCK) < 0) {
+            return false;
+        }
+        ev.events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+        ev.events |= EPOLLEXCLUSIVE;
+#endif
+        ev.data.fd = localListenSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, localListenSocket, &ev) < 0) {
+            return false;
+        }
+    }
+
+    running.store(true);
+    if (pthread_create(&thread, NULL, threadProc, this) != 0) {
+        running.store(false);
+        return false;
+    }
+    threadStarted = true;
+    return true;
+}
+
+// 热重启接管的会话 - 循环线程尚未启动，无需加锁
+void EventLoop::adoptSession(SimpleSharedPtr<ClientSession> session) {
+    adoptedSessions.push_back(session);
+}
+
+// 进入排空状态 - 由循环线程在下次唤醒时停止接受与读取，并关闭响应已写完的连接；
+// 热重启时先尝试把会话移交给新进程
+void EventLoop::beginDrain(bool handoff) {
+    handingOff.store(handoff);
+    draining.store(true);
+    wakeup();
+}
+
+// 请求中断全部连接 - 停止期限到期时由主线程调用，连接表只由循环线程访问，shutdown在循环线程中执行；
+// 两端都关后写出失败，排空时随即关闭
+void EventLoop::interruptConnections(bool force) {
+    interruptHow.store(force ? SHUT_RDWR : SHUT_RD);
+    wakeup();
+}
+
+void EventLoop::processInterruptRequest() {
+    int how = static_cast<int>(interruptHow.load());
+    if (how < 0) {
+        return;
+    }
+    interruptHow.store(-1);
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i]) {
+            shutdown(static_cast<SOCKET>(i), how);
+        }
+    }
+}
+
+// 停止循环线程 - 线程退出前会关闭其管理的全部连接；未启动时关闭已分配给本循环的接管会话
+void EventLoop::stop() {
+    if (!threadStarted) {
+        for (size_t i = 0; i < adoptedSessions.size(); ++i) {
+            server->closeSession(adoptedSessions[i]);
+        }
+        adoptedSessions.clear();
+        return;
+    }
+    running.store(false);
+    wakeup();
+    pthread_join(thread, NULL);
+    threadStarted = false;
+}
+
+void* EventLoop::threadProc(void* param) {
+    static_cast<EventLoop*>(param)->run();
+    return NULL;
+}
+
+// 唤醒循环线程 - eventfd计数加一即可触发EPOLLIN
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;  // 计数器已满时写入失败，但循环必然已处于可读状态
+}
+
+// 发送请求 - 调用线程直接在发送锁内写出
+void EventLoop::requestFlush(ClientSession* session) {
+    server->flushSessionOutput(*session);
+}
+
+// 关闭请求 - 由循环线程在下次唤醒时执行
+void EventLoop::requestClose(ClientSession* session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    {
+        SimpleLockGuard lock(closeMutex);
+        closeRequests.push_back(std::make_pair(socket, session->getSessionId()));
+    }
+    wakeup();
+}
+
+// 按套接字与会话ID查找连接 - 会话ID不一致说明原连接已关闭、描述符已被新连接复用
+SimpleSharedPtr<ClientSession> EventLoop::findSession(SOCKET socket, const std::string& sessionId) {
+    if (socket == INVALID_SOCKET || static_cast<size_t>(socket) >= connections.size() || !connections[socket] ||
+        connections[socket]->getSessionId() != sessionId) {
+        return SimpleSharedPtr<ClientSession>();
+    }
+    return connections[socket];
+}
+
+// 处理关闭请求 - 会话ID不一致说明原连接已关闭、描述符已被新连接复用
+void EventLoop::processCloseRequests() {
+    std::vector<std::pair<SOCKET, std::string> > requests;
+    {
+        SimpleLockGuard lock(closeMutex);
+        requests.swap(closeRequests);
+    }
+    for (size_t i = 0; i < requests.size(); ++i) {
+        SimpleSharedPtr<ClientSession> session = findSession(requests[i].first, requests[i].second);
+        if (!session || server->deferCloseUntilCommit(session)) {
+            continue;   // 暂存的响应提交后再次requestClose
+        }
+        server->flushSessionOutput(*session);  // 尽力送出GOODBYE/KICKED等最后的响应
+        closeConnection(session);
+    }
+}
+
+// 接受新连接 - accept4直接返回非阻塞套接字，创建会话并以边缘触发方式注册读写事件
+void EventLoop::acceptConnections(SOCKET listener) {
+    if (draining.load()) {
+        return;     // 监听套接字已关闭，移除前不再accept
+    }
+    for (int accepted = 0; accepted < MAX_ACCEPTS; ++accepted) {
+        SOCKET socket = server->acceptClient(listener, true);
+        if (socket == INVALID_SOCKET) {
+            server->handleAcceptFailure(listener, errno);   // 描述符耗尽时关闭一个等待中的连接，监听套接字不会一直就绪
+            return;
+        }
+        if (!server->admitConnection(socket)) {
+            continue;   // 超过连接数上限，已回复ERROR|BUSY并关闭
+        }
+
+        SimpleSharedPtr<ClientSession> session = server->openSession(socket, true, this);
+
+        if (static_cast<size_t>(socket) >= connections.size()) {
+            connections.resize(socket + 1);
+        }
+        connections[socket] = session;
+        scheduleTimeout(session);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = socket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &ev) < 0) {
+            closeConnection(session);
+        }
+    }
+}
+
+// 注册接管的会话 - 边缘触发注册时内核立即报告已就绪的事件: 套接字中已有的请求触发读取，
+// 可写触发冲刷旧进程未送出的响应；接收缓冲中已有的完整请求直接处理
+void EventLoop::registerAdoptedSessions() {
+    for (size_t i = 0; i < adoptedSessions.size(); ++i) {
+        SimpleSharedPtr<ClientSession> session = adoptedSessions[i];
+        SOCKET socket = session->getSocket();
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);     // io_uring后端接受的连接是阻塞的
+
+        if (static_cast<size_t>(socket) >= connections.size()) {
+            connections.resize(socket + 1);
+        }
+        connections[socket] = session;
+        scheduleTimeout(session);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = socket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &ev) < 0) {
+            closeConnection(session);
+            continue;
+        }
+        if (session->getInputBuffer().size() > 0 && !server->processSessionInput(session)) {
+            closeOrDefer(session);
+        }
+    }
+    adoptedSessions.clear();
+}
+
+// 事件循环主体
+void EventLoop::run() {
+    struct epoll_event events[MAX_EVENTS];
+    server->bindCurrentThread(THREAD_ROLE_IO, loopIndex);
+    if (shard && server->isPlacementEnabled()) {
+        shard->localize();          // 分片的用户在主线程加载，绑定后在本节点重建
+    }
+    registerAdoptedSessions();
+    if (shard) {
+        shard->processInbox();      // 本循环启动前其他分片投递的消息
+    }
+
+    while (running.load()) {
+        int timeout = timers.nextWaitMs(TimerWheel::nowMs());
+        if (listenerRemoved && handingOff.load() && (timeout < 0 || timeout > HANDOFF_RETRY_MS)) {
+            timeout = HANDOFF_RETRY_MS;
+        }
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        loopNowMs = TimerWheel::nowMs();
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == wakeFd) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                processCloseRequests();
+                processInterruptRequest();
+                if (shard) {
+                    shard->processInbox();
+                }
+                continue;
+            }
+
+            if (fd == listenSocket || fd == localListenSocket) {
+                acceptConnections(fd);
+                continue;
+            }
+
+            if (static_cast<size_t>(fd) >= connections.size() || !connections[fd]) {
+                continue;  // 同一批事件中连接已被关闭
+            }
+            SimpleSharedPtr<ClientSession> session = connections[fd];
+            uint32_t flags = events[i].events;
+
+            // 先读后写: 对端关闭前发送的数据仍需处理
+            if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                handleReadable(session);
+            }
+            if (connections[fd] && (flags & EPOLLOUT)) {
+                handleWritable(session);
+            }
+        }
+
+        processTimeouts();
+        if (draining.load()) {
+            drainConnections();
+        }
+    }
+
+    closeAllConnections();
+}
+
+// 读事件 - 直接读入会话的接收环形缓冲直到EAGAIN，缓冲写满时先分帧处理腾出空间
+void EventLoop::handleReadable(SimpleSharedPtr<ClientSession> session) {
+    SOCKET socket = session->getSocket();
+    InputRingBuffer& input = session->getInputBuffer();
+    bool peerClosed = false;
+
+    while (true) {
+        if (draining.load()) {
+            break;      // 排空期间不再读取，已读入的帧在下面处理完，连接在响应写完后关闭
+        }
+        size_t space;
+        char* target = input.writeSpace(space);
+        if (space == 0) {
+            if (!server->processSessionInput(session) || input.freeSpace() == 0) {
+                peerClosed = true;  // 帧过长或会话已结束
+                break;
+            }
+            continue;
+        }
+
+        ssize_t received = recv(socket, target, space, 0);
+        if (received > 0) {
+            input.commit(static_cast<size_t>(received));
+            session->touch(loopNowMs);
+            continue;
+        }
+        if (received == 0) {
+            peerClosed = true;  // 对端关闭连接
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            peerClosed = true;  // 连接错误
+        }
+        break;
+    }
+
+    // 处理本轮收到的全部完整帧
+    if (!server->processSessionInput(session)) {
+        peerClosed = true;
+    }
+
+    if (peerClosed) {
+        closeOrDefer(session);
+        return;
+    }
+
+    // 已登录会话的定时器按空闲期限惰性检查；未登录(含刚登出)的会话重新计时，使登录期限及时生效
+    // 持续发送请求却始终不登录的会话在此关闭
+    if (!session->getTimeoutTimer().isLinked() || !session->isLoggedIn()) {
+        SessionTimeout kind = scheduleTimeout(session);
+        if (kind != SESSION_TIMEOUT_NONE) {
+            server->recordSessionTimeout(session, kind);
+            closeOrDefer(session);
+        }
+    }
+}
+
+// 关闭连接，若会话仍有命令在执行线程中则等其执行完后由requestClose关闭
+void EventLoop::closeOrDefer(SimpleSharedPtr<ClientSession> session) {
+    if (server->deferSessionClose(session)) {
+        return;
+    }
+    server->flushSessionOutput(*session);  // 尽力送出GOODBYE/KICKED等最后的响应
+    closeConnection(session);
+}
+
+// 设置会话的超时定时器 - 未启用任何超时时不进入时间轮
+SessionTimeout EventLoop::scheduleTimeout(SimpleSharedPtr<ClientSession> session) {
+    unsigned long long deadline;
+    SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+    if (kind == SESSION_TIMEOUT_NONE && deadline > 0) {
+        timers.schedule(&session->getTimeoutTimer(), deadline);
+    }
+    return kind;
+}
+
+// 处理到期定时器 - 会话已超时则关闭，否则按新的期限重新计时
+void EventLoop::processTimeouts() {
+    expiredTimers.clear();
+    timers.advance(loopNowMs, expiredTimers);
+
+    for (size_t i = 0; i < expiredTimers.size(); ++i) {
+        ClientSession* expired = static_cast<ClientSession*>(expiredTimers[i]->context);
+        SOCKET socket = expired->getSocket();
+        if (socket == INVALID_SOCKET || static_cast<size_t>(socket) >= connections.size() ||
+            connections[socket].get() != expired) {
+            continue;
+        }
+        SimpleSharedPtr<ClientSession> session = connections[socket];
+
+        unsigned long long deadline;
+        SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+        if (kind == SESSION_TIMEOUT_NONE) {
+            if (deadline > 0) {
+                timers.schedule(&session->getTimeoutTimer(), deadline);
+            }
+            continue;
+        }
+        server->recordSessionTimeout(session, kind);
+        closeOrDefer(session);
+    }
+}
+
+// 写事件 - 套接字重新可写时继续冲刷发送缓冲
+void EventLoop::handleWritable(SimpleSharedPtr<ClientSession> session) {
+    if (server->flushSessionOutput(*session) < 0) {
+        closeConnection(session);
+    }
+}
+
+// 关闭单个连接 - 从连接表移除后交由服务器清理会话
+void EventLoop::closeConnection(SimpleSharedPtr<ClientSession> session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    detachConnection(socket, session);
+    server->closeSession(session);
+}
+
+void EventLoop::detachConnection(SOCKET socket, SimpleSharedPtr<ClientSession> session) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, socket, NULL);
+    timers.cancel(&session->getTimeoutTimer());
+    if (static_cast<size_t>(socket) < connections.size()) {
+        connections[socket] = SimpleSharedPtr<ClientSession>();
+    }
+}
+
+// 排空连接 - 每轮事件处理后检查，响应已写完且没有命令在执行线程中的连接立即关闭，
+// 未写完的等待EPOLLOUT继续写出；仍有命令的连接由执行线程执行完后通过requestClose关闭
+// 热重启时没有命令在执行线程中的连接连同未写完的响应移交给新进程，不可移交的照常关闭
+void EventLoop::drainConnections() {
+    if (!listenerRemoved) {
+        removeListeners();
+        listenerRemoved = true;
+    }
+    bool exportSessions = handingOff.load() && server->isExportingSessions();
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (!connections[i]) {
+            continue;
+        }
+        SimpleSharedPtr<ClientSession> session = connections[i];
+        if (exportSessions) {
+            if (server->hasPendingCommands(session)) {
+                continue;   // 执行完后再移交，不推迟关闭
+            }
+            if (server->exportSession(session)) {
+                detachConnection(static_cast<SOCKET>(i), session);
+                continue;
+            }
+        }
+        if (server->deferSessionClose(session) || server->flushSessionOutput(*session) > 0) {
+            continue;
+        }
+        closeConnection(session);
+    }
+}
+
+// 从epoll移除监听套接字 - 监听套接字本身由服务器关闭
+void EventLoop::removeListeners() {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, listenSocket, NULL);
+    if (localListenSocket != INVALID_SOCKET) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, localListenSocket, NULL);
+    }
+}
+
+// 循环退出时关闭全部连接 - 监听队列中尚未接受的连接随监听套接字关闭而被内核重置
+void EventLoop::closeAllConnections() {
+    removeListeners();
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i]) {
+            closeConnection(connections[i]);
+        }
+    }
+    connections.clear();
+}
+
+#endif // __linux__
@@ -0,0 +1,434 @@
+/*
+ * TCP用户系统 - 热重启实现
+ *
+ * 文件结构:
+ * 1. 记录收发 - 每条记录: [1字节类型][负载]，描述符以SCM_RIGHTS附带
+ * 2. 会话编码 - 字段依次为会话ID、登录用户、标志、未处理的请求、未送出的响应
+ * 3. 新进程 - 连接旧进程、接收描述符、分发给服务器
+ * 4. 旧进程 - 等待并校验新进程、收集会话、送出全部描述符
+ *
+ * 记录类型:
+ * - 'H' HELLO      新进程 -> 旧进程，负载为[协议版本]['1'接管会话/'0'不接管]
+ * - 'T' TCP监听    附带描述符
+ * - 'U' Unix域监听 附带描述符，负载为监听路径
+ * - 'S' 共享内存握手监听 附带描述符，负载为监听路径
+ * - 'C' 会话       附带连接描述符，负载为会话编码
+ * - 'E' END        移交结束，旧进程已保存用户数据
+ */
+
+#include "../Public/Hot_Restart.h"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <stdint.h>
+
+namespace {
+    const char RECORD_HELLO = 'H';
+    const char RECORD_TCP_LISTENER = 'T';
+    const char RECORD_UNIX_LISTENER = 'U';
+    const char RECORD_SHM_LISTENER = 'S';
+    const char RECORD_SESSION = 'C';
+    const char RECORD_END = 'E';
+
+    const char PROTOCOL_VERSION = 1;
+    const size_t MAX_RECORD_BYTES = HotRestart::MAX_SESSION_BYTES + 1024;   // 会话记录另含ID、用户名与长度字段
+    const int HELLO_TIMEOUT_MS = 1000;          // 旧进程等待HELLO的期限
+    const int TRANSFER_TIMEOUT_MS = 5000;       // 旧进程送出单条记录的期限
+
+    void setSocketTimeout(SOCKET socket, int option, unsigned long long timeoutMs) {
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<time_t>(timeoutMs / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((timeoutMs % 1000) * 1000);
+        setsockopt(socket, SOL_SOCKET, option, &timeout, sizeof(timeout));
+    }
+
+    void appendField(std::string& output, const std::string& field) {
+        uint32_t length = static_cast<uint32_t>(field.length());
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            output += static_cast<char>((length >> shift) & 0xFF);
+        }
+        output += field;
+    }
+
+    bool readField(const std::string& input, size_t& offset, std::string& field) {
+        if (input.length() - offset < 4) {
+            return false;
+        }
+        size_t length = 0;
+        for (int i = 0; i < 4; ++i) {
+            length = (length << 8) | static_cast<unsigned char>(input[offset + i]);
+        }
+        offset += 4;
+        if (input.length() - offset < length) {
+            return false;
+        }
+        field.assign(input, offset, length);
+        offset += length;
+        return true;
+    }
+
+    std::string encodeSession(const HandoffSession& session) {
+        std::string output;
+        appendField(output, session.sessionId);
+        appendField(output, session.loggedInUser);
+        output += static_cast<char>((session.inputBinary ? 1 : 0) | (session.outputBinary ? 2 : 0));
+        appendField(output, session.pendingInput);
+        appendField(output, session.pendingOutput);
+        return output;
+    }
+
+    bool decodeSession(const std::string& input, HandoffSession& session) {
+        size_t offset = 0;
+        if (!readField(input, offset, session.sessionId) || !readField(input, offset, session.loggedInUser) ||
+            offset >= input.length()) {
+            return false;
+        }
+        unsigned char flags = static_cast<unsigned char>(input[offset++]);
+        session.inputBinary = (flags & 1) != 0;
+        session.outputBinary = (flags & 2) != 0;
+        return readField(input, offset, session.pendingInput) && readField(input, offset, session.pendingOutput) &&
+               offset == input.length();
+    }
+}
+
+HotRestart::HotRestart(TCPUserSystemServer* owner, const std::string& path)
+    : server(owner), socketPath(path), listenSocket(INVALID_SOCKET), channel(INVALID_SOCKET),
+      acceptsSessions(false), unixListener(INVALID_SOCKET), shmListener(INVALID_SOCKET) {}
+
+HotRestart::~HotRestart() {
+    if (listenSocket != INVALID_SOCKET) {
+        closesocket(listenSocket);
+        unlink(socketPath.c_str());
+    }
+    if (channel != INVALID_SOCKET) {
+        closesocket(channel);
+    }
+    for (size_t i = 0; i < exportedSessions.size(); ++i) {
+        closesocket(exportedSessions[i].socket);
+    }
+    closeInherited();
+}
+
+// ---------- 记录收发 ----------
+
+bool HotRestart::sendRecord(char type, const std::string& payload, SOCKET fd) {
+    std::string record(1, type);
+    record += payload;
+
+    struct iovec iov;
+    iov.iov_base = &record[0];
+    iov.iov_len = record.length();
+    char controlBuffer[CMSG_SPACE(sizeof(int))];
+    memset(controlBuffer, 0, sizeof(controlBuffer));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd != INVALID_SOCKET) {
+        msg.msg_control = controlBuffer;
+        msg.msg_controllen = sizeof(controlBuffer);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    while (true) {
+        ssize_t sent = sendmsg(channel, &msg, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            return static_cast<size_t>(sent) == record.length();
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// 接收一条记录 - 附带的描述符即使记录无效也先取出，由调用方关闭
+bool HotRestart::receiveRecord(char& type, std::string& payload, SOCKET& fd) {
+    fd = INVALID_SOCKET;
+    recordBuffer.resize(MAX_RECORD_BYTES);
+
+    struct iovec iov;
+    iov.iov_base = &recordBuffer[0];
+    iov.iov_len = recordBuffer.size();
+    char controlBuffer[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = controlBuffer;
+    msg.msg_controllen = sizeof(controlBuffer);
+
+    ssize_t received;
+    do {
+        received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received >= 0) {
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+                cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+                memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+    }
+    if (received <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        return false;
+    }
+    type = recordBuffer[0];
+    payload.assign(&recordBuffer[1], static_cast<size_t>(received) - 1);
+    return true;
+}
+
+// ---------- 新进程 ----------
+
+// 连接旧进程并接收全部描述符 - 旧进程须先排空连接并保存数据，等待期限按旧进程的停止期限放宽
+bool HotRestart::inherit(bool acceptSessionHandoff, unsigned long long timeoutMs) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    channel = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (channel == INVALID_SOCKET) {
+        return false;
+    }
+    if (connect(channel, (sockaddr*)&address, sizeof(address)) != 0) {
+        closesocket(channel);       // 没有正在运行的旧进程
+        channel = INVALID_SOCKET;
+        return false;
+    }
+    setSocketTimeout(channel, SO_RCVTIMEO, timeoutMs);
+
+    std::string hello(1, PROTOCOL_VERSION);
+    hello += acceptSessionHandoff ? '1' : '0';
+    if (!sendRecord(RECORD_HELLO, hello, INVALID_SOCKET)) {
+        closesocket(channel);
+        channel = INVALID_SOCKET;
+        return false;
+    }
+    server->getLogger()->logInfo("已连接正在运行的旧进程，等待移交监听套接字与会话: " + socketPath);
+
+    bool finished = false;
+    while (!finished) {
+        char type;
+        std::string payload;
+        SOCKET fd;
+        if (!receiveRecord(type, payload, fd)) {
+            if (fd != INVALID_SOCKET) {
+                closesocket(fd);
+            }
+            break;
+        }
+        if (type == RECORD_END) {
+            finished = true;
+        } else if (fd == INVALID_SOCKET) {
+            continue;       // 监听与会话记录必须附带描述符
+        } else if (type == RECORD_TCP_LISTENER) {
+            tcpListeners.push_back(fd);
+        } else if (type == RECORD_UNIX_LISTENER && unixListener == INVALID_SOCKET) {
+            unixListener = fd;
+            unixPath = payload;
+        } else if (type == RECORD_SHM_LISTENER && shmListener == INVALID_SOCKET) {
+            shmListener = fd;
+            shmPath = payload;
+        } else if (type == RECORD_SESSION) {
+            HandoffSession session;
+            if (decodeSession(payload, session)) {
+                session.socket = fd;
+                inheritedSessions.push_back(session);
+            } else {
+                closesocket(fd);
+            }
+        } else {
+            closesocket(fd);
+        }
+    }
+    closesocket(channel);
+    channel = INVALID_SOCKET;
+
+    if (!finished) {
+        // 旧进程中途退出，其保存的用户数据可能不完整，收到的描述符也无法确认是否齐全
+        server->getLogger()->logWarning("热重启移交中断，改为重新监听");
+        closeInherited();
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << "热重启接收完成: TCP监听套接字 " << tcpListeners.size()
+       << (unixListener != INVALID_SOCKET ? "，Unix域监听套接字 1" : "")
+       << (shmListener != INVALID_SOCKET ? "，共享内存握手监听套接字 1" : "")
+       << "，会话 " << inheritedSessions.size();
+    server->getLogger()->logServerEvent(ss.str());
+    return true;
+}
+
+void HotRestart::takeTcpListeners(std::vector<SOCKET>& target) {
+    target.insert(target.end(), tcpListeners.begin(), tcpListeners.end());
+    tcpListeners.clear();
+}
+
+SOCKET HotRestart::takeUnixListener(const std::string& configuredPath) {
+    return takeLocalListener(unixListener, unixPath, configuredPath);
+}
+
+SOCKET HotRestart::takeShmListener(const std::string& configuredPath) {
+    return takeLocalListener(shmListener, shmPath, configuredPath);
+}
+
+// 取走继承的Unix域监听套接字 - 新配置不再使用该路径时关闭并删除套接字文件(旧进程移交时不删除)
+SOCKET HotRestart::takeLocalListener(SOCKET& listener, const std::string& path, const std::string& configuredPath) {
+    SOCKET taken = listener;
+    listener = INVALID_SOCKET;
+    if (taken != INVALID_SOCKET && path != configuredPath) {
+        closesocket(taken);
+        unlink(path.c_str());
+        taken = INVALID_SOCKET;
+    }
+    return taken;
+}
+
+void HotRestart::takeSessions(std::vector<HandoffSession>& target) {
+    target.insert(target.end(), inheritedSessions.begin(), inheritedSessions.end());
+    inheritedSessions.clear();
+}
+
+// 未被取走的描述符 - 监听路径的文件仍按takeLocalListener的规则处理
+void HotRestart::closeInherited() {
+    for (size_t i = 0; i < tcpListeners.size(); ++i) {
+        closesocket(tcpListeners[i]);
+    }
+    tcpListeners.clear();
+    takeUnixListener("");
+    takeShmListener("");
+    for (size_t i = 0; i < inheritedSessions.size(); ++i) {
+        closesocket(inheritedSessions[i].socket);
+    }
+    inheritedSessions.clear();
+}
+
+// 在移交路径上等待下一个进程 - 路径上遗留的套接字文件(旧进程已不再监听)由openUnixListener清理
+bool HotRestart::listen() {
+    listenSocket = server->openUnixListener(socketPath, SOCK_SEQPACKET);
+    if (listenSocket == INVALID_SOCKET) {
+        return false;
+    }
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+}
+
+// ---------- 旧进程 ----------
+
+// 等待新进程 - 只接受同一用户的进程，握手完成后关闭监听(不删除文件，新进程随后在同一路径监听)
+bool HotRestart::waitSuccessor(int timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = listenSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (listenSocket == INVALID_SOCKET || poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+    SOCKET peer = accept4(listenSocket, NULL, NULL, SOCK_CLOEXEC);
+    if (peer == INVALID_SOCKET) {
+        return false;
+    }
+
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(peer, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 || credentials.uid != getuid()) {
+        server->getLogger()->logWarning("拒绝其他用户进程的热重启请求");
+        closesocket(peer);
+        return false;
+    }
+
+    channel = peer;
+    setSocketTimeout(channel, SO_RCVTIMEO, HELLO_TIMEOUT_MS);
+    char type;
+    std::string payload;
+    SOCKET fd;
+    bool valid = receiveRecord(type, payload, fd) && type == RECORD_HELLO &&
+                 payload.length() >= 2 && payload[0] == PROTOCOL_VERSION;
+    if (fd != INVALID_SOCKET) {
+        closesocket(fd);
+    }
+    if (!valid) {
+        server->getLogger()->logWarning("热重启请求握手失败");
+        closesocket(channel);
+        channel = INVALID_SOCKET;
+        return false;
+    }
+    acceptsSessions = payload[1] == '1';
+
+    closesocket(listenSocket);
+    listenSocket = INVALID_SOCKET;
+
+    std::stringstream ss;
+    ss << "新进程(pid " << credentials.pid << ")请求热重启，停止服务并移交"
+       << (acceptsSessions ? "监听套接字与会话" : "监听套接字(新进程不接管会话)");
+    server->getLogger()->logServerEvent(ss.str());
+    return true;
+}
+
+void HotRestart::addSession(const HandoffSession& session) {
+    SimpleLockGuard lock(exportMutex);
+    exportedSessions.push_back(session);
+}
+
+// 送出全部描述符 - 会话描述符送出后即关闭本进程的副本；中途失败时剩余会话直接关闭
+bool HotRestart::transfer(const std::vector<SOCKET>& tcp, SOCKET unixSocket, const std::string& unixSocketPath,
+                          SOCKET shmSocket, const std::string& shmSocketPath) {
+    if (channel == INVALID_SOCKET) {
+        return false;
+    }
+    setSocketTimeout(channel, SO_SNDTIMEO, TRANSFER_TIMEOUT_MS);
+
+    bool ok = true;
+    size_t listenerCount = 0;
+    for (size_t i = 0; i < tcp.size() && ok; ++i) {
+        ok = sendRecord(RECORD_TCP_LISTENER, "", tcp[i]);
+        listenerCount += ok ? 1 : 0;
+    }
+    if (ok && unixSocket != INVALID_SOCKET) {
+        ok = sendRecord(RECORD_UNIX_LISTENER, unixSocketPath, unixSocket);
+        listenerCount += ok ? 1 : 0;
+    }
+    if (ok && shmSocket != INVALID_SOCKET) {
+        ok = sendRecord(RECORD_SHM_LISTENER, shmSocketPath, shmSocket);
+        listenerCount += ok ? 1 : 0;
+    }
+
+    std::vector<HandoffSession> sessions;
+    {
+        SimpleLockGuard lock(exportMutex);
+        sessions.swap(exportedSessions);
+    }
+    size_t sessionCount = 0;
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        if (ok) {
+            ok = sendRecord(RECORD_SESSION, encodeSession(sessions[i]), sessions[i].socket);
+            sessionCount += ok ? 1 : 0;
+        }
+        closesocket(sessions[i].socket);
+    }
+    if (ok) {
+        ok = sendRecord(RECORD_END, "", INVALID_SOCKET);
+    }
+    closesocket(channel);
+    channel = INVALID_SOCKET;
+
+    std::stringstream ss;
+    ss << "监听套接字 " << listenerCount << "，会话 " << sessionCount;
+    if (ok) {
+        server->getLogger()->logServerEvent("热重启移交完成: " + ss.str());
+    } else {
+        server->getLogger()->logError("热重启移交中断(" + ss.str() + ")，新进程将重新监听");
+    }
+    return ok;
+}
+
+#endif // __linux__
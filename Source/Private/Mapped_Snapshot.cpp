@@ -0,0 +1,352 @@
+/*
+ * TCP用户系统 - 二进制快照文件实现
+ *
+ * 文件结构:
+ * 1. 编码辅助 - 小端整数读写、用户ID哈希、文件头布局
+ * 2. 写出 - 记录编码、索引生成与文件头回填
+ * 3. 映射 - 打开与校验、按用户ID查找、认领与后台逐条复制
+ */
+
+#include "../Public/Mapped_Snapshot.h"
+
+namespace {
+    const char SNAPSHOT_MAGIC[8] = { 'T', 'U', 'S', 'R', 'S', 'N', 'A', 'P' };
+    const unsigned int SNAPSHOT_VERSION = 1;
+    const size_t HEADER_LENGTH = 64;
+
+    // 文件头字段偏移
+    const size_t HEADER_VERSION = 8;
+    const size_t HEADER_LENGTH_FIELD = 12;
+    const size_t HEADER_RECORD_COUNT = 16;
+    const size_t HEADER_RECORDS_OFFSET = 24;
+    const size_t HEADER_INDEX_OFFSET = 32;
+    const size_t HEADER_INDEX_SLOTS = 40;
+    const size_t HEADER_FILE_LENGTH = 48;
+
+    void putUint32(std::string& out, unsigned long long value) {
+        for (int i = 0; i < 4; ++i) {
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void putUint64(std::string& out, unsigned long long value) {
+        for (int i = 0; i < 8; ++i) {
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void setUint64(std::string& out, size_t offset, unsigned long long value) {
+        for (int i = 0; i < 8; ++i) {
+            out[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    unsigned int getUint32(const unsigned char* p) {
+        return static_cast<unsigned int>(p[0]) | (static_cast<unsigned int>(p[1]) << 8) |
+               (static_cast<unsigned int>(p[2]) << 16) | (static_cast<unsigned int>(p[3]) << 24);
+    }
+
+    unsigned long long getUint64(const unsigned char* p) {
+        return static_cast<unsigned long long>(getUint32(p)) |
+               (static_cast<unsigned long long>(getUint32(p + 4)) << 32);
+    }
+
+    // FNV-1a - 与分片归属使用同一种哈希
+    unsigned int hashId(const unsigned char* id, size_t length) {
+        unsigned int hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= id[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void putField(std::string& out, const std::string& field) {
+        putUint32(out, field.length());
+        out += field;
+    }
+}
+
+// 记录 - u32记录体长度，记录体为三个长度前缀的字段
+void SnapshotFileWriter::encode(const User& user, std::string& out) {
+    std::string id = user.getUserId();
+    std::string password = user.getPassword();
+    std::string userString = user.getUserString();
+    putUint32(out, 12 + id.length() + password.length() + userString.length());
+    putField(out, id);
+    putField(out, password);
+    putField(out, userString);
+}
+
+bool SnapshotFileWriter::open(const std::string& path) {
+    file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string header(HEADER_LENGTH, '\0');    // 全部记录与索引写出后回填
+    file.write(header.data(), static_cast<std::streamsize>(header.length()));
+    offset = HEADER_LENGTH;
+    return !file.fail();
+}
+
+// 写出若干条记录 - 同时记下每条记录的偏移与用户ID哈希，供生成索引
+void SnapshotFileWriter::write(const std::string& records) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(records.data());
+    size_t position = 0;
+    while (position + 8 <= records.length()) {
+        size_t bodyLength = getUint32(p + position);
+        size_t idLength = getUint32(p + position + 4);
+        entries.push_back(std::make_pair(hashId(p + position + 8, idLength), offset + position));
+        position += 4 + bodyLength;
+    }
+    file.write(records.data(), static_cast<std::streamsize>(records.length()));
+    offset += records.length();
+}
+
+// 生成索引 - 槽数为不小于记录数两倍的2的幂，线性探测
+bool SnapshotFileWriter::finish() {
+    size_t slots = 16;
+    while (slots < entries.size() * 2) {
+        slots <<= 1;
+    }
+    std::vector<unsigned long long> table(slots, 0);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        size_t slot = entries[i].first & (slots - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        table[slot] = entries[i].second;
+    }
+
+    std::string index;
+    index.reserve(slots * 8);
+    for (size_t i = 0; i < slots; ++i) {
+        putUint64(index, table[i]);
+    }
+    unsigned long long indexOffset = offset;
+    file.write(index.data(), static_cast<std::streamsize>(index.length()));
+    offset += index.length();
+
+    std::string header(HEADER_LENGTH, '\0');
+    header.replace(0, sizeof(SNAPSHOT_MAGIC), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    std::string fields;
+    putUint32(fields, SNAPSHOT_VERSION);
+    putUint32(fields, HEADER_LENGTH);
+    header.replace(HEADER_VERSION, fields.length(), fields);
+    setUint64(header, HEADER_RECORD_COUNT, entries.size());
+    setUint64(header, HEADER_RECORDS_OFFSET, HEADER_LENGTH);
+    setUint64(header, HEADER_INDEX_OFFSET, indexOffset);
+    setUint64(header, HEADER_INDEX_SLOTS, slots);
+    setUint64(header, HEADER_FILE_LENGTH, offset);
+    file.seekp(0);
+    file.write(header.data(), static_cast<std::streamsize>(header.length()));
+
+    std::vector<std::pair<unsigned int, unsigned long long> >().swap(entries);
+    file.close();
+    return !file.fail();
+}
+
+MappedUserFile::MappedUserFile()
+    : data(0), size(0),
+#ifdef _WIN32
+      fileHandle(INVALID_HANDLE_VALUE), mapping(NULL),
+#endif
+      recordCount(0), recordsEnd(0), indexSlots(0), remaining(0), cursor(0), damaged(0) {}
+
+MappedUserFile::~MappedUserFile() {
+    unmap();
+}
+
+void MappedUserFile::unmap() {
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+    mapping = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data) {
+        munmap(const_cast<unsigned char*>(data), size);
+    }
+#endif
+    data = 0;
+    size = 0;
+}
+
+bool MappedUserFile::hasSnapshotHeader(const std::string& path) {
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return file.read(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+// 映射并校验文件头 - 记录不在此时解析
+bool MappedUserFile::open(const std::string& path) {
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize;
+    if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize) ||
+        fileSize.QuadPart < static_cast<LONGLONG>(HEADER_LENGTH)) {
+        unmap();
+        return false;
+    }
+    mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    data = mapping ? static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : 0;
+    if (!data) {
+        unmap();
+        return false;
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(HEADER_LENGTH)) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);      // 映射保持对文件的引用，之后改名覆盖快照文件不影响映射
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const unsigned char*>(mapped);
+    size = static_cast<size_t>(info.st_size);
+#endif
+
+    unsigned long long indexOffset = getUint64(data + HEADER_INDEX_OFFSET);
+    unsigned long long slots = getUint64(data + HEADER_INDEX_SLOTS);
+    recordCount = getUint64(data + HEADER_RECORD_COUNT);
+    bool valid = memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 &&
+                 getUint32(data + HEADER_VERSION) == SNAPSHOT_VERSION &&
+                 getUint32(data + HEADER_LENGTH_FIELD) == HEADER_LENGTH &&
+                 getUint64(data + HEADER_RECORDS_OFFSET) == HEADER_LENGTH &&
+                 getUint64(data + HEADER_FILE_LENGTH) == size &&
+                 indexOffset >= HEADER_LENGTH && indexOffset <= size &&
+                 slots > 0 && (slots & (slots - 1)) == 0 && slots <= (size - indexOffset) / 8 &&
+                 indexOffset + slots * 8 == size && recordCount <= slots;
+    if (!valid) {
+        unmap();
+        return false;
+    }
+
+    recordsEnd = static_cast<size_t>(indexOffset);
+    indexSlots = static_cast<size_t>(slots);
+    claimed.assign(indexSlots, 0);
+    remaining.store(static_cast<long long>(recordCount));
+    cursor = HEADER_LENGTH;
+    return true;
+}
+
+// 记录的用户ID - 记录体与用户ID须完整落在记录区内
+bool MappedUserFile::readId(size_t recordOffset, const unsigned char*& id, size_t& idLength) const {
+    if (recordOffset < HEADER_LENGTH || recordOffset > recordsEnd || recordsEnd - recordOffset < 8) {
+        return false;
+    }
+    size_t bodyLength = getUint32(data + recordOffset);
+    idLength = getUint32(data + recordOffset + 4);
+    if (bodyLength > recordsEnd - recordOffset - 4 || bodyLength < 12 || idLength > bodyLength - 12) {
+        return false;
+    }
+    id = data + recordOffset + 8;
+    return true;
+}
+
+bool MappedUserFile::decode(size_t recordOffset, User& user) const {
+    const unsigned char* id;
+    size_t idLength;
+    if (!readId(recordOffset, id, idLength)) {
+        return false;
+    }
+    const unsigned char* end = data + recordOffset + 4 + getUint32(data + recordOffset);
+    const unsigned char* p = id + idLength;
+    size_t passwordLength = getUint32(p);
+    if (passwordLength > static_cast<size_t>(end - p) - 8) {
+        return false;
+    }
+    const unsigned char* password = p + 4;
+    p = password + passwordLength;
+    size_t stringLength = getUint32(p);
+    if (stringLength != static_cast<size_t>(end - p) - 4) {
+        return false;
+    }
+    user = User(std::string(reinterpret_cast<const char*>(id), idLength),
+                std::string(reinterpret_cast<const char*>(password), passwordLength));
+    user.setUserString(std::string(reinterpret_cast<const char*>(p + 4), stringLength));
+    return true;
+}
+
+// 索引查找 - recordOffset非0时按偏移匹配(后台复制已知记录位置)，否则比较用户ID
+size_t MappedUserFile::findSlot(const unsigned char* id, size_t idLength, unsigned long long recordOffset) const {
+    const unsigned char* index = data + recordsEnd;
+    size_t slot = hashId(id, idLength) & (indexSlots - 1);
+    for (size_t probes = 0; probes < indexSlots; ++probes) {
+        unsigned long long value = getUint64(index + slot * 8);
+        if (value == 0) {
+            break;
+        }
+        if (recordOffset != 0) {
+            if (value == recordOffset) {
+                return slot;
+            }
+        } else {
+            const unsigned char* candidate;
+            size_t candidateLength;
+            if (value <= recordsEnd && readId(static_cast<size_t>(value), candidate, candidateLength) &&
+                candidateLength == idLength && memcmp(candidate, id, idLength) == 0) {
+                return slot;
+            }
+        }
+        slot = (slot + 1) & (indexSlots - 1);
+    }
+    return indexSlots;
+}
+
+// 认领 - 无法解析的记录同样标记为已认领，只是不复制
+bool MappedUserFile::claimSlot(size_t slot, User& user) {
+    if (claimed[slot]) {
+        return false;
+    }
+    claimed[slot] = 1;
+    remaining.decrement();
+    return decode(static_cast<size_t>(getUint64(data + recordsEnd + slot * 8)), user);
+}
+
+bool MappedUserFile::claim(const std::string& userId, User& user) {
+    if (remaining.load() == 0) {
+        return false;
+    }
+    size_t slot = findSlot(reinterpret_cast<const unsigned char*>(userId.data()), userId.length(), 0);
+    return slot != indexSlots && claimSlot(slot, user);
+}
+
+// 顺序取记录 - 记录长度越界时无法定位下一条，停止并计为损坏
+bool MappedUserFile::nextRecord(size_t& recordOffset, std::string& userId) {
+    if (cursor >= recordsEnd) {
+        return false;
+    }
+    const unsigned char* id;
+    size_t idLength;
+    if (!readId(cursor, id, idLength)) {
+        ++damaged;
+        cursor = recordsEnd;
+        return false;
+    }
+    recordOffset = cursor;
+    userId.assign(reinterpret_cast<const char*>(id), idLength);
+    cursor += 4 + getUint32(data + cursor);
+    return true;
+}
+
+bool MappedUserFile::claimRecord(size_t recordOffset, const std::string& userId, User& user) {
+    size_t slot = findSlot(reinterpret_cast<const unsigned char*>(userId.data()), userId.length(), recordOffset);
+    return slot != indexSlots && claimSlot(slot, user);
+}
@@ -0,0 +1,895 @@
+/*
+ * TCP用户系统 - 共享内存传输实现
+ *
+ * 文件结构:
+ * 1. 等待原语 - 单调时钟、自旋提示、跨进程futex
+ * 2. 服务线程 - 握手、轮询请求环、写响应环、跨线程请求转交、超时与排空
+ * 3. ShmTransport - 监听套接字与服务线程组的生命周期
+ * 4. ShmClient - 客户端握手与收发
+ *
+ * 唤醒规则(两端对称，避免丢失唤醒):
+ * - 等待方: 先公布等待标志，完整内存屏障后复查环，仍无数据才睡眠
+ * - 生产方: 先发布环尾指针，完整内存屏障后读取对端等待标志，置位时才发起系统调用
+ * - 服务线程的等待标志写在其全部连接的共享段中，任一客户端发布请求都会写eventfd唤醒它
+ * - 响应环满时(客户端长时间不读取)服务线程以1毫秒间隔重试，不依赖客户端唤醒
+ */
+
+#include "../Public/Shm_Transport.h"
+
+#ifdef __linux__
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace {
+    const uint32_t SEGMENT_MAGIC = 0x53484D31;     // "SHM1"
+    const uint32_t SEGMENT_VERSION = 1;
+    const uint32_t RING_CAPACITY = 64 * 1024;       // 每个方向的环容量，与帧长度上限相同
+    const int MAX_EVENTS = 64;
+    const int MAX_ACCEPTS = 64;
+    const unsigned EVENT_CHECK_ROUNDS = 1024;       // 持续繁忙时每隔该轮数检查一次握手、控制连接与超时
+    const int CLIENT_WAIT_SLICE_MS = 100;           // 客户端单次futex等待上限，到期检查控制连接
+
+    unsigned long long nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + static_cast<unsigned long long>(ts.tv_nsec);
+    }
+
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // 单核时对端无法在自旋期间运行，自旋只会推迟对端
+    unsigned long long resolveSpinNs(unsigned spinMicroseconds) {
+        if (sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+            return 0;
+        }
+        return static_cast<unsigned long long>(spinMicroseconds) * 1000ULL;
+    }
+
+    // 共享段映射在不同进程中，不能使用FUTEX_PRIVATE_FLAG
+    void futexWait(volatile uint32_t* address, uint32_t expected, int timeoutMs) {
+        struct timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000L;
+        syscall(SYS_futex, address, FUTEX_WAIT, expected, &timeout, NULL, 0);
+    }
+
+    void futexWake(volatile uint32_t* address) {
+        syscall(SYS_futex, address, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// ---------- 服务线程 ----------
+
+ShmLoop::ShmLoop(TCPUserSystemServer* owner, int index, SOCKET listener, unsigned spinMicroseconds)
+    : server(owner), loopIndex(index), listenSocket(listener), epollFd(-1), wakeFd(-1),
+      spinNs(resolveSpinNs(spinMicroseconds)), running(false), draining(false), listenerRemoved(false),
+      threadStarted(false), loopNowMs(TimerWheel::nowMs()), remotePending(0),
+      acceptedCount(0), sleepCount(0), clientWakeCount(0) {}
+
+ShmLoop::~ShmLoop() {
+    stop();
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+// 创建epoll实例与唤醒eventfd并启动线程 - 握手监听套接字由全部服务线程共同注册
+bool ShmLoop::start() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0) {
+        return false;
+    }
+    ev.data.fd = listenSocket;
+#ifdef EPOLLEXCLUSIVE
+    ev.events |= EPOLLEXCLUSIVE;
+#endif
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &ev) != 0) {
+        return false;
+    }
+
+    running.store(true);
+    if (pthread_create(&thread, NULL, threadProc, this) != 0) {
+        running.store(false);
+        return false;
+    }
+    threadStarted = true;
+    return true;
+}
+
+// 进入排空状态 - 由服务线程在下一轮关闭送完响应的连接
+void ShmLoop::beginDrain() {
+    draining.store(true);
+    wakeup();
+}
+
+// 停止服务线程 - 线程退出前关闭其管理的全部连接
+void ShmLoop::stop() {
+    if (!threadStarted) {
+        return;
+    }
+    running.store(false);
+    wakeup();
+    pthread_join(thread, NULL);
+    threadStarted = false;
+}
+
+void* ShmLoop::threadProc(void* param) {
+    static_cast<ShmLoop*>(param)->run();
+    return NULL;
+}
+
+void ShmLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+// 请求发送 - 服务线程内直接写入响应环，其他线程(挤占通知、命令执行线程)经eventfd转交
+void ShmLoop::requestFlush(ClientSession* session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    if (threadStarted && pthread_equal(pthread_self(), thread)) {
+        // 握手期间(openSession发送欢迎消息时)连接表中已有该连接，会话指针尚未赋值
+        Channel* channel = findChannel(socket);
+        if (channel) {
+            flushChannel(channel, *session);
+        }
+        return;
+    }
+    {
+        SimpleLockGuard lock(remoteMutex);
+        remoteFlushes.push_back(socket);
+        remotePending.increment();
+    }
+    wakeup();
+}
+
+// 关闭请求 - 由命令执行线程在会话的剩余命令执行完后调用
+void ShmLoop::requestClose(ClientSession* session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    {
+        SimpleLockGuard lock(remoteMutex);
+        remoteCloses.push_back(std::make_pair(socket, session->getSessionId()));
+        remotePending.increment();
+    }
+    wakeup();
+}
+
+ShmLoop::Channel* ShmLoop::findChannel(SOCKET socket) {
+    if (socket == INVALID_SOCKET || static_cast<size_t>(socket) >= channels.size()) {
+        return 0;
+    }
+    return channels[socket];
+}
+
+// 处理转交的请求 - 会话ID不一致说明原连接已关闭、描述符已被新连接复用
+void ShmLoop::processRemoteRequests() {
+    std::vector<SOCKET> sockets;
+    std::vector<std::pair<SOCKET, std::string> > closes;
+    {
+        SimpleLockGuard lock(remoteMutex);
+        sockets.swap(remoteFlushes);
+        closes.swap(remoteCloses);
+        remotePending.store(0);
+    }
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        Channel* channel = findChannel(sockets[i]);
+        if (channel) {
+            flushChannel(channel, *channel->session);
+        }
+    }
+    for (size_t i = 0; i < closes.size(); ++i) {
+        Channel* channel = findChannel(closes[i].first);
+        if (channel && channel->session->getSessionId() == closes[i].second &&
+            !server->deferCloseUntilCommit(channel->session)) {
+            closeChannel(channel);      // 有响应等待提交时由提交后的requestClose关闭
+        }
+    }
+}
+
+// 发送缓冲写入响应环 - 客户端正在睡眠时futex唤醒
+bool ShmLoop::flushChannel(Channel* channel, ClientSession& session) {
+    size_t written;
+    {
+        SimpleLockGuard lock(session.getOutputMutex());
+        std::string& output = session.getOutputBuffer();
+        if (output.empty()) {
+            channel->outputPending = false;
+            return false;
+        }
+        written = channel->responses.write(output.data(), output.length());
+        output.erase(0, written);
+        channel->outputPending = !output.empty();
+    }
+    if (written == 0) {
+        return false;
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&channel->header->clientWaiting.value, __ATOMIC_RELAXED)) {
+        futexWake(&channel->header->responseTail.value);
+        ++clientWakeCount;
+    }
+    return true;
+}
+
+// 处理单个连接 - 请求环中的数据复制进会话接收缓冲，分帧后交给服务器执行
+bool ShmLoop::serviceChannel(Channel* channel) {
+    bool progress = false;
+    if (channel->outputPending) {
+        progress = flushChannel(channel, *channel->session);
+    }
+    if (channel->closing) {
+        return progress;
+    }
+    if (closeIfCorrupted(channel)) {
+        return true;
+    }
+    SimpleSharedPtr<ClientSession> session = channel->session;
+
+    // 被其他会话挤占或收到QUIT的会话在响应送出后关闭
+    if (!session->getIsActive()) {
+        if (!channel->outputPending) {
+            closeOrDefer(channel);
+        }
+        return progress;
+    }
+    if (draining.load() || channel->requests.readable() == 0) {
+        return progress;
+    }
+
+    InputRingBuffer& input = session->getInputBuffer();
+    while (channel->requests.readable() > 0) {
+        size_t space;
+        char* target = input.writeSpace(space);
+        if (space == 0) {
+            break;      // 剩余数据在处理完已收到的帧后的下一轮读取
+        }
+        input.commit(channel->requests.read(target, space));
+    }
+    if (closeIfCorrupted(channel)) {
+        return true;
+    }
+
+    session->touch(loopNowMs);
+    if (!server->processSessionInput(session)) {
+        closeOrDefer(channel);
+        return true;
+    }
+    // 未登录(含刚登出)的会话重新计时，使登录期限及时生效
+    if (!session->getTimeoutTimer().isLinked() || !session->isLoggedIn()) {
+        SessionTimeout kind = scheduleTimeout(session);
+        if (kind != SESSION_TIMEOUT_NONE) {
+            server->recordSessionTimeout(session, kind);
+            closeOrDefer(channel);
+        }
+    }
+    return true;
+}
+
+// 轮询全部连接 - 处理中关闭的连接由末尾的连接换位填补
+bool ShmLoop::pollChannels() {
+    bool progress = false;
+    size_t i = 0;
+    while (i < active.size()) {
+        SOCKET socket = active[i];
+        if (serviceChannel(channels[socket])) {
+            progress = true;
+        }
+        if (i < active.size() && active[i] == socket) {
+            ++i;
+        }
+    }
+    return progress;
+}
+
+bool ShmLoop::anyReadable() {
+    for (size_t i = 0; i < active.size(); ++i) {
+        Channel* channel = channels[active[i]];
+        if (!channel->closing && (channel->requests.readable() > 0 || channel->requests.isCorrupted() ||
+                                  channel->responses.isCorrupted())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 共享段损坏 - 客户端可以任意改写段中的计数器，越界后环不再读写，关闭连接
+bool ShmLoop::closeIfCorrupted(Channel* channel) {
+    if (!channel->requests.isCorrupted() && !channel->responses.isCorrupted()) {
+        return false;
+    }
+    server->getLogger()->logWarning("共享内存连接的环计数器越界，关闭连接: " + channel->session->getSessionId());
+    closeOrDefer(channel);
+    return true;
+}
+
+void ShmLoop::setWaiting(uint32_t value) {
+    for (size_t i = 0; i < active.size(); ++i) {
+        __atomic_store_n(&channels[active[i]]->header->serverWaiting.value, value, __ATOMIC_RELAXED);
+    }
+}
+
+// 设置会话的超时定时器 - 未启用任何超时时不进入时间轮
+SessionTimeout ShmLoop::scheduleTimeout(SimpleSharedPtr<ClientSession> session) {
+    unsigned long long deadline;
+    SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+    if (kind == SESSION_TIMEOUT_NONE && deadline > 0) {
+        timers.schedule(&session->getTimeoutTimer(), deadline);
+    }
+    return kind;
+}
+
+// 处理到期定时器 - 会话已超时则关闭，否则按新的期限重新计时
+void ShmLoop::processTimeouts() {
+    expiredTimers.clear();
+    timers.advance(loopNowMs, expiredTimers);
+
+    for (size_t i = 0; i < expiredTimers.size(); ++i) {
+        ClientSession* expired = static_cast<ClientSession*>(expiredTimers[i]->context);
+        Channel* channel = findChannel(expired->getSocket());
+        if (!channel || channel->session.get() != expired || channel->closing) {
+            continue;
+        }
+        SimpleSharedPtr<ClientSession> session = channel->session;
+
+        unsigned long long deadline;
+        SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+        if (kind == SESSION_TIMEOUT_NONE) {
+            if (deadline > 0) {
+                timers.schedule(&session->getTimeoutTimer(), deadline);
+            }
+            continue;
+        }
+        server->recordSessionTimeout(session, kind);
+        closeOrDefer(channel);
+    }
+}
+
+// 等待并处理epoll事件: 唤醒、握手、控制连接断开
+void ShmLoop::waitEvents(int timeoutMs) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+    loopNowMs = TimerWheel::nowMs();
+
+    for (int i = 0; i < count; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == wakeFd) {
+            uint64_t value;
+            ssize_t readBytes = read(wakeFd, &value, sizeof(value));
+            (void)readBytes;
+        } else if (fd == listenSocket) {
+            acceptChannels();
+        } else {
+            // 握手后客户端不再在控制连接上发送数据，可读即对端已关闭
+            Channel* channel = findChannel(fd);
+            if (channel) {
+                closeOrDefer(channel);
+            }
+        }
+    }
+    processTimeouts();
+}
+
+// 接受握手 - 每个新连接创建共享段并建立会话
+void ShmLoop::acceptChannels() {
+    for (int i = 0; i < MAX_ACCEPTS; ++i) {
+        SOCKET control = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (control == INVALID_SOCKET) {
+            return;
+        }
+        if (draining.load()) {
+            closesocket(control);
+            continue;
+        }
+        // 超过连接数上限时直接关闭，客户端握手失败
+        if (!server->admitConnection(control, false)) {
+            continue;
+        }
+
+        Channel* channel = createChannel(control);
+        if (!channel) {
+            server->getLogger()->logWarning("共享内存握手失败");
+            closesocket(control);
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = control;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, control, &ev) != 0) {
+            munmap(channel->segment, channel->segmentSize);
+            delete channel;
+            closesocket(control);
+            continue;
+        }
+
+        if (static_cast<size_t>(control) >= channels.size()) {
+            channels.resize(control + 1, 0);
+        }
+        channels[control] = channel;
+        active.push_back(control);
+        ++acceptedCount;
+
+        server->getLogger()->logInfo("新客户端连接: 共享内存 " + server->getConfig().shmSocketPath);
+        channel->session = server->openSession(control, true, this);
+        scheduleTimeout(channel->session);
+    }
+}
+
+// 创建共享段(memfd) - 段描述符与本线程的eventfd一起以SCM_RIGHTS发给客户端，映射建立后即可关闭段描述符
+ShmLoop::Channel* ShmLoop::createChannel(SOCKET control) {
+    size_t segmentSize = sizeof(ShmSegmentHeader) + 2 * static_cast<size_t>(RING_CAPACITY);
+    int memFd = memfd_create("tcp_user_shm", MFD_CLOEXEC);
+    if (memFd < 0) {
+        return 0;
+    }
+    if (ftruncate(memFd, static_cast<off_t>(segmentSize)) != 0) {
+        close(memFd);
+        return 0;
+    }
+    void* segment = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (segment == MAP_FAILED) {
+        close(memFd);
+        return 0;
+    }
+
+    // ftruncate后段内容全为0，计数器与标志无需再初始化
+    ShmSegmentHeader* header = static_cast<ShmSegmentHeader*>(segment);
+    header->magic = SEGMENT_MAGIC;
+    header->version = SEGMENT_VERSION;
+    header->ringCapacity = RING_CAPACITY;
+
+    char marker = 'S';
+    struct iovec iov;
+    iov.iov_base = &marker;
+    iov.iov_len = 1;
+    int fds[2] = { memFd, wakeFd };
+    char controlBuffer[CMSG_SPACE(sizeof(fds))];
+    memset(controlBuffer, 0, sizeof(controlBuffer));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = controlBuffer;
+    msg.msg_controllen = sizeof(controlBuffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    // 新连接的发送缓冲为空，非阻塞发送1字节不会返回EAGAIN
+    ssize_t sent = sendmsg(control, &msg, MSG_NOSIGNAL);
+    close(memFd);
+    if (sent != 1) {
+        munmap(segment, segmentSize);
+        return 0;
+    }
+
+    Channel* channel = new Channel;
+    channel->control = control;
+    channel->segment = segment;
+    channel->segmentSize = segmentSize;
+    channel->header = header;
+    char* rings = static_cast<char*>(segment) + sizeof(ShmSegmentHeader);
+    channel->requests.attach(rings, RING_CAPACITY, header->requestHead, header->requestTail);
+    channel->responses.attach(rings + RING_CAPACITY, RING_CAPACITY, header->responseHead, header->responseTail);
+    return channel;
+}
+
+// 关闭连接，若会话仍有命令在执行线程中则等其执行完后由requestClose关闭(期间不再处理请求)
+void ShmLoop::closeOrDefer(Channel* channel) {
+    if (channel->closing) {
+        return;
+    }
+    if (server->deferSessionClose(channel->session)) {
+        channel->closing = true;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, channel->control, NULL);
+        return;
+    }
+    closeChannel(channel);
+}
+
+// 关闭连接 - 尽量送出剩余响应，通知客户端会话结束后注销会话并解除映射
+void ShmLoop::closeChannel(Channel* channel) {
+    SOCKET control = channel->control;
+    flushChannel(channel, *channel->session);
+    __atomic_store_n(&channel->header->serverClosed.value, 1, __ATOMIC_RELEASE);
+    futexWake(&channel->header->responseTail.value);
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, control, NULL);
+    timers.cancel(&channel->session->getTimeoutTimer());
+    channels[control] = 0;
+    for (size_t i = 0; i < active.size(); ++i) {
+        if (active[i] == control) {
+            active[i] = active.back();
+            active.pop_back();
+            break;
+        }
+    }
+
+    server->closeSession(channel->session);     // 关闭控制套接字
+    munmap(channel->segment, channel->segmentSize);
+    delete channel;
+}
+
+// 排空连接 - 送完响应的连接关闭；仍有命令在执行线程中的连接由执行线程执行完后关闭
+void ShmLoop::drainChannels() {
+    if (!listenerRemoved) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenSocket, NULL);
+        listenerRemoved = true;
+    }
+    size_t i = 0;
+    while (i < active.size()) {
+        SOCKET socket = active[i];
+        Channel* channel = channels[socket];
+        if (!channel->closing && !channel->outputPending) {
+            closeOrDefer(channel);
+        }
+        if (i < active.size() && active[i] == socket) {
+            ++i;
+        }
+    }
+}
+
+void ShmLoop::closeAllChannels() {
+    while (!active.empty()) {
+        closeChannel(channels[active.back()]);
+    }
+}
+
+// 服务线程主体 - 有请求时持续轮询，空闲超过自旋时间后公布等待标志并睡眠在epoll上
+void ShmLoop::run() {
+    unsigned long long spinStart = 0;
+    unsigned rounds = 0;
+    server->bindCurrentThread(THREAD_ROLE_SHM, loopIndex);
+
+    while (running.load()) {
+        if (remotePending.load() > 0) {
+            processRemoteRequests();
+        }
+        bool progress = pollChannels();
+        if (draining.load()) {
+            drainChannels();
+        }
+
+        if (progress) {
+            spinStart = 0;
+            if (++rounds % EVENT_CHECK_ROUNDS == 0) {
+                waitEvents(0);
+            }
+            continue;
+        }
+        if (spinNs > 0) {
+            unsigned long long now = nowNs();
+            if (spinStart == 0) {
+                spinStart = now;
+            }
+            if (now - spinStart < spinNs) {
+                cpuRelax();
+                continue;
+            }
+        }
+
+        // 公布等待标志后复查，与客户端"发布请求后检查标志"配对
+        setWaiting(1);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (anyReadable() || remotePending.load() > 0 || !running.load()) {
+            setWaiting(0);
+            continue;
+        }
+
+        int timeoutMs = timers.nextWaitMs(TimerWheel::nowMs());
+        for (size_t i = 0; i < active.size(); ++i) {
+            if (channels[active[i]]->outputPending) {
+                timeoutMs = 1;  // 响应环已满，等待客户端读取
+                break;
+            }
+        }
+        ++sleepCount;
+        waitEvents(timeoutMs);
+        setWaiting(0);
+        spinStart = 0;
+    }
+
+    closeAllChannels();
+}
+
+// ---------- 共享内存传输 ----------
+
+ShmTransport::ShmTransport(TCPUserSystemServer* owner, const std::string& path)
+    : server(owner), socketPath(path), listenSocket(INVALID_SOCKET) {}
+
+ShmTransport::~ShmTransport() {
+    stop();
+    for (size_t i = 0; i < loops.size(); ++i) {
+        delete loops[i];
+    }
+    loops.clear();
+}
+
+// 创建握手监听套接字并启动服务线程 - 失败时由调用方stop并释放
+bool ShmTransport::start(int threadCount, unsigned spinMicroseconds, SOCKET inherited) {
+    listenSocket = inherited != INVALID_SOCKET ? inherited : server->openUnixListener(socketPath);
+    if (listenSocket == INVALID_SOCKET) {
+        return false;
+    }
+    // 各服务线程共同监听，被其他线程抢先接受时accept4须立即返回
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+    int count = threadCount > 0 ? threadCount : 1;
+    for (int i = 0; i < count; ++i) {
+        ShmLoop* loop = new ShmLoop(server, i, listenSocket, spinMicroseconds);
+        loops.push_back(loop);
+        if (!loop->start()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShmTransport::beginDrain() {
+    for (size_t i = 0; i < loops.size(); ++i) {
+        loops[i]->beginDrain();
+    }
+}
+
+// 排空后服务线程已不再监听，描述符交给调用方移交
+SOCKET ShmTransport::detachListener() {
+    SOCKET listener = listenSocket;
+    listenSocket = INVALID_SOCKET;
+    return listener;
+}
+
+// 停止服务线程后再关闭监听套接字，避免描述符被复用时仍在epoll中
+void ShmTransport::stop() {
+    for (size_t i = 0; i < loops.size(); ++i) {
+        loops[i]->stop();
+    }
+    if (listenSocket != INVALID_SOCKET) {
+        closesocket(listenSocket);
+        unlink(socketPath.c_str());
+        listenSocket = INVALID_SOCKET;
+    }
+}
+
+// 统计摘要 - 服务线程已停止后调用
+std::string ShmTransport::describeStats() {
+    unsigned long long accepted = 0;
+    unsigned long long sleeps = 0;
+    unsigned long long wakes = 0;
+    for (size_t i = 0; i < loops.size(); ++i) {
+        accepted += loops[i]->getAcceptedCount();
+        sleeps += loops[i]->getSleepCount();
+        wakes += loops[i]->getClientWakeCount();
+    }
+    std::stringstream ss;
+    ss << "服务线程 " << loops.size() << "，连接 " << accepted << "，服务线程睡眠 " << sleeps
+       << " 次，唤醒客户端 " << wakes << " 次";
+    return ss.str();
+}
+
+// ---------- 客户端 ----------
+
+ShmClient::ShmClient(unsigned spinMicroseconds)
+    : controlSocket(INVALID_SOCKET), wakeFd(-1), segment(0), segmentSize(0), header(0),
+      spinNs(resolveSpinNs(spinMicroseconds)) {}
+
+ShmClient::~ShmClient() {
+    close();
+}
+
+// 握手 - 连接服务器的Unix域套接字，接收共享段与服务线程的eventfd并映射共享段
+bool ShmClient::connect(const std::string& path) {
+    close();
+
+    sockaddr_un serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(serverAddr.sun_path)) {
+        return false;
+    }
+    strncpy(serverAddr.sun_path, path.c_str(), sizeof(serverAddr.sun_path) - 1);
+
+    controlSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (controlSocket == INVALID_SOCKET) {
+        return false;
+    }
+    if (::connect(controlSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+        close();
+        return false;
+    }
+
+    char marker;
+    struct iovec iov;
+    iov.iov_base = &marker;
+    iov.iov_len = 1;
+    int fds[2] = { -1, -1 };
+    char controlBuffer[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = controlBuffer;
+    msg.msg_controllen = sizeof(controlBuffer);
+    if (recvmsg(controlSocket, &msg, MSG_CMSG_CLOEXEC) != 1) {
+        close();
+        return false;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        close();
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    wakeFd = fds[1];
+
+    struct stat info;
+    if (fstat(fds[0], &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(ShmSegmentHeader)) {
+        ::close(fds[0]);
+        close();
+        return false;
+    }
+    segmentSize = static_cast<size_t>(info.st_size);
+    segment = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    ::close(fds[0]);
+    if (segment == MAP_FAILED) {
+        segment = 0;
+        close();
+        return false;
+    }
+
+    ShmSegmentHeader* mapped = static_cast<ShmSegmentHeader*>(segment);
+    uint32_t capacity = mapped->ringCapacity;
+    if (mapped->magic != SEGMENT_MAGIC || mapped->version != SEGMENT_VERSION || capacity == 0 ||
+        (capacity & (capacity - 1)) != 0 || segmentSize < sizeof(ShmSegmentHeader) + 2 * static_cast<size_t>(capacity)) {
+        close();
+        return false;
+    }
+    header = mapped;
+    char* rings = static_cast<char*>(segment) + sizeof(ShmSegmentHeader);
+    requests.attach(rings, capacity, header->requestHead, header->requestTail);
+    responses.attach(rings + capacity, capacity, header->responseHead, header->responseTail);
+    return true;
+}
+
+// 断开 - 关闭控制连接即通知服务器结束会话
+void ShmClient::close() {
+    header = 0;
+    if (segment) {
+        munmap(segment, segmentSize);
+        segment = 0;
+    }
+    if (wakeFd >= 0) {
+        ::close(wakeFd);
+        wakeFd = -1;
+    }
+    if (controlSocket != INVALID_SOCKET) {
+        ::close(controlSocket);
+        controlSocket = INVALID_SOCKET;
+    }
+}
+
+// 服务器已结束会话，或服务器进程退出(控制连接对端关闭)
+bool ShmClient::serverGone() {
+    if (__atomic_load_n(&header->serverClosed.value, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    struct pollfd pfd;
+    pfd.fd = controlSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// 发送 - 发布请求后服务线程在睡眠才写eventfd唤醒它
+bool ShmClient::send(const char* data, size_t length) {
+    if (!header) {
+        return false;
+    }
+    size_t sent = 0;
+    while (true) {
+        sent += requests.write(data + sent, length - sent);
+        if (requests.isCorrupted()) {
+            return false;
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&header->serverWaiting.value, __ATOMIC_RELAXED)) {
+            uint64_t one = 1;
+            ssize_t written = write(wakeFd, &one, sizeof(one));
+            (void)written;
+        }
+        if (sent == length) {
+            return true;
+        }
+        // 请求环已满，等待服务线程消费
+        if (serverGone()) {
+            return false;
+        }
+        sched_yield();
+    }
+}
+
+// 接收 - 先自旋，超过自旋时间后公布等待标志并睡眠在响应环尾指针的futex上
+int ShmClient::receive(char* buffer, size_t capacity, int timeoutMs) {
+    if (!header) {
+        return -1;
+    }
+    unsigned long long start = nowNs();
+    unsigned long long timeoutNs = timeoutMs > 0 ? static_cast<unsigned long long>(timeoutMs) * 1000000ULL : 0;
+
+    while (true) {
+        if (responses.readable() > 0) {
+            return static_cast<int>(responses.read(buffer, capacity));
+        }
+        if (responses.isCorrupted() || __atomic_load_n(&header->serverClosed.value, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+        if (timeoutMs == 0) {
+            return 0;
+        }
+
+        unsigned long long elapsed = nowNs() - start;
+        if (elapsed < spinNs) {
+            cpuRelax();
+            continue;
+        }
+        int sliceMs = CLIENT_WAIT_SLICE_MS;
+        if (timeoutMs > 0) {
+            if (elapsed >= timeoutNs) {
+                return 0;
+            }
+            unsigned long long remainingMs = (timeoutNs - elapsed + 999999ULL) / 1000000ULL;
+            if (remainingMs < static_cast<unsigned long long>(sliceMs)) {
+                sliceMs = static_cast<int>(remainingMs);
+            }
+        }
+
+        // 先记下尾指针再公布等待标志: 之后服务器发布的响应要么被复查看到，要么使futex立即返回
+        uint32_t observed = __atomic_load_n(&header->responseTail.value, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&header->clientWaiting.value, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (responses.readable() == 0 && !__atomic_load_n(&header->serverClosed.value, __ATOMIC_ACQUIRE)) {
+            futexWait(&header->responseTail.value, observed, sliceMs);
+        }
+        __atomic_store_n(&header->clientWaiting.value, 0, __ATOMIC_RELAXED);
+
+        if (responses.readable() == 0 && serverGone()) {
+            return -1;
+        }
+    }
+}
+
+#endif // __linux__
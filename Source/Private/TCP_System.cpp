@@ -8,20 +8,38 @@
  * 4. 用户管理业务逻辑 - 注册、登录、密码修改等核心功能
  * 5. 数据持久化 - CSV格式文件读写，实现用户数据的持久存储
  * 6. 网络通信 - 可靠的消息发送接收机制，支持超时处理
+ * 7. 运行配置 - 命令行配置项解析
  * 
  * 技术实现:
  * - 基于TCP的自定义文本协议
- * - 多线程并发处理客户端连接
+ * - 多线程并发处理客户端连接(每连接一线程、epoll事件循环或io_uring)
  * - 线程安全的用户数据管理
  * - 实时的操作日志记录
  * - 优雅的服务器关闭处理
  */
 
 #include "../Public/TCP_System.h"
+#include "../Public/Event_Loop.h"
+#include "../Public/Uring_Loop.h"
+#include "../Public/Worker_Pool.h"
+#include "../Public/Work_Scheduler.h"
+#include "../Public/Shm_Transport.h"
+#include "../Public/Hot_Restart.h"
+#include "../Public/User_Shard.h"
+#include "../Public/Thread_Placement.h"
+#include "../Public/Write_Ahead_Log.h"
+#include "../Public/User_Snapshot.h"
+#include "../Public/Mapped_Snapshot.h"
+#include "../Public/Csv_Loader.h"
 #include <ctime>
 #include <cstdlib>
 #include <sys/stat.h> // mkdir
 #include <sstream>   // stringstream
+#include <algorithm> // swap
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#endif
 
 // 创建目录的辅助函数
 bool createDirectory(const std::string& path) {
@@ -102,53 +120,563 @@ void ServerLogger::logServerEvent(const std::string& event) {
     writeLog("SERVER", event);
 }
 
-// 协议消息解析实现 - 解析"COMMAND|param1|param2"格式的消息
-ProtocolMessage ProtocolMessage::parse(const std::string& message) {
-    ProtocolMessage msg;
-    std::istringstream iss(message);
-    std::string part;
-    
-    if (std::getline(iss, msg.command, '|')) {
-        while (std::getline(iss, part, '|')) {
-            msg.parameters.push_back(part);
+ProtocolMessage::ProtocolMessage()
+    : parameterCount(0), shed(false), frame(0), frameLength(0), commandInFrame(false), owned(false) {}
+
+// 复制 - 引用外部帧时只复制视图，已retain的消息连同帧副本一起复制
+ProtocolMessage::ProtocolMessage(const ProtocolMessage& other)
+    : command(other.command), parameterCount(other.parameterCount), shed(other.shed), frame(other.frame),
+      frameLength(other.frameLength), commandInFrame(other.commandInFrame), owned(other.owned),
+      storage(other.storage) {
+    for (size_t i = 0; i < parameterCount; ++i) {
+        parameters[i] = other.parameters[i];
+    }
+    if (owned) {
+        rebase(storage.data());
+    }
+}
+
+ProtocolMessage& ProtocolMessage::operator=(const ProtocolMessage& other) {
+    if (this != &other) {
+        ProtocolMessage copy(other);
+        swap(copy);
+    }
+    return *this;
+}
+
+// 交换 - 短帧副本保存在std::string内部，交换后地址改变，视图需重新定位
+void ProtocolMessage::swap(ProtocolMessage& other) {
+    std::swap(command, other.command);
+    for (size_t i = 0; i < MAX_PARAMETERS; ++i) {
+        std::swap(parameters[i], other.parameters[i]);
+    }
+    std::swap(parameterCount, other.parameterCount);
+    std::swap(shed, other.shed);
+    std::swap(frame, other.frame);
+    std::swap(frameLength, other.frameLength);
+    std::swap(commandInFrame, other.commandInFrame);
+    std::swap(owned, other.owned);
+    storage.swap(other.storage);
+    if (owned) {
+        rebase(storage.data());
+    }
+    if (other.owned) {
+        other.rebase(other.storage.data());
+    }
+}
+
+// 复制所引用的帧 - 之后接收缓冲可以被覆盖
+void ProtocolMessage::retain() {
+    if (owned || !frame) {
+        return;
+    }
+    storage.assign(frame, frameLength);
+    owned = true;
+    rebase(storage.data());
+}
+
+void ProtocolMessage::rebase(const char* newFrame) {
+    if (commandInFrame) {
+        command.data = newFrame + (command.data - frame);
+    }
+    for (size_t i = 0; i < parameterCount; ++i) {
+        parameters[i].data = newFrame + (parameters[i].data - frame);
+    }
+    frame = newFrame;
+}
+
+// 协议消息解析实现 - 解析"COMMAND|param1|param2"格式的消息，按'|'切分为视图
+void ProtocolMessage::parse(const char* text, size_t length, ProtocolMessage& message) {
+    message = ProtocolMessage();
+    message.frame = text;
+    message.frameLength = length;
+    message.commandInFrame = true;
+
+    const char* end = text + length;
+    const char* separator = static_cast<const char*>(memchr(text, '|', length));
+    if (!separator) {
+        message.command = SimpleStringView(text, length);
+        return;
+    }
+    message.command = SimpleStringView(text, static_cast<size_t>(separator - text));
+
+    // 与逐段getline一致: 末尾'|'之后的空段不算参数
+    const char* start = separator + 1;
+    while (start < end && message.parameterCount < MAX_PARAMETERS) {
+        separator = static_cast<const char*>(memchr(start, '|', static_cast<size_t>(end - start)));
+        const char* fieldEnd = separator ? separator : end;
+        message.parameters[message.parameterCount++] = SimpleStringView(start, static_cast<size_t>(fieldEnd - start));
+        if (!separator) {
+            break;
         }
+        start = separator + 1;
     }
-    
-    return msg;
 }
 
 // 协议消息序列化 - 将消息对象转换为传输格式
 std::string ProtocolMessage::serialize() const {
-    std::string result = command;
-    for (size_t i = 0; i < parameters.size(); ++i) {
-        result += "|" + parameters[i];
+    std::string result = command.str();
+    for (size_t i = 0; i < parameterCount; ++i) {
+        result += '|';
+        result.append(parameters[i].data, parameters[i].length);
     }
     return result;
 }
 
+// 二进制协议 - 读取2字节网络字节序长度
+static size_t readUint16(const char* data, size_t offset) {
+    return (static_cast<size_t>(static_cast<unsigned char>(data[offset])) << 8) |
+           static_cast<size_t>(static_cast<unsigned char>(data[offset + 1]));
+}
+
+static void appendUint16(std::string& output, size_t value) {
+    output += static_cast<char>((value >> 8) & 0xFF);
+    output += static_cast<char>(value & 0xFF);
+}
+
+static void appendUint32(std::string& output, size_t value) {
+    output += static_cast<char>((value >> 24) & 0xFF);
+    output += static_cast<char>((value >> 16) & 0xFF);
+    output += static_cast<char>((value >> 8) & 0xFF);
+    output += static_cast<char>(value & 0xFF);
+}
+
+// 二进制请求解码 - 操作码映射为文本命令名，字段按长度直接截取为视图
+bool ProtocolMessage::decodeBinary(const char* payload, size_t length, ProtocolMessage& message) {
+    static const char* const commands[] = {
+        "", "REGISTER", "LOGIN", "FORCE_LOGIN", "LOGOUT", "DELETE",
+        "CHANGE_PASSWORD", "SET_STRING", "GET_STRING", "QUIT", "STATS", "BGSAVE"
+    };
+
+    if (length == 0) {
+        return false;
+    }
+    unsigned char opcode = static_cast<unsigned char>(payload[0]);
+    if (opcode < BIN_OP_REGISTER || opcode > BIN_OP_BGSAVE) {
+        return false;
+    }
+    message = ProtocolMessage();
+    message.frame = payload;
+    message.frameLength = length;
+    message.command = SimpleStringView(commands[opcode], strlen(commands[opcode]));
+
+    // 超出MAX_PARAMETERS的字段仍校验长度，但不保存
+    size_t offset = 1;
+    while (offset < length) {
+        if (offset + 2 > length) {
+            return false;
+        }
+        size_t fieldLength = readUint16(payload, offset);
+        offset += 2;
+        if (offset + fieldLength > length) {
+            return false;
+        }
+        if (message.parameterCount < MAX_PARAMETERS) {
+            message.parameters[message.parameterCount++] = SimpleStringView(payload + offset, fieldLength);
+        }
+        offset += fieldLength;
+    }
+    return true;
+}
+
+// 文本响应编码为二进制帧
+void ProtocolMessage::appendBinaryResponse(const std::string& response, std::string& output) {
+    size_t separator = response.find('|');
+    std::string type = response.substr(0, separator);
+
+    unsigned char opcode = BIN_RESP_OTHER;
+    if (type == "SUCCESS") {
+        opcode = BIN_RESP_SUCCESS;
+    } else if (type == "ERROR") {
+        opcode = BIN_RESP_ERROR;
+    } else if (type == "CONFLICT") {
+        opcode = BIN_RESP_CONFLICT;
+    } else if (type == "KICKED") {
+        opcode = BIN_RESP_KICKED;
+    } else if (type == "GOODBYE") {
+        opcode = BIN_RESP_GOODBYE;
+    }
+
+    // 负载长度写在最前，先预留再回填
+    size_t frameStart = output.length();
+    output.append(BINARY_HEADER_LENGTH, '\0');
+    output += static_cast<char>(opcode);
+
+    if (opcode == BIN_RESP_OTHER) {
+        appendUint16(output, response.length());
+        output += response;
+    } else if (separator != std::string::npos) {
+        // CONFLICT的各部分均由服务器生成，按'|'拆分；其余响应可能携带用户数据，剩余部分整体作为一个字段
+        size_t start = separator + 1;
+        size_t end;
+        while (opcode == BIN_RESP_CONFLICT && (end = response.find('|', start)) != std::string::npos) {
+            appendUint16(output, end - start);
+            output.append(response, start, end - start);
+            start = end + 1;
+        }
+        appendUint16(output, response.length() - start);
+        output.append(response, start, std::string::npos);
+    }
+
+    std::string header;
+    appendUint32(header, output.length() - frameStart - BINARY_HEADER_LENGTH);
+    output.replace(frameStart, BINARY_HEADER_LENGTH, header);
+}
+
+// 运行配置默认值 - 与原有的每连接一线程行为一致
+ServerConfig::ServerConfig()
+    : port(8080), dataFileName("users.txt"), ioMode(IO_MODE_THREAD), ioThreads(0),
+      acceptThreads(0), listenBacklog(511), workerThreads(64), workerQueue(1024), workerStackKb(0),
+      workerOverflow(POOL_OVERFLOW_QUEUE), execThreads(0), tcpNoDelay(true),
+      idleTimeout(30), loginTimeout(0), shutdownTimeout(5), unixSocketPath(),
+      shmSocketPath(), shmThreads(1), shmSpinUs(50), handoffSocketPath(), maxOutputKb(1024),
+      maxConnections(0), maxInflight(0), maxQueuedKb(0), shardPerCore(false),
+      cpuAffinity("off"), checkpointInterval(300), checkpointWalKb(65536),
+      durability(DURABILITY_BATCHED), commitIntervalMs(0), bgsaveMutations(0), adminPassword() {}
+
+// 解析非负整数配置值
+static bool parseNonNegativeInt(const std::string& value, int& result) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.length() > 9) {
+        return false;
+    }
+    result = atoi(value.c_str());
+    return true;
+}
+
+// 应用单个配置项
+bool ServerConfig::applyOption(const std::string& key, const std::string& value) {
+    if (key == "port") {
+        int parsed;
+        if (!parseNonNegativeInt(value, parsed) || parsed <= 0 || parsed > 65535) {
+            return false;
+        }
+        port = parsed;
+        return true;
+    }
+    if (key == "data-file") {
+        if (value.empty()) {
+            return false;
+        }
+        dataFileName = value;
+        return true;
+    }
+    if (key == "io-mode") {
+        if (value == "thread") {
+            ioMode = IO_MODE_THREAD;
+        } else if (value == "epoll") {
+            ioMode = IO_MODE_EPOLL;
+        } else if (value == "io_uring") {
+            ioMode = IO_MODE_IO_URING;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (key == "io-threads") {
+        return parseNonNegativeInt(value, ioThreads);
+    }
+    if (key == "accept-threads") {
+        return parseNonNegativeInt(value, acceptThreads);
+    }
+    if (key == "listen-backlog") {
+        int parsed;
+        if (!parseNonNegativeInt(value, parsed) || parsed <= 0) {
+            return false;
+        }
+        listenBacklog = parsed;
+        return true;
+    }
+    if (key == "worker-threads" || key == "worker-queue") {
+        int parsed;
+        if (!parseNonNegativeInt(value, parsed) || parsed <= 0) {
+            return false;
+        }
+        (key == "worker-threads" ? workerThreads : workerQueue) = parsed;
+        return true;
+    }
+    if (key == "tcp-nodelay" || key == "shard-per-core") {
+        bool enabled;
+        if (value == "1" || value == "on") {
+            enabled = true;
+        } else if (value == "0" || value == "off") {
+            enabled = false;
+        } else {
+            return false;
+        }
+        (key == "tcp-nodelay" ? tcpNoDelay : shardPerCore) = enabled;
+        return true;
+    }
+    if (key == "exec-threads") {
+        return parseNonNegativeInt(value, execThreads);
+    }
+    if (key == "idle-timeout") {
+        return parseNonNegativeInt(value, idleTimeout);
+    }
+    if (key == "login-timeout") {
+        return parseNonNegativeInt(value, loginTimeout);
+    }
+    if (key == "shutdown-timeout") {
+        return parseNonNegativeInt(value, shutdownTimeout);
+    }
+    if (key == "unix-socket") {
+#ifndef _WIN32
+        if (value.empty() || value.length() >= sizeof(((sockaddr_un*)0)->sun_path)) {
+            return false;
+        }
+#endif
+        unixSocketPath = value;
+        return true;
+    }
+    if (key == "shm-socket") {
+#ifndef _WIN32
+        if (value.empty() || value.length() >= sizeof(((sockaddr_un*)0)->sun_path)) {
+            return false;
+        }
+#endif
+        shmSocketPath = value;
+        return true;
+    }
+    if (key == "handoff-socket") {
+#ifndef _WIN32
+        if (value.empty() || value.length() >= sizeof(((sockaddr_un*)0)->sun_path)) {
+            return false;
+        }
+#endif
+        handoffSocketPath = value;
+        return true;
+    }
+    if (key == "shm-threads") {
+        int parsed;
+        if (!parseNonNegativeInt(value, parsed) || parsed <= 0) {
+            return false;
+        }
+        shmThreads = parsed;
+        return true;
+    }
+    if (key == "shm-spin-us") {
+        return parseNonNegativeInt(value, shmSpinUs);
+    }
+    if (key == "max-output-kb") {
+        return parseNonNegativeInt(value, maxOutputKb);
+    }
+    if (key == "max-connections") {
+        return parseNonNegativeInt(value, maxConnections);
+    }
+    if (key == "max-inflight") {
+        return parseNonNegativeInt(value, maxInflight);
+    }
+    if (key == "max-queued-kb") {
+        return parseNonNegativeInt(value, maxQueuedKb);
+    }
+    if (key == "cpu-affinity") {
+        // CPU列表的区间与取值在启动时对照本机CPU检查
+        if (value.empty() || (value != "off" && value != "auto" &&
+                              value.find_first_not_of("0123456789,-") != std::string::npos)) {
+            return false;
+        }
+        cpuAffinity = value;
+        return true;
+    }
+    if (key == "checkpoint-interval") {
+        return parseNonNegativeInt(value, checkpointInterval);
+    }
+    if (key == "checkpoint-wal-kb") {
+        return parseNonNegativeInt(value, checkpointWalKb);
+    }
+    if (key == "durability") {
+        if (value == "none") {
+            durability = DURABILITY_NONE;
+        } else if (value == "batched") {
+            durability = DURABILITY_BATCHED;
+        } else if (value == "per-write") {
+            durability = DURABILITY_PER_WRITE;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (key == "commit-interval-ms") {
+        return parseNonNegativeInt(value, commitIntervalMs);
+    }
+    if (key == "bgsave-mutations") {
+        return parseNonNegativeInt(value, bgsaveMutations);
+    }
+    if (key == "admin-password") {
+        adminPassword = value;
+        return true;
+    }
+    if (key == "worker-stack-kb") {
+        return parseNonNegativeInt(value, workerStackKb);
+    }
+    if (key == "worker-overflow") {
+        if (value == "queue") {
+            workerOverflow = POOL_OVERFLOW_QUEUE;
+        } else if (value == "reject") {
+            workerOverflow = POOL_OVERFLOW_REJECT;
+        } else if (value == "shed") {
+            workerOverflow = POOL_OVERFLOW_SHED;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// 配置项帮助信息
+std::string ServerConfig::usage() {
+    return
+        "  --port=<端口>              监听端口 (默认 8080，未指定时交互输入)\n"
+        "  --data-file=<文件名>       用户数据文件名，存放于users目录 (默认 users.txt)\n"
+        "  --io-mode=<thread|epoll|io_uring>\n"
+        "                             I/O模型: 每连接一线程 / epoll事件循环 / io_uring (默认 thread)\n"
+        "  --io-threads=<数量>        事件循环线程数，0表示按CPU核数 (默认 0)\n"
+        "  --accept-threads=<数量>    thread模型的接受线程数，0表示按CPU核数 (默认 0)\n"
+        "  --listen-backlog=<长度>    每个监听套接字的连接队列长度 (默认 511)\n"
+        "  --worker-threads=<数量>    thread模型的工作线程数，即可同时服务的连接数 (默认 64)\n"
+        "  --worker-queue=<数量>      等待工作线程的连接队列容量 (默认 1024)\n"
+        "  --worker-stack-kb=<KB>     工作线程栈大小，0表示系统默认 (默认 0)\n"
+        "  --worker-overflow=<queue|reject|shed>\n"
+        "                             队列满时: 等待空位 / 拒绝新连接 / 丢弃最早排队的连接 (默认 queue)\n"
+        "  --exec-threads=<数量>      epoll/io_uring模式的命令执行线程数(工作窃取调度)，\n"
+        "                             0表示在I/O线程内直接执行 (默认 0)\n"
+        "  --shard-per-core=<on|off>  每核一分片: 用户按ID分区到各epoll事件循环，跨分片操作经无锁队列\n"
+        "                             传递，不经过全局用户锁与会话锁 (默认 off，使用epoll模型，仅Linux)\n"
+        "  --cpu-affinity=<off|auto|CPU列表>\n"
+        "                             把接受、I/O、工作与命令执行线程按序号绑定到CPU(如0-7,16-23)，\n"
+        "                             线程改为在本NUMA节点分配内存 (默认 off，仅Linux)\n"
+        "  --tcp-nodelay=<on|off>     客户端连接禁用Nagle算法 (默认 on)\n"
+        "  --idle-timeout=<秒>        连接空闲超时，0表示不限 (默认 30)\n"
+        "  --login-timeout=<秒>       连接后(或登出后)须在该时间内登录，0表示不限 (默认 0)\n"
+        "  --shutdown-timeout=<秒>    停止时等待连接送完响应的期限，到期后强制关闭 (默认 5)\n"
+        "  --max-output-kb=<KB>       每个连接未送出响应的积压上限，超过时关闭连接，0表示不限 (默认 1024)\n"
+        "  --max-connections=<数量>   连接数上限，超过时回复ERROR|BUSY并关闭新连接，0表示不限 (默认 0)\n"
+        "  --max-inflight=<数量>      已接收未执行完的请求数上限，超过时回复ERROR|BUSY，0表示不限 (默认 0)\n"
+        "  --max-queued-kb=<KB>       已接收未执行完的请求字节上限，超过时回复ERROR|BUSY，0表示不限 (默认 0)\n"
+        "  --checkpoint-interval=<秒> 数据日志有新记录时按该间隔重写数据文件，0表示只在停止时 (默认 300)\n"
+        "  --checkpoint-wal-kb=<KB>   数据日志超过该大小时提前重写数据文件，0表示不限 (默认 65536)\n"
+        "  --durability=<none|batched|per-write>\n"
+        "                             用户修改的持久化: none只写入内核，batched组提交(一次同步一批修改后\n"
+        "                             一起送出响应)，per-write每次修改同步一次 (默认 batched)\n"
+        "  --commit-interval-ms=<毫秒> 组提交收到修改后再等待的时间以合并更多修改，0表示立即提交 (默认 0)\n"
+        "  --bgsave-mutations=<次数>  自上次检查点起修改达到该次数时由fork出的子进程写出数据文件，0表示不自动触发 (默认 0)\n"
+        "  --admin-password=<密码>    TCP连接执行管理命令(STATS、BGSAVE)须给出的密码，本机Unix域连接不需要 (默认不设置，只接受本机连接)\n"
+        "  --unix-socket=<路径>       同时在该路径监听Unix域套接字，供本机客户端使用 (默认不监听)\n"
+        "  --shm-socket=<路径>        启用共享内存传输，本机客户端经该路径握手 (默认不启用，仅Linux)\n"
+        "  --shm-threads=<数量>       共享内存传输的服务线程数 (默认 1)\n"
+        "  --shm-spin-us=<微秒>       共享内存两端睡眠前的自旋时间，单核时不自旋 (默认 50)\n"
+        "  --handoff-socket=<路径>    热重启: 启动时从该路径上运行中的旧进程接管监听套接字与连接，\n"
+        "                             之后在该路径等待下一个新进程 (默认不启用，仅Linux)\n";
+}
+
 // 服务器构造函数 - 初始化服务器状态并加载历史数据
 TCPUserSystemServer::TCPUserSystemServer(int serverPort, const std::string& filename) 
-    : serverSocket(INVALID_SOCKET), running(false), port(serverPort), dataFile(filename) {
+    : localListenSocket(INVALID_SOCKET), running(false), stopRequested(0), port(serverPort), dataFile(filename), usersSnapshot(0), mappedUsers(0),
+      mappedLoadStartMs(0), dataLoadFailed(false), workerPool(0), scheduler(0), shmTransport(0), hotRestart(0), placement(0), userLog(0),
+      snapshotWriter(0), lastCheckpointMs(0),
+      commitWaitersClosed(false), acceptWakeFd(-1), spareFd(-1) {
+    config.port = serverPort;
+    config.dataFileName = filename;
+    initialize();
+}
+
+// 按运行配置构造服务器
+TCPUserSystemServer::TCPUserSystemServer(const ServerConfig& serverConfig)
+    : localListenSocket(INVALID_SOCKET), running(false), stopRequested(0), port(serverConfig.port),
+      dataFile(serverConfig.dataFileName), config(serverConfig), usersSnapshot(0), mappedUsers(0),
+      mappedLoadStartMs(0), dataLoadFailed(false), workerPool(0), scheduler(0), shmTransport(0), hotRestart(0), placement(0), userLog(0),
+      snapshotWriter(0), lastCheckpointMs(0),
+      commitWaitersClosed(false), acceptWakeFd(-1), spareFd(-1) {
+    initialize();
+}
+
+// 构造函数公共部分 - 创建目录、初始化日志并加载用户数据
+void TCPUserSystemServer::initialize() {
     // 确保当前目录下的log和users目录存在
     createDirectory("log");
     createDirectory("users");
     
     // 设置用户数据文件路径
-    dataFile = "users/" + filename;
+    dataFile = "users/" + config.dataFileName;
+    snapshotFile = dataFile + ".snap";
+    srand(static_cast<unsigned int>(time(0)));  // 会话ID随机部分只需播种一次
     
     // 初始化日志系统，日志文件存放在当前目录的log目录
     logger = new ServerLogger("log/server.log", true);
     
     std::stringstream ss;
-    ss << serverPort;
+    ss << port;
     logger->logServerEvent("TCP用户系统服务器初始化，端口: " + ss.str());
-    logger->logInfo("数据文件路径: " + dataFile);
+    logger->logInfo("数据文件路径: " + dataFile + "，快照文件: " + snapshotFile);
+
+#ifndef __linux__
+    if (config.ioMode != IO_MODE_THREAD) {
+        logger->logWarning("当前平台不支持epoll/io_uring，回退到每连接一线程模型");
+        config.ioMode = IO_MODE_THREAD;
+    }
+#endif
+#ifdef _WIN32
+    if (!config.unixSocketPath.empty()) {
+        logger->logWarning("当前平台不支持Unix域套接字监听，只监听TCP端口");
+        config.unixSocketPath.clear();
+    }
+#endif
+#ifndef __linux__
+    if (!config.shmSocketPath.empty()) {
+        logger->logWarning("当前平台不支持共享内存传输");
+        config.shmSocketPath.clear();
+    }
+    if (!config.handoffSocketPath.empty()) {
+        logger->logWarning("当前平台不支持热重启");
+        config.handoffSocketPath.clear();
+    }
+    if (config.shardPerCore) {
+        logger->logWarning("当前平台不支持分片模式");
+        config.shardPerCore = false;
+    }
+    if (config.cpuAffinity != "off") {
+        logger->logWarning("当前平台不支持线程CPU绑定");
+        config.cpuAffinity = "off";
+    }
+#else
+    // 线程CPU绑定: CPU列表无效时不绑定，继续运行
+    if (config.cpuAffinity != "off") {
+        placement = new ThreadPlacement();
+        std::string error;
+        if (!placement->configure(config.cpuAffinity, error)) {
+            logger->logWarning("线程CPU绑定未启用: " + error);
+            delete placement;
+            placement = 0;
+            config.cpuAffinity = "off";
+        }
+    }
+
+    // 分片模式: 命令在各分片的循环线程内执行，会话只由epoll事件循环驱动
+    if (config.shardPerCore) {
+        if (config.ioMode != IO_MODE_EPOLL) {
+            logger->logWarning("分片模式使用epoll事件循环，忽略--io-mode");
+            config.ioMode = IO_MODE_EPOLL;
+        }
+        if (config.execThreads > 0) {
+            logger->logWarning("分片模式在各分片的循环线程内执行命令，忽略--exec-threads");
+            config.execThreads = 0;
+        }
+        if (!config.shmSocketPath.empty()) {
+            logger->logWarning("分片模式不支持共享内存传输");
+            config.shmSocketPath.clear();
+        }
+    }
+#endif
     
+    usersSnapshot = new UserTableSnapshot(&users, &usersMutex);
     loadFromFile();  // 启动时加载用户数据
     
     std::stringstream userCount;
-    userCount << users.size();
+    userCount << users.size() + (mappedUsers ? mappedUsers->getRecordCount() : 0);
     logger->logInfo("用户数据加载完成，当前用户数量: " + userCount.str());
+    if (mappedUsers) {
+        logger->logInfo("快照文件已映射，用户在首次访问时复制到用户表，其余由检查点线程在启动后复制");
+    }
 }
 
 // 服务器析构函数 - 确保资源正确释放
@@ -156,10 +684,28 @@ TCPUserSystemServer::~TCPUserSystemServer() {
     if (logger) {
         logger->logServerEvent("服务器正在关闭...");
     }
-    stopServer();       // 停止服务器
-    saveToFile();       // 保存数据
+    stopServer();       // 停止服务器(运行中时包含保存数据)
+#ifdef __linux__
+    delete hotRestart;  // 启动失败时仍在监听的移交套接字
+    hotRestart = 0;
+    delete placement;
+    placement = 0;
+#endif
+    delete snapshotWriter;  // 启动失败时已启动的检查点线程
+    snapshotWriter = 0;
+    delete userLog;     // 启动失败时已打开的日志
+    userLog = 0;
+    delete usersSnapshot;
+    usersSnapshot = 0;
+    delete mappedUsers;
+    mappedUsers = 0;
+#ifdef __linux__
+    if (spareFd >= 0) {
+        close(spareFd);
+        spareFd = -1;
+    }
+#endif
     if (logger) {
-        logger->logInfo("用户数据已保存");
         delete logger;
         logger = 0;
     }
@@ -186,585 +732,2719 @@ void TCPUserSystemServer::cleanupNetwork() {
 }
 
 // 服务器启动 - 创建监听套接字并进入主循环
+// 每个事件循环(或接受线程)独占一个以SO_REUSEPORT绑定的监听套接字，
+// 由内核在各套接字间分摊新连接，避免单一接受线程与单一连接队列成为瓶颈
 bool TCPUserSystemServer::startServer() {
     if (!initializeNetwork()) {
         logger->logError("网络初始化失败");
         return false;
     }
 
-    // 创建TCP套接字
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket == INVALID_SOCKET) {
-        logger->logError("创建服务器套接字失败");
+    // 热重启时接管旧进程的监听套接字(数量沿用旧进程)，否则io_uring/epoll模式每个循环一个监听套接字，线程模式每个接受线程一个
+    bool inherited = inheritListenSockets();
+    if (dataLoadFailed) {
+        logger->logError("数据文件损坏或版本不符，拒绝启动以免检查点覆盖原数据");
+        closeListenSockets();
+        return false;
+    }
+    int listenerCount = config.ioMode == IO_MODE_THREAD ? resolveAcceptCount() : resolveLoopCount();
+    if ((!inherited && !openListenSockets(listenerCount)) || !openLocalListenSocket()) {
+        closeListenSockets();
         return false;
     }
+#ifdef __linux__
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
 
-    // 设置套接字选项 - 允许地址重用
-    int opt = 1;
-    if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt)) < 0) {
-        logger->logError("设置套接字选项失败");
-        closesocket(serverSocket);
+    // 热重启时旧进程已在停止时做完检查点，此后才打开日志
+    if (!openUserLog()) {
+        closeListenSockets();
+        return false;
+    }
+    snapshotWriter = new SnapshotWriter(this);
+    if (!snapshotWriter->start()) {
+        logger->logError("检查点线程启动失败");
+        closeListenSockets();
         return false;
     }
 
-    // 绑定服务器地址和端口
-    sockaddr_in serverAddr = {};
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;  // 监听所有网络接口
-    serverAddr.sin_port = htons(static_cast<unsigned short>(port));
+    running.store(true);
 
-    if (bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-        std::stringstream ss;
-        ss << port;
-        logger->logError("绑定地址失败，端口: " + ss.str());
-        closesocket(serverSocket);
+    // 事件循环模式可选的命令执行线程 - 须先于事件循环创建
+    if (config.ioMode != IO_MODE_THREAD && config.execThreads > 0) {
+        scheduler = new WorkScheduler(this, config.execThreads);
+        if (!scheduler->start()) {
+            logger->logError("命令执行线程启动失败");
+            running.store(false);
+            delete scheduler;
+            scheduler = 0;
+            closeListenSockets();
+            return false;
+        }
+        std::stringstream execInfo;
+        execInfo << config.execThreads;
+        logger->logInfo("命令执行线程数(工作窃取): " + execInfo.str());
+    }
+
+    if (!startShmTransport()) {
+        running.store(false);
+        if (scheduler) {
+            scheduler->stop();
+            delete scheduler;
+            scheduler = 0;
+        }
+        closeListenSockets();
         return false;
     }
 
-    // 开始监听客户端连接
-    if (listen(serverSocket, 10) == SOCKET_ERROR) {
-        logger->logError("监听失败");
-        closesocket(serverSocket);
+    // io_uring不可用(内核过旧或被禁用)时回退到epoll
+    if (config.ioMode == IO_MODE_IO_URING && !startUringLoops()) {
+        logger->logWarning("io_uring不可用，回退到epoll事件循环");
+        config.ioMode = IO_MODE_EPOLL;
+    }
+
+    if (config.ioMode == IO_MODE_EPOLL && !startEventLoops()) {
+        logger->logError("事件循环启动失败");
+        running.store(false);
+        delete shmTransport;
+        shmTransport = 0;
+        delete scheduler;
+        scheduler = 0;
+        closeListenSockets();
         return false;
     }
 
-    running.store(true);
+#ifdef __linux__
+    // 在移交路径上等待下一个新进程
+    if (hotRestart && !hotRestart->listen()) {
+        logger->logWarning("热重启移交套接字创建失败，本次运行不支持热重启: " + config.handoffSocketPath);
+        delete hotRestart;
+        hotRestart = 0;
+    }
+#endif
+
     std::stringstream ss;
-    ss << port;
-    logger->logServerEvent("TCP用户系统服务器启动成功，端口: " + ss.str());
+    ss << port << "，监听套接字: " << listenSockets.size() << "，连接队列: " << config.listenBacklog;
+    const char* modeName = config.ioMode == IO_MODE_IO_URING ? "io_uring" :
+                           (config.ioMode == IO_MODE_EPOLL ? "epoll" : "每连接一线程");
+    if (localListenSocket != INVALID_SOCKET) {
+        ss << "，Unix域套接字: " << config.unixSocketPath;
+    }
+    if (shmTransport) {
+        ss << "，共享内存握手: " << config.shmSocketPath;
+    }
+    if (hotRestart) {
+        ss << "，热重启移交: " << config.handoffSocketPath;
+    }
+    logger->logServerEvent("TCP用户系统服务器启动成功，端口: " + ss.str() + "，I/O模型: " + modeName);
+    reportPlacement();
 
-    // 主循环 - 接受客户端连接并创建处理线程
-    while (running.load()) {
-        sockaddr_in clientAddr;
-        socklen_t clientAddrLen = sizeof(clientAddr);
-        
-        SOCKET clientSocket = accept(serverSocket, (sockaddr*)&clientAddr, &clientAddrLen);
-        if (clientSocket == INVALID_SOCKET) {
-            if (running.load()) {
-                logger->logWarning("接受客户端连接失败");
+    // 线程模式 - 每个监听套接字一个接受线程，连接交给固定大小的工作线程池处理
+    if (config.ioMode == IO_MODE_THREAD && !startAcceptThreads()) {
+        running.store(false);
+        delete shmTransport;
+        shmTransport = 0;
+        closeListenSockets();
+        return false;
+    }
+
+    // 全部I/O线程已就绪，检查点线程开始复制映射的数据文件
+    snapshotWriter->requestLoad();
+
+    // 连接由接受线程或各事件循环线程接受，主线程等待停止请求(或新进程的热重启请求)后执行停止流程
+    while (running.load() && !stopRequested) {
+        checkpointIfDue();
+#ifdef __linux__
+        if (hotRestart) {
+            if (hotRestart->waitSuccessor(50)) {
+                break;      // 新进程已连接，停止服务并移交
             }
             continue;
         }
-
-        std::stringstream clientInfo;
-        clientInfo << inet_ntoa(clientAddr.sin_addr) << ":" << ntohs(clientAddr.sin_port);
-        logger->logInfo("新客户端连接: " + clientInfo.str());
-
-        // 为客户端创建独立处理线程
-        ThreadParam* param = new ThreadParam;
-        param->server = this;
-        param->clientSocket = clientSocket;
-
+#endif
 #ifdef _WIN32
-        HANDLE thread = CreateThread(NULL, 0, clientThreadProc, param, 0, NULL);
-        if (thread) {
-            clientThreads.push_back(thread);
-        }
+        Sleep(50);
 #else
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, clientThreadProc, param) == 0) {
-            clientThreads.push_back(thread);
-        }
+        usleep(50000);
 #endif
     }
-
+    stopServer();
     return true;
 }
 
-// 客户端处理线程入口点 - 跨平台线程函数封装
-#ifdef _WIN32
-DWORD WINAPI TCPUserSystemServer::clientThreadProc(LPVOID param) {
-#else
-void* TCPUserSystemServer::clientThreadProc(void* param) {
+// 启动共享内存传输 - 服务线程直接调用processSessionInput，启用命令执行线程时同样提交给调度器
+bool TCPUserSystemServer::startShmTransport() {
+#ifdef __linux__
+    SOCKET inherited = hotRestart ? hotRestart->takeShmListener(config.shmSocketPath) : INVALID_SOCKET;
+    if (config.shmSocketPath.empty()) {
+        return true;
+    }
+    shmTransport = new ShmTransport(this, config.shmSocketPath);
+    if (!shmTransport->start(config.shmThreads, static_cast<unsigned>(config.shmSpinUs), inherited)) {
+        logger->logError("共享内存传输启动失败");
+        delete shmTransport;
+        shmTransport = 0;
+        return false;
+    }
+    std::stringstream ss;
+    ss << "共享内存传输服务线程数: " << config.shmThreads << "，自旋 " << config.shmSpinUs << " 微秒";
+    if (sysconf(_SC_NPROCESSORS_ONLN) <= 1) {
+        ss << "(单核环境不自旋)";
+    }
+    logger->logInfo(ss.str());
 #endif
-    ThreadParam* p = static_cast<ThreadParam*>(param);
-    p->server->handleClient(p->clientSocket);
-    delete p;  // 清理线程参数
-#ifdef _WIN32
-    return 0;
+    return true;
+}
+
+// 线程类别名称 - 放置报告与绑定失败日志使用，下标为ThreadRole
+static const char* const threadRoleNames[] = { "接受线程", "I/O循环", "共享内存服务线程", "工作线程", "命令执行线程" };
+
+// 绑定当前线程 - 失败时只记录警告，线程照常运行
+void TCPUserSystemServer::bindCurrentThread(ThreadRole role, int index) {
+#ifdef __linux__
+    std::string error;
+    if (placement && !placement->bindCurrentThread(index, error)) {
+        std::stringstream ss;
+        ss << threadRoleNames[role] << " " << index << ": " << error;
+        logger->logWarning("线程CPU绑定失败，" + ss.str());
+    }
 #else
-    return NULL;
+    (void)role;
+    (void)index;
 #endif
 }
 
-// 用户登录 - 验证用户凭据并更新会话状态，支持挤占下线
-std::string TCPUserSystemServer::loginUser(SimpleSharedPtr<ClientSession> session, const std::string& userId, const std::string& password) {
-    SimpleLockGuard lock(usersMutex);
-    
-    if (session->isLoggedIn()) {
-        return "ERROR|当前会话已有用户登录";
+// 放置报告 - 启动时记录CPU与NUMA节点，以及本次运行各类线程将绑定的CPU
+void TCPUserSystemServer::reportPlacement() {
+#ifdef __linux__
+    if (!placement) {
+        return;
     }
-
-    std::map<std::string, User>::iterator it = users.find(userId);
-    if (it == users.end()) {
-        return "ERROR|用户不存在";
+    logger->logInfo("线程CPU绑定: " + placement->describeTopology());
+    if (config.ioMode == IO_MODE_THREAD) {
+        logger->logInfo("线程CPU绑定: " + placement->describeRole(threadRoleNames[THREAD_ROLE_ACCEPT],
+                                                                static_cast<int>(listenSockets.size())));
+        logger->logInfo("线程CPU绑定: " + placement->describeRole(threadRoleNames[THREAD_ROLE_WORKER],
+                                                                config.workerThreads));
+    } else {
+        logger->logInfo("线程CPU绑定: " + placement->describeRole(threadRoleNames[THREAD_ROLE_IO],
+                                                                static_cast<int>(tcpListenerCount())));
+        if (scheduler) {
+            logger->logInfo("线程CPU绑定: " + placement->describeRole(threadRoleNames[THREAD_ROLE_EXEC],
+                                                                    config.execThreads));
+        }
     }
-
-    if (!it->second.verifyPassword(password)) {
-        return "ERROR|密码错误";
+    if (shmTransport) {
+        logger->logInfo("线程CPU绑定: " + placement->describeRole(threadRoleNames[THREAD_ROLE_SHM],
+                                                                config.shmThreads));
     }
-
-    // 检查用户是否已在其他会话中登录
-    std::string existingSessionId = findUserSession(userId);
-    if (!existingSessionId.empty()) {
-        // 用户已在其他会话中登录，询问是否挤占下线
-        return "CONFLICT|用户已在其他客户端登录|" + existingSessionId + "|是否挤占下线？(Y/N)";
+    if (!userShards.empty()) {
+        logger->logInfo("线程CPU绑定: 用户分片由所属I/O循环在其NUMA节点上重建");
     }
-
-    session->setLoggedInUser(userId);
-    return "SUCCESS|登录成功";
+#endif
 }
 
-// 处理挤占登录请求
-std::string TCPUserSystemServer::handleLoginConflict(SimpleSharedPtr<ClientSession> session, 
-                                                     const std::string& userId, 
-                                                     const std::string& password,
-                                                     bool forceLogin) {
-    SimpleLockGuard lock(usersMutex);
-    
-    if (session->isLoggedIn()) {
-        return "ERROR|当前会话已有用户登录";
-    }
-
-    std::map<std::string, User>::iterator it = users.find(userId);
-    if (it == users.end()) {
-        return "ERROR|用户不存在";
+// 创建工作线程池与接受线程
+bool TCPUserSystemServer::startAcceptThreads() {
+    workerPool = new WorkerPool(this, config.workerThreads, static_cast<size_t>(config.workerQueue),
+                                static_cast<size_t>(config.workerStackKb) * 1024, config.workerOverflow);
+    if (!workerPool->start()) {
+        logger->logError("工作线程池启动失败");
+        delete workerPool;
+        workerPool = 0;
+        return false;
     }
-
-    if (!it->second.verifyPassword(password)) {
-        return "ERROR|密码错误";
+    std::stringstream poolInfo;
+    poolInfo << config.workerThreads << "，等待队列: " << config.workerQueue
+             << "，溢出策略: " << WorkerPool::policyName(config.workerOverflow);
+    logger->logInfo("工作线程数: " + poolInfo.str());
+
+#ifdef __linux__
+    if (hotRestart) {
+        acceptWakeFd = eventfd(0, EFD_CLOEXEC);
     }
-
-    std::string existingSessionId = findUserSession(userId);
-    if (!existingSessionId.empty()) {
-        if (!forceLogin) {
-            return "ERROR|登录已取消";
-        }
-        
-        // 强制下线已存在的会话
-        SimpleSharedPtr<ClientSession> existingSession;
-        {
-            SimpleLockGuard sessionLock(sessionsMutex);
-            std::map<std::string, SimpleSharedPtr<ClientSession>>::iterator sessionIt = sessions.find(existingSessionId);
-            if (sessionIt != sessions.end()) {
-                existingSession = sessionIt->second;
+#endif
+    for (size_t i = 0; i < listenSockets.size(); ++i) {
+        AcceptParam* param = new AcceptParam;
+        param->server = this;
+        param->listener = listenSockets[i];
+        param->index = static_cast<int>(i);
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, acceptThreadProc, param, 0, NULL);
+        if (thread) {
+            acceptThreads.push_back(thread);
+        } else {
+            delete param;
+        }
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, acceptThreadProc, param) == 0) {
+            acceptThreads.push_back(thread);
+        } else {
+            delete param;
+        }
+#endif
+    }
+    if (acceptThreads.empty()) {
+        logger->logError("接受线程启动失败");
+        delete workerPool;     // 析构时停止并回收工作线程
+        workerPool = 0;
+        return false;
+    }
+    return true;
+}
+
+// 接受线程数 - 默认与CPU核数一致；没有SO_REUSEPORT时多个套接字无法绑定同一端口
+int TCPUserSystemServer::resolveAcceptCount() const {
+#ifdef SO_REUSEPORT
+    int acceptCount = config.acceptThreads;
+    if (acceptCount <= 0) {
+        acceptCount = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    return acceptCount > 0 ? acceptCount : 1;
+#else
+    return 1;
+#endif
+}
+
+// 创建监听套接字 - 多于一个时全部设置SO_REUSEPORT后绑定同一端口
+bool TCPUserSystemServer::openListenSockets(int count) {
+    sockaddr_in serverAddr = {};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;  // 监听所有网络接口
+    serverAddr.sin_port = htons(static_cast<unsigned short>(port));
+
+    for (int i = 0; i < count; ++i) {
+#ifdef __linux__
+        SOCKET listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+        SOCKET listener = socket(AF_INET, SOCK_STREAM, 0);
+#endif
+        if (listener == INVALID_SOCKET) {
+            logger->logError("创建服务器套接字失败");
+            closeListenSockets();
+            return false;
+        }
+        listenSockets.push_back(listener);
+
+        // 设置套接字选项 - 允许地址重用
+        int opt = 1;
+        if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt)) < 0) {
+            logger->logError("设置套接字选项失败");
+            closeListenSockets();
+            return false;
+        }
+#ifdef SO_REUSEPORT
+        if (count > 1 && setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt)) < 0) {
+            logger->logError("设置SO_REUSEPORT失败");
+            closeListenSockets();
+            return false;
+        }
+#endif
+
+        // 绑定服务器地址和端口
+        if (bind(listener, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+            std::stringstream ss;
+            ss << port;
+            logger->logError("绑定地址失败，端口: " + ss.str());
+            closeListenSockets();
+            return false;
+        }
+
+        // 开始监听客户端连接 - 队列长度受内核somaxconn限制
+        if (listen(listener, config.listenBacklog) == SOCKET_ERROR) {
+            logger->logError("监听失败");
+            closeListenSockets();
+            return false;
+        }
+    }
+    return true;
+}
+
+// 创建Unix域监听套接字 - 本机客户端不经过TCP协议栈，会话与协议处理与TCP连接完全相同
+// 由各事件循环共同监听(或由一个独立的接受线程接受)，不设置SO_REUSEPORT
+bool TCPUserSystemServer::openLocalListenSocket() {
+#ifndef _WIN32
+    SOCKET listener = INVALID_SOCKET;
+#ifdef __linux__
+    if (hotRestart) {
+        listener = hotRestart->takeUnixListener(config.unixSocketPath);    // 热重启时沿用旧进程的监听
+    }
+    if (listener != INVALID_SOCKET && config.ioMode == IO_MODE_THREAD) {
+        fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) & ~O_NONBLOCK);
+    }
+#endif
+    if (config.unixSocketPath.empty()) {
+        return true;
+    }
+    if (listener == INVALID_SOCKET) {
+        listener = openUnixListener(config.unixSocketPath);
+    }
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+    localListenSocket = listener;
+    listenSockets.push_back(listener);
+#endif
+    return true;
+}
+
+// 热重启接管 - 连接移交路径上运行中的旧进程并接收其监听套接字，端口与配置不同的TCP监听不再使用
+// 旧进程在送出描述符前已保存用户数据，接管后重新加载
+bool TCPUserSystemServer::inheritListenSockets() {
+#ifdef __linux__
+    if (config.handoffSocketPath.empty()) {
+        return false;
+    }
+    hotRestart = new HotRestart(this, config.handoffSocketPath);
+    unsigned long long waitMs = (static_cast<unsigned long long>(config.shutdownTimeout) + 30ULL) * 1000ULL;
+    if (!hotRestart->inherit(config.ioMode != IO_MODE_THREAD, waitMs)) {
+        return false;
+    }
+
+    {
+        SimpleLockGuard lock(usersMutex);
+        users.clear();
+        loadFromFile();
+        std::stringstream userCount;
+        userCount << users.size() + (mappedUsers ? mappedUsers->getRecordCount() : 0);
+        logger->logInfo("已重新加载旧进程保存的用户数据，当前用户数量: " + userCount.str());
+    }
+
+    std::vector<SOCKET> inherited;
+    hotRestart->takeTcpListeners(inherited);
+    for (size_t i = 0; i < inherited.size(); ++i) {
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        if (getsockname(inherited[i], (sockaddr*)&address, &length) != 0 || address.sin_family != AF_INET ||
+            ntohs(address.sin_port) != port) {
+            closesocket(inherited[i]);
+            continue;
+        }
+        // 非阻塞标志属于与旧进程共用的打开文件，thread模型的接受线程需要阻塞accept
+        if (config.ioMode == IO_MODE_THREAD) {
+            fcntl(inherited[i], F_SETFL, fcntl(inherited[i], F_GETFL, 0) & ~O_NONBLOCK);
+        }
+        listenSockets.push_back(inherited[i]);
+    }
+    if (listenSockets.empty()) {
+        if (!inherited.empty()) {
+            logger->logWarning("旧进程的监听端口与配置不同，改为重新监听");
+        }
+        return false;
+    }
+    std::stringstream ss;
+    ss << "接管旧进程的TCP监听套接字: " << listenSockets.size();
+    logger->logInfo(ss.str());
+    return true;
+#else
+    return false;
+#endif
+}
+
+// TCP监听套接字个数 - Unix域监听套接字位于listenSockets末尾
+size_t TCPUserSystemServer::tcpListenerCount() const {
+    return listenSockets.size() - (localListenSocket != INVALID_SOCKET ? 1 : 0);
+}
+
+// 绑定并监听Unix域套接字 - 本地监听、共享内存握手与热重启移交共用
+SOCKET TCPUserSystemServer::openUnixListener(const std::string& path, int type) {
+#ifndef _WIN32
+    sockaddr_un localAddr;
+    memset(&localAddr, 0, sizeof(localAddr));
+    localAddr.sun_family = AF_UNIX;
+    strncpy(localAddr.sun_path, path.c_str(), sizeof(localAddr.sun_path) - 1);
+
+#ifdef __linux__
+    SOCKET listener = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+#else
+    SOCKET listener = socket(AF_UNIX, type, 0);
+#endif
+    if (listener == INVALID_SOCKET) {
+        logger->logError("创建Unix域套接字失败");
+        return INVALID_SOCKET;
+    }
+
+    // 上次运行遗留的套接字文件会使bind失败 - 无人监听时才删除，不抢占正在运行的服务器
+    struct stat info;
+    if (lstat(localAddr.sun_path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        if (connect(listener, (sockaddr*)&localAddr, sizeof(localAddr)) == 0) {
+            logger->logError("Unix域套接字已被其他进程监听: " + path);
+            closesocket(listener);
+            return INVALID_SOCKET;
+        }
+        unlink(localAddr.sun_path);
+        closesocket(listener);
+#ifdef __linux__
+        listener = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+#else
+        listener = socket(AF_UNIX, type, 0);
+#endif
+        if (listener == INVALID_SOCKET) {
+            logger->logError("创建Unix域套接字失败");
+            return INVALID_SOCKET;
+        }
+    }
+
+    if (bind(listener, (sockaddr*)&localAddr, sizeof(localAddr)) == SOCKET_ERROR) {
+        logger->logError("绑定Unix域套接字失败: " + path);
+        closesocket(listener);
+        return INVALID_SOCKET;
+    }
+    if (listen(listener, config.listenBacklog) == SOCKET_ERROR) {
+        logger->logError("Unix域套接字监听失败: " + path);
+        closesocket(listener);
+        unlink(localAddr.sun_path);
+        return INVALID_SOCKET;
+    }
+    return listener;
+#else
+    (void)path;
+    return INVALID_SOCKET;
+#endif
+}
+
+// 关闭全部监听套接字，Unix域监听套接字的文件一并删除(已移交给新进程时保留)
+void TCPUserSystemServer::closeListenSockets(bool removeFiles) {
+    for (size_t i = 0; i < listenSockets.size(); ++i) {
+        closesocket(listenSockets[i]);
+    }
+    listenSockets.clear();
+#ifndef _WIN32
+    if (localListenSocket != INVALID_SOCKET) {
+        if (removeFiles) {
+            unlink(config.unixSocketPath.c_str());
+        }
+        localListenSocket = INVALID_SOCKET;
+    }
+#endif
+}
+
+// 日志用的对端描述 - Unix域连接的对端通常未绑定地址，记录监听路径
+std::string TCPUserSystemServer::describeClientAddress(const sockaddr_storage& address) const {
+    std::stringstream info;
+    if (address.ss_family == AF_INET) {
+        const sockaddr_in* inet = reinterpret_cast<const sockaddr_in*>(&address);
+        info << inet_ntoa(inet->sin_addr) << ":" << ntohs(inet->sin_port);
+    } else {
+        info << "unix:" << config.unixSocketPath;
+    }
+    return info.str();
+}
+
+// 接受一个连接 - Linux下用accept4一次性设置非阻塞与CLOEXEC，省去额外的fcntl调用
+SOCKET TCPUserSystemServer::acceptClient(SOCKET listener, bool nonBlocking) {
+    sockaddr_storage clientAddr;
+    socklen_t clientAddrLen = sizeof(clientAddr);
+
+#ifdef __linux__
+    int flags = SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0);
+    SOCKET clientSocket = accept4(listener, (sockaddr*)&clientAddr, &clientAddrLen, flags);
+#else
+    SOCKET clientSocket = accept(listener, (sockaddr*)&clientAddr, &clientAddrLen);
+    if (clientSocket != INVALID_SOCKET && nonBlocking) {
+#ifdef _WIN32
+        u_long mode = 1;
+        ioctlsocket(clientSocket, FIONBIO, &mode);
+#else
+        fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(clientSocket, F_SETFD, FD_CLOEXEC);
+#endif
+    }
+#endif
+    if (clientSocket == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    noteAcceptSuccess();
+    if (listener != localListenSocket) {
+        configureClientSocket(clientSocket);
+    }
+
+    logger->logInfo("新客户端连接: " + describeClientAddress(clientAddr));
+    return clientSocket;
+}
+
+// 接受失败 - 描述符耗尽(EMFILE/ENFILE)时等待中的连接留在监听队列里，每次接受都会立即再失败；
+// 释放预留描述符接受并关闭一个等待中的连接，客户端得到连接关闭而不是一直等待，再重新预留。
+// 连续失败只记录第一次，避免每次重试都写日志
+bool TCPUserSystemServer::handleAcceptFailure(SOCKET listener, int error) {
+#ifdef _WIN32
+    if (error == WSAEWOULDBLOCK || error == WSAEINTR || error == WSAECONNRESET) {
+        return false;
+    }
+#else
+    if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR || error == ECONNABORTED) {
+        return false;
+    }
+#endif
+    if (!running.load()) {
+        return false;
+    }
+    if (acceptFailures.increment() == 1) {
+        std::stringstream ss;
+#ifdef _WIN32
+        ss << "接受客户端连接失败: 错误码 " << error << "，恢复前不再重复记录";
+#else
+        ss << "接受客户端连接失败: " << strerror(error) << "，恢复前不再重复记录";
+#endif
+        logger->logWarning(ss.str());
+    }
+
+#ifdef __linux__
+    if (error == EMFILE || error == ENFILE) {
+        SimpleLockGuard lock(spareFdMutex);
+        if (spareFd >= 0) {
+            close(spareFd);
+            spareFd = -1;
+            struct pollfd pending;
+            pending.fd = listener;
+            pending.events = POLLIN;
+            pending.revents = 0;
+            if (poll(&pending, 1, 0) > 0) {     // 线程模型的监听套接字是阻塞的，没有等待中的连接时不能accept
+                SOCKET dropped = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+                if (dropped != INVALID_SOCKET) {
+                    closesocket(dropped);
+                }
+            }
+            spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+    }
+#endif
+    return true;
+}
+
+void TCPUserSystemServer::noteAcceptSuccess() {
+    if (acceptFailures.load() == 0) {
+        return;
+    }
+    long long failures = acceptFailures.load();
+    acceptFailures.store(0);
+    std::stringstream ss;
+    ss << "接受客户端连接已恢复，此前连续失败 " << failures << " 次";
+    logger->logInfo(ss.str());
+}
+
+// 新连接套接字选项 - 响应已按读批次合并，禁用Nagle避免最后一段等待ACK
+void TCPUserSystemServer::configureClientSocket(SOCKET clientSocket) {
+    if (config.tcpNoDelay) {
+        int opt = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&opt, sizeof(opt));
+    }
+}
+
+// 持续性接受错误后的退避时间(毫秒)
+static const int ACCEPT_RETRY_DELAY_MS = 10;
+
+// 接受循环 - 为每个客户端创建独立处理线程
+void TCPUserSystemServer::acceptLoop(SOCKET listener) {
+    while (running.load()) {
+#ifdef __linux__
+        // 监听套接字要移交给新进程时不能shutdown，改为同时等待唤醒eventfd
+        if (acceptWakeFd >= 0) {
+            struct pollfd fds[2];
+            fds[0].fd = listener;
+            fds[0].events = POLLIN;
+            fds[1].fd = acceptWakeFd;
+            fds[1].events = POLLIN;
+            fds[0].revents = fds[1].revents = 0;
+            if (poll(fds, 2, -1) <= 0 || (fds[1].revents & POLLIN) || !(fds[0].revents & POLLIN)) {
+                continue;
+            }
+        }
+#endif
+        SOCKET clientSocket = acceptClient(listener, false);
+        if (clientSocket == INVALID_SOCKET) {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+#else
+            int error = errno;
+#endif
+            // 持续性错误(如描述符耗尽)立即重试只会空转，稍等再接受
+            if (handleAcceptFailure(listener, error)) {
+#ifdef _WIN32
+                Sleep(ACCEPT_RETRY_DELAY_MS);
+#else
+                usleep(ACCEPT_RETRY_DELAY_MS * 1000);
+#endif
+            }
+            continue;
+        }
+
+        // 交给工作线程池，队列满时按溢出策略等待或拒绝
+        if (admitConnection(clientSocket)) {
+            workerPool->submit(clientSocket);
+        }
+    }
+}
+
+// 接受线程入口点
+#ifdef _WIN32
+DWORD WINAPI TCPUserSystemServer::acceptThreadProc(LPVOID param) {
+#else
+void* TCPUserSystemServer::acceptThreadProc(void* param) {
+#endif
+    AcceptParam* p = static_cast<AcceptParam*>(param);
+    p->server->bindCurrentThread(THREAD_ROLE_ACCEPT, p->index);
+    p->server->acceptLoop(p->listener);
+    delete p;
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+// 事件循环线程数 - 默认与CPU核数一致
+int TCPUserSystemServer::resolveLoopCount() const {
+    int loopCount = config.ioThreads;
+#ifndef _WIN32
+    if (loopCount <= 0) {
+        loopCount = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+#endif
+    return loopCount > 0 ? loopCount : 1;
+}
+
+// 启动epoll事件循环线程
+bool TCPUserSystemServer::startEventLoops() {
+#ifdef __linux__
+    int loopCount = static_cast<int>(tcpListenerCount());
+    for (int i = 0; i < loopCount; ++i) {
+        eventLoops.push_back(new EventLoop(this, i, listenSockets[i], localListenSocket));
+    }
+
+    // 分片模式 - 每个循环一个分片，已加载的用户按ID分配到各分片，运行期间users不再使用
+    if (config.shardPerCore) {
+        for (int i = 0; i < loopCount; ++i) {
+            userShards.push_back(new UserShard(this, i, &userShards, eventLoops[i]));
+            userShards[i]->setMappedPending(mappedUsers != 0);
+            eventLoops[i]->setShard(userShards[i]);
+        }
+        SimpleLockGuard lock(usersMutex);
+        for (std::map<std::string, User>::iterator it = users.begin(); it != users.end(); ++it) {
+            userShards[UserShard::shardOf(it->first, userShards.size())]->getUsers()[it->first] = it->second;
+        }
+        users.clear();
+    }
+
+    // 热重启接管的会话轮流分配给各循环，由循环线程启动后注册
+    std::vector<HandoffSession> handoff;
+    if (hotRestart) {
+        hotRestart->takeSessions(handoff);
+    }
+    for (size_t i = 0; i < handoff.size(); ++i) {
+        EventLoop* loop = eventLoops[i % eventLoops.size()];
+        loop->adoptSession(adoptSession(handoff[i], true, loop));
+    }
+
+    for (int i = 0; i < loopCount; ++i) {
+        if (!eventLoops[i]->start()) {
+            stopEventLoops();       // 未启动的循环关闭已分配给它的会话
+            return false;
+        }
+    }
+
+    std::stringstream ss;
+    ss << loopCount;
+    if (!userShards.empty()) {
+        ss << "，每核一分片";
+    }
+    logger->logInfo("epoll事件循环线程数: " + ss.str());
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 启动io_uring事件循环线程 - 每个循环在自己的监听套接字上提交多次触发accept
+bool TCPUserSystemServer::startUringLoops() {
+#ifdef __linux__
+    int loopCount = static_cast<int>(tcpListenerCount());
+    for (int i = 0; i < loopCount; ++i) {
+        UringLoop* loop = new UringLoop(this, i, listenSockets[i], localListenSocket);
+        uringLoops.push_back(loop);
+        if (!loop->initialize()) {
+            stopEventLoops();       // 回退到epoll，热重启接管的会话尚未取出
+            return false;
+        }
+    }
+
+    std::vector<HandoffSession> handoff;
+    if (hotRestart) {
+        hotRestart->takeSessions(handoff);
+    }
+    for (size_t i = 0; i < handoff.size(); ++i) {
+        UringLoop* loop = uringLoops[i % uringLoops.size()];
+        loop->adoptSession(adoptSession(handoff[i], false, loop));
+    }
+
+    for (int i = 0; i < loopCount; ++i) {
+        if (!uringLoops[i]->start()) {
+            stopEventLoops();
+            return false;
+        }
+    }
+
+    std::stringstream ss;
+    ss << loopCount;
+    logger->logInfo("io_uring事件循环线程数: " + ss.str());
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 停止事件循环 - 各循环线程退出前关闭自身管理的连接
+// 分片模式下循环线程之间互相投递消息，全部循环停止后才释放循环与分片；分片的用户合并回users
+void TCPUserSystemServer::stopEventLoops() {
+#ifdef __linux__
+    for (size_t i = 0; i < eventLoops.size(); ++i) {
+        eventLoops[i]->stop();
+    }
+    for (size_t i = 0; i < eventLoops.size(); ++i) {
+        delete eventLoops[i];
+    }
+    for (size_t i = 0; i < uringLoops.size(); ++i) {
+        uringLoops[i]->stop();
+        delete uringLoops[i];
+    }
+    if (!userShards.empty()) {
+        std::vector<UserShard*> shards;
+        shards.swap(userShards);    // 之后saveToFile直接读取users
+        SimpleLockGuard lock(usersMutex);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (logger) {
+                logger->logInfo("分片统计: " + shards[i]->describeStats());
+            }
+            users.insert(shards[i]->getUsers().begin(), shards[i]->getUsers().end());
+            delete shards[i];
+        }
+    }
+#endif
+    eventLoops.clear();
+    uringLoops.clear();
+}
+
+// 用户登录 - 验证用户凭据并更新会话状态，支持挤占下线
+std::string TCPUserSystemServer::loginUser(SimpleSharedPtr<ClientSession> session, const SimpleStringView& userId, const SimpleStringView& password) {
+    SimpleLockGuard lock(usersMutex);
+    
+    if (session->isLoggedIn()) {
+        return "ERROR|当前会话已有用户登录";
+    }
+
+    std::map<std::string, User>::iterator it = findUser(userId.str());
+    if (it == users.end()) {
+        return "ERROR|用户不存在";
+    }
+
+    if (!it->second.verifyPassword(password)) {
+        return "ERROR|密码错误";
+    }
+
+    // 检查用户是否已在其他会话中登录 - 之后使用表中的键，不再复制请求参数
+    std::string existingSessionId = findUserSession(it->first);
+    if (!existingSessionId.empty()) {
+        // 用户已在其他会话中登录，询问是否挤占下线
+        return "CONFLICT|用户已在其他客户端登录|" + existingSessionId + "|是否挤占下线？(Y/N)";
+    }
+
+    session->setLoggedInUser(it->first);
+    return "SUCCESS|登录成功";
+}
+
+// 处理挤占登录请求 - 用户锁内只完成登录状态的转移，挤占通知在释放锁后交给原会话的I/O上下文送出
+std::string TCPUserSystemServer::handleLoginConflict(SimpleSharedPtr<ClientSession> session, 
+                                                     const SimpleStringView& userId, 
+                                                     const SimpleStringView& password,
+                                                     bool forceLogin) {
+    SimpleSharedPtr<ClientSession> existingSession;
+    std::string user;
+    {
+        SimpleLockGuard lock(usersMutex);
+
+        if (session->isLoggedIn()) {
+            return "ERROR|当前会话已有用户登录";
+        }
+
+        std::map<std::string, User>::iterator it = findUser(userId.str());
+        if (it == users.end()) {
+            return "ERROR|用户不存在";
+        }
+
+        if (!it->second.verifyPassword(password)) {
+            return "ERROR|密码错误";
+        }
+
+        std::string existingSessionId = findUserSession(it->first);
+        if (!existingSessionId.empty()) {
+            if (!forceLogin) {
+                return "ERROR|登录已取消";
+            }
+
+            // 强制下线已存在的会话
+            {
+                SimpleLockGuard sessionLock(sessionsMutex);
+                std::map<std::string, SimpleSharedPtr<ClientSession>>::iterator sessionIt = sessions.find(existingSessionId);
+                if (sessionIt != sessions.end()) {
+                    existingSession = sessionIt->second;
+                }
             }
+
+            if (existingSession) {
+                // 先标记再通知 - 原会话不再处理请求，其I/O上下文送出通知后关闭连接
+                existingSession->setLoggedInUser("");  // 清除登录状态
+                existingSession->setInactive();        // 标记会话为非活跃状态
+            }
+        }
+
+        session->setLoggedInUser(it->first);
+        user = it->first;
+    }
+
+    if (existingSession) {
+        notifyAndClose(existingSession, "KICKED|您的账号在其他地方登录，连接已断开");
+        std::cout << "[服务器] 用户 " << user << " 被新会话挤占下线，原会话ID: " 
+                  << existingSession->getSessionId().substr(0, 8) << std::endl;
+    }
+    return "SUCCESS|登录成功，已挤占原会话";
+}
+
+// 查找用户当前登录的会话ID
+std::string TCPUserSystemServer::findUserSession(const std::string& userId) {
+    SimpleLockGuard sessionLock(sessionsMutex);
+    
+    for (std::map<std::string, SimpleSharedPtr<ClientSession>>::iterator it = sessions.begin(); 
+         it != sessions.end(); ++it) {
+        if (it->second->isLoggedIn() && it->second->getLoggedInUser() == userId) {
+            return it->first;  // 返回会话ID
+        }
+    }
+    return "";  // 未找到
+}
+
+// 是否为本用户进程经Unix域套接字接入 - 套接字文件按umask创建，其他用户也可能连接，
+// 与热重启握手一样按SO_PEERCRED核对对端进程的用户，只有与服务器同一用户的进程视为本地管理连接
+static bool isSameUserLocalSocket(SOCKET socket) {
+#ifdef __linux__
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(socket, reinterpret_cast<sockaddr*>(&address), &length) != 0 || address.ss_family != AF_UNIX) {
+        return false;
+    }
+    struct ucred credentials;
+    length = sizeof(credentials);
+    return getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == getuid();
+#else
+    (void)socket;
+    return false;
+#endif
+}
+
+// 创建会话 - 注册到会话表并发送欢迎消息
+SimpleSharedPtr<ClientSession> TCPUserSystemServer::openSession(SOCKET clientSocket, bool nonBlocking,
+                                                                SessionDriver* driver) {
+    // 创建唯一会话
+    std::string sessionId = generateSessionId();
+    SimpleSharedPtr<ClientSession> session(new ClientSession(clientSocket, sessionId, nonBlocking, driver));
+    if (isSameUserLocalSocket(clientSocket)) {
+        session->setLocalConnection();
+    }
+    
+    logger->logInfo("创建新会话: " + sessionId);
+    
+    // 注册会话 - 线程安全操作；分片模式下会话只登记在所属循环的连接表中
+    if (config.shardPerCore) {
+        connectionCount.increment();
+    } else {
+        SimpleLockGuard lock(sessionsMutex);
+        sessions[sessionId] = session;
+        connectionCount.increment();
+    }
+
+    // 发送欢迎消息
+    sendToSession(session, "WELCOME|TCP用户系统服务器|" + sessionId);
+    return session;
+}
+
+// 处理接收缓冲 - 取出全部完整帧并解析，各I/O模型共用
+// 启用命令执行线程时消息交给调度器按序执行，分片模式交给会话所属分片，否则在当前线程内直接处理
+bool TCPUserSystemServer::processSessionInput(SimpleSharedPtr<ClientSession> session) {
+    InputRingBuffer& input = session->getInputBuffer();
+    UserShard* shard = session->getDriver() ? session->getDriver()->getShard() : 0;
+    const char* frame;
+    size_t frameLength;
+    std::vector<ProtocolMessage> commands;
+    bool frameError = false;
+
+    // 本批请求的响应合并后一次写出
+    if (!scheduler) {
+        corkSession(session);
+    }
+
+    // 会话被挤占或退出后不再处理剩余消息；停止期间已收到的帧照常处理，排空阶段送出其响应
+    while (session->getIsActive()) {
+        ProtocolMessage msg;
+        if (session->isInputBinary()) {
+            int result = input.nextBinaryFrame(frame, frameLength, MAX_FRAME_LENGTH);
+            if (result == 0) {
+                break;
+            }
+            if (result < 0 || !ProtocolMessage::decodeBinary(frame, frameLength, msg)) {
+                frameError = true;  // 帧过长或格式错误，二进制流无法再同步
+                break;
+            }
+        } else {
+            if (!input.nextFrame(frame, frameLength)) {
+                break;
+            }
+            ProtocolMessage::parse(frame, frameLength, msg);
+            // 协议切换在分帧时立即生效，其后的数据按二进制帧解析
+            if (msg.command == "PROTOCOL" && msg.parameterCount > 0 && msg.parameters[0] == "BINARY") {
+                session->setInputBinary();
+            }
+        }
+
+        // 超过准入上限的请求不再执行，只占一个位置以便按序回复ERROR|BUSY
+        if (!admitRequest(msg)) {
+            if (scheduler) {
+                commands.push_back(ProtocolMessage());
+                commands.back().shed = true;
+            } else if (shard) {
+                ProtocolMessage marker;
+                marker.shed = true;
+                submitToShard(shard, session, marker);
+            } else {
+                sendToSession(session, BUSY_RESPONSE);
+            }
+            continue;
+        }
+
+        // 交给执行线程的消息在接收缓冲被下次recv覆盖后才执行，先复制帧
+        if (scheduler) {
+            msg.retain();
+            commands.push_back(ProtocolMessage());
+            commands.back().swap(msg);
+        } else if (shard) {
+            submitToShard(shard, session, msg);     // 执行完(或会话结束)时由分片释放在途计数
+        } else {
+            processClientMessage(session, msg);
+            finishRequest(msg);
+        }
+    }
+
+    if (scheduler) {
+        scheduler->submit(session, commands);
+    } else {
+        uncorkSession(session);
+    }
+
+    // 防止消息过长攻击 - 不完整的帧超过上限时断开
+    if (frameError || input.size() > MAX_FRAME_LENGTH) {
+        return false;
+    }
+    return session->getIsActive();
+}
+
+// 交给会话所属分片按序执行 - 分片只在Linux epoll模式下存在
+void TCPUserSystemServer::submitToShard(UserShard* shard, SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg) {
+#ifdef __linux__
+    shard->submit(session, msg);
+#else
+    (void)shard;
+    processClientMessage(session, msg);
+    finishRequest(msg);
+#endif
+}
+
+// 推迟关闭 - 会话仍有命令在调度器中时由执行线程在执行完后通过驱动关闭，返回true表示已推迟
+bool TCPUserSystemServer::deferSessionClose(SimpleSharedPtr<ClientSession> session) {
+    if (deferCloseUntilCommit(session)) {
+        return true;
+    }
+    if (config.shardPerCore) {
+        // 分片模式只由所属循环线程调用: 有请求在其他分片执行时，结果返回并执行完排队的请求后关闭
+        if (!session->isCommandScheduled()) {
+            return false;
+        }
+        session->setCloseDeferred();
+        return true;
+    }
+    if (!scheduler) {
+        return false;
+    }
+    SimpleLockGuard lock(session->getCommandMutex());
+    if (!session->isCommandScheduled()) {
+        return false;
+    }
+    session->setCloseDeferred();
+    return true;
+}
+
+// 等待提交后关闭 - 事件循环会话有暂存的响应时，由提交线程放行后经requestClose关闭，返回true表示已推迟
+bool TCPUserSystemServer::deferCloseUntilCommit(SimpleSharedPtr<ClientSession> session) {
+    if (!session->getDriver()) {
+        return false;   // 阻塞会话在写出前自行等待提交
+    }
+    SimpleLockGuard lock(session->getOutputMutex());
+    if (session->getCommitSeq() == 0 || session->getSocket() == INVALID_SOCKET) {
+        return false;
+    }
+    session->setCloseAfterCommit();
+    return true;
+}
+
+// 结束会话 - 记录登出、注销会话并关闭套接字
+void TCPUserSystemServer::closeSession(SimpleSharedPtr<ClientSession> session) {
+    std::string sessionId = session->getSessionId();
+
+    // 会话结束时的清理工作
+    std::string loggedInUser = session->getLoggedInUser();
+    if (!loggedInUser.empty()) {
+        logger->logUserOperation(sessionId, loggedInUser, "SESSION_END", "自动登出");
+    }
+
+    // 清理会话 - 分片模式下由所属分片释放排队的请求并清除登录表
+#ifdef __linux__
+    UserShard* shard = session->getDriver() ? session->getDriver()->getShard() : 0;
+    if (shard) {
+        shard->sessionClosed(*session);
+        connectionCount.decrement();
+    } else
+#endif
+    {
+        SimpleLockGuard lock(sessionsMutex);
+        if (sessions.erase(sessionId) > 0) {
+            connectionCount.decrement();
+        }
+    }
+
+    // 在发送锁内关闭套接字，避免其他线程向已被复用的描述符写入
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        closesocket(session->getSocket());
+        session->invalidateSocket();
+    }
+    session->setInactive();
+    logger->logInfo("客户端会话结束: " + sessionId);
+}
+
+// 连接准入 - 会话数达到上限时立即回复并关闭，不创建会话；上限为近似值(并发接受时可能略微超出)
+bool TCPUserSystemServer::admitConnection(SOCKET clientSocket, bool reply) {
+    if (config.maxConnections <= 0 || connectionCount.load() < config.maxConnections) {
+        return true;
+    }
+    rejectedConnections.increment();
+    if (reply) {
+        sendMessage(clientSocket, BUSY_RESPONSE);   // 新连接的发送缓冲为空，不会阻塞
+    }
+    closesocket(clientSocket);
+    return false;
+}
+
+// 请求准入 - 先计入再检查，超过任一上限时撤销；协议切换与退出不受限制(切换已在分帧时生效)
+bool TCPUserSystemServer::admitRequest(const ProtocolMessage& msg) {
+    long long inflight = inflightRequests.increment();
+    long long queued = queuedRequestBytes.add(static_cast<long long>(msg.frameSize()));
+    bool overLimit = (config.maxInflight > 0 && inflight > config.maxInflight) ||
+                     (config.maxQueuedKb > 0 && queued > static_cast<long long>(config.maxQueuedKb) * 1024);
+    if (!overLimit || msg.command == "PROTOCOL" || msg.command == "QUIT") {
+        return true;
+    }
+    finishRequest(msg);
+    shedRequests.increment();
+    return false;
+}
+
+// 请求执行完或被丢弃 - 被拒绝的请求未计入，不释放
+void TCPUserSystemServer::finishRequest(const ProtocolMessage& msg) {
+    if (msg.shed) {
+        return;
+    }
+    releaseRequest(msg.frameSize());
+}
+
+void TCPUserSystemServer::releaseRequest(size_t frameBytes) {
+    inflightRequests.decrement();
+    queuedRequestBytes.add(-static_cast<long long>(frameBytes));
+}
+
+std::string TCPUserSystemServer::describeAdmissionStats() {
+    std::stringstream ss;
+    ss << "connections=" << connectionCount.load() << ";max_connections=" << config.maxConnections
+       << ";rejected_connections=" << rejectedConnections.load()
+       << ";inflight=" << inflightRequests.load() << ";max_inflight=" << config.maxInflight
+       << ";queued_bytes=" << queuedRequestBytes.load() << ";max_queued_bytes=" << static_cast<long long>(config.maxQueuedKb) * 1024
+       << ";shed_requests=" << shedRequests.load()
+       << ";output_overflows=" << outputOverflows.load();
+    if (workerPool) {
+        WorkerPoolStats stats = workerPool->getStats();
+        ss << ";pool_rejected=" << stats.rejected << ";pool_shed=" << stats.shed;
+    }
+    return ss.str();
+}
+
+// 会话是否仍有命令在调度器中(或有等待提交的响应) - 与deferSessionClose不同，只查询不推迟关闭
+bool TCPUserSystemServer::hasPendingCommands(SimpleSharedPtr<ClientSession> session) {
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        if (session->getCommitSeq() != 0) {
+            return true;
+        }
+    }
+    if (config.shardPerCore) {
+        return session->isCommandScheduled();   // 有请求在其他分片执行
+    }
+    if (!scheduler) {
+        return false;
+    }
+    SimpleLockGuard lock(session->getCommandMutex());
+    return session->isCommandScheduled();
+}
+
+// 是否正在向接管会话的新进程移交
+bool TCPUserSystemServer::isExportingSessions() const {
+#ifdef __linux__
+    return hotRestart && hotRestart->isHandingOff() && hotRestart->successorAcceptsSessions();
+#else
+    return false;
+#endif
+}
+
+// 移交会话 - 由所属事件循环在会话没有命令执行、没有在途I/O时调用；
+// 套接字与未处理的请求、未送出的响应交给移交通道，会话在本进程中注销但不关闭套接字
+bool TCPUserSystemServer::exportSession(SimpleSharedPtr<ClientSession> session) {
+#ifdef __linux__
+    if (!isExportingSessions() || !session->getIsActive() || session->isCloseDeferred()) {
+        return false;   // 已退出或被挤占的会话照常送出最后的响应后关闭
+    }
+    HandoffSession record;
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        std::string& output = session->getOutputBuffer();
+        if (session->getSocket() == INVALID_SOCKET ||
+            output.length() + session->getInputBuffer().size() > HotRestart::MAX_SESSION_BYTES) {
+            return false;
+        }
+        record.socket = session->getSocket();
+        record.pendingOutput.swap(output);
+        record.outputBinary = session->isOutputBinary();
+        session->invalidateSocket();    // 之后其他线程的发送直接丢弃
+    }
+    record.sessionId = session->getSessionId();
+    record.loggedInUser = session->getLoggedInUser();
+    record.inputBinary = session->isInputBinary();
+    session->getInputBuffer().takeAll(record.pendingInput);
+    hotRestart->addSession(record);
+
+    if (config.shardPerCore) {
+        connectionCount.decrement();
+    } else {
+        SimpleLockGuard lock(sessionsMutex);
+        if (sessions.erase(record.sessionId) > 0) {
+            connectionCount.decrement();
+        }
+    }
+    session->setInactive();
+    logger->logInfo("会话移交新进程: " + record.sessionId +
+                    (record.loggedInUser.empty() ? "" : "，用户 " + record.loggedInUser));
+    return true;
+#else
+    (void)session;
+    return false;
+#endif
+}
+
+#ifdef __linux__
+// 接管会话 - 保留旧进程的会话ID(与已有会话重复时重新生成)与登录状态，不再发送欢迎消息；
+// 未处理的请求与未送出的响应原样恢复，由所属事件循环启动后继续处理
+SimpleSharedPtr<ClientSession> TCPUserSystemServer::adoptSession(const HandoffSession& record, bool nonBlocking,
+                                                                 SessionDriver* driver) {
+    std::string sessionId = record.sessionId;
+    SimpleSharedPtr<ClientSession> session;
+    {
+        SimpleLockGuard lock(sessionsMutex);
+        if (sessionId.empty() || sessions.find(sessionId) != sessions.end()) {
+            sessionId = generateSessionId();
+        }
+        // 会话序号越过接管的会话ID，之后新生成的ID不会与其重复
+        if (sessionId.length() > 8) {
+            long long sequence = static_cast<long long>(strtoul(sessionId.substr(sessionId.length() - 8).c_str(), 0, 16));
+            if (sequence > sessionCounter.load()) {
+                sessionCounter.store(sequence);
+            }
+        }
+        session =SimpleSharedPtr<ClientSession>(new ClientSession(record.socket, sessionId, nonBlocking, driver));
+        if (isSameUserLocalSocket(record.socket)) {
+            session->setLocalConnection();
+        }
+        if (!config.shardPerCore) {
+            sessions[sessionId] = session;
+        }
+        connectionCount.increment();
+    }
+
+    // 用户在重启期间不会被删除(旧进程停止服务后才保存数据)，仍按当前数据确认；
+    // 分片模式下用户已分配到各分片(循环线程尚未启动)，同时登记到用户所在分片的登录表
+    if (!record.loggedInUser.empty()) {
+        UserShard* home = driver ? driver->getShard() : 0;
+        if (home) {
+            UserShard* shard = userShards[UserShard::shardOf(record.loggedInUser, userShards.size())];
+            if (shard->findUser(record.loggedInUser) != shard->getUsers().end()) {
+                session->setLoggedInUser(record.loggedInUser);
+                shard->adoptLogin(record.loggedInUser, home->getIndex(), record.socket, sessionId);
+            }
+        } else {
+            SimpleLockGuard lock(usersMutex);
+            if (findUser(record.loggedInUser) != users.end()) {
+                session->setLoggedInUser(record.loggedInUser);
+            }
+        }
+    }
+    if (record.inputBinary) {
+        session->setInputBinary();
+    }
+    if (record.outputBinary) {
+        session->setOutputBinary();
+    }
+    session->getInputBuffer().append(record.pendingInput.data(), record.pendingInput.length());
+    session->getOutputBuffer() = record.pendingOutput;
+
+    logger->logInfo("接管旧进程会话: " + sessionId +
+                    (session->isLoggedIn() ? "，用户 " + session->getLoggedInUser() : ""));
+    return session;
+}
+#endif
+
+// 设置阻塞接收的超时(毫秒)，0表示不限
+static void setReceiveTimeout(SOCKET socket, unsigned long long timeoutMs) {
+#ifdef _WIN32
+    DWORD timeout = static_cast<DWORD>(timeoutMs);
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+#else
+    struct timeval timeout;
+    timeout.tv_sec = static_cast<time_t>(timeoutMs / 1000);
+    timeout.tv_usec = static_cast<suseconds_t>((timeoutMs % 1000) * 1000);
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+// 阻塞接收是否因SO_RCVTIMEO超时返回
+static bool isReceiveTimeout() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAETIMEDOUT;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// 单个客户端连接处理 - 管理客户端会话生命周期
+// 接收超时按最近的超时期限设置，收到数据时不重设；超时唤醒后重新判定，未到期则按剩余时间重设
+void TCPUserSystemServer::handleClient(SOCKET clientSocket) {
+    SimpleSharedPtr<ClientSession> session = openSession(clientSocket, false);
+
+    unsigned long long deadline;
+    unsigned long long now = TimerWheel::nowMs();
+    checkSessionTimeout(*session, now, deadline);
+    unsigned long long armedMs = deadline > now ? deadline - now : 0;
+    if (armedMs > 0) {
+        setReceiveTimeout(clientSocket, armedMs);
+    }
+
+    // 消息处理循环 - 一次接收可能包含多条流水线请求，全部处理后再接收
+    while (running.load() && session->getIsActive()) {
+        int received = receiveInput(*session);
+        now = TimerWheel::nowMs();
+        if (received > 0) {
+            session->touch(now);
+            if (!processSessionInput(session)) {
+                break;
+            }
+            // 持续发送请求的连接不会触发接收超时，登录期限在此检查
+            if (config.loginTimeout > 0 && !session->isLoggedIn()) {
+                SessionTimeout kind = checkSessionTimeout(*session, now, deadline);
+                if (kind != SESSION_TIMEOUT_NONE) {
+                    recordSessionTimeout(session, kind);
+                    break;
+                }
+            }
+            continue;
+        }
+        if (received == 0 || !isReceiveTimeout()) {
+            break;  // 客户端断开连接或连接错误
+        }
+
+        SessionTimeout kind = checkSessionTimeout(*session, now, deadline);
+        if (kind != SESSION_TIMEOUT_NONE) {
+            recordSessionTimeout(session, kind);
+            break;
+        }
+        unsigned long long remaining = deadline > now ? deadline - now : 1;
+        if (remaining != armedMs) {
+            armedMs = remaining;
+            setReceiveTimeout(clientSocket, armedMs);
+        }
+    }
+
+    flushSessionOutput(*session);   // 被挤占时由本线程送出KICKED
+    closeSession(session);
+}
+
+// 会话超时判定 - 空闲超时从最近一次收到数据起算，登录超时从最近一次进入未登录状态起算
+SessionTimeout TCPUserSystemServer::checkSessionTimeout(ClientSession& session, unsigned long long nowMs,
+                                                        unsigned long long& nextDeadlineMs) {
+    nextDeadlineMs = 0;
+    if (config.idleTimeout > 0) {
+        unsigned long long idleDeadline = session.getLastActivity() + static_cast<unsigned long long>(config.idleTimeout) * 1000ULL;
+        if (nowMs >= idleDeadline) {
+            return SESSION_TIMEOUT_IDLE;
+        }
+        nextDeadlineMs = idleDeadline;
+    }
+    if (config.loginTimeout > 0 && !session.isLoggedIn()) {
+        unsigned long long loginDeadline = session.getAnonymousSince() + static_cast<unsigned long long>(config.loginTimeout) * 1000ULL;
+        if (nowMs >= loginDeadline) {
+            return SESSION_TIMEOUT_LOGIN;
+        }
+        if (nextDeadlineMs == 0 || loginDeadline < nextDeadlineMs) {
+            nextDeadlineMs = loginDeadline;
+        }
+    }
+    return SESSION_TIMEOUT_NONE;
+}
+
+// 记录超时关闭
+void TCPUserSystemServer::recordSessionTimeout(SimpleSharedPtr<ClientSession> session, SessionTimeout kind) {
+    if (kind == SESSION_TIMEOUT_LOGIN) {
+        loginTimeouts.increment();
+        logger->logInfo("会话[" + session->getSessionId().substr(0, 8) + "] 登录超时，关闭连接");
+    } else {
+        idleTimeouts.increment();
+        logger->logInfo("会话[" + session->getSessionId().substr(0, 8) + "] 空闲超时，关闭连接");
+    }
+}
+
+// 客户端消息处理 - 解析文本命令后分发
+void TCPUserSystemServer::processClientMessage(SimpleSharedPtr<ClientSession> session, const std::string& message) {
+    ProtocolMessage msg;
+    ProtocolMessage::parse(message.data(), message.length(), msg);
+    processClientMessage(session, msg);
+}
+
+// 命令分发表 - 命令名、最少参数个数、参数不足时的操作名、处理函数
+const TCPUserSystemServer::CommandEntry TCPUserSystemServer::commandTable[] = {
+    { "REGISTER",        2, "注册",         &TCPUserSystemServer::executeRegister },
+    { "LOGIN",           2, "登录",         &TCPUserSystemServer::executeLogin },
+    { "FORCE_LOGIN",     3, "强制登录",     &TCPUserSystemServer::executeForceLogin },
+    { "LOGOUT",          0, "登出",         &TCPUserSystemServer::executeLogout },
+    { "DELETE",          2, "注销账户",     &TCPUserSystemServer::executeDelete },
+    { "CHANGE_PASSWORD", 2, "修改密码",     &TCPUserSystemServer::executeChangePassword },
+    { "SET_STRING",      1, "设置字符串",   &TCPUserSystemServer::executeSetString },
+    { "GET_STRING",      0, "查看字符串",   &TCPUserSystemServer::executeGetString },
+    { "PROTOCOL",        0, "协议切换",     &TCPUserSystemServer::executeProtocol },
+    { "QUIT",            0, "退出",         &TCPUserSystemServer::executeQuit },
+    { "STATS",           0, "运行统计",     &TCPUserSystemServer::executeStats },
+    { "BGSAVE",          0, "后台保存",     &TCPUserSystemServer::executeBgsave },
+};
+
+const size_t TCPUserSystemServer::commandCount = sizeof(commandTable) / sizeof(commandTable[0]);
+
+namespace {
+    // 命令索引 - 按(长度, 首字节)分桶，桶内同键的命令以链表相连(目前每个桶最多一条)
+    // 首次使用时由commandTable生成，之后只读
+    struct CommandIndex {
+        enum { LENGTH_BUCKETS = 16, BYTE_BUCKETS = 32, NONE = 0xFF };
+
+        unsigned char head[LENGTH_BUCKETS][BYTE_BUCKETS];
+        std::vector<unsigned char> next;
+
+        static size_t lengthBucket(size_t length) { return length & (LENGTH_BUCKETS - 1); }
+        static size_t byteBucket(char c) { return static_cast<unsigned char>(c) & (BYTE_BUCKETS - 1); }
+
+        CommandIndex(const TCPUserSystemServer::CommandEntry* table, size_t count) : next(count, NONE) {
+            memset(head, NONE, sizeof(head));
+            // 倒序插入，同桶命令保持表中顺序
+            for (size_t i = count; i-- > 0;) {
+                size_t length = strlen(table[i].name);
+                unsigned char& slot = head[lengthBucket(length)][byteBucket(table[i].name[0])];
+                next[i] = slot;
+                slot = static_cast<unsigned char>(i);
+            }
+        }
+    };
+}
+
+// 按命令名查表 - 先按长度与首字节定位桶，再比较完整命令名
+const TCPUserSystemServer::CommandEntry* TCPUserSystemServer::findCommand(const SimpleStringView& command) {
+    static const CommandIndex index(commandTable, commandCount);
+
+    if (command.empty()) {
+        return 0;
+    }
+    unsigned char i = index.head[CommandIndex::lengthBucket(command.length)][CommandIndex::byteBucket(command.data[0])];
+    while (i != CommandIndex::NONE) {
+        if (command == commandTable[i].name) {
+            return &commandTable[i];
+        }
+        i = index.next[i];
+    }
+    return 0;
+}
+
+// 命令分发 - 查表调用相应业务逻辑，文本与二进制协议共用
+void TCPUserSystemServer::processClientMessage(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    if (msg.shed) {
+        sendToSession(session, BUSY_RESPONSE);
+        return;
+    }
+
+    std::string response;
+    const CommandEntry* entry = findCommand(msg.command);
+
+    if (!entry) {
+        response = "ERROR|未知命令: " + msg.command.str();
+        logger->logWarning("会话[" + session->getSessionId().substr(0, 8) + "] 未知命令: " + msg.command.str());
+    } else if (msg.parameterCount < entry->minParameters) {
+        response = "ERROR|参数不足";
+        logger->logWarning("会话[" + session->getSessionId().substr(0, 8) + "] " + entry->operation + "操作参数不足");
+    } else {
+        response = (this->*(entry->handler))(session, msg);
+        if (!holdForCommit(session, takeCommitSeq())) {
+            response = PERSIST_FAILED_RESPONSE;
+        }
+    }
+
+    if (!response.empty()) {
+        sendToSession(session, response);
+    }
+}
+
+std::string TCPUserSystemServer::executeRegister(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    std::string response = registerUser(msg.parameters[0], msg.parameters[1]);
+    std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
+    logger->logUserOperation(session->getSessionId(), msg.parameters[0].str(), "REGISTER", result);
+    return response;
+}
+
+std::string TCPUserSystemServer::executeLogin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    std::string response = loginUser(session, msg.parameters[0], msg.parameters[1]);
+    std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : 
+                       (response.find("CONFLICT") != std::string::npos ? "冲突" : "失败"));
+    logger->logUserOperation(session->getSessionId(), msg.parameters[0].str(), "LOGIN", result);
+    return response;
+}
+
+std::string TCPUserSystemServer::executeForceLogin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    bool forceLogin = (msg.parameters[2] == "Y" || msg.parameters[2] == "y");
+    std::string response = handleLoginConflict(session, msg.parameters[0], msg.parameters[1], forceLogin);
+    std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
+    logger->logUserOperation(session->getSessionId(), msg.parameters[0].str(), "FORCE_LOGIN", result + (forceLogin ? "(强制)" : "(取消)"));
+    return response;
+}
+
+std::string TCPUserSystemServer::executeLogout(SimpleSharedPtr<ClientSession> session, const ProtocolMessage&) {
+    std::string userId = session->getLoggedInUser();
+    std::string response = logoutUser(session);
+    logger->logUserOperation(session->getSessionId(), userId, "LOGOUT", "用户登出");
+    return response;
+}
+
+std::string TCPUserSystemServer::executeDelete(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    std::string response = deleteUser(session, msg.parameters[0], msg.parameters[1]);
+    std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
+    logger->logUserOperation(session->getSessionId(), msg.parameters[0].str(), "DELETE", result);
+    return response;
+}
+
+std::string TCPUserSystemServer::executeChangePassword(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    std::string userId = session->getLoggedInUser();
+    std::string response = changePassword(session, msg.parameters[0], msg.parameters[1]);
+    std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
+    logger->logUserOperation(session->getSessionId(), userId, "CHANGE_PASSWORD", result);
+    return response;
+}
+
+std::string TCPUserSystemServer::executeSetString(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    std::string userId = session->getLoggedInUser();
+    std::string response = setUserString(session, msg.parameters[0]);
+    logger->logUserOperation(session->getSessionId(), userId, "SET_STRING", "设置用户字符串");
+    return response;
+}
+
+std::string TCPUserSystemServer::executeGetString(SimpleSharedPtr<ClientSession> session, const ProtocolMessage&) {
+    std::string userId = session->getLoggedInUser();
+    std::string response = getUserString(session);
+    logger->logUserOperation(session->getSessionId(), userId, "GET_STRING", "查看用户字符串");
+    return response;
+}
+
+// 切换确认以文本发送，之后的响应改用二进制帧
+std::string TCPUserSystemServer::executeProtocol(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    if (msg.parameterCount == 0 || msg.parameters[0] != "BINARY") {
+        return "ERROR|不支持的协议";
+    }
+    sendToSession(session, "SUCCESS|已切换到二进制协议");
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        session->setOutputBinary();
+    }
+    logger->logInfo("会话[" + session->getSessionId().substr(0, 8) + "] 切换到二进制协议");
+    return "";
+}
+
+std::string TCPUserSystemServer::executeQuit(SimpleSharedPtr<ClientSession> session, const ProtocolMessage&) {
+    std::string userId = session->getLoggedInUser();
+    logger->logUserOperation(session->getSessionId(), userId.empty() ? "未登录" : userId, "QUIT", "客户端退出");
+    sendToSession(session, "GOODBYE|感谢使用");
+    session->setInactive();
+    return "";
+}
+
+// 运行统计 - 准入控制的当前量与拒绝计数，用于调整各项上限；以及检查点的耗时、大小与写时复制增长
+std::string TCPUserSystemServer::executeStats(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    if (!authorizeAdmin(session, msg)) {
+        return "ERROR|需要管理权限";
+    }
+    std::string stats = describeAdmissionStats();
+    if (snapshotWriter) {
+        stats += ";" + snapshotWriter->describeCounters();
+    }
+    return "SUCCESS|" + stats;
+}
+
+// 管理命令的权限 - 与服务器同一用户的本机Unix域连接直接允许；其他连接须以第一个参数给出--admin-password配置的密码，
+// 未配置密码时一律拒绝
+bool TCPUserSystemServer::authorizeAdmin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    if (session->isLocalConnection()) {
+        return true;
+    }
+    if (!config.adminPassword.empty() && msg.parameterCount > 0 && msg.parameters[0] == config.adminPassword) {
+        return true;
+    }
+    logger->logWarning("会话[" + session->getSessionId().substr(0, 8) + "] 无管理权限，拒绝" + msg.command.str());
+    return false;
+}
+
+// 后台保存 - 请求检查点线程以fork快照写出数据文件，不等待写出完成
+std::string TCPUserSystemServer::executeBgsave(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg) {
+    if (!authorizeAdmin(session, msg)) {
+        return "ERROR|需要管理权限";
+    }
+    if (!snapshotWriter || !snapshotWriter->request(SNAPSHOT_FORK)) {
+        return "ERROR|检查点正在进行";
+    }
+    logger->logInfo("会话[" + session->getSessionId().substr(0, 8) + "] 请求后台保存");
+    return "SUCCESS|后台保存已开始";
+}
+
+// 用户注册 - 检查用户名唯一性并创建新用户
+std::string TCPUserSystemServer::registerUser(const SimpleStringView& userId, const SimpleStringView& password) {
+    SimpleLockGuard lock(usersMutex);  // 保护用户数据访问
+    
+    std::string id = userId.str();
+    if (findUser(id) != users.end()) {
+        return "ERROR|用户ID已存在";
+    }
+
+    if (userId.empty() || password.empty()) {
+        return "ERROR|用户ID和密码不能为空";
+    }
+    if (!acceptsUserWrites()) {
+        return PERSIST_FAILED_RESPONSE;
+    }
+
+    usersSnapshot->beforeWrite(id);
+    User& user = users[id];
+    user = User(id, password.str());
+    logUserUpdate(user);  // 立即持久化
+    return "SUCCESS|用户注册成功";
+}
+
+// 用户登出 - 清除会话中的登录状态
+std::string TCPUserSystemServer::logoutUser(SimpleSharedPtr<ClientSession> session) {
+    if (!session->isLoggedIn()) {
+        return "ERROR|没有用户处于登录状态";
+    }
+
+    std::string userId = session->getLoggedInUser();
+    session->setLoggedInUser("");
+    
+    std::cout << "[服务器] 用户 " << userId << " 从会话 " 
+              << session->getSessionId().substr(0, 8) << " 登出" << std::endl;
+              
+    return "SUCCESS|登出成功";
+}
+
+// 用户注销 - 永久删除用户账户
+std::string TCPUserSystemServer::deleteUser(SimpleSharedPtr<ClientSession> session, const SimpleStringView& userId, const SimpleStringView& password) {
+    SimpleLockGuard lock(usersMutex);
+    
+    std::map<std::string, User>::iterator it = findUser(userId.str());
+    if (it == users.end()) {
+        return "ERROR|用户不存在";
+    }
+
+    if (!it->second.verifyPassword(password)) {
+        return "ERROR|密码错误";
+    }
+    if (!acceptsUserWrites()) {
+        return PERSIST_FAILED_RESPONSE;
+    }
+
+    // 如果删除的是当前登录用户，先登出
+    if (userId == session->getLoggedInUser()) {
+        session->setLoggedInUser("");
+    }
+
+    usersSnapshot->beforeWrite(it->first);
+    users.erase(it);
+    logUserDelete(userId.str());
+    return "SUCCESS|用户注销成功";
+}
+
+// 设置用户字符串 - 更新用户的自定义数据
+std::string TCPUserSystemServer::setUserString(SimpleSharedPtr<ClientSession> session, const SimpleStringView& str) {
+    if (!session->isLoggedIn()) {
+        return "ERROR|请先登录";
+    }
+
+    SimpleLockGuard lock(usersMutex);
+    std::map<std::string, User>::iterator it = findUser(session->getLoggedInUser());
+    if (it != users.end()) {
+        if (!acceptsUserWrites()) {
+            return PERSIST_FAILED_RESPONSE;
         }
-        
-        if (existingSession) {
-            // 通知被挤占的客户端
-            sendMessage(existingSession->getSocket(), "KICKED|您的账号在其他地方登录，连接已断开");
-            existingSession->setLoggedInUser("");  // 清除登录状态
-            existingSession->setInactive();        // 标记会话为非活跃状态
-            
-            std::cout << "[服务器] 用户 " << userId << " 被新会话挤占下线，原会话ID: " 
-                      << existingSessionId.substr(0, 8) << std::endl;
+        usersSnapshot->beforeWrite(it->first);
+        it->second.setUserString(str.str());
+        logUserUpdate(it->second);
+        return "SUCCESS|用户字符串已更新";
+    }
+
+    return "ERROR|用户不存在";
+}
+
+// 获取用户字符串 - 返回用户的自定义数据
+std::string TCPUserSystemServer::getUserString(SimpleSharedPtr<ClientSession> session) {
+    if (!session->isLoggedIn()) {
+        return "ERROR|请先登录";
+    }
+
+    SimpleLockGuard lock(usersMutex);
+    std::map<std::string, User>::iterator it = findUser(session->getLoggedInUser());
+    if (it != users.end()) {
+        return "SUCCESS|" + it->second.getUserString();
+    }
+
+    return "ERROR|用户不存在";
+}
+
+// 修改密码 - 验证旧密码后更新为新密码
+std::string TCPUserSystemServer::changePassword(SimpleSharedPtr<ClientSession> session, const SimpleStringView& oldPassword, const SimpleStringView& newPassword) {
+    if (!session->isLoggedIn()) {
+        return "ERROR|请先登录";
+    }
+
+    if (oldPassword.empty() || newPassword.empty()) {
+        return "ERROR|密码不能为空";
+    }
+
+    SimpleLockGuard lock(usersMutex);
+    std::map<std::string, User>::iterator it = findUser(session->getLoggedInUser());
+    if (it != users.end()) {
+        if (!it->second.verifyPassword(oldPassword)) {
+            return "ERROR|旧密码错误";
+        }
+        if (!acceptsUserWrites()) {
+            return PERSIST_FAILED_RESPONSE;
         }
+
+        usersSnapshot->beforeWrite(it->first);
+        it->second.setPassword(newPassword.str());
+        logUserUpdate(it->second);
+        return "SUCCESS|密码修改成功";
     }
 
-    session->setLoggedInUser(userId);
-    return "SUCCESS|登录成功，已挤占原会话";
+    return "ERROR|用户不存在";
 }
 
-// 查找用户当前登录的会话ID
-std::string TCPUserSystemServer::findUserSession(const std::string& userId) {
-    SimpleLockGuard sessionLock(sessionsMutex);
+// 生成会话ID - 8位随机十六进制 + 8位递增序号，同一秒内的大量连接也不会重复
+std::string TCPUserSystemServer::generateSessionId() {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    std::string sessionId;
+    for (int i = 0; i < 8; ++i) {
+        sessionId += hexDigits[rand() % 16];
+    }
+    unsigned long long sequence = static_cast<unsigned long long>(sessionCounter.increment());
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        sessionId += hexDigits[(sequence >> shift) & 0xF];
+    }
+    return sessionId;
+}
+
+// 发送消息到客户端 - 消息与结束符用writev一次写出，不额外拼接字符串
+bool TCPUserSystemServer::sendMessage(SOCKET socket, const std::string& message) {
+#ifdef _WIN32
+    std::string fullMessage = message + "\n";  // 添加消息结束符
+    int totalSent = 0;
+    int messageLength = static_cast<int>(fullMessage.length());
     
-    for (std::map<std::string, SimpleSharedPtr<ClientSession>>::iterator it = sessions.begin(); 
-         it != sessions.end(); ++it) {
-        if (it->second->isLoggedIn() && it->second->getLoggedInUser() == userId) {
-            return it->first;  // 返回会话ID
+    while (totalSent < messageLength) {
+        int sent = send(socket, fullMessage.c_str() + totalSent, messageLength - totalSent, MSG_NOSIGNAL);
+        if (sent == SOCKET_ERROR) {
+            return false;
         }
+        totalSent += sent;
     }
-    return "";  // 未找到
+    return true;
+#else
+    static const char terminator = '\n';
+    struct iovec parts[2];
+    parts[0].iov_base = const_cast<char*>(message.data());
+    parts[0].iov_len = message.length();
+    parts[1].iov_base = const_cast<char*>(&terminator);
+    parts[1].iov_len = 1;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = parts;
+    msg.msg_iovlen = 2;
+
+    while (parts[1].iov_len > 0) {
+        ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // 部分写入 - 跳过已发送的部分
+        size_t remaining = static_cast<size_t>(sent);
+        while (msg.msg_iovlen > 0 && remaining >= msg.msg_iov[0].iov_len) {
+            remaining -= msg.msg_iov[0].iov_len;
+            msg.msg_iov[0].iov_len = 0;
+            if (msg.msg_iovlen > 1) {
+                ++msg.msg_iov;
+            }
+            --msg.msg_iovlen;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov[0].iov_base = static_cast<char*>(msg.msg_iov[0].iov_base) + remaining;
+            msg.msg_iov[0].iov_len -= remaining;
+        }
+    }
+    return true;
+#endif
 }
 
-// 单个客户端连接处理 - 管理客户端会话生命周期
-void TCPUserSystemServer::handleClient(SOCKET clientSocket) {
-    // 创建唯一会话
-    std::string sessionId = generateSessionId();
-    SimpleSharedPtr<ClientSession> session(new ClientSession(clientSocket, sessionId));
-    
-    logger->logInfo("创建新会话: " + sessionId);
-    
-    // 注册会话 - 线程安全操作
+// 写入发送队列(调用者持有outputMutex) - 积压超过上限的会话视为不读取响应的慢客户端，
+// 丢弃消息并标记为非活跃，由其I/O上下文关闭连接；首次超限时返回false并置overflowed
+bool TCPUserSystemServer::queueSessionOutput(ClientSession& session, const std::string& message, bool& overflowed) {
+    overflowed = false;
+    if (session.hasOutputOverflowed() || session.hasCommitFailed()) {
+        return false;   // 修改未能提交的会话已回复错误，之后的响应(可能是刚执行完的修改的SUCCESS)不再送出
+    }
+    // 有修改等待提交时之后的响应全部暂存，保持顺序
+    std::string& output = session.getCommitSeq() != 0 ? session.getHeldOutput() : session.getOutputBuffer();
+    size_t queued = session.getOutputBuffer().length() + session.getHeldOutput().length();
+    size_t limit = static_cast<size_t>(config.maxOutputKb) * 1024;
+    if (limit > 0 && queued + message.length() + 1 > limit) {
+        session.setOutputOverflowed();
+        session.setInactive();
+        overflowed = true;
+        return false;
+    }
+    if (session.isOutputBinary()) {
+        ProtocolMessage::appendBinaryResponse(message, output);
+    } else {
+        output += message;
+        output += '\n';
+    }
+    return true;
+}
+
+// 发送队列超限 - 计数并记录，连接由会话所属的I/O上下文关闭
+void TCPUserSystemServer::recordOutputOverflow(SimpleSharedPtr<ClientSession> session) {
+    outputOverflows.increment();
+    std::stringstream info;
+    info << "会话发送队列超过上限(" << config.maxOutputKb << " KB)，关闭连接: " << session->getSessionId();
+    logger->logWarning(info.str());
+}
+
+// 按会话发送消息 - 响应写入会话发送队列；合并期间只缓存，否则立即写出
+// 事件循环会话由驱动写出，阻塞会话由调用线程(即会话所属的工作线程)直接写出
+bool TCPUserSystemServer::sendToSession(SimpleSharedPtr<ClientSession> session, const std::string& message) {
+    bool overflowed;
     {
-        SimpleLockGuard lock(sessionsMutex);
-        sessions[sessionId] = session;
+        SimpleLockGuard lock(session->getOutputMutex());
+        if (session->getSocket() == INVALID_SOCKET) {
+            return false;
+        }
+        if (queueSessionOutput(*session, message, overflowed) && session->isCorked()) {
+            return true;    // 由uncorkSession统一写出
+        }
+    }
+    if (overflowed) {
+        recordOutputOverflow(session);
+        return false;
     }
 
-    // 发送欢迎消息
-    sendMessage(clientSocket, "WELCOME|TCP用户系统服务器|" + sessionId);
+    if (session->getDriver()) {
+        session->getDriver()->requestFlush(session.get());
+        return true;
+    }
+    return flushSessionOutput(*session) >= 0;
+}
 
-    // 消息处理循环
-    while (running.load() && session->getIsActive()) {
-        std::string message = receiveMessage(clientSocket);
-        if (message.empty()) {
-            break;  // 客户端断开连接
+// 跨会话通知并关闭(如挤占下线) - 只写入目标会话的发送队列，调用线程不做任何套接字写入，
+// 由目标会话所属的I/O上下文送出后关闭: 事件循环类驱动经requestClose转交循环线程，
+// 阻塞会话以shutdown关闭读端唤醒阻塞在recv上的工作线程，由其写出剩余数据后结束会话
+void TCPUserSystemServer::notifyAndClose(SimpleSharedPtr<ClientSession> session, const std::string& message) {
+    bool overflowed;
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        SOCKET socket = session->getSocket();
+        if (socket == INVALID_SOCKET) {
+            return;
+        }
+        queueSessionOutput(*session, message, overflowed);
+        if (!session->getDriver()) {
+            // 在发送锁内执行 - 工作线程在同一把锁内关闭套接字，描述符不会已被复用
+#ifdef _WIN32
+            shutdown(socket, SD_RECEIVE);
+#else
+            shutdown(socket, SHUT_RD);
+#endif
         }
+    }
+    if (overflowed) {
+        recordOutputOverflow(session);
+    }
+    if (session->getDriver()) {
+        session->getDriver()->requestClose(session.get());
+    }
+}
+
+// 开始合并响应
+void TCPUserSystemServer::corkSession(SimpleSharedPtr<ClientSession> session) {
+    SimpleLockGuard lock(session->getOutputMutex());
+    session->cork();
+}
 
-        processClientMessage(session, message);
+// 结束合并 - 本批产生的全部响应一次写出
+void TCPUserSystemServer::uncorkSession(SimpleSharedPtr<ClientSession> session) {
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        if (!session->uncork() || (session->getOutputBuffer().empty() && session->getHeldOutput().empty())) {
+            return;
+        }
     }
 
-    // 会话结束时的清理工作
-    std::string loggedInUser = session->getLoggedInUser();
-    if (!loggedInUser.empty()) {
-        logger->logUserOperation(sessionId, loggedInUser, "SESSION_END", "自动登出");
+    if (session->getDriver()) {
+        session->getDriver()->requestFlush(session.get());
+    } else {
+        flushSessionOutput(*session);
+    }
+}
+
+// 冲刷发送缓冲 - 阻塞套接字写完为止；非阻塞套接字写满时保留剩余数据，等待EPOLLOUT事件继续
+int TCPUserSystemServer::flushSessionOutput(ClientSession& session) {
+    if (!session.isNonBlocking()) {
+        return flushBlockingOutput(session);
+    }
+    SimpleLockGuard lock(session.getOutputMutex());
+    SOCKET socket = session.getSocket();
+    std::string& output = session.getOutputBuffer();
+    if (socket == INVALID_SOCKET) {
+        output.clear();
+        return -1;
+    }
+
+    size_t totalSent = 0;
+    int result = 0;
+    while (totalSent < output.length()) {
+        int sent = send(socket, output.data() + totalSent, static_cast<int>(output.length() - totalSent), MSG_NOSIGNAL);
+        if (sent == SOCKET_ERROR) {
+#ifndef _WIN32
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                result = 1;
+                break;
+            }
+#endif
+            result = -1;
+            break;
+        }
+        totalSent += static_cast<size_t>(sent);
+    }
+
+    output.erase(0, totalSent);
+    return result;
+}
+
+// 冲刷阻塞会话 - 只由会话所属的工作线程调用，也只有它会关闭套接字；
+// 在锁内取走待发送数据后在锁外写出，对端不读取时阻塞的只是该工作线程，其他线程仍可随时写入发送队列
+int TCPUserSystemServer::flushBlockingOutput(ClientSession& session) {
+    std::string pending;
+    SOCKET socket;
+    unsigned long long commitSeq;
+    {
+        SimpleLockGuard lock(session.getOutputMutex());
+        commitSeq = session.getCommitSeq();
+    }
+    // 组提交: 修改已同步到磁盘后才送出其响应；日志失败时丢弃暂存的响应，回复错误后结束会话
+    bool committed = commitSeq == 0 || userLog->waitDurable(commitSeq);
+    {
+        SimpleLockGuard lock(session.getOutputMutex());
+        if (committed) {
+            session.releaseHeldOutput(commitSeq);
+        } else {
+            bool overflowed;
+            session.discardHeldOutput();
+            queueSessionOutput(session, PERSIST_FAILED_RESPONSE, overflowed);
+            session.setCommitFailed();
+            session.setInactive();
+        }
+        socket = session.getSocket();
+        pending.swap(session.getOutputBuffer());
+    }
+    if (socket == INVALID_SOCKET) {
+        return -1;
+    }
+
+    size_t totalSent = 0;
+    while (totalSent < pending.length()) {
+        int sent = send(socket, pending.data() + totalSent, static_cast<int>(pending.length() - totalSent), MSG_NOSIGNAL);
+        if (sent == SOCKET_ERROR) {
+#ifndef _WIN32
+            if (errno == EINTR) {
+                continue;
+            }
+#endif
+            return -1;
+        }
+        totalSent += static_cast<size_t>(sent);
+    }
+    return 0;
+}
+
+// 接收客户端数据 - 直接写入会话的接收环形缓冲，不完整的帧留待下次接收补齐
+int TCPUserSystemServer::receiveInput(ClientSession& session) {
+    size_t space;
+    char* target = session.getInputBuffer().writeSpace(space);
+    if (space == 0) {
+        return -1;  // 缓冲已满仍无完整帧
+    }
+
+    int received = recv(session.getSocket(), target, static_cast<int>(space), 0);
+    if (received > 0) {
+        session.getInputBuffer().commit(static_cast<size_t>(received));
+    }
+    return received;
+}
+
+// 停止时的检查点 - 全部线程已退出，在调用线程上写出
+void TCPUserSystemServer::saveToFile() {
+    SnapshotStats stats;
+    writeCheckpoint(stats, SNAPSHOT_VERSIONED);
+}
+
+// 检查点 - 先轮换日志，之后的修改写入新日志；快照写出后删除轮换出的日志
+// 运行期间由后台检查点线程调用，修改请求照常执行(见writeUserFile与forkUserFile)
+bool TCPUserSystemServer::writeCheckpoint(SnapshotStats& stats, SnapshotMethod method) {
+    SimpleLockGuard lock(checkpointMutex);
+    while (!loadMappedUsers(SNAPSHOT_CHUNK_RECORDS)) {
+        // 快照须包含全部用户: 停止时复制检查点线程尚未复制完的部分
+    }
+    if (userLog) {
+        userLog->rotate();          // 上次检查点未完成时不轮换，快照同样包含轮换出的日志中的修改
+    }
+    bool saved = method == SNAPSHOT_FORK ? forkUserFile(stats) : writeUserFile(stats);
+    if (saved && userLog) {
+        userLog->removeRotated();
+    }
+    return saved;
+}
+
+// 分块写出快照 - 读取一块时持有用户表的锁，写文件时不持有
+static void streamSnapshot(UserTableSnapshot& snapshot, SnapshotFileWriter& file, SnapshotStats& stats) {
+    std::string chunk;
+    bool finished = false;
+    while (!finished) {
+        chunk.clear();
+        finished = snapshot.readChunk(chunk, SNAPSHOT_CHUNK_RECORDS, stats);
+        file.write(chunk);
+    }
+}
+
+// 写出数据文件 - 先写临时文件再改名，写到一半崩溃时原快照不受影响；
+// 各用户表(分片模式下每个分片一个)在日志轮换后开始快照，写出的是快照时刻的内容，
+// 写出期间的修改只在修改前为尚未写出的用户保留旧版本
+bool TCPUserSystemServer::writeUserFile(SnapshotStats& stats) {
+    std::string tempFile = snapshotFile + ".tmp";
+    SnapshotFileWriter file;
+    if (!file.open(tempFile)) {
+        std::cerr << "警告: 无法保存用户数据到文件: " << tempFile << std::endl;
+        return false;
+    }
+
+    {
+        SimpleLockGuard lock(usersMutex);
+        usersSnapshot->begin();
+    }
+#ifdef __linux__
+    for (size_t i = 0; i < userShards.size(); ++i) {
+        userShards[i]->beginSnapshot();
+    }
+    for (size_t i = 0; i < userShards.size(); ++i) {
+        streamSnapshot(userShards[i]->getSnapshot(), file, stats);
+    }
+#endif
+    streamSnapshot(*usersSnapshot, file, stats);
+
+    bool written = file.finish();
+    stats.bytes = file.getBytes();
+    // 需要持久化时快照先同步再改名: 之后会删除轮换出的日志，快照须先于日志落盘
+    if (!written || (config.durability != DURABILITY_NONE && !WriteAheadLog::syncPath(tempFile))) {
+        std::cerr << "警告: 保存用户数据时发生错误" << std::endl;
+        remove(tempFile.c_str());
+        return false;
+    }
+    return installUserFile(tempFile);
+}
+
+// fork快照 - 在全部用户表的锁内fork，子进程写出fork时刻的用户表，父进程只在fork期间阻塞修改；
+// 检查点线程等待子进程写完后改名
+bool TCPUserSystemServer::forkUserFile(SnapshotStats& stats) {
+#ifdef __linux__
+    std::string tempFile = snapshotFile + ".tmp";
+    bool durable = config.durability != DURABILITY_NONE;
+
+    // 与writeUserFile相同，分片在前、users在后；锁按同一顺序获取，没有其他线程同时持有两把
+    std::vector<const std::map<std::string, User>*> tables;
+    for (size_t i = 0; i < userShards.size(); ++i) {
+        userShards[i]->getWriteMutex().lock();
+        tables.push_back(&userShards[i]->getUsers());
+    }
+    usersMutex.lock();
+    tables.push_back(&users);
+
+    ForkedSnapshot child;
+    bool started = child.start(tables, tempFile, durable, stats);
+
+    usersMutex.unlock();
+    for (size_t i = userShards.size(); i-- > 0;) {
+        userShards[i]->getWriteMutex().unlock();
     }
 
-    // 清理会话
-    {
-        SimpleLockGuard lock(sessionsMutex);
-        sessions.erase(sessionId);
+    if (!started) {
+        std::cerr << "警告: 无法创建写出快照的子进程" << std::endl;
+        return false;
+    }
+    if (!child.wait(stats)) {
+        std::cerr << "警告: 子进程保存用户数据时发生错误" << std::endl;
+        remove(tempFile.c_str());
+        return false;
     }
+    return installUserFile(tempFile);
+#else
+    return writeUserFile(stats);
+#endif
+}
 
-    closesocket(clientSocket);
-    logger->logInfo("客户端会话结束: " + sessionId);
+// 替换快照文件 - 临时文件已写完(需要持久化时已同步)；文本数据文件不被改写
+bool TCPUserSystemServer::installUserFile(const std::string& tempFile) {
+#ifdef _WIN32
+    bool replaced = MoveFileExA(tempFile.c_str(), snapshotFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool replaced = rename(tempFile.c_str(), snapshotFile.c_str()) == 0;
+    if (replaced && config.durability != DURABILITY_NONE) {
+        replaced = WriteAheadLog::syncPath("users");    // 改名后的目录项
+    }
+#endif
+    if (!replaced) {
+        std::cerr << "警告: 无法替换用户快照文件: " << snapshotFile << std::endl;
+        remove(tempFile.c_str());
+    }
+    return replaced;
 }
 
-// 客户端消息处理 - 解析命令并调用相应业务逻辑
-void TCPUserSystemServer::processClientMessage(SimpleSharedPtr<ClientSession> session, const std::string& message) {
-    ProtocolMessage msg = ProtocolMessage::parse(message);
-    std::string response;
-    std::string sessionId = session->getSessionId();
+// 从文件加载用户数据 - 服务器启动时恢复历史数据: 先加载快照，再重放预写日志
+// 二进制快照(数据文件名加.snap)只映射不解析；日志中有记录时要在快照之上重放，先把映射的记录全部复制到users；
+// 还没有快照时读取文本数据文件(早期版本写出的CSV，首行为转义标记时字段带转义)，映射后分块并行解析，
+// 之后的检查点写出快照文件，文本数据文件保持原样，此后不再读取
+void TCPUserSystemServer::loadFromFile() {
+    delete mappedUsers;     // 热重启重新加载时丢弃之前的映射
+    mappedUsers = 0;
 
-    // 命令分发处理
-    if (msg.command == "REGISTER") {
-        if (msg.parameters.size() >= 2) {
-            response = registerUser(msg.parameters[0], msg.parameters[1]);
-            std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
-            logger->logUserOperation(sessionId, msg.parameters[0], "REGISTER", result);
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 注册操作参数不足");
-        }
+    // 数据文件本身是快照格式时(曾以数据文件名写出快照)同样映射，不按文本解析
+    std::string snapshotPath = snapshotFile;
+    if (!MappedUserFile::hasSnapshotHeader(snapshotPath) && MappedUserFile::hasSnapshotHeader(dataFile)) {
+        snapshotPath = dataFile;
     }
-    else if (msg.command == "LOGIN") {
-        if (msg.parameters.size() >= 2) {
-            response = loginUser(session, msg.parameters[0], msg.parameters[1]);
-            std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : 
-                               (response.find("CONFLICT") != std::string::npos ? "冲突" : "失败"));
-            logger->logUserOperation(sessionId, msg.parameters[0], "LOGIN", result);
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 登录操作参数不足");
+    if (MappedUserFile::hasSnapshotHeader(snapshotPath)) {
+        MappedUserFile* mapped = new MappedUserFile();
+        if (!mapped->open(snapshotPath)) {
+            delete mapped;
+            dataLoadFailed = true;
+            logger->logError("无法映射快照文件(损坏或版本不符): " + snapshotPath);
+            return;
         }
-    }
-    else if (msg.command == "FORCE_LOGIN") {
-        if (msg.parameters.size() >= 3) {
-            bool forceLogin = (msg.parameters[2] == "Y" || msg.parameters[2] == "y");
-            response = handleLoginConflict(session, msg.parameters[0], msg.parameters[1], forceLogin);
-            std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
-            logger->logUserOperation(sessionId, msg.parameters[0], "FORCE_LOGIN", result + (forceLogin ? "(强制)" : "(取消)"));
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 强制登录操作参数不足");
+        struct stat info;
+        if (snapshotPath == snapshotFile && stat(dataFile.c_str(), &info) == 0) {
+            logger->logInfo("已有快照文件，文本数据文件不再读取: " + dataFile);
         }
-    }
-    else if (msg.command == "LOGOUT") {
-        std::string userId = session->getLoggedInUser();
-        response = logoutUser(session);
-        logger->logUserOperation(sessionId, userId, "LOGOUT", "用户登出");
-    }
-    else if (msg.command == "DELETE") {
-        if (msg.parameters.size() >= 2) {
-            response = deleteUser(session, msg.parameters[0], msg.parameters[1]);
-            std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
-            logger->logUserOperation(sessionId, msg.parameters[0], "DELETE", result);
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 注销账户操作参数不足");
+        mappedLoadStartMs = TimerWheel::nowMs();
+        if (!WriteAheadLog::hasLogRecords(dataFile)) {
+            mappedUsers = mapped;
+            return;
         }
-    }
-    else if (msg.command == "CHANGE_PASSWORD") {
-        if (msg.parameters.size() >= 2) {
-            std::string userId = session->getLoggedInUser();
-            response = changePassword(session, msg.parameters[0], msg.parameters[1]);
-            std::string result = (response.find("SUCCESS") != std::string::npos ? "成功" : "失败");
-            logger->logUserOperation(sessionId, userId, "CHANGE_PASSWORD", result);
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 修改密码操作参数不足");
+
+        size_t offset;
+        std::string userId;
+        User user;
+        while (mapped->nextRecord(offset, userId)) {
+            if (mapped->claimRecord(offset, userId, user)) {
+                users[userId] = user;
+            }
         }
-    }
-    else if (msg.command == "SET_STRING") {
-        if (msg.parameters.size() >= 1) {
-            std::string userId = session->getLoggedInUser();
-            response = setUserString(session, msg.parameters[0]);
-            logger->logUserOperation(sessionId, userId, "SET_STRING", "设置用户字符串");
-        } else {
-            response = "ERROR|参数不足";
-            logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 设置字符串操作参数不足");
+        if (mapped->getDamaged() > 0 || mapped->getRemaining() > 0) {
+            logger->logError("快照文件中有无法读取的记录，已忽略");
+        }
+        delete mapped;
+    } else {
+        CsvLoadStats loaded;
+        if (CsvUserLoader::load(dataFile, users, loaded) && loaded.records > 0) {
+            std::stringstream ss;
+            ss << "已加载文本格式数据文件(" << (loaded.escaped ? "转义" : "未转义") << "): 记录 " << loaded.records
+               << "，" << loaded.bytes / 1024 << " KB，解析线程 " << loaded.threads << "(" << loaded.scanner
+               << ")，解析 " << loaded.parseMs << " ms，合并 " << loaded.mergeMs << " ms";
+            logger->logInfo(ss.str());
         }
     }
-    else if (msg.command == "GET_STRING") {
-        std::string userId = session->getLoggedInUser();
-        response = getUserString(session);
-        logger->logUserOperation(sessionId, userId, "GET_STRING", "查看用户字符串");
+
+    WalReplayStats replayed;
+    WriteAheadLog::replay(dataFile, users, replayed);
+    if (replayed.records > 0) {
+        std::stringstream ss;
+        ss << replayed.records;
+        logger->logInfo("已重放数据日志记录: " + ss.str());
     }
-    else if (msg.command == "QUIT") {
-        std::string userId = session->getLoggedInUser();
-        response = "GOODBYE|感谢使用";
-        logger->logUserOperation(sessionId, userId.empty() ? "未登录" : userId, "QUIT", "客户端退出");
-        sendMessage(session->getSocket(), response);
-        session->setInactive();
-        return;
+    if (replayed.damaged > 0) {
+        logger->logWarning("数据日志末尾有未写完或损坏的记录，已忽略其后的内容");
     }
-    else {
-        response = "ERROR|未知命令: " + msg.command;
-        logger->logWarning("会话[" + sessionId.substr(0, 8) + "] 未知命令: " + msg.command);
+}
+
+// 查找用户 - 调用者持有usersMutex；映射的快照尚未全部复制时，未找到的用户从映射中认领到users
+std::map<std::string, User>::iterator TCPUserSystemServer::findUser(const std::string& userId) {
+    std::map<std::string, User>::iterator it = users.find(userId);
+    User user;
+    if (it == users.end() && claimMappedUser(userId, user)) {
+        it = users.insert(std::make_pair(userId, user)).first;
     }
+    return it;
+}
 
-    sendMessage(session->getSocket(), response);
+bool TCPUserSystemServer::claimMappedUser(const std::string& userId, User& user) {
+    return mappedUsers && mappedUsers->claim(userId, user);
 }
 
-// 用户注册 - 检查用户名唯一性并创建新用户
-std::string TCPUserSystemServer::registerUser(const std::string& userId, const std::string& password) {
-    SimpleLockGuard lock(usersMutex);  // 保护用户数据访问
-    
-    if (users.find(userId) != users.end()) {
-        return "ERROR|用户ID已存在";
+// 复制映射中的用户 - 先在锁外按记录顺序取出一块记录的位置，再在各自用户表的锁内认领；
+// 同一时刻只有一个线程调用(启动后的检查点线程，或停止时的主线程)
+bool TCPUserSystemServer::loadMappedUsers(size_t maxRecords) {
+    if (!mappedUsers) {
+        return true;
+    }
+    std::vector<std::pair<size_t, std::string> > batch;
+    size_t offset;
+    std::string userId;
+    while (batch.size() < maxRecords && mappedUsers->nextRecord(offset, userId)) {
+        batch.push_back(std::make_pair(offset, userId));
     }
 
-    if (userId.empty() || password.empty()) {
-        return "ERROR|用户ID和密码不能为空";
+    User user;
+    bool sharded = false;
+#ifdef __linux__
+    sharded = !userShards.empty();
+    if (sharded) {
+        std::vector<std::vector<size_t> > owned(userShards.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            owned[UserShard::shardOf(batch[i].second, userShards.size())].push_back(i);
+        }
+        for (size_t s = 0; s < owned.size(); ++s) {
+            if (owned[s].empty()) {
+                continue;
+            }
+            SimpleLockGuard lock(userShards[s]->getWriteMutex());
+            std::map<std::string, User>& table = userShards[s]->getUsers();
+            for (size_t i = 0; i < owned[s].size(); ++i) {
+                const std::pair<size_t, std::string>& record = batch[owned[s][i]];
+                if (mappedUsers->claimRecord(record.first, record.second, user)) {
+                    table.insert(std::make_pair(record.second, user));
+                }
+            }
+        }
+    }
+#endif
+    if (!sharded) {
+        SimpleLockGuard lock(usersMutex);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (mappedUsers->claimRecord(batch[i].first, batch[i].second, user)) {
+                users.insert(std::make_pair(batch[i].second, user));
+            }
+        }
     }
 
-    users[userId] = User(userId, password);
-    saveToFile();  // 立即持久化
-    return "SUCCESS|用户注册成功";
+    if (batch.size() == maxRecords) {
+        return false;
+    }
+    releaseMappedUsers();
+    return true;
 }
 
-// 用户登出 - 清除会话中的登录状态
-std::string TCPUserSystemServer::logoutUser(SimpleSharedPtr<ClientSession> session) {
-    if (!session->isLoggedIn()) {
-        return "ERROR|没有用户处于登录状态";
+// 释放映射 - 按需认领的线程读取mappedUsers时持有某个用户表的锁，置空时持有全部(与fork快照的加锁顺序相同)
+void TCPUserSystemServer::releaseMappedUsers() {
+    size_t total = mappedUsers->getRecordCount();
+    bool damaged = mappedUsers->getDamaged() > 0 || mappedUsers->getRemaining() > 0;
+#ifdef __linux__
+    for (size_t i = 0; i < userShards.size(); ++i) {
+        userShards[i]->getWriteMutex().lock();
     }
+#endif
+    usersMutex.lock();
+    delete mappedUsers;
+    mappedUsers = 0;
+    usersMutex.unlock();
+#ifdef __linux__
+    for (size_t i = userShards.size(); i-- > 0;) {
+        userShards[i]->setMappedPending(false);
+        userShards[i]->getWriteMutex().unlock();
+    }
+#endif
 
-    std::string userId = session->getLoggedInUser();
-    session->setLoggedInUser("");
-    
-    std::cout << "[服务器] 用户 " << userId << " 从会话 " 
-              << session->getSessionId().substr(0, 8) << " 登出" << std::endl;
-              
-    return "SUCCESS|登出成功";
+    std::stringstream ss;
+    ss << "快照文件已全部复制到用户表: 用户 " << total << "，自映射起 " << TimerWheel::nowMs() - mappedLoadStartMs << " ms";
+    logger->logInfo(ss.str());
+    if (damaged) {
+        logger->logError("快照文件中有无法读取的记录，已忽略");
+    }
 }
 
-// 用户注销 - 永久删除用户账户
-std::string TCPUserSystemServer::deleteUser(SimpleSharedPtr<ClientSession> session, const std::string& userId, const std::string& password) {
-    SimpleLockGuard lock(usersMutex);
-    
-    std::map<std::string, User>::iterator it = users.find(userId);
-    if (it == users.end()) {
-        return "ERROR|用户不存在";
+// 打开预写日志 - 上次运行留下的日志已在加载时重放，先写出包含它们的快照再清空日志，
+// 避免在可能不完整的日志末尾继续追加；快照写出失败时保留日志，截掉末尾未写完或损坏的记录后在其后追加
+bool TCPUserSystemServer::openUserLog() {
+    userLog = new WriteAheadLog(this, dataFile, config.durability, config.commitIntervalMs);
+    bool truncate = false;
+    if (userLog->hasRecords()) {
+        SimpleLockGuard lock(checkpointMutex);
+        SnapshotStats stats;
+        truncate = writeUserFile(stats);
+        if (truncate) {
+            userLog->removeRotated();
+        }
     }
-
-    if (!it->second.verifyPassword(password)) {
-        return "ERROR|密码错误";
+    if (!userLog->open(truncate)) {
+        logger->logError("无法打开数据日志: " + dataFile + ".wal");
+        delete userLog;
+        userLog = 0;
+        return false;
     }
-
-    // 如果删除的是当前登录用户，先登出
-    if (session->getLoggedInUser() == userId) {
-        session->setLoggedInUser("");
+    std::stringstream info;
+    info << "数据日志持久化模式: " << WriteAheadLog::modeName(userLog->getMode());
+    if (userLog->getMode() == DURABILITY_BATCHED) {
+        info << "，提交间隔 " << config.commitIntervalMs << " ms";
     }
-
-    users.erase(it);
-    saveToFile();
-    return "SUCCESS|用户注销成功";
+    logger->logInfo(info.str());
+    lastCheckpointMs = TimerWheel::nowMs();
+    return true;
 }
 
-// 设置用户字符串 - 更新用户的自定义数据
-std::string TCPUserSystemServer::setUserString(SimpleSharedPtr<ClientSession> session, const std::string& str) {
-    if (!session->isLoggedIn()) {
-        return "ERROR|请先登录";
+// 定期检查点 - 日志有新记录且到达间隔，或日志超过上限
+void TCPUserSystemServer::checkpointIfDue() {
+    if (!userLog || !snapshotWriter) {
+        return;
     }
-
-    SimpleLockGuard lock(usersMutex);
-    std::map<std::string, User>::iterator it = users.find(session->getLoggedInUser());
-    if (it != users.end()) {
-        it->second.setUserString(str);
-        saveToFile();
-        return "SUCCESS|用户字符串已更新";
+    unsigned long long now = TimerWheel::nowMs();
+    unsigned long long pending = userLog->getPendingBytes();
+    bool intervalDue = config.checkpointInterval > 0 && pending > 0 &&
+                       now - lastCheckpointMs >= static_cast<unsigned long long>(config.checkpointInterval) * 1000ULL;
+    bool sizeDue = config.checkpointWalKb > 0 &&
+                   pending >= static_cast<unsigned long long>(config.checkpointWalKb) * 1024ULL;
+    unsigned long long mutations = userLog->getPendingRecords();
+    bool mutationsDue = config.bgsaveMutations > 0 &&
+                        mutations >= static_cast<unsigned long long>(config.bgsaveMutations);
+    if (!intervalDue && !sizeDue && !mutationsDue) {
+        return;
     }
+    SnapshotMethod method = mutationsDue ? SNAPSHOT_FORK : SNAPSHOT_VERSIONED;
 
-    return "ERROR|用户不存在";
+    // 由后台线程写出，上一次检查点仍在进行时下一轮再检查
+    if (snapshotWriter->request(method)) {
+        lastCheckpointMs = now;
+        std::stringstream ss;
+        if (method == SNAPSHOT_FORK) {
+            ss << "开始后台保存，自上次检查点修改 " << mutations << " 次";
+        } else {
+            ss << "开始检查点，日志 " << pending / 1024 << " KB";
+        }
+        logger->logInfo(ss.str());
+    }
 }
 
-// 获取用户字符串 - 返回用户的自定义数据
-std::string TCPUserSystemServer::getUserString(SimpleSharedPtr<ClientSession> session) {
-    if (!session->isLoggedIn()) {
-        return "ERROR|请先登录";
-    }
+// 当前线程最近一次修改的日志序号 - 命令处理函数在执行线程上同步调用logUser*，
+// 执行完由同一线程取走，决定响应是否需要等待提交
+static thread_local unsigned long long lastCommitSeq = 0;
 
-    SimpleLockGuard lock(usersMutex);
-    std::map<std::string, User>::iterator it = users.find(session->getLoggedInUser());
-    if (it != users.end()) {
-        return "SUCCESS|" + it->second.getUserString();
+// 记录用户修改 - 调用者持有保护该用户的锁(usersMutex或所在分片的写锁)，日志顺序与内存修改顺序一致
+void TCPUserSystemServer::logUserUpdate(const User& user) {
+    if (!userLog) {
+        return;
     }
-
-    return "ERROR|用户不存在";
+    unsigned long long seq = userLog->appendPut(user);
+    if (seq == 0) {
+        logger->logError("数据日志写入失败，用户: " + user.getUserId());
+    }
+    lastCommitSeq = seq != 0 ? seq : COMMIT_SEQ_FAILED;
 }
 
-// 修改密码 - 验证旧密码后更新为新密码
-std::string TCPUserSystemServer::changePassword(SimpleSharedPtr<ClientSession> session, const std::string& oldPassword, const std::string& newPassword) {
-    if (!session->isLoggedIn()) {
-        return "ERROR|请先登录";
+void TCPUserSystemServer::logUserDelete(const std::string& userId) {
+    if (!userLog) {
+        return;
     }
-
-    if (oldPassword.empty() || newPassword.empty()) {
-        return "ERROR|密码不能为空";
+    unsigned long long seq = userLog->appendDelete(userId);
+    if (seq == 0) {
+        logger->logError("数据日志写入失败，用户: " + userId);
     }
+    lastCommitSeq = seq != 0 ? seq : COMMIT_SEQ_FAILED;
+}
 
-    SimpleLockGuard lock(usersMutex);
-    std::map<std::string, User>::iterator it = users.find(session->getLoggedInUser());
-    if (it != users.end()) {
-        if (!it->second.verifyPassword(oldPassword)) {
-            return "ERROR|旧密码错误";
-        }
-        
-        it->second.setPassword(newPassword);
-        saveToFile();
-        return "SUCCESS|密码修改成功";
-    }
+unsigned long long TCPUserSystemServer::takeCommitSeq() {
+    unsigned long long seq = lastCommitSeq;
+    lastCommitSeq = 0;
+    return seq;
+}
 
-    return "ERROR|用户不存在";
+bool TCPUserSystemServer::acceptsUserWrites() {
+    return !userLog || !userLog->hasFailed();
 }
 
-// 生成会话ID - 创建16位十六进制随机字符串
-std::string TCPUserSystemServer::generateSessionId() {
-    srand(static_cast<unsigned int>(time(0)));
-    std::string sessionId;
-    for (int i = 0; i < 16; ++i) {
-        sessionId += "0123456789ABCDEF"[rand() % 16];
+// 暂存响应直到提交 - 只在组提交模式下需要，其余模式追加返回时记录已提交；
+// 事件循环会话登记到等待列表，由提交线程放行后通知驱动写出；阻塞会话在写出前自行等待。
+// 记录未能写入时返回false，调用者以PERSIST_FAILED_RESPONSE代替原响应
+bool TCPUserSystemServer::holdForCommit(SimpleSharedPtr<ClientSession> session, unsigned long long seq) {
+    if (seq == COMMIT_SEQ_FAILED) {
+        return false;
+    }
+    if (seq == 0 || !userLog || userLog->getMode() != DURABILITY_BATCHED || seq <= userLog->getDurableSeq()) {
+        return true;
     }
-    return sessionId;
-}
 
-// 发送消息到客户端 - 确保完整发送所有数据
-bool TCPUserSystemServer::sendMessage(SOCKET socket, const std::string& message) {
-    std::string fullMessage = message + "\n";  // 添加消息结束符
-    int totalSent = 0;
-    int messageLength = static_cast<int>(fullMessage.length());
-    
-    while (totalSent < messageLength) {
-        int sent = send(socket, fullMessage.c_str() + totalSent, messageLength - totalSent, 0);
-        if (sent == SOCKET_ERROR) {
-            return false;
+    bool newlyHeld;
+    {
+        SimpleLockGuard lock(session->getOutputMutex());
+        newlyHeld = session->holdOutputUntil(seq);
+    }
+    if (!session->getDriver()) {
+        return true;
+    }
+    if (newlyHeld) {
+        SimpleLockGuard lock(commitWaitersMutex);
+        if (!commitWaitersClosed) {
+            commitWaiters.push_back(session);
         }
-        totalSent += sent;
     }
-    
+    // 登记前提交线程可能已完成(或失败于)这一批，补做一次放行避免响应滞留
+    unsigned long long durable = userLog->getDurableSeq();
+    if (seq <= durable || userLog->hasFailed()) {
+        releaseCommitWaiters(durable);
+    }
     return true;
 }
 
-// 接收客户端消息 - 支持超时和完整消息接收
-std::string TCPUserSystemServer::receiveMessage(SOCKET socket) {
-    char buffer[1024];
-    std::string message;
-    
-    // 设置接收超时
-#ifdef _WIN32
-    DWORD timeout = 30000;  // 30秒超时
-    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
-#else
-    struct timeval timeout;
-    timeout.tv_sec = 30;
-    timeout.tv_usec = 0;
-    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-#endif
-    
-    while (true) {
-        int received = recv(socket, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) {
-            return "";  // 连接断开或超时
-        }
-        
-        buffer[received] = '\0';
-        message += buffer;
-        
-        // 检查消息完整性(以换行符结尾)
-        size_t pos = message.find('\n');
-        if (pos != std::string::npos) {
-            return message.substr(0, pos);
+// 放行已提交的会话 - 整个过程持有commitWaitersMutex，停止流程置位commitWaitersClosed后不再调用驱动；
+// 日志已失败时仍在等待的会话不会再提交，丢弃暂存的响应，回复PERSIST_FAILED_RESPONSE后关闭连接
+void TCPUserSystemServer::releaseCommitWaiters(unsigned long long durableSeq) {
+    bool failed = userLog && userLog->hasFailed();
+    SimpleLockGuard lock(commitWaitersMutex);
+    if (commitWaitersClosed) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < commitWaiters.size(); ++i) {
+        SimpleSharedPtr<ClientSession> session = commitWaiters[i];
+        bool released;
+        bool closing;
+        {
+            SimpleLockGuard outputLock(session->getOutputMutex());
+            released = session->releaseHeldOutput(durableSeq);
+            closing = session->isCloseAfterCommit();
+            if (!released && failed) {
+                bool overflowed;
+                session->discardHeldOutput();
+                queueSessionOutput(*session, PERSIST_FAILED_RESPONSE, overflowed);
+                session->setCommitFailed();
+                released = true;
+                closing = true;
+            }
         }
-        
-        // 防止消息过长攻击
-        if (message.length() > 4096) {
-            return "";
+        if (!released) {
+            commitWaiters[kept++] = session;
+        } else if (closing) {
+            session->getDriver()->requestClose(session.get());
+        } else {
+            session->getDriver()->requestFlush(session.get());
         }
     }
+    commitWaiters.resize(kept);
 }
 
-// 保存用户数据到文件 - CSV格式持久化存储
-void TCPUserSystemServer::saveToFile() {
-    std::ofstream file(dataFile.c_str());
-    if (!file.is_open()) {
-        std::cerr << "警告: 无法保存用户数据到文件: " << dataFile << std::endl;
-        return;
-    }
+// 请求停止 - 信号处理函数中只设置标志，停止流程由startServer所在的主线程执行
+void TCPUserSystemServer::requestStop() {
+    stopRequested = 1;
+}
 
-    for (std::map<std::string, User>::const_iterator it = users.begin(); 
-         it != users.end(); ++it)
-    {
-        file << it->second.serialize() << std::endl;
+// 对全部会话套接字执行shutdown - 只关读端时阻塞在recv的线程立即返回，已产生的响应仍可送出；
+// 两端都关时阻塞在send上的线程也会返回。会话先从会话表移除再关闭套接字，表中的描述符不会已被复用
+size_t TCPUserSystemServer::interruptSessions(bool force) {
+#ifdef _WIN32
+    int how = force ? SD_BOTH : SD_RECEIVE;
+#else
+    int how = force ? SHUT_RDWR : SHUT_RD;
+#endif
+#ifdef __linux__
+    // 分片模式下会话只登记在所属循环的连接表中，由各循环线程对自己的连接执行shutdown
+    if (config.shardPerCore) {
+        for (size_t i = 0; i < eventLoops.size(); ++i) {
+            eventLoops[i]->interruptConnections(force);
+        }
+        return static_cast<size_t>(connectionCount.load());
     }
-    
-    if (file.fail()) {
-        std::cerr << "警告: 保存用户数据时发生错误" << std::endl;
+#endif
+    SimpleLockGuard lock(sessionsMutex);
+    for (std::map<std::string, SimpleSharedPtr<ClientSession> >::iterator it = sessions.begin();
+         it != sessions.end(); ++it) {
+        SOCKET socket = it->second->getSocket();
+        if (socket != INVALID_SOCKET) {
+            shutdown(socket, how);
+        }
     }
-    
-    file.close();
+    return sessions.size();
 }
 
-// 从文件加载用户数据 - 服务器启动时恢复历史数据
-void TCPUserSystemServer::loadFromFile() {
-    std::ifstream file(dataFile.c_str());
-    if (!file.is_open()) {
-        return;  // 文件不存在是正常的(首次运行)
-    }
-
-    std::string line;
-    while (std::getline(file, line)) {
-        if (!line.empty()) {
-            User user = User::deserialize(line);
-            users[user.getUserId()] = user;
+// 等待全部会话结束 - 按会话计数判断(分片模式下会话不在会话表中)
+bool TCPUserSystemServer::waitSessionsClosed(unsigned long long deadlineMs) {
+    while (true) {
+        if (connectionCount.load() == 0) {
+            return true;
+        }
+        if (TimerWheel::nowMs() >= deadlineMs) {
+            return false;
         }
+#ifdef _WIN32
+        Sleep(10);
+#else
+        usleep(10000);
+#endif
     }
-    file.close();
 }
 
-// 停止服务器 - 优雅关闭所有连接和线程
+// 停止服务器 - 分阶段执行并记录各阶段耗时
+// 1. 停止接受: 关闭监听，事件循环进入排空状态(不再接受与读取)
+// 2. 排空连接: 已收到请求的响应送出后关闭连接，超过shutdown-timeout仍未结束的连接强制关闭
+// 3. 回收线程: 命令执行线程、事件循环、工作线程池与接受线程
+// 4. 保存数据
+// 5. 热重启移交(新进程请求时): 监听套接字保持监听，空闲会话在第2阶段从事件循环摘下，此时连同监听套接字送出
 void TCPUserSystemServer::stopServer() {
     if (running.load()) {
         running.store(false);
-        
+        unsigned long long stopStart = TimerWheel::nowMs();
+        unsigned long long deadline = stopStart + static_cast<unsigned long long>(config.shutdownTimeout) * 1000ULL;
+        bool handoff = false;
+#ifdef __linux__
+        handoff = hotRestart && hotRestart->isHandingOff();
+#endif
+
         if (logger) {
-            logger->logServerEvent("服务器正在停止...");
+            logger->logServerEvent(handoff ? "服务器正在停止并移交给新进程..." : "服务器正在停止...");
         }
-        
-        // 关闭监听套接字
-        if (serverSocket != INVALID_SOCKET) {
-            closesocket(serverSocket);
-            serverSocket = INVALID_SOCKET;
+
+        // 事件循环先进入排空状态再关闭监听，循环不会在已关闭的监听套接字上反复accept
+#ifdef __linux__
+        for (size_t i = 0; i < eventLoops.size(); ++i) {
+            eventLoops[i]->beginDrain(handoff);
         }
-        
-        // 等待所有客户端线程结束
+        for (size_t i = 0; i < uringLoops.size(); ++i) {
+            uringLoops[i]->beginDrain(handoff);
+        }
+        if (shmTransport) {
+            shmTransport->beginDrain();
+        }
+        if (acceptWakeFd >= 0) {
+            uint64_t one = 1;
+            ssize_t written = write(acceptWakeFd, &one, sizeof(one));
+            (void)written;
+        }
+#endif
+
+        // 唤醒阻塞在accept上的接受线程 - 监听套接字在线程退出后再关闭，避免描述符被复用；
+        // 移交时监听套接字与新进程共用，shutdown会使其停止监听，接受线程已由eventfd唤醒
+        bool keepListening = handoff && (acceptThreads.empty() || acceptWakeFd >= 0);
+        for (size_t i = 0; i < listenSockets.size() && !keepListening; ++i) {
 #ifdef _WIN32
-        for (size_t i = 0; i < clientThreads.size(); ++i) {
-            if (clientThreads[i] != NULL) {
-                WaitForSingleObject(clientThreads[i], 5000);  // 等待5秒
-                CloseHandle(clientThreads[i]);
+            closesocket(listenSockets[i]);
+#else
+            shutdown(listenSockets[i], SHUT_RDWR);
+#endif
+        }
+        unsigned long long acceptStopped = TimerWheel::nowMs();
+
+        // 线程模式的工作线程阻塞在recv上，关闭读端使其立即返回并结束会话；
+        // 事件循环模式由各循环在送完响应后自行关闭连接，命令执行线程继续执行已排队的命令
+        if (config.ioMode == IO_MODE_THREAD) {
+            interruptSessions(false);
+        }
+        size_t forced = 0;
+        if (!waitSessionsClosed(deadline)) {
+            forced = interruptSessions(true);   // 对端不读取等原因无法送完的连接
+        }
+        unsigned long long drainFinished = TimerWheel::nowMs();
+
+        // 等待进行中的后台检查点 - 它读取的分片随事件循环一起回收
+        if (snapshotWriter) {
+            snapshotWriter->stop();
+        }
+
+        // 先停止命令执行线程，之后不再有线程向事件循环请求关闭连接
+        if (scheduler) {
+            scheduler->stop();
+        }
+
+        // 组提交的等待列表在事件循环回收前关闭，提交线程之后不再调用即将销毁的驱动
+        {
+            SimpleLockGuard lock(commitWaitersMutex);
+            commitWaitersClosed = true;
+            commitWaiters.clear();
+        }
+
+        // 停止事件循环，循环线程会关闭其管理的所有连接
+        stopEventLoops();
+#ifdef __linux__
+        SOCKET shmListener = INVALID_SOCKET;
+        if (shmTransport) {
+            if (handoff) {
+                shmListener = shmTransport->detachListener();   // 共享内存连接不移交，客户端重新握手
+            }
+            shmTransport->stop();
+            if (logger) {
+                logger->logInfo("共享内存传输统计: " + shmTransport->describeStats());
             }
+            delete shmTransport;
+            shmTransport = 0;
+        }
+#endif
+        if (scheduler) {
+            if (logger) {
+                logger->logInfo("命令调度统计: " + scheduler->describeStats());
+            }
+            delete scheduler;
+            scheduler = 0;
+        }
+
+        // 停止工作线程池 - 唤醒等待队列空位的接受线程，等待工作线程处理完当前会话，排队中的连接直接关闭
+        if (workerPool) {
+            workerPool->stop();
+        }
+
+        // 等待接受线程结束
+#ifdef _WIN32
+        for (size_t i = 0; i < acceptThreads.size(); ++i) {
+            WaitForSingleObject(acceptThreads[i], 5000);
+            CloseHandle(acceptThreads[i]);
         }
 #else
-        for (size_t i = 0; i < clientThreads.size(); ++i) {
-            pthread_join(clientThreads[i], NULL);
+        for (size_t i = 0; i < acceptThreads.size(); ++i) {
+            pthread_join(acceptThreads[i], NULL);
         }
 #endif
-        clientThreads.clear();
+        acceptThreads.clear();
+#ifndef _WIN32
+        if (!handoff) {
+            closeListenSockets();
+        }
+#else
+        listenSockets.clear();
+#endif
         
+        if (workerPool) {
+            if (logger) {
+                logger->logInfo("工作线程池统计: " + workerPool->describeStats());
+            }
+            delete workerPool;
+            workerPool = 0;
+        }
+        unsigned long long threadsStopped = TimerWheel::nowMs();
+
+        // 全部线程已退出，用户数据不再变化
+        saveToFile();
+        unsigned long long saved = TimerWheel::nowMs();
+        if (userLog) {
+            userLog->close();
+            if (logger) {
+                logger->logInfo("数据日志统计: " + userLog->describeStats());
+            }
+            delete userLog;
+            userLog = 0;
+        }
+        if (snapshotWriter) {
+            if (logger) {
+                logger->logInfo("检查点统计: " + snapshotWriter->describeStats());
+            }
+            delete snapshotWriter;
+            snapshotWriter = 0;
+        }
+
+#ifdef __linux__
+        // 新进程在收到全部描述符后才加载用户数据，送出后只关闭本进程的副本
+        if (handoff) {
+            std::vector<SOCKET> tcpListeners(listenSockets.begin(), listenSockets.begin() + tcpListenerCount());
+            hotRestart->transfer(tcpListeners, localListenSocket, config.unixSocketPath,
+                                 shmListener, config.shmSocketPath);
+            closeListenSockets(false);
+            if (shmListener != INVALID_SOCKET) {
+                closesocket(shmListener);
+            }
+        }
+        delete hotRestart;      // 未移交时删除移交套接字文件
+        hotRestart = 0;
+        if (acceptWakeFd >= 0) {
+            close(acceptWakeFd);
+            acceptWakeFd = -1;
+        }
+#endif
+        unsigned long long handedOff = TimerWheel::nowMs();
+
         if (logger) {
+            std::stringstream timeoutInfo;
+            timeoutInfo << "超时关闭连接: 空闲 " << idleTimeouts.load() << "，登录 " << loginTimeouts.load()
+                        << "；发送队列超限关闭连接: " << outputOverflows.load();
+            logger->logInfo(timeoutInfo.str());
+            logger->logInfo("准入控制统计: " + describeAdmissionStats());
+
+            std::stringstream phaseInfo;
+            phaseInfo << "停止用时(ms): 停止接受 " << (acceptStopped - stopStart)
+                      << "，排空连接 " << (drainFinished - acceptStopped)
+                      << "，回收线程 " << (threadsStopped - drainFinished)
+                      << "，保存数据 " << (saved - threadsStopped);
+            if (handoff) {
+                phaseInfo << "，移交 " << (handedOff - saved);
+            }
+            phaseInfo << "，合计 " << (handedOff - stopStart);
+            if (forced > 0) {
+                phaseInfo << "；超过停止期限强制关闭连接 " << forced;
+            }
+            logger->logInfo(phaseInfo.str());
             logger->logServerEvent("服务器已停止");
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,209 @@
+/*
+ * TCP用户系统 - 线程绑定与NUMA放置实现
+ *
+ * 文件结构:
+ * 1. 拓扑读取 - 进程允许的CPU(sched_getaffinity)与/sys中各NUMA节点的CPU列表
+ * 2. 配置解析 - auto或"0-3,8"格式的CPU列表
+ * 3. 线程绑定 - sched_setaffinity + set_mempolicy(MPOL_LOCAL)
+ * 4. 放置报告
+ */
+
+#include "../Public/Thread_Placement.h"
+
+#ifdef __linux__
+
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+namespace {
+    const int MPOL_LOCAL_POLICY = 4;        // linux/mempolicy.h中的MPOL_LOCAL(3.8+)
+    const int MAX_REPORTED_THREADS = 16;    // 报告中逐个列出的线程数，其余只给出数量
+
+    // 读取单行文本文件
+    bool readLine(const std::string& path, std::string& line) {
+        std::ifstream file(path.c_str());
+        return file.is_open() && std::getline(file, line);
+    }
+
+    // 连续编号压缩为区间，如0,1,2,5 -> 0-2,5
+    std::string formatCpuList(const std::vector<int>& list) {
+        std::stringstream ss;
+        for (size_t i = 0; i < list.size();) {
+            size_t j = i;
+            while (j + 1 < list.size() && list[j + 1] == list[j] + 1) {
+                ++j;
+            }
+            if (i > 0) {
+                ss << ",";
+            }
+            ss << list[i];
+            if (j > i) {
+                ss << "-" << list[j];
+            }
+            i = j + 1;
+        }
+        return ss.str();
+    }
+}
+
+ThreadPlacement::ThreadPlacement() : nodeCount(0) {}
+
+// CPU列表 - 逗号分隔的编号或区间
+bool ThreadPlacement::parseCpuList(const std::string& text, std::vector<int>& result) {
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789-") != std::string::npos) {
+            return false;
+        }
+        size_t dash = item.find('-');
+        std::string lowText = item.substr(0, dash);
+        std::string highText = dash == std::string::npos ? lowText : item.substr(dash + 1);
+        if (lowText.empty() || highText.empty() || highText.find('-') != std::string::npos ||
+            lowText.length() > 5 || highText.length() > 5) {
+            return false;
+        }
+        int low = atoi(lowText.c_str());
+        int high = atoi(highText.c_str());
+        if (low > high || high >= CPU_SETSIZE) {
+            return false;
+        }
+        for (int cpu = low; cpu <= high; ++cpu) {
+            result.push_back(cpu);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return !result.empty();
+}
+
+// NUMA拓扑 - 没有/sys/devices/system/node(未启用NUMA的内核)时全部CPU视为节点0
+void ThreadPlacement::loadTopology() {
+    cpuNodes.assign(CPU_SETSIZE, -1);
+    nodeCount = 0;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.length() == 4 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            int node = atoi(name.c_str() + 4);
+            std::string line;
+            std::vector<int> nodeCpus;
+            if (!readLine("/sys/devices/system/node/" + name + "/cpulist", line) ||
+                !parseCpuList(line, nodeCpus)) {
+                continue;   // 没有CPU的节点(如纯内存节点)
+            }
+            for (size_t i = 0; i < nodeCpus.size(); ++i) {
+                cpuNodes[nodeCpus[i]] = node;
+            }
+            nodeCount = std::max(nodeCount, node + 1);
+        }
+        closedir(dir);
+    }
+    if (nodeCount == 0) {
+        cpuNodes.assign(CPU_SETSIZE, 0);
+        nodeCount = 1;
+    }
+}
+
+bool ThreadPlacement::configure(const std::string& spec, std::string& error) {
+    loadTopology();
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        error = "无法读取进程允许的CPU: " + std::string(strerror(errno));
+        return false;
+    }
+
+    std::vector<int> requested;
+    if (spec == "auto") {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            requested.push_back(cpu);
+        }
+    } else if (!parseCpuList(spec, requested)) {
+        error = "CPU列表格式错误: " + spec;
+        return false;
+    }
+
+    // 只保留进程允许运行的CPU(taskset/cgroup限制)
+    cpus.clear();
+    for (size_t i = 0; i < requested.size(); ++i) {
+        if (CPU_ISSET(requested[i], &allowed)) {
+            cpus.push_back(requested[i]);
+        }
+    }
+    if (cpus.empty()) {
+        error = "CPU列表中没有进程允许运行的CPU: " + spec;
+        return false;
+    }
+    return true;
+}
+
+int ThreadPlacement::nodeOf(int cpu) const {
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpuNodes.size()) {
+        return -1;
+    }
+    return cpuNodes[cpu];
+}
+
+// 绑定当前线程 - 先绑定CPU再改内存策略，之后的首次访问都在本节点分配
+bool ThreadPlacement::bindCurrentThread(int index, std::string& error) const {
+    int cpu = cpuFor(index);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        std::stringstream ss;
+        ss << "绑定CPU " << cpu << " 失败: " << strerror(errno);
+        error = ss.str();
+        return false;
+    }
+    if (nodeCount > 1 && syscall(SYS_set_mempolicy, MPOL_LOCAL_POLICY, NULL, 0) != 0) {
+        error = "设置本地内存分配策略失败: " + std::string(strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// 拓扑概况 - 参与绑定的CPU按节点分组
+std::string ThreadPlacement::describeTopology() const {
+    std::stringstream ss;
+    ss << "CPU " << formatCpuList(cpus) << "，NUMA节点 " << nodeCount << " (";
+    bool first = true;
+    for (int node = 0; node < nodeCount; ++node) {
+        std::vector<int> nodeCpus;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            if (nodeOf(cpus[i]) == node) {
+                nodeCpus.push_back(cpus[i]);
+            }
+        }
+        if (!nodeCpus.empty()) {
+            ss << (first ? "" : "; ") << "节点" << node << ": CPU " << formatCpuList(nodeCpus);
+            first = false;
+        }
+    }
+    ss << ")";
+    return ss.str();
+}
+
+// 某类线程的绑定 - 如"I/O循环 x4: 0->CPU0(节点0) 1->CPU1(节点0) ..."
+std::string ThreadPlacement::describeRole(const char* role, int count) const {
+    std::stringstream ss;
+    ss << role << " x" << count << ":";
+    for (int i = 0; i < count && i < MAX_REPORTED_THREADS; ++i) {
+        int cpu = cpuFor(i);
+        ss << " " << i << "->CPU" << cpu << "(节点" << nodeOf(cpu) << ")";
+    }
+    if (count > MAX_REPORTED_THREADS) {
+        ss << " ...(按序号轮流绑定)";
+    }
+    return ss.str();
+}
+
+#endif // __linux__
@@ -0,0 +1,161 @@
+/*
+ * TCP用户系统 - 分层时间轮实现
+ *
+ * 文件结构:
+ * 1. 节点插入/删除 - 按距当前刻度的差值选择层，按到期刻度的对应位选择槽
+ * 2. 刻度推进 - 逐刻度下沉高层槽并收集第0层到期节点；时间轮为空时直接跳到目标刻度
+ * 3. 等待时间 - 扫描第0层直到下一个非空槽或下沉边界
+ *
+ * 分层规则:
+ * - 差值d < 64时位于第0层槽(expires & 63)
+ * - 64^k <= d < 64^(k+1)时位于第k层槽((expires >> 6k) & 63)，
+ *   该槽在刻度推进到(expires >> 6k) << 6k时下沉，此时差值已小于64^k
+ * - 超出最高层范围的到期时间截断到最高层的最远刻度，由使用者在到期时重新计算
+ */
+
+#include "../Public/Timer_Wheel.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+TimerWheel::TimerWheel(unsigned tickMilliseconds)
+    : currentTick(0), startMs(nowMs()), tickMs(tickMilliseconds > 0 ? tickMilliseconds : 1), count(0) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            slots[level][slot].prev = &slots[level][slot];
+            slots[level][slot].next = &slots[level][slot];
+        }
+    }
+}
+
+// 单调时钟 - 不受系统时间调整影响
+unsigned long long TimerWheel::nowMs() {
+#ifdef _WIN32
+    return static_cast<unsigned long long>(GetTickCount64());
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000ULL + static_cast<unsigned long long>(ts.tv_nsec) / 1000000ULL;
+#endif
+}
+
+// 按到期刻度放入对应层的槽尾部
+void TimerWheel::link(TimerNode* node) {
+    if (node->expires <= currentTick) {
+        node->expires = currentTick + 1;
+    }
+    const unsigned long long range = 1ULL << (SLOT_BITS * LEVELS);
+    if (node->expires - currentTick >= range) {
+        node->expires = currentTick + range - 1;
+    }
+
+    unsigned long long delta = node->expires - currentTick;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    TimerNode* head = &slots[level][(node->expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::unlink(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = 0;
+    node->next = 0;
+}
+
+// 在单调时钟deadlineMs到期 - 换算为刻度时向上取整，保证不会提前到期
+void TimerWheel::schedule(TimerNode* node, unsigned long long deadlineMs) {
+    if (node->isLinked()) {
+        unlink(node);
+    } else {
+        ++count;
+    }
+    unsigned long long elapsed = deadlineMs > startMs ? deadlineMs - startMs : 0;
+    node->expires = (elapsed + tickMs - 1) / tickMs;
+    link(node);
+}
+
+void TimerWheel::cancel(TimerNode* node) {
+    if (node->isLinked()) {
+        unlink(node);
+        --count;
+    }
+}
+
+// 下沉第level层当前槽 - 节点按剩余差值重新放入更低的层
+void TimerWheel::cascade(int level) {
+    TimerNode* head = &slots[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    TimerNode* node = head->next;
+    head->prev = head;
+    head->next = head;
+
+    while (node != head) {
+        TimerNode* next = node->next;
+        link(node);
+        node = next;
+    }
+}
+
+// 推进到nowMs - 逐刻度处理，每个刻度先下沉到达边界的高层槽，再取出第0层当前槽
+void TimerWheel::advance(unsigned long long nowMs, std::vector<TimerNode*>& expired) {
+    unsigned long long target = nowMs > startMs ? (nowMs - startMs) / tickMs : 0;
+    if (count == 0) {
+        if (target > currentTick) {
+            currentTick = target;
+        }
+        return;
+    }
+
+    while (currentTick < target) {
+        ++currentTick;
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((currentTick & ((1ULL << (SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        TimerNode* head = &slots[0][currentTick & (SLOTS - 1)];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            unlink(node);
+            --count;
+            expired.push_back(node);
+        }
+        if (count == 0) {
+            currentTick = target;
+        }
+    }
+}
+
+// 距下一次需要推进的毫秒数 - 第0层下一个非空槽，或最近的下沉边界
+int TimerWheel::nextWaitMs(unsigned long long nowMs) const {
+    if (count == 0) {
+        return -1;
+    }
+
+    unsigned long long tick = currentTick + 1;
+    while ((tick & (SLOTS - 1)) != 0) {
+        const TimerNode* head = &slots[0][tick & (SLOTS - 1)];
+        if (head->next != head) {
+            break;
+        }
+        ++tick;
+    }
+
+    unsigned long long due = startMs + tick * tickMs;
+    if (due <= nowMs) {
+        return 0;
+    }
+    unsigned long long wait = due - nowMs;
+    return wait > 0x7FFFFFFFULL ? 0x7FFFFFFF : static_cast<int>(wait);
+}
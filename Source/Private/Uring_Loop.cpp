@@ -0,0 +1,908 @@
+/*
+ * TCP用户系统 - io_uring I/O后端实现
+ *
+ * 文件结构:
+ * 1. UringQueue - io_uring_setup/io_uring_enter封装与环形队列内存映射
+ * 2. UringLoop生命周期 - 初始化、提供缓冲环注册、线程启动与停止
+ * 3. 请求提交 - accept/recv/send/eventfd读取
+ * 4. 完成事件处理 - 新连接接管、接收数据分帧、发送续传、连接关闭
+ *
+ * 技术实现:
+ * - user_data高32位为操作类型，低32位为套接字描述符
+ * - 连接关闭采用两阶段: 先shutdown促使在途操作完成，全部完成后再关闭描述符，
+ *   避免内核仍引用已释放的发送缓冲
+ * - 不使用SQPOLL，SQE在io_uring_enter之前不会被内核读取
+ * - 会话超时: 时间轮给出下次检查时间，比在途超时请求更早时提交新的IORING_OP_TIMEOUT
+ * - 热重启移交: IORING_OP_ASYNC_CANCEL取消监听上的accept与连接上的recv(不能shutdown共用的套接字)，
+ *   recv取消完成、send完成且没有命令在执行线程中的连接连同未送出的数据移交
+ */
+
+#include "../Public/Uring_Loop.h"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <string.h>
+
+namespace {
+    const unsigned RING_ENTRIES = 1024;        // 提交队列深度
+    const unsigned BUFFER_COUNT = 512;         // 提供缓冲数量(必须为2的幂)
+    const unsigned BUFFER_SIZE = 4096;         // 单个接收缓冲大小
+    const unsigned short BUFFER_GROUP = 0;     // 缓冲组编号
+
+    // 完成事件类型 - 编码在user_data高32位
+    const uint64_t OP_ACCEPT = 1;
+    const uint64_t OP_RECV = 2;
+    const uint64_t OP_SEND = 3;
+    const uint64_t OP_WAKE = 4;
+    const uint64_t OP_TIMER = 5;
+    const uint64_t OP_CANCEL = 6;
+    const uint64_t OP_ACCEPT_RETRY = 7;
+
+    const int HANDOFF_RETRY_MS = 10;           // 热重启移交时重试仍有命令在执行的连接的间隔
+    const int ACCEPT_RETRY_MS = 10;            // accept持续失败后重新提交的间隔
+
+    uint64_t makeUserData(uint64_t op, int fd) {
+        return (op << 32) | static_cast<uint32_t>(fd);
+    }
+}
+
+// ==================== UringQueue ====================
+
+UringQueue::UringQueue()
+    : ringFd(-1), sqHead(0), sqTail(0), sqMask(0), sqEntries(0), sqArray(0), sqes(0),
+      cqHead(0), cqTail(0), cqMask(0), cqes(0),
+      sqRingPtr(0), sqRingSize(0), cqRingPtr(0), cqRingSize(0), sqesSize(0), pendingSubmit(0) {}
+
+UringQueue::~UringQueue() {
+    destroy();
+}
+
+// 创建io_uring实例并映射提交环、完成环和SQE数组
+bool UringQueue::setup(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ringFd < 0) {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        if (cqRingSize > sqRingSize) {
+            sqRingSize = cqRingSize;
+        }
+        cqRingSize = sqRingSize;
+    }
+
+    sqRingPtr = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd, IORING_OFF_SQ_RING);
+    if (sqRingPtr == MAP_FAILED) {
+        sqRingPtr = 0;
+        destroy();
+        return false;
+    }
+
+    if (singleMmap) {
+        cqRingPtr = sqRingPtr;
+    } else {
+        cqRingPtr = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd, IORING_OFF_CQ_RING);
+        if (cqRingPtr == MAP_FAILED) {
+            cqRingPtr = 0;
+            destroy();
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqesPtr = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd, IORING_OFF_SQES);
+    if (sqesPtr == MAP_FAILED) {
+        destroy();
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqesPtr);
+
+    char* sq = static_cast<char*>(sqRingPtr);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cqRingPtr);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+// 解除映射并关闭io_uring实例，内核会取消全部在途请求
+void UringQueue::destroy() {
+    if (sqes) {
+        munmap(sqes, sqesSize);
+        sqes = 0;
+    }
+    if (cqRingPtr && cqRingPtr != sqRingPtr) {
+        munmap(cqRingPtr, cqRingSize);
+    }
+    cqRingPtr = 0;
+    if (sqRingPtr) {
+        munmap(sqRingPtr, sqRingSize);
+        sqRingPtr = 0;
+    }
+    if (ringFd >= 0) {
+        close(ringFd);
+        ringFd = -1;
+    }
+}
+
+// 获取空闲SQE - 提交队列已满时先提交已填充的请求
+struct io_uring_sqe* UringQueue::getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    if (tail - head >= sqEntries) {
+        submitAndWait(0);
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= sqEntries) {
+            return NULL;
+        }
+    }
+
+    unsigned index = tail & sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pendingSubmit;
+    return sqe;
+}
+
+// 提交已填充的请求，并可选地等待至少waitCount个完成事件
+int UringQueue::submitAndWait(unsigned waitCount) {
+    unsigned flags = waitCount > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, pendingSubmit, waitCount, flags, NULL, 0));
+    if (submitted >= 0) {
+        pendingSubmit = static_cast<unsigned>(submitted) >= pendingSubmit ? 0 : pendingSubmit - submitted;
+    }
+    return submitted;
+}
+
+struct io_uring_cqe* UringQueue::peekCqe() {
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return NULL;
+    }
+    return &cqes[head & cqMask];
+}
+
+void UringQueue::advanceCq() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+// ==================== UringLoop ====================
+
+UringLoop::UringLoop(TCPUserSystemServer* owner, int index, SOCKET listener, SOCKET localListener)
+    : server(owner), loopIndex(index), listenSocket(listener), localListenSocket(localListener),
+      wakeFd(-1), wakeValue(0),
+      running(false), draining(false), drainStarted(false), handingOff(false), threadStarted(false),
+      bufferRing(0), bufferRingSize(0), bufferPool(0), bufferTail(0), multishotAccept(true), multishotRecv(true),
+      loopNowMs(TimerWheel::nowMs()), timerArmedMs(0), timerSequence(0) {
+    memset(&timerSpec, 0, sizeof(timerSpec));
+    memset(&acceptRetrySpec, 0, sizeof(acceptRetrySpec));
+}
+
+UringLoop::~UringLoop() {
+    stop();
+    ring.destroy();
+    if (bufferRing) {
+        munmap(bufferRing, bufferRingSize);
+    }
+    delete[] bufferPool;
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+// 初始化io_uring实例 - 任一步骤失败说明内核不支持，由服务器回退到epoll
+bool UringLoop::initialize() {
+    if (!ring.setup(RING_ENTRIES)) {
+        return false;
+    }
+    if (!setupBufferRing()) {
+        return false;
+    }
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    return wakeFd >= 0;
+}
+
+// 注册提供缓冲环(需要Linux 5.19+)
+bool UringLoop::setupBufferRing() {
+    bufferRingSize = BUFFER_COUNT * sizeof(struct io_uring_buf);
+    bufferRing = mmap(NULL, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufferRing == MAP_FAILED) {
+        bufferRing = 0;
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    reg.ring_entries = BUFFER_COUNT;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring.getFd(), IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return false;
+    }
+
+    bufferPool = new char[BUFFER_COUNT * BUFFER_SIZE];
+    for (unsigned i = 0; i < BUFFER_COUNT; ++i) {
+        recycleBuffer(static_cast<unsigned short>(i));
+    }
+    return true;
+}
+
+// 归还接收缓冲 - 缓冲环尾指针与bufs[0].resv字段重叠，只写addr/len/bid
+void UringLoop::recycleBuffer(unsigned short bufferId) {
+    struct io_uring_buf* bufs = static_cast<struct io_uring_buf*>(bufferRing);
+    struct io_uring_buf* buf = &bufs[bufferTail & (BUFFER_COUNT - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(bufferPool + static_cast<size_t>(bufferId) * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bufferId;
+    ++bufferTail;
+
+    unsigned short* tail = reinterpret_cast<unsigned short*>(static_cast<char*>(bufferRing) + 14);
+    __atomic_store_n(tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+bool UringLoop::start() {
+    running.store(true);
+    if (pthread_create(&thread, NULL, threadProc, this) != 0) {
+        running.store(false);
+        return false;
+    }
+    threadStarted = true;
+    return true;
+}
+
+// 热重启接管的会话 - 循环线程尚未启动，无需加锁
+void UringLoop::adoptSession(SimpleSharedPtr<ClientSession> session) {
+    adoptedSessions.push_back(session);
+}
+
+// 进入排空状态 - 由循环线程在下次唤醒时对全部连接发起关闭，热重启时改为移交
+void UringLoop::beginDrain(bool handoff) {
+    handingOff.store(handoff);
+    draining.store(true);
+    wakeup();
+}
+
+// 停止循环线程 - 线程退出前会关闭其管理的全部连接；未启动时关闭已分配给本循环的接管会话
+void UringLoop::stop() {
+    if (!threadStarted) {
+        for (size_t i = 0; i < adoptedSessions.size(); ++i) {
+            server->closeSession(adoptedSessions[i]);
+        }
+        adoptedSessions.clear();
+        return;
+    }
+    running.store(false);
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+    pthread_join(thread, NULL);
+    threadStarted = false;
+}
+
+void* UringLoop::threadProc(void* param) {
+    static_cast<UringLoop*>(param)->run();
+    return NULL;
+}
+
+// 请求发送 - 循环线程内直接记录，其他线程(如挤占通知)经eventfd转交
+void UringLoop::requestFlush(ClientSession* session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    if (threadStarted && pthread_equal(pthread_self(), thread)) {
+        dirtySockets.push_back(socket);
+        return;
+    }
+    {
+        SimpleLockGuard lock(remoteMutex);
+        remoteFlushes.push_back(socket);
+    }
+    wakeup();
+}
+
+// 关闭请求 - 由命令执行线程在会话的剩余命令执行完后调用
+void UringLoop::requestClose(ClientSession* session) {
+    SOCKET socket = session->getSocket();
+    if (socket == INVALID_SOCKET) {
+        return;
+    }
+    {
+        SimpleLockGuard lock(remoteMutex);
+        remoteCloses.push_back(std::make_pair(socket, session->getSessionId()));
+    }
+    wakeup();
+}
+
+void UringLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+// ---------- 请求提交 ----------
+
+void UringLoop::armAccept(SOCKET listener) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (multishotAccept) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+    sqe->user_data = makeUserData(OP_ACCEPT, listener);
+}
+
+void UringLoop::armAcceptRetry(SOCKET listener) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        armAccept(listener);
+        return;
+    }
+    acceptRetrySpec.tv_sec = 0;
+    acceptRetrySpec.tv_nsec = static_cast<long long>(ACCEPT_RETRY_MS) * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&acceptRetrySpec);
+    sqe->len = 1;
+    sqe->user_data = makeUserData(OP_ACCEPT_RETRY, listener);
+}
+
+// 接收请求不指定缓冲，由内核在数据到达时从缓冲组中选择
+void UringLoop::armRecv(SOCKET socket) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        beginClose(socket);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    if (multishotRecv) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    } else {
+        sqe->len = BUFFER_SIZE;
+    }
+    sqe->user_data = makeUserData(OP_RECV, socket);
+    connections[socket]->recvArmed = true;
+}
+
+void UringLoop::armWake() {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeValue);
+    sqe->len = sizeof(wakeValue);
+    sqe->user_data = makeUserData(OP_WAKE, wakeFd);
+}
+
+// 超时请求 - 只在时间轮的下次检查时间早于在途请求时提交，旧请求到期后按普通唤醒处理
+void UringLoop::armTimer() {
+    int wait = timers.nextWaitMs(loopNowMs);
+    if (drainStarted && handingOff.load() && (wait < 0 || wait > HANDOFF_RETRY_MS)) {
+        wait = HANDOFF_RETRY_MS;
+    }
+    if (wait < 0) {
+        return;
+    }
+    unsigned long long due = loopNowMs + static_cast<unsigned long long>(wait);
+    if (timerArmedMs != 0 && timerArmedMs <= due) {
+        return;
+    }
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        return;
+    }
+    timerSpec.tv_sec = wait / 1000;
+    timerSpec.tv_nsec = static_cast<long long>(wait % 1000) * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&timerSpec);
+    sqe->len = 1;
+    sqe->user_data = makeUserData(OP_TIMER, static_cast<int>(++timerSequence));
+    timerArmedMs = due;
+}
+
+// 取消在途请求 - 被取消的请求以-ECANCELED完成(多次触发请求不再带IORING_CQE_F_MORE)
+bool UringLoop::cancelRequest(uint64_t userData) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = makeUserData(OP_CANCEL, 0);
+    return true;
+}
+
+// 设置会话的超时定时器 - 未启用任何超时时不进入时间轮
+SessionTimeout UringLoop::scheduleTimeout(SimpleSharedPtr<ClientSession> session) {
+    unsigned long long deadline;
+    SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+    if (kind == SESSION_TIMEOUT_NONE && deadline > 0) {
+        timers.schedule(&session->getTimeoutTimer(), deadline);
+    }
+    return kind;
+}
+
+// 处理到期定时器 - 会话已超时则关闭，否则按新的期限重新计时
+void UringLoop::processTimeouts() {
+    expiredTimers.clear();
+    timers.advance(loopNowMs, expiredTimers);
+
+    for (size_t i = 0; i < expiredTimers.size(); ++i) {
+        ClientSession* expired = static_cast<ClientSession*>(expiredTimers[i]->context);
+        SOCKET socket = expired->getSocket();
+        if (socket == INVALID_SOCKET || static_cast<size_t>(socket) >= connections.size() ||
+            !connections[socket] || connections[socket]->session.get() != expired ||
+            connections[socket]->closing) {
+            continue;
+        }
+        SimpleSharedPtr<ClientSession> session = connections[socket]->session;
+
+        unsigned long long deadline;
+        SessionTimeout kind = server->checkSessionTimeout(*session, loopNowMs, deadline);
+        if (kind == SESSION_TIMEOUT_NONE) {
+            if (deadline > 0) {
+                timers.schedule(&session->getTimeoutTimer(), deadline);
+            }
+            continue;
+        }
+        server->recordSessionTimeout(session, kind);
+        closeOrDefer(socket);
+    }
+}
+
+// 提交发送 - 每个连接同时只有一个send在途，期间产生的响应在会话发送缓冲中累积
+void UringLoop::submitSend(SOCKET socket) {
+    Connection* conn = connections[socket];
+    if (conn->sendInflight) {
+        return;
+    }
+    if (conn->sendOffset >= conn->sending.length()) {
+        conn->sending.clear();
+        conn->sendOffset = 0;
+        SimpleLockGuard lock(conn->session->getOutputMutex());
+        conn->sending.swap(conn->session->getOutputBuffer());
+    }
+    if (conn->sending.empty()) {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        return;  // 队列暂满，下一轮循环重试
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = socket;
+    sqe->addr = reinterpret_cast<uint64_t>(conn->sending.data() + conn->sendOffset);
+    sqe->len = static_cast<unsigned>(conn->sending.length() - conn->sendOffset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = makeUserData(OP_SEND, socket);
+    conn->sendInflight = true;
+}
+
+// 提交本轮产生的全部发送请求
+void UringLoop::submitDirtySends() {
+    std::vector<SOCKET> sockets;
+    sockets.swap(dirtySockets);
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        SOCKET socket = sockets[i];
+        if (static_cast<size_t>(socket) < connections.size() && connections[socket]) {
+            submitSend(socket);
+        }
+    }
+}
+
+// ---------- 完成事件处理 ----------
+
+void UringLoop::handleCompletion(struct io_uring_cqe* cqe) {
+    uint64_t op = cqe->user_data >> 32;
+    int fd = static_cast<int>(cqe->user_data & 0xFFFFFFFFu);
+    int result = cqe->res;
+    unsigned flags = cqe->flags;
+
+    if (op == OP_ACCEPT) {
+        handleAccept(fd, result, flags);
+    } else if (op == OP_RECV) {
+        handleRecv(fd, result, flags);
+    } else if (op == OP_SEND) {
+        handleSend(fd, result);
+    } else if (op == OP_CANCEL) {
+        // 取消结果以被取消请求自身的完成事件为准
+    } else if (op == OP_ACCEPT_RETRY) {
+        if (running.load() && !draining.load()) {
+            armAccept(fd);
+        }
+    } else if (op == OP_TIMER) {
+        // 到期检查在本轮完成事件处理后统一进行
+        if (static_cast<unsigned>(fd) == timerSequence) {
+            timerArmedMs = 0;
+        }
+    } else if (op == OP_WAKE) {
+        std::vector<SOCKET> sockets;
+        std::vector<std::pair<SOCKET, std::string> > closes;
+        {
+            SimpleLockGuard lock(remoteMutex);
+            sockets.swap(remoteFlushes);
+            closes.swap(remoteCloses);
+        }
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            SOCKET socket = sockets[i];
+            if (static_cast<size_t>(socket) >= connections.size() || !connections[socket]) {
+                continue;
+            }
+            submitSend(socket);
+            // 被其他会话挤占的连接在通知送出后关闭(有响应等待提交时由提交后的requestClose关闭)
+            if (!connections[socket]->session->getIsActive() &&
+                !server->deferCloseUntilCommit(connections[socket]->session)) {
+                beginClose(socket);
+            }
+        }
+        // 会话ID不一致说明原连接已关闭、描述符已被新连接复用
+        for (size_t i = 0; i < closes.size(); ++i) {
+            SOCKET socket = closes[i].first;
+            if (static_cast<size_t>(socket) < connections.size() && connections[socket] &&
+                connections[socket]->session->getSessionId() == closes[i].second &&
+                !server->deferCloseUntilCommit(connections[socket]->session)) {
+                beginClose(socket);
+            }
+        }
+        if (running.load()) {
+            armWake();
+        }
+    }
+}
+
+// 新连接 - 创建会话并提交多次触发recv
+void UringLoop::handleAccept(SOCKET listener, int result, unsigned flags) {
+    bool rearm = !(flags & IORING_CQE_F_MORE);
+
+    if (result >= 0) {
+        SOCKET socket = result;
+        server->noteAcceptSuccess();
+        // 热重启时取消accept前已接受的连接同样移交给新进程
+        if (!running.load() || (draining.load() && !exportingSessions())) {
+            closesocket(socket);
+            return;
+        }
+
+        // 超过连接数上限时已回复并关闭，accept照常继续
+        if (server->admitConnection(socket)) {
+            sockaddr_storage clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
+            if (getpeername(socket, (sockaddr*)&clientAddr, &clientAddrLen) == 0) {
+                server->getLogger()->logInfo("新客户端连接: " + server->describeClientAddress(clientAddr));
+            }
+
+            if (listener == listenSocket) {
+                server->configureClientSocket(socket);
+            }
+
+            if (static_cast<size_t>(socket) >= connections.size()) {
+                connections.resize(socket + 1, 0);
+            }
+            Connection* conn = new Connection;
+            connections[socket] = conn;
+            conn->session = server->openSession(socket, false, this);
+            scheduleTimeout(conn->session);
+            if (!draining.load()) {
+                armRecv(socket);
+            }
+        }
+    } else if (result == -EINVAL && multishotAccept) {
+        multishotAccept = false;  // 内核不支持多次触发accept，降级为逐次提交
+        rearm = true;
+    } else if (rearm && running.load() && !draining.load() && server->handleAcceptFailure(listener, -result)) {
+        // 描述符耗尽时内核在分配描述符时就失败，立即重新提交只会空转
+        armAcceptRetry(listener);
+        rearm = false;
+    }
+
+    if (rearm && running.load() && !draining.load()) {
+        armAccept(listener);
+    }
+}
+
+// 接收完成 - 数据追加到会话接收缓冲后立即归还缓冲并分帧处理
+void UringLoop::handleRecv(SOCKET socket, int result, unsigned flags) {
+    Connection* conn = static_cast<size_t>(socket) < connections.size() ? connections[socket] : 0;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        unsigned short bufferId = static_cast<unsigned short>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (conn && result > 0 && !conn->closing) {
+            // 处理后残留的不完整帧不超过上限，环形缓冲总能容纳一个完整的提供缓冲
+            conn->session->getInputBuffer().append(bufferPool + static_cast<size_t>(bufferId) * BUFFER_SIZE,
+                                                   static_cast<size_t>(result));
+        }
+        recycleBuffer(bufferId);
+    }
+    if (!conn) {
+        return;
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+        conn->recvArmed = false;
+    }
+
+    if (conn->closing) {
+        finishCloseIfIdle(socket);
+        return;
+    }
+    if (draining.load()) {
+        return;     // 等待执行线程执行完剩余命令后关闭，期间收到的请求不再处理
+    }
+
+    if (result > 0) {
+        conn->session->touch(loopNowMs);
+        if (!server->processSessionInput(conn->session)) {
+            closeOrDefer(socket);
+            return;
+        }
+        // 未登录(含刚登出)的会话重新计时，使登录期限及时生效；持续发送请求却始终不登录的会话在此关闭
+        if (!conn->session->getTimeoutTimer().isLinked() || !conn->session->isLoggedIn()) {
+            SessionTimeout kind = scheduleTimeout(conn->session);
+            if (kind != SESSION_TIMEOUT_NONE) {
+                server->recordSessionTimeout(conn->session, kind);
+                closeOrDefer(socket);
+                return;
+            }
+        }
+    } else if (result == -EINVAL && multishotRecv && !conn->recvArmed) {
+        multishotRecv = false;  // 内核不支持多次触发recv，降级为逐次提交
+    } else if (result != -ENOBUFS) {
+        closeOrDefer(socket);  // 对端关闭或连接错误
+        return;
+    }
+
+    if (!conn->recvArmed) {
+        armRecv(socket);
+    }
+}
+
+// 发送完成 - 未写完的部分续传，写完后继续发送期间累积的响应
+void UringLoop::handleSend(SOCKET socket, int result) {
+    Connection* conn = static_cast<size_t>(socket) < connections.size() ? connections[socket] : 0;
+    if (!conn) {
+        return;
+    }
+    conn->sendInflight = false;
+
+    if (result < 0) {
+        conn->sending.clear();
+        conn->sendOffset = 0;
+        if (!conn->closing) {
+            beginClose(socket);
+        } else {
+            finishCloseIfIdle(socket);
+        }
+        return;
+    }
+
+    conn->sendOffset += static_cast<size_t>(result);
+    submitSend(socket);
+
+    if (conn->closing && !conn->sendInflight) {
+        shutdown(socket, SHUT_RDWR);  // 最后的响应已送出，促使在途recv完成
+        finishCloseIfIdle(socket);
+    }
+}
+
+// 开始关闭连接 - 先送出剩余响应，再shutdown让在途recv返回
+void UringLoop::beginClose(SOCKET socket) {
+    Connection* conn = connections[socket];
+    if (conn->closing) {
+        return;
+    }
+    conn->closing = true;
+    submitSend(socket);
+    if (!conn->sendInflight) {
+        shutdown(socket, SHUT_RDWR);
+    }
+    finishCloseIfIdle(socket);
+}
+
+// 关闭连接，若会话仍有命令在执行线程中则等其执行完后由requestClose关闭(期间不再提交recv)
+void UringLoop::closeOrDefer(SOCKET socket) {
+    if (!server->deferSessionClose(connections[socket]->session)) {
+        beginClose(socket);
+    }
+}
+
+// 全部在途操作完成后才真正关闭描述符并释放连接状态
+void UringLoop::finishCloseIfIdle(SOCKET socket) {
+    Connection* conn = connections[socket];
+    if (!conn || !conn->closing || conn->recvArmed || conn->sendInflight) {
+        return;
+    }
+    connections[socket] = 0;
+    timers.cancel(&conn->session->getTimeoutTimer());
+    server->closeSession(conn->session);
+    delete conn;
+}
+
+// 排空连接 - 全部连接送完剩余响应后关闭；仍有命令在执行线程中的连接由执行线程执行完后关闭
+// 热重启时监听套接字不会被shutdown，先取消其上的accept；连接由exportConnections逐个移交
+void UringLoop::drainConnections() {
+    if (drainStarted) {
+        return;
+    }
+    drainStarted = true;
+    if (handingOff.load()) {
+        cancelRequest(makeUserData(OP_ACCEPT, listenSocket));
+        if (localListenSocket != INVALID_SOCKET) {
+            cancelRequest(makeUserData(OP_ACCEPT, localListenSocket));
+        }
+        if (exportingSessions()) {
+            return;
+        }
+    }
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i] && !connections[i]->closing) {
+            // 排空开始前已读入接收缓冲的帧照常执行，其响应送出后再关闭
+            server->processSessionInput(connections[i]->session);
+            closeOrDefer(static_cast<SOCKET>(i));
+        }
+    }
+}
+
+bool UringLoop::exportingSessions() const {
+    return handingOff.load() && server->isExportingSessions();
+}
+
+// 移交连接 - 在途recv取消完成、send完成且没有命令在执行线程中时移交给新进程，不可移交的照常关闭
+void UringLoop::exportConnections() {
+    for (size_t i = 0; i < connections.size(); ++i) {
+        Connection* conn = connections[i];
+        SOCKET socket = static_cast<SOCKET>(i);
+        if (!conn || conn->closing) {
+            continue;
+        }
+        if (conn->recvArmed) {
+            if (!conn->cancelRequested) {
+                conn->cancelRequested = cancelRequest(makeUserData(OP_RECV, socket));
+            }
+            continue;
+        }
+        if (conn->sendInflight || server->hasPendingCommands(conn->session)) {
+            continue;
+        }
+
+        // 已从发送缓冲取出但未送出的部分放回缓冲开头，随会话一起移交(或由beginClose送出)
+        if (conn->sendOffset < conn->sending.length()) {
+            SimpleLockGuard lock(conn->session->getOutputMutex());
+            conn->session->getOutputBuffer().insert(0, conn->sending, conn->sendOffset, std::string::npos);
+        }
+        conn->sending.clear();
+        conn->sendOffset = 0;
+
+        if (!server->exportSession(conn->session)) {
+            beginClose(socket);
+            continue;
+        }
+        connections[i] = 0;
+        timers.cancel(&conn->session->getTimeoutTimer());
+        delete conn;
+    }
+}
+
+// 接管的会话 - 套接字中已有的请求由recv取得，旧进程未送出的响应提交send，接收缓冲中已有的完整请求直接处理
+void UringLoop::registerAdoptedSessions() {
+    for (size_t i = 0; i < adoptedSessions.size(); ++i) {
+        SimpleSharedPtr<ClientSession> session = adoptedSessions[i];
+        SOCKET socket = session->getSocket();
+        if (static_cast<size_t>(socket) >= connections.size()) {
+            connections.resize(socket + 1, 0);
+        }
+        Connection* conn = new Connection;
+        connections[socket] = conn;
+        conn->session = session;
+        scheduleTimeout(session);
+        dirtySockets.push_back(socket);
+        armRecv(socket);
+        if (connections[socket] && !conn->closing && session->getInputBuffer().size() > 0 &&
+            !server->processSessionInput(session)) {
+            closeOrDefer(socket);
+        }
+    }
+    adoptedSessions.clear();
+}
+
+// 循环退出 - 关闭全部连接并等待其在途操作完成
+void UringLoop::closeAllConnections() {
+    size_t remaining = 0;
+    for (size_t i = 0; i < connections.size(); ++i) {
+        if (connections[i]) {
+            beginClose(static_cast<SOCKET>(i));
+            if (connections[i]) {
+                shutdown(static_cast<SOCKET>(i), SHUT_RDWR);
+                ++remaining;
+            }
+        }
+    }
+
+    while (remaining > 0) {
+        if (ring.submitAndWait(1) < 0 && errno != EINTR) {
+            break;
+        }
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring.peekCqe()) != NULL) {
+            struct io_uring_cqe copy = *cqe;
+            ring.advanceCq();
+            handleCompletion(&copy);
+        }
+        remaining = 0;
+        for (size_t i = 0; i < connections.size(); ++i) {
+            if (connections[i]) {
+                ++remaining;
+            }
+        }
+    }
+}
+
+// 事件循环主体 - 提交累积的请求，等待并处理完成事件
+void UringLoop::run() {
+    server->bindCurrentThread(THREAD_ROLE_IO, loopIndex);
+    registerAdoptedSessions();
+    armWake();
+    armAccept(listenSocket);
+    if (localListenSocket != INVALID_SOCKET) {
+        armAccept(localListenSocket);
+    }
+
+    while (running.load()) {
+        submitDirtySends();
+        armTimer();
+        int ret = ring.submitAndWait(1);
+        if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            server->getLogger()->logError("io_uring_enter 失败，事件循环退出");
+            break;
+        }
+        loopNowMs = TimerWheel::nowMs();
+
+        struct io_uring_cqe* cqe;
+        while ((cqe = ring.peekCqe()) != NULL) {
+            struct io_uring_cqe copy = *cqe;
+            ring.advanceCq();
+            handleCompletion(&copy);
+        }
+        processTimeouts();
+        if (draining.load()) {
+            drainConnections();
+            if (exportingSessions()) {
+                exportConnections();
+            }
+        }
+    }
+
+    closeAllConnections();
+}
+
+#endif // __linux__
@@ -0,0 +1,564 @@
+/*
+ * TCP用户系统 - 分片模式(每核一分片)实现
+ *
+ * 文件结构:
+ * 1. 生命周期与统计
+ * 2. 请求分派 - 在会话所属分片上判断请求的执行位置: 本地命令、本分片用户、其他分片用户
+ * 3. 用户操作 - 在用户所在分片上执行，结果与直接调用TCPUserSystemServer的对应函数一致
+ * 4. 消息处理 - 收件队列中的请求、结果、挤占与登出通知
+ *
+ * 技术实现:
+ * - 会话状态(登录用户、排队请求)只由所属分片修改，用户数据与登录表只由用户所在分片修改
+ * - 会话有请求在其他分片执行时置commandScheduled，之后的请求保留帧后进入pendingCommands，
+ *   结果返回后依次继续执行；期间连接要求关闭则推迟到排队的请求执行完
+ * - 结果返回时会话可能已关闭(套接字与会话ID不再对应)，登录结果随即撤销，避免登录表残留
+ * - 修改用户数据时在写锁内追加预写日志记录；检查点依次持有各分片的写锁读取全部用户
+ */
+
+#include "../Public/User_Shard.h"
+#include "../Public/Event_Loop.h"
+
+#ifdef __linux__
+
+namespace {
+    const int MAX_INBOX_BATCH = 256;    // 单次唤醒最多处理的消息数，其余留到下一轮，避免饿死连接
+
+    // 需要在用户所在分片执行的命令 - 参数不足时按本地命令处理，由服务器回复参数不足
+    struct ShardCommand {
+        const char* name;
+        size_t minParameters;
+        ShardOperation operation;
+    };
+
+    const ShardCommand shardCommands[] = {
+        { "REGISTER",        2, SHARD_OP_REGISTER },
+        { "LOGIN",           2, SHARD_OP_LOGIN },
+        { "FORCE_LOGIN",     3, SHARD_OP_FORCE_LOGIN },
+        { "DELETE",          2, SHARD_OP_DELETE },
+        { "CHANGE_PASSWORD", 2, SHARD_OP_CHANGE_PASSWORD },
+        { "SET_STRING",      1, SHARD_OP_SET_STRING },
+        { "GET_STRING",      0, SHARD_OP_GET_STRING },
+    };
+
+    bool findShardCommand(const ProtocolMessage& msg, ShardOperation& operation) {
+        if (msg.shed) {
+            return false;
+        }
+        for (size_t i = 0; i < sizeof(shardCommands) / sizeof(shardCommands[0]); ++i) {
+            if (msg.command == shardCommands[i].name) {
+                operation = shardCommands[i].operation;
+                return msg.parameterCount >= shardCommands[i].minParameters;
+            }
+        }
+        return false;
+    }
+
+    bool isSuccess(const std::string& response) {
+        return response.find("SUCCESS") != std::string::npos;
+    }
+
+    // 操作日志 - 操作名与结果描述同TCPUserSystemServer的execute*函数
+    void logOperation(ServerLogger* logger, const ShardMessage& reply) {
+        const std::string& response = reply.response;
+        switch (reply.operation) {
+        case SHARD_OP_REGISTER:
+            logger->logUserOperation(reply.sessionId, reply.userId, "REGISTER", isSuccess(response) ? "成功" : "失败");
+            break;
+        case SHARD_OP_LOGIN:
+            logger->logUserOperation(reply.sessionId, reply.userId, "LOGIN", isSuccess(response) ? "成功" :
+                                     (response.find("CONFLICT") != std::string::npos ? "冲突" : "失败"));
+            break;
+        case SHARD_OP_FORCE_LOGIN: {
+            bool forceLogin = reply.arguments[1] == "Y" || reply.arguments[1] == "y";
+            logger->logUserOperation(reply.sessionId, reply.userId, "FORCE_LOGIN",
+                                     std::string(isSuccess(response) ? "成功" : "失败") + (forceLogin ? "(强制)" : "(取消)"));
+            break;
+        }
+        case SHARD_OP_DELETE:
+            logger->logUserOperation(reply.sessionId, reply.userId, "DELETE", isSuccess(response) ? "成功" : "失败");
+            break;
+        case SHARD_OP_CHANGE_PASSWORD:
+            logger->logUserOperation(reply.sessionId, reply.sessionUser, "CHANGE_PASSWORD", isSuccess(response) ? "成功" : "失败");
+            break;
+        case SHARD_OP_SET_STRING:
+            logger->logUserOperation(reply.sessionId, reply.sessionUser, "SET_STRING", "设置用户字符串");
+            break;
+        case SHARD_OP_GET_STRING:
+            logger->logUserOperation(reply.sessionId, reply.sessionUser, "GET_STRING", "查看用户字符串");
+            break;
+        }
+    }
+}
+
+UserShard::UserShard(TCPUserSystemServer* owner, int shardIndex, const std::vector<UserShard*>* allShards, EventLoop* ownerLoop)
+    : server(owner), index(shardIndex), peers(allShards), loop(ownerLoop), snapshot(&users, &writeMutex), wakePending(0), mappedPending(0),
+      localOperations(0), forwardedOperations(0), servedOperations(0), kicksSent(0), wakeups(0) {}
+
+// 全部循环线程退出后释放未处理的消息
+UserShard::~UserShard() {
+    while (ShardMessage* message = inbox.pop()) {
+        if (message->type == SHARD_REQUEST || message->type == SHARD_REPLY) {
+            server->releaseRequest(message->requestBytes);
+        }
+        delete message;
+    }
+}
+
+// 用户所属分片 - FNV-1a哈希
+int UserShard::shardOf(const std::string& userId, size_t shardCount) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < userId.length(); ++i) {
+        hash ^= static_cast<unsigned char>(userId[i]);
+        hash *= 16777619u;
+    }
+    return static_cast<int>(hash % shardCount);
+}
+
+UserShard* UserShard::shardFor(const std::string& userId) const {
+    return (*peers)[shardOf(userId, peers->size())];
+}
+
+// 热重启接管的已登录会话 - 循环线程启动前登记到登录表
+void UserShard::adoptLogin(const std::string& userId, int homeShard, SOCKET socket, const std::string& sessionId) {
+    Owner owner;
+    owner.shard = homeShard;
+    owner.socket = socket;
+    owner.sessionId = sessionId;
+    owners[userId] = owner;
+}
+
+// 在循环线程上重建用户表与登录表 - 绑定CPU后调用，节点与字符串按首次写入在本NUMA节点分配；
+// 检查点线程可能正在读取users，交换在写锁内进行，旧表在锁外释放
+void UserShard::localize() {
+    std::map<std::string, Owner> localOwners(owners.begin(), owners.end());
+    owners.swap(localOwners);
+    SimpleLockGuard lock(writeMutex);       // 检查点线程可能正在复制映射的数据文件
+    std::map<std::string, User> localUsers(users.begin(), users.end());
+    users.swap(localUsers);
+}
+
+// 查找本分片的用户 - 映射的数据文件全部复制之后只有本线程修改users，无需加锁；
+// 之前检查点线程也在写入，查找与认领都在写锁内
+std::map<std::string, User>::iterator UserShard::findUser(const std::string& userId) {
+    if (!__atomic_load_n(&mappedPending, __ATOMIC_ACQUIRE)) {
+        return users.find(userId);
+    }
+    SimpleLockGuard lock(writeMutex);
+    std::map<std::string, User>::iterator it = users.find(userId);
+    User user;
+    if (it == users.end() && server->claimMappedUser(userId, user)) {
+        it = users.insert(std::make_pair(userId, user)).first;
+    }
+    return it;
+}
+
+void UserShard::setMappedPending(bool pending) {
+    __atomic_store_n(&mappedPending, pending ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+// 投递消息 - 消费者尚未被唤醒时才写eventfd，同一批消息只唤醒一次
+void UserShard::post(ShardMessage* message) {
+    inbox.push(message);
+    if (__atomic_exchange_n(&wakePending, 1, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_add_fetch(&wakeups, 1ULL, __ATOMIC_RELAXED);
+        loop->wakeup();
+    }
+}
+
+// 按序执行会话的一条请求 - 已有请求在其他分片执行时排队
+void UserShard::submit(SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg) {
+    if (session->isCommandScheduled()) {
+        msg.retain();
+        session->getPendingCommands().push_back(ProtocolMessage());
+        session->getPendingCommands().back().swap(msg);
+        return;
+    }
+    dispatch(session, msg);
+}
+
+// 分派请求 - 会话命令与参数错误在本地处理；用户操作在用户所在分片执行
+void UserShard::dispatch(SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg) {
+    ShardMessage request;
+    if (!findShardCommand(msg, request.operation)) {
+        std::string previousUser = session->getLoggedInUser();
+        server->processClientMessage(session, msg);
+        if (!previousUser.empty() && !session->isLoggedIn()) {
+            notifyLogout(previousUser, session->getSessionId());    // LOGOUT
+        }
+        server->finishRequest(msg);
+        return;
+    }
+
+    std::string response;
+    if (!buildRequest(*session, msg, request, response)) {
+        request.response = response;
+        logOperation(server->getLogger(), request);
+        server->sendToSession(session, response);
+        server->finishRequest(msg);
+        return;
+    }
+
+    UserShard* target = shardFor(request.userId);
+    if (target == this) {
+        ++localOperations;
+        execute(request);
+        if (request.effect == SHARD_EFFECT_LOGIN) {
+            session->setLoggedInUser(request.userId);
+        } else if (request.effect == SHARD_EFFECT_LOGOUT) {
+            session->setLoggedInUser("");
+        }
+        if (!server->holdForCommit(session, server->takeCommitSeq())) {
+            request.response = PERSIST_FAILED_RESPONSE;
+        }
+        logOperation(server->getLogger(), request);
+        server->sendToSession(session, request.response);
+        server->finishRequest(msg);
+        return;
+    }
+
+    ++forwardedOperations;
+    session->setCommandScheduled(true);
+    target->post(new ShardMessage(request));
+}
+
+// 填写请求 - 只依赖会话状态的检查在所属分片完成，错误信息与服务器的对应函数一致
+bool UserShard::buildRequest(ClientSession& session, const ProtocolMessage& msg, ShardMessage& request,
+                             std::string& response) {
+    request.type = SHARD_REQUEST;
+    request.homeShard = index;
+    request.socket = session.getSocket();
+    request.sessionId = session.getSessionId();
+    request.sessionUser = session.getLoggedInUser();
+    request.requestBytes = msg.frameSize();
+
+    switch (request.operation) {
+    case SHARD_OP_LOGIN:
+    case SHARD_OP_FORCE_LOGIN:
+        request.userId = msg.parameters[0].str();
+        request.arguments[0] = msg.parameters[1].str();
+        if (request.operation == SHARD_OP_FORCE_LOGIN) {
+            request.arguments[1] = msg.parameters[2].str();
+        }
+        if (session.isLoggedIn()) {
+            response = "ERROR|当前会话已有用户登录";
+            return false;
+        }
+        return true;
+    case SHARD_OP_REGISTER:
+    case SHARD_OP_DELETE:
+        request.userId = msg.parameters[0].str();
+        request.arguments[0] = msg.parameters[1].str();
+        return true;
+    case SHARD_OP_CHANGE_PASSWORD:
+    case SHARD_OP_SET_STRING:
+    case SHARD_OP_GET_STRING:
+        request.userId = request.sessionUser;
+        if (!session.isLoggedIn()) {
+            response = "ERROR|请先登录";
+            return false;
+        }
+        if (request.operation == SHARD_OP_CHANGE_PASSWORD) {
+            if (msg.parameters[0].empty() || msg.parameters[1].empty()) {
+                response = "ERROR|密码不能为空";
+                return false;
+            }
+            request.arguments[1] = msg.parameters[1].str();
+        }
+        if (request.operation != SHARD_OP_GET_STRING) {
+            request.arguments[0] = msg.parameters[0].str();
+        }
+        return true;
+    }
+    return false;
+}
+
+// 执行用户操作 - 只在用户所在分片的循环线程中调用；修改用户数据与追加日志记录时持有写锁
+void UserShard::execute(ShardMessage& request) {
+    std::map<std::string, User>::iterator it = findUser(request.userId);
+    request.effect = SHARD_EFFECT_NONE;
+
+    switch (request.operation) {
+    case SHARD_OP_REGISTER:
+        if (it != users.end()) {
+            request.response = "ERROR|用户ID已存在";
+        } else if (request.userId.empty() || request.arguments[0].empty()) {
+            request.response = "ERROR|用户ID和密码不能为空";
+        } else if (!server->acceptsUserWrites()) {
+            request.response = PERSIST_FAILED_RESPONSE;
+        } else {
+            {
+                SimpleLockGuard lock(writeMutex);
+                snapshot.beforeWrite(request.userId);
+                User& user = users[request.userId];
+                user = User(request.userId, request.arguments[0]);
+                server->logUserUpdate(user);
+            }
+            request.response = "SUCCESS|用户注册成功";
+        }
+        return;
+
+    case SHARD_OP_LOGIN:
+    case SHARD_OP_FORCE_LOGIN: {
+        if (it == users.end()) {
+            request.response = "ERROR|用户不存在";
+            return;
+        }
+        if (!it->second.verifyPassword(request.arguments[0])) {
+            request.response = "ERROR|密码错误";
+            return;
+        }
+        std::map<std::string, Owner>::iterator owner = owners.find(request.userId);
+        if (owner != owners.end()) {
+            if (request.operation == SHARD_OP_LOGIN) {
+                request.response = "CONFLICT|用户已在其他客户端登录|" + owner->second.sessionId + "|是否挤占下线？(Y/N)";
+                return;
+            }
+            if (request.arguments[1] != "Y" && request.arguments[1] != "y") {
+                request.response = "ERROR|登录已取消";
+                return;
+            }
+
+            // 挤占通知交给原会话的所属分片，由它清除登录状态并关闭连接
+            ShardMessage* kick = new ShardMessage();
+            kick->type = SHARD_KICK;
+            kick->socket = owner->second.socket;
+            kick->sessionId = owner->second.sessionId;
+            kick->userId = request.userId;
+            if (owner->second.shard == index) {
+                applyKick(*kick);
+                delete kick;
+            } else {
+                ++kicksSent;
+                (*peers)[owner->second.shard]->post(kick);
+            }
+        }
+
+        Owner& entry = owners[request.userId];
+        entry.shard = request.homeShard;
+        entry.socket = request.socket;
+        entry.sessionId = request.sessionId;
+        request.effect = SHARD_EFFECT_LOGIN;
+        request.response = request.operation == SHARD_OP_LOGIN ? "SUCCESS|登录成功" : "SUCCESS|登录成功，已挤占原会话";
+        return;
+    }
+
+    case SHARD_OP_DELETE:
+        if (it == users.end()) {
+            request.response = "ERROR|用户不存在";
+            return;
+        }
+        if (!it->second.verifyPassword(request.arguments[0])) {
+            request.response = "ERROR|密码错误";
+            return;
+        }
+        if (!server->acceptsUserWrites()) {
+            request.response = PERSIST_FAILED_RESPONSE;
+            return;
+        }
+        // 删除的是当前登录用户时先登出；其他会话上的登录保持不变(与非分片模式一致)
+        if (request.sessionUser == request.userId) {
+            request.effect = SHARD_EFFECT_LOGOUT;
+            releaseOwner(request.userId, request.sessionId);
+        }
+        {
+            SimpleLockGuard lock(writeMutex);
+            snapshot.beforeWrite(request.userId);
+            users.erase(it);
+            server->logUserDelete(request.userId);
+        }
+        request.response = "SUCCESS|用户注销成功";
+        return;
+
+    case SHARD_OP_CHANGE_PASSWORD:
+        if (it == users.end()) {
+            request.response = "ERROR|用户不存在";
+            return;
+        }
+        if (!it->second.verifyPassword(request.arguments[0])) {
+            request.response = "ERROR|旧密码错误";
+            return;
+        }
+        if (!server->acceptsUserWrites()) {
+            request.response = PERSIST_FAILED_RESPONSE;
+            return;
+        }
+        {
+            SimpleLockGuard lock(writeMutex);
+            snapshot.beforeWrite(request.userId);
+            it->second.setPassword(request.arguments[1]);
+            server->logUserUpdate(it->second);
+        }
+        request.response = "SUCCESS|密码修改成功";
+        return;
+
+    case SHARD_OP_SET_STRING:
+        if (it == users.end()) {
+            request.response = "ERROR|用户不存在";
+            return;
+        }
+        if (!server->acceptsUserWrites()) {
+            request.response = PERSIST_FAILED_RESPONSE;
+            return;
+        }
+        {
+            SimpleLockGuard lock(writeMutex);
+            snapshot.beforeWrite(request.userId);
+            it->second.setUserString(request.arguments[0]);
+            server->logUserUpdate(it->second);
+        }
+        request.response = "SUCCESS|用户字符串已更新";
+        return;
+
+    case SHARD_OP_GET_STRING:
+        if (it == users.end()) {
+            request.response = "ERROR|用户不存在";
+            return;
+        }
+        request.response = "SUCCESS|" + it->second.getUserString();
+        return;
+    }
+}
+
+// 处理收件队列 - 先清除唤醒标志再读取，之后入队的消息会再次唤醒本分片
+void UserShard::processInbox() {
+    __atomic_exchange_n(&wakePending, 0, __ATOMIC_SEQ_CST);
+
+    for (int processed = 0; processed < MAX_INBOX_BATCH; ++processed) {
+        ShardMessage* message = inbox.pop();
+        if (!message) {
+            return;
+        }
+        switch (message->type) {
+        case SHARD_REQUEST:
+            ++servedOperations;
+            execute(*message);
+            message->commitSeq = server->takeCommitSeq();
+            message->type = SHARD_REPLY;
+            (*peers)[message->homeShard]->post(message);
+            continue;
+        case SHARD_REPLY:
+            applyReply(*message);
+            break;
+        case SHARD_KICK:
+            applyKick(*message);
+            break;
+        case SHARD_LOGOUT:
+            releaseOwner(message->userId, message->sessionId);
+            break;
+        }
+        delete message;
+    }
+    loop->wakeup();     // 本批未处理完，下一轮继续
+}
+
+// 应用结果 - 会话已关闭时撤销登录并释放准入计数；否则更新登录状态、送出响应并继续执行排队的请求
+void UserShard::applyReply(ShardMessage& reply) {
+    SimpleSharedPtr<ClientSession> session = loop->findSession(reply.socket, reply.sessionId);
+    if (!session) {
+        if (reply.effect == SHARD_EFFECT_LOGIN) {
+            notifyLogout(reply.userId, reply.sessionId);
+        }
+        server->releaseRequest(reply.requestBytes);
+        return;
+    }
+
+    if (reply.effect == SHARD_EFFECT_LOGIN) {
+        session->setLoggedInUser(reply.userId);
+    } else if (reply.effect == SHARD_EFFECT_LOGOUT) {
+        session->setLoggedInUser("");
+    }
+    if (!server->holdForCommit(session, reply.commitSeq)) {
+        reply.response = PERSIST_FAILED_RESPONSE;
+    }
+    logOperation(server->getLogger(), reply);
+    server->sendToSession(session, reply.response);
+    server->releaseRequest(reply.requestBytes);
+
+    session->setCommandScheduled(false);
+    drainPending(session);
+}
+
+// 继续执行排队的请求，直到又有请求发往其他分片；会话已结束或要求关闭时释放剩余请求并关闭连接
+void UserShard::drainPending(SimpleSharedPtr<ClientSession> session) {
+    std::deque<ProtocolMessage>& pending = session->getPendingCommands();
+    server->corkSession(session);
+    while (!pending.empty() && !session->isCommandScheduled() && session->getIsActive()) {
+        ProtocolMessage msg;
+        msg.swap(pending.front());
+        pending.pop_front();
+        dispatch(session, msg);
+    }
+    server->uncorkSession(session);
+
+    if (session->isCommandScheduled()) {
+        return;
+    }
+    if (!session->getIsActive() || session->isCloseDeferred()) {
+        for (size_t i = 0; i < pending.size(); ++i) {
+            server->finishRequest(pending[i]);
+        }
+        pending.clear();
+        loop->requestClose(session.get());
+    }
+}
+
+// 挤占 - 会话仍以该用户登录时清除登录状态，送出通知后关闭连接
+void UserShard::applyKick(const ShardMessage& kick) {
+    SimpleSharedPtr<ClientSession> session = loop->findSession(kick.socket, kick.sessionId);
+    if (!session || session->getLoggedInUser() != kick.userId) {
+        return;
+    }
+    session->setLoggedInUser("");
+    session->setInactive();
+    server->notifyAndClose(session, "KICKED|您的账号在其他地方登录，连接已断开");
+    std::cout << "[服务器] 用户 " << kick.userId << " 被新会话挤占下线，原会话ID: "
+              << kick.sessionId.substr(0, 8) << std::endl;
+}
+
+// 清除登录表 - 只在记录的仍是该会话时清除(之后的登录可能已覆盖)
+void UserShard::releaseOwner(const std::string& userId, const std::string& sessionId) {
+    std::map<std::string, Owner>::iterator owner = owners.find(userId);
+    if (owner != owners.end() && owner->second.sessionId == sessionId) {
+        owners.erase(owner);
+    }
+}
+
+void UserShard::notifyLogout(const std::string& userId, const std::string& sessionId) {
+    UserShard* target = shardFor(userId);
+    if (target == this) {
+        releaseOwner(userId, sessionId);
+        return;
+    }
+    ShardMessage* notice = new ShardMessage();
+    notice->type = SHARD_LOGOUT;
+    notice->userId = userId;
+    notice->sessionId = sessionId;
+    target->post(notice);
+}
+
+// 会话结束 - 排队未执行的请求释放准入计数，已登录时通知用户所在分片
+void UserShard::sessionClosed(ClientSession& session) {
+    std::deque<ProtocolMessage>& pending = session.getPendingCommands();
+    for (size_t i = 0; i < pending.size(); ++i) {
+        server->finishRequest(pending[i]);
+    }
+    pending.clear();
+    if (session.isLoggedIn()) {
+        notifyLogout(session.getLoggedInUser(), session.getSessionId());
+    }
+}
+
+void UserShard::beginSnapshot() {
+    SimpleLockGuard lock(writeMutex);
+    snapshot.begin();
+}
+
+std::string UserShard::describeStats() {
+    std::stringstream ss;
+    ss << "分片" << index << ": 用户 " << users.size() << "，本地执行 " << localOperations
+       << "，转发 " << forwardedOperations << "，代执行 " << servedOperations
+       << "，挤占通知 " << kicksSent << "，唤醒 " << __atomic_load_n(&wakeups, __ATOMIC_RELAXED);
+    return ss.str();
+}
+
+#endif // __linux__
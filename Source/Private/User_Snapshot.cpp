@@ -0,0 +1,398 @@
+/*
+ * TCP用户系统 - 用户表快照与后台检查点实现
+ *
+ * 文件结构:
+ * 1. 快照 - 开始、修改前保留旧版本、按用户ID顺序分块读取
+ * 2. fork快照 - 创建子进程、子进程写出、父进程等待并取回统计
+ * 3. 后台检查点线程 - 等待请求，执行服务器的检查点并记录统计
+ */
+
+#include "../Public/User_Snapshot.h"
+#include "../Public/Write_Ahead_Log.h"
+#include "../Public/Mapped_Snapshot.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#endif
+
+void UserTableSnapshot::begin() {
+    active = true;
+    started = false;
+    cursor.clear();
+    preserved.clear();
+}
+
+// 修改前保留旧版本 - 只保留快照时刻的内容，同一用户之后的修改不再覆盖
+void UserTableSnapshot::beforeWrite(const std::string& userId) {
+    if (!active || (started && userId <= cursor) || preserved.find(userId) != preserved.end()) {
+        return;
+    }
+    PreservedUser& entry = preserved[userId];
+    std::map<std::string, User>::const_iterator it = table->find(userId);
+    entry.existed = it != table->end();
+    if (entry.existed) {
+        entry.user = it->second;
+    }
+}
+
+// 分块读取 - 按用户ID合并表中的当前内容与保留的旧版本，保留的旧版本优先
+bool UserTableSnapshot::readChunk(std::string& out, size_t maxRecords, SnapshotStats& stats) {
+    SimpleLockGuard lock(*tableMutex);
+    if (!active) {
+        return true;
+    }
+
+    std::map<std::string, User>::const_iterator live = started ? table->upper_bound(cursor) : table->begin();
+    std::map<std::string, PreservedUser>::iterator kept = preserved.begin();
+    for (size_t processed = 0; processed < maxRecords; ++processed) {
+        bool haveLive = live != table->end();
+        bool haveKept = kept != preserved.end();
+        if (!haveLive && !haveKept) {
+            active = false;
+            preserved.clear();
+            return true;
+        }
+
+        if (haveKept && (!haveLive || kept->first <= live->first)) {
+            if (haveLive && live->first == kept->first) {
+                ++live;
+            }
+            if (kept->second.existed) {
+                SnapshotFileWriter::encode(kept->second.user, out);
+                ++stats.records;
+                ++stats.preserved;
+            }
+            cursor = kept->first;
+            preserved.erase(kept++);
+        } else {
+            SnapshotFileWriter::encode(live->second, out);
+            ++stats.records;
+            cursor = live->first;
+            ++live;
+        }
+        started = true;
+    }
+    return false;
+}
+
+#ifdef __linux__
+// 子进程经管道交给父进程的结果
+struct ForkedSnapshotResult {
+    unsigned long long ok;
+    unsigned long long records;
+    unsigned long long bytes;
+    unsigned long long cowBytes;
+};
+
+ForkedSnapshot::~ForkedSnapshot() {
+    if (resultPipe >= 0) {
+        close(resultPipe);
+    }
+    if (child > 0) {
+        while (waitpid(child, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+// 创建子进程 - 调用者持有全部用户表的锁，父进程只等待fork本身
+bool ForkedSnapshot::start(const std::vector<const std::map<std::string, User>*>& tables, const std::string& tempFile,
+                           bool durable, SnapshotStats& stats) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+
+    unsigned long long startMs = TimerWheel::nowMs();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runChild(tables, tempFile, durable, fds[1]);   // 不返回
+    }
+    stats.forked = true;
+    stats.forkMs = TimerWheel::nowMs() - startMs;
+
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return false;
+    }
+    child = pid;
+    resultPipe = fds[0];
+    return true;
+}
+
+// 子进程 - 只有本线程存活，其他线程持有的锁可能永远不会释放，因此不使用日志与任何共享锁；
+// 用户表的锁由父进程持有，子进程直接读取fork时刻的内容
+void ForkedSnapshot::runChild(const std::vector<const std::map<std::string, User>*>& tables,
+                              const std::string& tempFile, bool durable, int resultFd) {
+    // 停止信号由父进程处理，父进程停止时会等待本次写出；父进程意外退出时子进程随之结束
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    // 关闭继承的套接字等描述符，父进程关闭连接时不会因子进程仍持有而推迟
+    std::vector<int> inherited;
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            int fd = atoi(entry->d_name);
+            if (fd > 2 && fd != resultFd && fd != dirfd(dir)) {
+                inherited.push_back(fd);
+            }
+        }
+        closedir(dir);
+    }
+    for (size_t i = 0; i < inherited.size(); ++i) {
+        close(inherited[i]);
+    }
+
+    ForkedSnapshotResult result;
+    memset(&result, 0, sizeof(result));
+    SnapshotFileWriter file;
+    bool written = file.open(tempFile);
+    std::string chunk;
+    for (size_t t = 0; written && t < tables.size(); ++t) {
+        std::map<std::string, User>::const_iterator it;
+        for (it = tables[t]->begin(); it != tables[t]->end(); ++it) {
+            SnapshotFileWriter::encode(it->second, chunk);
+            if (++result.records % SNAPSHOT_CHUNK_RECORDS == 0) {
+                file.write(chunk);
+                chunk.clear();
+            }
+        }
+    }
+    if (written) {
+        file.write(chunk);
+        written = file.finish() && (!durable || WriteAheadLog::syncPath(tempFile));
+        result.bytes = file.getBytes();
+    }
+
+    result.ok = written ? 1 : 0;
+    result.cowBytes = privateDirtyBytes();
+    ssize_t sent = write(resultFd, &result, sizeof(result));    // 小于PIPE_BUF，一次写完
+    _exit(written && sent == static_cast<ssize_t>(sizeof(result)) ? 0 : 1);
+}
+
+// 本进程的私有脏页 - 子进程中即fork之后被复制(或新分配)的页，内核不支持smaps_rollup时为0
+unsigned long long ForkedSnapshot::privateDirtyBytes() {
+    FILE* smaps = fopen("/proc/self/smaps_rollup", "r");
+    if (!smaps) {
+        return 0;
+    }
+    unsigned long long totalKb = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), smaps)) {
+        unsigned long long kb;
+        if (sscanf(line, "Private_Dirty: %llu kB", &kb) == 1) {
+            totalKb += kb;
+        }
+    }
+    fclose(smaps);
+    return totalKb * 1024ULL;
+}
+
+// 等待子进程 - 结果不完整或退出状态非0都视为写出失败
+bool ForkedSnapshot::wait(SnapshotStats& stats) {
+    ForkedSnapshotResult result;
+    memset(&result, 0, sizeof(result));
+    size_t received = 0;
+    while (received < sizeof(result)) {
+        ssize_t n = read(resultPipe, reinterpret_cast<char*>(&result) + received, sizeof(result) - received);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        received += static_cast<size_t>(n);
+    }
+    close(resultPipe);
+    resultPipe = -1;
+
+    int status = 0;
+    while (waitpid(child, &status, 0) < 0 && errno == EINTR) {
+    }
+    child = -1;
+
+    if (received != sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !result.ok) {
+        return false;
+    }
+    stats.records += result.records;
+    stats.bytes += result.bytes;
+    stats.cowBytes = result.cowBytes;
+    return true;
+}
+#endif
+
+SnapshotWriter::SnapshotWriter(TCPUserSystemServer* owner)
+    : server(owner), requested(false), loadRequested(false), method(SNAPSHOT_VERSIONED), busy(false), stopping(false),
+      completed(0), failed(0), totalMs(0), lastMs(0), forkSaves(0), maxCowBytes(0), threadStarted(false) {}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+bool SnapshotWriter::start() {
+#ifdef _WIN32
+    thread = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+    threadStarted = thread != NULL;
+#else
+    threadStarted = pthread_create(&thread, NULL, threadProc, this) == 0;
+#endif
+    return threadStarted;
+}
+
+void SnapshotWriter::stop() {
+    {
+        SimpleLockGuard lock(mutex);
+        stopping = true;
+    }
+    condition.notifyAll();
+    if (threadStarted) {
+#ifdef _WIN32
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+#else
+        pthread_join(thread, NULL);
+#endif
+        threadStarted = false;
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI SnapshotWriter::threadProc(LPVOID param) {
+    static_cast<SnapshotWriter*>(param)->run();
+    return 0;
+}
+#else
+void* SnapshotWriter::threadProc(void* param) {
+    static_cast<SnapshotWriter*>(param)->run();
+    return NULL;
+}
+#endif
+
+bool SnapshotWriter::request(SnapshotMethod snapshotMethod) {
+    {
+        SimpleLockGuard lock(mutex);
+        if (requested || busy || stopping) {
+            return false;
+        }
+        requested = true;
+        method = snapshotMethod;
+    }
+    condition.notifyOne();
+    return true;
+}
+
+void SnapshotWriter::requestLoad() {
+    {
+        SimpleLockGuard lock(mutex);
+        loadRequested = true;
+    }
+    condition.notifyOne();
+}
+
+// 复制映射的数据文件 - 每块之间检查停止，停止流程在写出最后的检查点前复制剩余部分；
+// 期间到达的检查点请求在复制完后执行
+void SnapshotWriter::loadMapped() {
+    while (!server->loadMappedUsers(SNAPSHOT_CHUNK_RECORDS)) {
+        SimpleLockGuard lock(mutex);
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void SnapshotWriter::run() {
+    while (true) {
+        SnapshotMethod current;
+        bool load;
+        {
+            SimpleLockGuard lock(mutex);
+            while (!requested && !loadRequested && !stopping) {
+                condition.wait(mutex);
+            }
+            if (stopping) {
+                return;     // 停止流程随后自行做最后一次检查点
+            }
+            load = loadRequested;
+            if (load) {
+                loadRequested = false;
+            } else {
+                requested = false;
+                busy = true;
+                current = method;
+            }
+        }
+        if (load) {
+            loadMapped();
+            continue;
+        }
+
+        unsigned long long startMs = TimerWheel::nowMs();
+        SnapshotStats stats;
+        bool saved = server->writeCheckpoint(stats, current);
+        unsigned long long elapsed = TimerWheel::nowMs() - startMs;
+
+        {
+            SimpleLockGuard lock(mutex);
+            busy = false;
+            if (saved) {
+                ++completed;
+                totalMs += elapsed;
+                lastMs = elapsed;
+                last = stats;
+                if (stats.forked) {
+                    ++forkSaves;
+                    if (stats.cowBytes > maxCowBytes) {
+                        maxCowBytes = stats.cowBytes;
+                    }
+                }
+            } else {
+                ++failed;
+            }
+        }
+
+        std::stringstream ss;
+        if (saved && stats.forked) {
+            ss << "后台保存完成(子进程): 用户 " << stats.records << "，快照 " << stats.bytes / 1024
+               << " KB，fork 阻塞 " << stats.forkMs << " ms，写时复制 " << stats.cowBytes / 1024
+               << " KB，耗时 " << elapsed << " ms";
+            server->getLogger()->logInfo(ss.str());
+        } else if (saved) {
+            ss << "检查点完成: 用户 " << stats.records << "，写出期间保留旧版本 " << stats.preserved
+               << "，快照 " << stats.bytes / 1024 << " KB，耗时 " << elapsed << " ms";
+            server->getLogger()->logInfo(ss.str());
+        } else {
+            server->getLogger()->logError("检查点失败，数据日志保留到下一次检查点");
+        }
+    }
+}
+
+std::string SnapshotWriter::describeStats() {
+    SimpleLockGuard lock(mutex);
+    std::stringstream ss;
+    ss << "后台检查点 " << completed << " 次，失败 " << failed << "，累计耗时 " << totalMs << " ms";
+    if (completed > 0) {
+        ss << "，最近一次: 用户 " << last.records << "，保留旧版本 " << last.preserved
+           << "，" << last.bytes / 1024 << " KB，" << lastMs << " ms";
+    }
+    if (forkSaves > 0) {
+        ss << "，其中子进程写出 " << forkSaves << " 次，写时复制最多 " << maxCowBytes / 1024 << " KB";
+    }
+    return ss.str();
+}
+
+std::string SnapshotWriter::describeCounters() {
+    SimpleLockGuard lock(mutex);
+    std::stringstream ss;
+    ss << "snapshots=" << completed << ";snapshot_failures=" << failed
+       << ";snapshot_in_progress=" << (requested || busy ? 1 : 0)
+       << ";last_snapshot_ms=" << lastMs << ";last_snapshot_bytes=" << last.bytes
+       << ";last_fork_ms=" << last.forkMs << ";last_cow_bytes=" << last.cowBytes
+       << ";max_cow_bytes=" << maxCowBytes;
+    return ss.str();
+}
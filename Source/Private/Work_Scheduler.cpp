@@ -0,0 +1,243 @@
+/*
+ * TCP用户系统 - 工作窃取命令调度器实现
+ *
+ * 文件结构:
+ * 1. 生命周期管理 - 执行线程创建与停止
+ * 2. 命令提交 - 会话变为可运行时按套接字分配初始执行线程
+ * 3. 执行线程 - 自取/窃取会话、批量执行命令、空闲等待
+ *
+ * 调度规则:
+ * - 会话的commandScheduled标志在其位于任一运行队列或正在执行期间保持为真，
+ *   提交新命令时不会重复入队，因此同一会话不会被两个线程同时执行
+ * - 每次最多执行MAX_BATCH条命令后让出，高频连接与其他连接轮流执行
+ */
+
+#include "../Public/Work_Scheduler.h"
+
+namespace {
+    const size_t MAX_BATCH = 16;        // 单个会话每次最多连续执行的命令数
+}
+
+WorkScheduler::WorkScheduler(TCPUserSystemServer* owner, int threadCount)
+    : server(owner), readyCount(0), stopping(false), executedCount(0), stealCount(0) {
+    int count = threadCount > 0 ? threadCount : 1;
+    for (int i = 0; i < count; ++i) {
+        Worker* worker = new Worker;
+        worker->scheduler = this;
+        worker->index = i;
+        workers.push_back(worker);
+    }
+}
+
+WorkScheduler::~WorkScheduler() {
+    stop();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+// 启动执行线程
+bool WorkScheduler::start() {
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Worker* worker = workers[i];
+#ifdef _WIN32
+        worker->thread = CreateThread(NULL, 0, threadProc, worker, 0, NULL);
+        if (!worker->thread) {
+            return false;
+        }
+#else
+        if (pthread_create(&worker->thread, NULL, threadProc, worker) != 0) {
+            return false;
+        }
+#endif
+        worker->threadStarted = true;
+    }
+    return true;
+}
+
+// 停止执行线程 - 运行队列中剩余的会话由各自的事件循环在退出时关闭
+void WorkScheduler::stop() {
+    {
+        SimpleLockGuard lock(idleMutex);
+        stopping.store(true);
+    }
+    idleCondition.notifyAll();
+
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Worker* worker = workers[i];
+        if (!worker->threadStarted) {
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject(worker->thread, INFINITE);
+        CloseHandle(worker->thread);
+#else
+        pthread_join(worker->thread, NULL);
+#endif
+        worker->threadStarted = false;
+
+        SimpleLockGuard lock(worker->mutex);
+        worker->runQueue.clear();
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI WorkScheduler::threadProc(LPVOID param) {
+    Worker* worker = static_cast<Worker*>(param);
+    worker->scheduler->workerLoop(worker);
+    return 0;
+}
+#else
+void* WorkScheduler::threadProc(void* param) {
+    Worker* worker = static_cast<Worker*>(param);
+    worker->scheduler->workerLoop(worker);
+    return NULL;
+}
+#endif
+
+// 提交命令 - 会话原本不在任何运行队列中时，放入按套接字选定的执行线程
+void WorkScheduler::submit(SimpleSharedPtr<ClientSession> session, std::vector<ProtocolMessage>& commands) {
+    if (commands.empty() || stopping.load()) {
+        return;
+    }
+
+    bool becameRunnable = false;
+    {
+        SimpleLockGuard lock(session->getCommandMutex());
+        std::deque<ProtocolMessage>& pending = session->getPendingCommands();
+        for (size_t i = 0; i < commands.size(); ++i) {
+            pending.push_back(ProtocolMessage());
+            pending.back().swap(commands[i]);
+        }
+        if (!session->isCommandScheduled()) {
+            session->setCommandScheduled(true);
+            becameRunnable = true;
+        }
+    }
+
+    if (becameRunnable) {
+        size_t home = static_cast<size_t>(session->getSocket()) % workers.size();
+        enqueue(workers[home], session);
+    }
+}
+
+// 会话放入运行队列尾部并唤醒一个空闲线程
+void WorkScheduler::enqueue(Worker* worker, SimpleSharedPtr<ClientSession> session) {
+    {
+        SimpleLockGuard lock(worker->mutex);
+        worker->runQueue.push_back(session);
+    }
+    readyCount.increment();
+
+    // 先增加计数再在锁内通知，等待方在锁内检查计数，不会丢失唤醒
+    SimpleLockGuard lock(idleMutex);
+    idleCondition.notifyOne();
+}
+
+// 从自己的运行队列头部取会话
+bool WorkScheduler::takeLocal(Worker* worker, SimpleSharedPtr<ClientSession>& session) {
+    SimpleLockGuard lock(worker->mutex);
+    if (worker->runQueue.empty()) {
+        return false;
+    }
+    session = worker->runQueue.front();
+    worker->runQueue.pop_front();
+    readyCount.decrement();
+    return true;
+}
+
+// 从其他线程运行队列尾部窃取整个会话(连同其全部待执行命令)
+bool WorkScheduler::steal(Worker* thief, SimpleSharedPtr<ClientSession>& session) {
+    size_t count = workers.size();
+    for (size_t offset = 1; offset < count; ++offset) {
+        Worker* victim = workers[(static_cast<size_t>(thief->index) + offset) % count];
+        SimpleLockGuard lock(victim->mutex);
+        if (victim->runQueue.empty()) {
+            continue;
+        }
+        session = victim->runQueue.back();
+        victim->runQueue.pop_back();
+        readyCount.decrement();
+        stealCount.increment();
+        return true;
+    }
+    return false;
+}
+
+// 执行会话的一批命令 - 未执行完则重新入队，执行完且需要关闭时通知驱动
+void WorkScheduler::runSession(Worker* worker, SimpleSharedPtr<ClientSession> session) {
+    std::vector<ProtocolMessage> batch;
+    {
+        SimpleLockGuard lock(session->getCommandMutex());
+        std::deque<ProtocolMessage>& pending = session->getPendingCommands();
+        while (!pending.empty() && batch.size() < MAX_BATCH) {
+            batch.push_back(ProtocolMessage());
+            batch.back().swap(pending.front());
+            pending.pop_front();
+        }
+    }
+
+    // 本批命令的响应合并后一次写出
+    size_t executed = 0;
+    server->corkSession(session);
+    for (; executed < batch.size() && session->getIsActive(); ++executed) {
+        server->processClientMessage(session, batch[executed]);
+    }
+    server->uncorkSession(session);
+    executedCount.add(static_cast<long long>(executed));
+    for (size_t i = 0; i < batch.size(); ++i) {
+        server->finishRequest(batch[i]);    // 含会话退出后未执行的命令
+    }
+
+    bool requeue = false;
+    bool closeNow = false;
+    {
+        SimpleLockGuard lock(session->getCommandMutex());
+        std::deque<ProtocolMessage>& pending = session->getPendingCommands();
+        if (!session->getIsActive()) {
+            // 会话已退出或被挤占，剩余命令不再执行
+            for (size_t i = 0; i < pending.size(); ++i) {
+                server->finishRequest(pending[i]);
+            }
+            pending.clear();
+        }
+        if (pending.empty()) {
+            session->setCommandScheduled(false);
+            closeNow = session->isCloseDeferred() || !session->getIsActive();
+        } else {
+            requeue = true;
+        }
+    }
+
+    if (requeue) {
+        enqueue(worker, session);
+    } else if (closeNow && session->getDriver()) {
+        session->getDriver()->requestClose(session.get());
+    }
+}
+
+// 执行线程主体 - 先取自己的队列，再窃取，都没有时等待
+void WorkScheduler::workerLoop(Worker* worker) {
+    server->bindCurrentThread(THREAD_ROLE_EXEC, worker->index);
+    while (!stopping.load()) {
+        SimpleSharedPtr<ClientSession> session;
+        if (takeLocal(worker, session) || steal(worker, session)) {
+            runSession(worker, session);
+            continue;
+        }
+
+        SimpleLockGuard lock(idleMutex);
+        while (readyCount.load() <= 0 && !stopping.load()) {
+            idleCondition.wait(idleMutex);
+        }
+    }
+}
+
+// 统计摘要
+std::string WorkScheduler::describeStats() {
+    std::stringstream ss;
+    ss << "执行线程 " << workers.size() << "，已执行命令 " << executedCount.load()
+       << "，窃取会话 " << stealCount.load();
+    return ss.str();
+}
@@ -0,0 +1,217 @@
+/*
+ * TCP用户系统 - 工作线程池实现
+ *
+ * 文件结构:
+ * 1. 生命周期管理 - 按配置的栈大小创建工作线程，停止时关闭排队连接
+ * 2. 任务提交 - 有界队列，队列满时按策略等待/拒绝/丢弃
+ * 3. 工作线程 - 取出连接后调用TCPUserSystemServer::handleClient直到会话结束
+ * 4. 运行统计
+ */
+
+#include "../Public/Worker_Pool.h"
+
+#ifndef _WIN32
+#include <limits.h>
+#endif
+
+WorkerPool::WorkerPool(TCPUserSystemServer* owner, int workers, size_t capacity,
+                       size_t threadStackSize, PoolOverflowPolicy overflowPolicy)
+    : server(owner), threadCount(workers > 0 ? workers : 1), queueCapacity(capacity > 0 ? capacity : 1),
+      stackSize(threadStackSize), policy(overflowPolicy), stopping(false), startedThreads(0),
+      busy(0), peakQueued(0), submitted(0), completed(0), rejected(0), shed(0), blocked(0) {}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+// 创建工作线程 - 栈大小不低于系统允许的最小值
+bool WorkerPool::start() {
+    for (int i = 0; i < threadCount; ++i) {
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, stackSize, threadProc, this,
+                                     stackSize > 0 ? STACK_SIZE_PARAM_IS_A_RESERVATION : 0, NULL);
+        if (!thread) {
+            return false;
+        }
+        threads.push_back(thread);
+#else
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (stackSize > 0) {
+            size_t size = stackSize < static_cast<size_t>(PTHREAD_STACK_MIN) ?
+                          static_cast<size_t>(PTHREAD_STACK_MIN) : stackSize;
+            pthread_attr_setstacksize(&attr, size);
+        }
+        pthread_t thread;
+        int result = pthread_create(&thread, &attr, threadProc, this);
+        pthread_attr_destroy(&attr);
+        if (result != 0) {
+            return false;
+        }
+        threads.push_back(thread);
+#endif
+    }
+    return true;
+}
+
+// 停止线程池 - 排队中的连接直接关闭，正在处理的会话由服务器停止标志结束
+void WorkerPool::stop() {
+    std::deque<SOCKET> abandoned;
+    {
+        SimpleLockGuard lock(mutex);
+        stopping = true;
+        abandoned.swap(queue);
+    }
+    notEmpty.notifyAll();
+    notFull.notifyAll();
+
+    for (size_t i = 0; i < abandoned.size(); ++i) {
+        closesocket(abandoned[i]);
+    }
+
+#ifdef _WIN32
+    for (size_t i = 0; i < threads.size(); ++i) {
+        WaitForSingleObject(threads[i], 5000);  // 等待5秒
+        CloseHandle(threads[i]);
+    }
+#else
+    for (size_t i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+    threads.clear();
+}
+
+// 提交新连接 - 队列满时按策略处理
+bool WorkerPool::submit(SOCKET socket) {
+    SOCKET victim = INVALID_SOCKET;
+    {
+        SimpleLockGuard lock(mutex);
+
+        if (!stopping && queue.size() >= queueCapacity) {
+            if (policy == POOL_OVERFLOW_QUEUE) {
+                ++blocked;
+                while (!stopping && queue.size() >= queueCapacity) {
+                    notFull.wait(mutex);
+                }
+            } else if (policy == POOL_OVERFLOW_SHED) {
+                victim = queue.front();     // 等待最久的连接最可能已被客户端放弃
+                queue.pop_front();
+                ++shed;
+            }
+        }
+
+        if (stopping || queue.size() >= queueCapacity) {
+            ++rejected;
+            victim = INVALID_SOCKET;
+        } else {
+            queue.push_back(socket);
+            ++submitted;
+            if (queue.size() > peakQueued) {
+                peakQueued = queue.size();
+            }
+            socket = INVALID_SOCKET;
+        }
+    }
+
+    if (victim != INVALID_SOCKET) {
+        server->getLogger()->logWarning("工作线程池队列已满，丢弃等待最久的连接");
+        refuse(victim);
+    }
+    if (socket != INVALID_SOCKET) {
+        server->getLogger()->logWarning("工作线程池队列已满，拒绝新连接");
+        refuse(socket);
+        return false;
+    }
+
+    notEmpty.notifyOne();
+    return true;
+}
+
+// 回复繁忙并关闭连接 - 连接尚未创建会话，直接写套接字
+void WorkerPool::refuse(SOCKET socket) {
+    server->sendMessage(socket, BUSY_RESPONSE);
+    closesocket(socket);
+}
+
+// 工作线程主体 - 循环取出连接并完整处理其会话
+void WorkerPool::workerLoop() {
+    int index;
+    {
+        SimpleLockGuard lock(mutex);
+        index = startedThreads++;
+    }
+    server->bindCurrentThread(THREAD_ROLE_WORKER, index);
+
+    while (true) {
+        SOCKET socket;
+        {
+            SimpleLockGuard lock(mutex);
+            while (!stopping && queue.empty()) {
+                notEmpty.wait(mutex);
+            }
+            if (queue.empty()) {
+                return;     // 已停止且无排队连接
+            }
+            socket = queue.front();
+            queue.pop_front();
+            ++busy;
+        }
+        notFull.notifyOne();
+
+        server->handleClient(socket);
+
+        SimpleLockGuard lock(mutex);
+        --busy;
+        ++completed;
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI WorkerPool::threadProc(LPVOID param) {
+    static_cast<WorkerPool*>(param)->workerLoop();
+    return 0;
+}
+#else
+void* WorkerPool::threadProc(void* param) {
+    static_cast<WorkerPool*>(param)->workerLoop();
+    return NULL;
+}
+#endif
+
+// 读取运行统计快照
+WorkerPoolStats WorkerPool::getStats() {
+    SimpleLockGuard lock(mutex);
+    WorkerPoolStats stats;
+    stats.threads = threadCount;
+    stats.busy = busy;
+    stats.queued = queue.size();
+    stats.capacity = queueCapacity;
+    stats.peakQueued = peakQueued;
+    stats.submitted = submitted;
+    stats.completed = completed;
+    stats.rejected = rejected;
+    stats.shed = shed;
+    stats.blocked = blocked;
+    return stats;
+}
+
+// 统计摘要 - 忙碌线程/总线程、排队/容量及累计计数
+std::string WorkerPool::describeStats() {
+    WorkerPoolStats stats = getStats();
+    std::stringstream ss;
+    ss << "忙碌线程 " << stats.busy << "/" << stats.threads
+       << "，排队 " << stats.queued << "/" << stats.capacity << " (峰值 " << stats.peakQueued << ")"
+       << "，已提交 " << stats.submitted << "，已完成 " << stats.completed
+       << "，拒绝 " << stats.rejected << "，丢弃 " << stats.shed << "，等待 " << stats.blocked
+       << "，溢出策略 " << policyName(policy);
+    return ss.str();
+}
+
+const char* WorkerPool::policyName(PoolOverflowPolicy overflowPolicy) {
+    switch (overflowPolicy) {
+        case POOL_OVERFLOW_REJECT: return "reject";
+        case POOL_OVERFLOW_SHED: return "shed";
+        default: return "queue";
+    }
+}
@@ -0,0 +1,506 @@
+/*
+ * TCP用户系统 - 用户数据预写日志实现
+ *
+ * 文件结构:
+ * 1. 打开与关闭 - 组提交模式下启动/停止提交线程
+ * 2. 追加 - 每条记录组装成一行；组提交模式放入共享缓冲，其余模式直接写出
+ * 3. 组提交 - 提交线程取走整批记录，一次写出、一次同步，再放行等待的响应
+ * 4. 轮换 - 检查点开始时提交缓冲并把当前日志改名，之后的记录写入新文件
+ * 5. 重放 - 启动时按记录顺序应用到用户表
+ */
+
+#include "../Public/Write_Ahead_Log.h"
+
+namespace {
+    const char RECORD_PUT = '+';
+    const char RECORD_DELETE = '-';
+    const size_t CHECKSUM_DIGITS = 8;
+
+    // 把已刷新到内核的数据同步到磁盘 - Linux只需同步数据与文件长度
+    bool syncFile(FILE* file) {
+#ifdef _WIN32
+        return _commit(_fileno(file)) == 0;
+#elif defined(__linux__)
+        return fdatasync(fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    void sleepMs(int ms) {
+#ifdef _WIN32
+        Sleep(ms);
+#else
+        usleep(ms * 1000);
+#endif
+    }
+
+    // 日志所在目录 - 新建与改名只有在目录项同步后才能在掉电后保留
+    std::string directoryOf(const std::string& filePath) {
+        size_t slash = filePath.find_last_of("/\\");
+        return slash == std::string::npos ? std::string(".") : filePath.substr(0, slash);
+    }
+}
+
+WriteAheadLog::WriteAheadLog(TCPUserSystemServer* owner, const std::string& dataFile,
+                             DurabilityMode durability, int intervalMs)
+    : server(owner), path(dataFile + ".wal"), rotatedPath(dataFile + ".wal.1"), directory(directoryOf(dataFile)),
+      mode(durability), commitIntervalMs(intervalMs), file(0), appendedSeq(0), durableSeq(0), failed(false), stopping(false),
+      pendingBytes(0), pendingRecords(0), bytes(0), failures(0), rotations(0), commits(0), largestBatch(0), syncMs(0),
+      committerStarted(false) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+    if (file) {
+        fclose(file);
+    }
+}
+
+const char* WriteAheadLog::modeName(DurabilityMode durability) {
+    switch (durability) {
+    case DURABILITY_NONE:
+        return "none";
+    case DURABILITY_PER_WRITE:
+        return "per-write";
+    default:
+        return "batched";
+    }
+}
+
+// 校验和 - 记录负载的FNV-1a哈希
+unsigned int WriteAheadLog::checksum(const std::string& payload) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < payload.length(); ++i) {
+        hash ^= static_cast<unsigned char>(payload[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+long WriteAheadLog::fileSize(const std::string& filePath) {
+    FILE* f = fopen(filePath.c_str(), "rb");
+    if (!f) {
+        return -1;
+    }
+    long size = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : 0;
+    fclose(f);
+    return size;
+}
+
+// 同步文件或目录 - Windows不能打开目录，目录项由NTFS日志保证
+bool WriteAheadLog::syncPath(const std::string& filePath) {
+#ifdef _WIN32
+    int fd = _open(filePath.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = _commit(fd) == 0;
+    _close(fd);
+    return synced;
+#else
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+bool WriteAheadLog::open(bool truncate) {
+    {
+        SimpleLockGuard fileLock(fileMutex);
+        if (file) {
+            fclose(file);
+            file = 0;
+        }
+        if (!truncate) {
+            WalReplayStats checked;
+            unsigned long long validBytes = 0;
+            if (!replayFile(path, 0, checked, validBytes) && !truncateFile(path, validBytes)) {
+                return false;
+            }
+        }
+        file = fopen(path.c_str(), truncate ? "wb" : "ab");
+        if (!file) {
+            return false;
+        }
+#ifndef _WIN32
+        if (mode != DURABILITY_NONE) {
+            syncPath(directory);
+        }
+#endif
+        SimpleLockGuard lock(mutex);
+        pendingBytes = 0;
+        pendingRecords = 0;
+        if (!truncate) {
+            long size = fileSize(path);
+            pendingBytes = size > 0 ? static_cast<unsigned long long>(size) : 0;
+        }
+        stopping = false;
+    }
+
+    if (mode == DURABILITY_BATCHED && !committerStarted) {
+#ifdef _WIN32
+        committer = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+        committerStarted = committer != NULL;
+#else
+        committerStarted = pthread_create(&committer, NULL, threadProc, this) == 0;
+#endif
+        if (!committerStarted) {
+            mode = DURABILITY_PER_WRITE;    // 没有提交线程时逐条同步，持久性不降低
+        }
+    }
+    return true;
+}
+
+// 关闭 - 停止提交线程后提交剩余记录；之后的追加直接写出
+void WriteAheadLog::close() {
+    {
+        SimpleLockGuard lock(mutex);
+        stopping = true;
+    }
+    pendingCondition.notifyAll();
+
+    if (committerStarted) {
+#ifdef _WIN32
+        WaitForSingleObject(committer, INFINITE);
+        CloseHandle(committer);
+#else
+        pthread_join(committer, NULL);
+#endif
+        committerStarted = false;
+    }
+
+    SimpleLockGuard fileLock(fileMutex);
+    commitPending();
+}
+
+bool WriteAheadLog::hasRecords() const {
+    return fileSize(path) > 0 || fileSize(rotatedPath) >= 0;
+}
+
+bool WriteAheadLog::hasLogRecords(const std::string& dataFile) {
+    return fileSize(dataFile + ".wal") > 0 || fileSize(dataFile + ".wal.1") >= 0;
+}
+
+// 写出并按需同步 - 调用者持有fileMutex
+bool WriteAheadLog::writeOut(const std::string& data, bool sync) {
+    if (!file || fwrite(data.data(), 1, data.length(), file) != data.length() || fflush(file) != 0) {
+        return false;
+    }
+    if (!sync) {
+        return true;
+    }
+    unsigned long long startMs = TimerWheel::nowMs();
+    bool synced = syncFile(file);
+    unsigned long long elapsed = TimerWheel::nowMs() - startMs;
+    SimpleLockGuard lock(mutex);
+    syncMs += elapsed;
+    return synced;
+}
+
+// 已提交序号前进 - 只在写出并同步成功后调用
+void WriteAheadLog::publishDurable(unsigned long long seq, unsigned long long batchRecords) {
+    {
+        SimpleLockGuard lock(mutex);
+        if (seq > durableSeq) {
+            durableSeq = seq;
+        }
+        ++commits;
+        if (batchRecords > largestBatch) {
+            largestBatch = batchRecords;
+        }
+    }
+    durableCondition.notifyAll();
+}
+
+// 写出或同步失败 - 日志末尾可能留下不完整的记录，之后追加的记录重放时会随之被丢弃，因此不再接受修改；
+// 已提交序号不再前进，唤醒等待者由其向客户端报告失败
+void WriteAheadLog::markFailed() {
+    bool first;
+    {
+        SimpleLockGuard lock(mutex);
+        first = !failed;
+        failed = true;
+        ++failures;
+    }
+    durableCondition.notifyAll();
+    if (first) {
+        server->getLogger()->logError("数据日志写入或同步失败，已停止接受修改(重启后恢复): " + path);
+    }
+}
+
+bool WriteAheadLog::hasFailed() {
+    SimpleLockGuard lock(mutex);
+    return failed;
+}
+
+// 追加一条记录 - 组装为完整一行；组提交模式只放入缓冲，由提交线程写出
+unsigned long long WriteAheadLog::appendRecord(char type, const std::string& payload) {
+    char header[CHECKSUM_DIGITS + 3];
+    snprintf(header, sizeof(header), "%c%08x,", type, checksum(payload));
+    std::string line;
+    line.reserve(CHECKSUM_DIGITS + 3 + payload.length());
+    line.append(header, CHECKSUM_DIGITS + 2);
+    line += payload;
+    line += '\n';
+
+    if (mode == DURABILITY_BATCHED) {
+        bool queued = false;
+        unsigned long long seq = 0;
+        {
+            SimpleLockGuard lock(mutex);
+            if (failed) {
+                return 0;
+            }
+            if (!stopping) {
+                bool wasEmpty = pending.empty();
+                pending += line;
+                seq = ++appendedSeq;
+                bytes += line.length();
+                pendingBytes += line.length();
+                ++pendingRecords;
+                queued = true;
+                if (wasEmpty) {
+                    pendingCondition.notifyOne();
+                }
+            }
+        }
+        if (queued) {
+            return seq;
+        }
+        // 提交线程已停止(服务器关闭中): 直接写出并同步
+    }
+
+    SimpleLockGuard fileLock(fileMutex);
+    if (hasFailed()) {
+        return 0;
+    }
+    bool written = writeOut(line, mode != DURABILITY_NONE);
+    unsigned long long seq;
+    {
+        SimpleLockGuard lock(mutex);
+        seq = ++appendedSeq;
+        bytes += line.length();
+        pendingBytes += line.length();
+        ++pendingRecords;
+    }
+    if (!written) {
+        markFailed();
+        return 0;
+    }
+    publishDurable(seq, 1);
+    return seq;
+}
+
+unsigned long long WriteAheadLog::appendPut(const User& user) {
+    return appendRecord(RECORD_PUT, user.serialize());
+}
+
+// 删除记录只需要用户ID，借用User的序列化完成转义
+unsigned long long WriteAheadLog::appendDelete(const std::string& userId) {
+    return appendRecord(RECORD_DELETE, User(userId, "").serialize());
+}
+
+// 提交一批 - 调用者持有fileMutex；取走缓冲后追加者可继续写入下一批；失败时整批都未提交，返回0
+unsigned long long WriteAheadLog::commitPending() {
+    std::string batch;
+    unsigned long long seq;
+    unsigned long long batchRecords;
+    {
+        SimpleLockGuard lock(mutex);
+        if (pending.empty()) {
+            return 0;
+        }
+        batch.swap(pending);
+        seq = appendedSeq;
+        batchRecords = seq - durableSeq;
+    }
+
+    if (!writeOut(batch, true)) {
+        markFailed();
+        return 0;
+    }
+    publishDurable(seq, batchRecords);
+    return seq;
+}
+
+#ifdef _WIN32
+DWORD WINAPI WriteAheadLog::threadProc(LPVOID param) {
+    static_cast<WriteAheadLog*>(param)->commitLoop();
+    return 0;
+}
+#else
+void* WriteAheadLog::threadProc(void* param) {
+    static_cast<WriteAheadLog*>(param)->commitLoop();
+    return NULL;
+}
+#endif
+
+// 提交线程 - 缓冲非空时(可选地再等待提交间隔)写出整批，同步期间到达的记录自然组成下一批
+void WriteAheadLog::commitLoop() {
+    while (true) {
+        {
+            SimpleLockGuard lock(mutex);
+            while (pending.empty() && !stopping) {
+                pendingCondition.wait(mutex);
+            }
+            if (stopping) {
+                return;     // 剩余记录由close()提交
+            }
+        }
+        if (commitIntervalMs > 0) {
+            sleepMs(commitIntervalMs);
+        }
+
+        unsigned long long seq;
+        {
+            SimpleLockGuard fileLock(fileMutex);
+            seq = commitPending();
+        }
+        if (seq != 0 || hasFailed()) {
+            server->releaseCommitWaiters(getDurableSeq());     // 失败时由服务器向仍在等待的会话回复错误
+        }
+    }
+}
+
+unsigned long long WriteAheadLog::getDurableSeq() {
+    SimpleLockGuard lock(mutex);
+    return durableSeq;
+}
+
+bool WriteAheadLog::waitDurable(unsigned long long seq) {
+    SimpleLockGuard lock(mutex);
+    while (durableSeq < seq && !failed) {
+        durableCondition.wait(mutex);
+    }
+    return durableSeq >= seq;
+}
+
+// 轮换 - 先提交缓冲(旧日志中的记录都已写出)，再关闭当前日志并改名，重新创建空日志
+bool WriteAheadLog::rotate() {
+    unsigned long long committed = 0;
+    bool renamed = false;
+    {
+        SimpleLockGuard fileLock(fileMutex);
+        if (fileSize(rotatedPath) >= 0) {
+            return false;   // 上一次检查点未完成，轮换出的日志须保留到快照写出
+        }
+        committed = commitPending();
+        if (file) {
+            fclose(file);
+        }
+        renamed = rename(path.c_str(), rotatedPath.c_str()) == 0;
+        file = fopen(path.c_str(), "ab");
+#ifndef _WIN32
+        if (mode != DURABILITY_NONE) {
+            syncPath(directory);
+        }
+#endif
+        if (renamed) {
+            SimpleLockGuard lock(mutex);
+            pendingBytes = 0;
+            pendingRecords = 0;
+            ++rotations;
+        }
+    }
+    if (committed != 0 || hasFailed()) {
+        server->releaseCommitWaiters(getDurableSeq());
+    }
+    return renamed;
+}
+
+void WriteAheadLog::removeRotated() {
+    SimpleLockGuard fileLock(fileMutex);
+    remove(rotatedPath.c_str());
+}
+
+unsigned long long WriteAheadLog::getPendingBytes() {
+    SimpleLockGuard lock(mutex);
+    return pendingBytes;
+}
+
+unsigned long long WriteAheadLog::getPendingRecords() {
+    SimpleLockGuard lock(mutex);
+    return pendingRecords;
+}
+
+std::string WriteAheadLog::describeStats() {
+    SimpleLockGuard lock(mutex);
+    std::stringstream ss;
+    ss << "模式 " << modeName(mode) << "，记录 " << appendedSeq << "，字节 " << bytes
+       << "，提交 " << commits << " 次";
+    if (commits > 0) {
+        ss << "(平均每次 " << (appendedSeq / commits) << " 条，最多 " << largestBatch << " 条)";
+    }
+    ss << "，同步耗时 " << syncMs << " 毫秒，轮换 " << rotations << "，写入失败 " << failures;
+    return ss.str();
+}
+
+// 重放单个日志文件 - 遇到未写完或校验和不符的记录时停止，返回false
+bool WriteAheadLog::replayFile(const std::string& logPath, std::map<std::string, User>* users,
+                               WalReplayStats& stats, unsigned long long& validBytes) {
+    validBytes = 0;
+    std::ifstream log(logPath.c_str(), std::ios::binary);
+    if (!log.is_open()) {
+        return true;
+    }
+
+    std::string line;
+    while (std::getline(log, line)) {
+        if (log.eof()) {
+            return false;       // 最后一行没有换行: 写入中途崩溃
+        }
+        if (line.length() < CHECKSUM_DIGITS + 2 || line[CHECKSUM_DIGITS + 1] != ',' ||
+            (line[0] != RECORD_PUT && line[0] != RECORD_DELETE)) {
+            return false;
+        }
+        std::string payload = line.substr(CHECKSUM_DIGITS + 2);
+        unsigned int expected = static_cast<unsigned int>(
+            strtoul(line.substr(1, CHECKSUM_DIGITS).c_str(), NULL, 16));
+        if (checksum(payload) != expected) {
+            return false;
+        }
+
+        validBytes += line.length() + 1;
+        if (!users) {
+            continue;
+        }
+        User user = User::deserialize(payload);
+        if (line[0] == RECORD_PUT) {
+            (*users)[user.getUserId()] = user;
+        } else {
+            users->erase(user.getUserId());
+        }
+        ++stats.records;
+    }
+    return true;
+}
+
+// 截断到length字节并同步，截掉的是重放时已被忽略的内容
+bool WriteAheadLog::truncateFile(const std::string& filePath, unsigned long long length) {
+#ifdef _WIN32
+    int fd = _open(filePath.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    bool truncated = _chsize_s(fd, static_cast<__int64>(length)) == 0 && _commit(fd) == 0;
+    _close(fd);
+    return truncated;
+#else
+    return ::truncate(filePath.c_str(), static_cast<off_t>(length)) == 0 && syncPath(filePath);
+#endif
+}
+
+void WriteAheadLog::replay(const std::string& dataFile, std::map<std::string, User>& users,
+                           WalReplayStats& stats) {
+    unsigned long long validBytes;
+    if (!replayFile(dataFile + ".wal.1", &users, stats, validBytes)) {
+        ++stats.damaged;
+    }
+    if (!replayFile(dataFile + ".wal", &users, stats, validBytes)) {
+        ++stats.damaged;
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * TCP用户系统 - 文本数据文件并行加载头文件
+ *
+ * 文件结构:
+ * 1. CsvLoadStats - 一次加载的统计
+ * 2. CsvUserLoader - 映射文本格式(CSV)数据文件，分块并行解析后合并到用户表
+ *
+ * 加载规则:
+ * - 首行为USER_FILE_ESCAPED_MARKER的文件字段带转义，其他文件是早期版本写出的未转义文件；
+ *   两种格式中换行字节总是记录的结束(未转义格式的字段不含换行)，因此按换行切分的各块互不相干
+ * - 文件按CPU数切成大致相等的块，每块的起点后移到上一个换行之后；每个线程解析一块到各自的数组，
+ *   主线程按块的顺序合并，同一用户ID出现多次时后出现的生效(与逐行加载相同)
+ * - 转义格式每行的解析结果与User::deserialize相同: 前两个未转义的逗号分隔三个字段，转义按相同规则还原；
+ *   未转义格式与User::deserializeLegacy相同: 按前两个逗号切分，反斜杠是普通字节；空行跳过
+ *
+ * 技术特点:
+ * - 查找换行、逗号(与转义格式的反斜杠)时每次比较16字节(SSE2)或32字节(AVX2，运行时检测)，其他平台逐字节
+ * - 早期版本按用户ID顺序写出，合并时从用户表末尾插入，每个用户只比较常数次
+ * - 小文件(每个线程不足1MB)减少线程数，空文件不映射
+ */
+
+#ifndef TCP_CSV_LOADER_H
+#define TCP_CSV_LOADER_H
+
+#include "TCP_System.h"
+
+// 一次加载的统计
+struct CsvLoadStats {
+    size_t records;                 // 解析出的用户记录数(含重复的用户ID)
+    unsigned long long bytes;       // 文件字节数
+    int threads;                    // 参与解析的线程数
+    const char* scanner;            // 查找分隔符所用的指令集: avx2、sse2或scalar
+    bool escaped;                   // 文件以转义标记开头，字段带转义
+    unsigned long long parseMs;     // 并行解析耗时
+    unsigned long long mergeMs;     // 合并到用户表的耗时
+
+    CsvLoadStats() : records(0), bytes(0), threads(0), scanner("scalar"), escaped(false), parseMs(0), mergeMs(0) {}
+};
+
+class CsvUserLoader {
+public:
+    // 加载path到users(调用者保证此时没有其他线程访问users)；文件不存在或无法映射返回false
+    static bool load(const std::string& path, std::map<std::string, User>& users, CsvLoadStats& stats);
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * TCP用户系统 - epoll事件循环头文件
+ *
+ * 文件结构:
+ * 1. EventLoop - 单线程反应堆，复用管理一组ClientSession
+ *    - 每个循环独占一个SO_REUSEPORT监听套接字，直接以accept4接受非阻塞连接
+ *    - 启用Unix域套接字时各循环共同监听它(EPOLLEXCLUSIVE，新连接只唤醒一个循环)
+ *    - 套接字为非阻塞，以EPOLLET边缘触发方式读写直到EAGAIN
+ *    - 完整消息交由TCPUserSystemServer::processClientMessage处理，协议保持不变
+ *    - 空闲/登录超时由本循环的分层时间轮跟踪，epoll_wait的等待时间取自时间轮
+ *    - 服务器停止时先进入排空状态: 不再接受与读取(已读入的帧照常处理)，连接的响应写完后关闭；
+ *      期限到期时由循环线程shutdown全部连接(分片模式的会话不在服务器的会话表中)
+ *    - 热重启时没有命令在执行的会话从连接表摘下移交给新进程，新进程的循环启动时注册接管的会话
+ *    - 分片模式下每个循环拥有一个UserShard(见User_Shard.h)，被唤醒时处理其收件队列
+ *
+ * 技术特点:
+ * - 仅Linux可用，其他平台服务器自动回退到每连接一线程模型
+ * - 连接表按套接字描述符下标索引，事件分发O(1)
+ */
+
+#ifndef TCP_EVENT_LOOP_H
+#define TCP_EVENT_LOOP_H
+
+#include "TCP_System.h"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// epoll事件循环 - 每个实例独占一个线程
+class EventLoop : public SessionDriver {
+private:
+    TCPUserSystemServer* server;      // 所属服务器
+    int loopIndex;                    // 循环编号(用于日志与CPU绑定)
+    int epollFd;                      // epoll实例
+    int wakeFd;                       // 跨线程唤醒用eventfd
+    SOCKET listenSocket;              // 本循环独占的监听套接字(由服务器创建与关闭)
+    SOCKET localListenSocket;         // 各循环共用的Unix域监听套接字，未启用为INVALID_SOCKET
+    SimpleAtomicBool running;         // 循环运行标志
+    SimpleAtomicBool draining;        // 排空状态 - 不再接受新连接与读取新请求
+    bool listenerRemoved;             // 排空时监听套接字是否已从epoll移除(仅循环线程访问)
+    SimpleAtomicBool handingOff;      // 热重启排空 - 会话尽量移交给新进程而不是关闭
+    SimpleAtomicInt interruptHow;     // 其他线程请求对全部连接执行的shutdown方式，-1表示没有请求
+    UserShard* shard;                 // 分片模式下本循环拥有的用户分片，否则为空
+    pthread_t thread;                 // 循环线程
+    bool threadStarted;               // 线程是否已创建
+
+    // 连接表 - 以套接字描述符为下标，仅由循环线程访问
+    std::vector<SimpleSharedPtr<ClientSession> > connections;
+
+    // 会话超时 - 收到数据只更新会话的活动时间，定时器到期时再按实际期限判定或重新计时
+    TimerWheel timers;
+    std::vector<TimerNode*> expiredTimers;
+    unsigned long long loopNowMs;     // 本轮事件处理开始时的单调时钟
+
+    // 其他线程请求关闭的连接(套接字 + 会话ID，用于确认描述符未被复用)
+    std::vector<std::pair<SOCKET, std::string> > closeRequests;
+    SimpleMutex closeMutex;
+
+    // 热重启接管的会话 - 循环线程启动前由服务器加入，启动后注册到epoll
+    std::vector<SimpleSharedPtr<ClientSession> > adoptedSessions;
+
+    void run();                                               // 事件循环主体
+    void acceptConnections(SOCKET listener);                  // 接受监听队列中的新连接
+    void registerAdoptedSessions();                           // 注册热重启接管的会话
+    void removeListeners();                                   // 从epoll移除监听套接字
+    void processCloseRequests();                              // 关闭其他线程请求关闭的连接
+    void processInterruptRequest();                           // 对全部连接执行其他线程请求的shutdown
+    void closeOrDefer(SimpleSharedPtr<ClientSession> session);  // 命令执行完前推迟关闭
+    SessionTimeout scheduleTimeout(SimpleSharedPtr<ClientSession> session); // 按下一个超时期限计时，已超时时返回超时类型
+    void processTimeouts();                                   // 关闭已超时的会话
+    void handleReadable(SimpleSharedPtr<ClientSession> session);
+    void handleWritable(SimpleSharedPtr<ClientSession> session);
+    void closeConnection(SimpleSharedPtr<ClientSession> session);
+    void detachConnection(SOCKET socket, SimpleSharedPtr<ClientSession> session);  // 从epoll、时间轮与连接表移除
+    void drainConnections();                                  // 关闭响应已写完的连接
+    void closeAllConnections();
+
+public:
+    EventLoop(TCPUserSystemServer* owner, int index, SOCKET listener, SOCKET localListener = INVALID_SOCKET);
+    ~EventLoop();
+
+    bool start();                       // 创建epoll实例并启动循环线程
+    void adoptSession(SimpleSharedPtr<ClientSession> session);  // 热重启接管的会话，须在start前调用
+    void setShard(UserShard* userShard) { shard = userShard; }  // 分片模式，须在start前调用
+    void wakeup();                      // 唤醒阻塞在epoll_wait的循环线程，可在任意线程调用
+    SimpleSharedPtr<ClientSession> findSession(SOCKET socket, const std::string& sessionId);  // 仅循环线程
+    void beginDrain(bool handoff = false);  // 进入排空状态(不等待)，连接全部关闭或移交后由stop回收线程
+    void interruptConnections(bool force);  // 由循环线程对全部连接执行shutdown(force时两端都关)，可在任意线程调用
+    void stop();                        // 请求停止并等待线程退出，仍未关闭的连接直接关闭
+
+    // SessionDriver - 任意线程直接非阻塞写出，写不完的部分由EPOLLOUT继续
+    virtual void requestFlush(ClientSession* session);
+    virtual void requestClose(ClientSession* session);
+    virtual UserShard* getShard() { return shard; }
+
+    static void* threadProc(void* param);
+};
+
+#endif // __linux__
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * TCP用户系统 - 热重启头文件
+ *
+ * 文件结构:
+ * 1. HandoffSession - 移交中的单个会话: 套接字与会话状态
+ * 2. HotRestart - 新旧进程之间的移交通道
+ *    - 旧进程: 在--handoff-socket路径上等待新进程，收到请求后停止服务并送出监听套接字与空闲会话
+ *    - 新进程: 启动时先连接该路径，接收旧进程的描述符后直接使用，之后自己在该路径上等待下一次重启
+ *
+ * 移交流程:
+ * 1. 新进程连接移交套接字(SOCK_SEQPACKET)，发送HELLO(协议版本、是否接管会话)
+ * 2. 旧进程校验对端uid后停止服务: 监听套接字不关闭、不shutdown(新进程共用)，新连接留在连接队列中；
+ *    事件循环把没有命令在执行的会话从连接表摘下，连同未处理的请求与未送出的响应交给本模块
+ * 3. 旧进程保存用户数据后依次送出监听套接字、会话(各一条记录，描述符以SCM_RIGHTS附带)与END，然后退出
+ * 4. 新进程收到END后重新加载用户数据，以继承的监听套接字启动，把会话分配给各事件循环
+ *
+ * 技术特点:
+ * - 监听套接字始终处于监听状态，重启期间到达的连接在内核队列中等待，不会被拒绝
+ * - 已登录的连接保持连接与登录状态，客户端无需重连
+ * - 每条记录一个数据报，记录边界由SOCK_SEQPACKET保证，无需自行分帧
+ * - 仅Linux可用
+ */
+
+#ifndef TCP_HOT_RESTART_H
+#define TCP_HOT_RESTART_H
+
+#include "TCP_System.h"
+
+#ifdef __linux__
+
+// 移交中的会话 - 旧进程从事件循环摘下时填写，新进程据此重建ClientSession
+struct HandoffSession {
+    SOCKET socket;
+    std::string sessionId;
+    std::string loggedInUser;
+    bool inputBinary;
+    bool outputBinary;
+    std::string pendingInput;       // 已接收但尚未组成完整帧的数据
+    std::string pendingOutput;      // 尚未写入套接字的响应
+
+    HandoffSession() : socket(INVALID_SOCKET), inputBinary(false), outputBinary(false) {}
+};
+
+// 热重启移交通道
+class HotRestart {
+public:
+    static const size_t MAX_SESSION_BYTES = 128 * 1024;    // 单个会话随移交携带的数据上限，超出的会话直接关闭
+
+private:
+    TCPUserSystemServer* server;
+    std::string socketPath;
+    SOCKET listenSocket;            // 等待下一个进程的监听套接字
+    SOCKET channel;                 // 与对端进程的连接
+    bool acceptsSessions;           // 新进程是否接管会话(thread模型不接管)
+    std::vector<char> recordBuffer;
+
+    // 旧进程: 待移交的会话(各事件循环线程写入)
+    std::vector<HandoffSession> exportedSessions;
+    SimpleMutex exportMutex;
+
+    // 新进程: 从旧进程接收的描述符，被取走前由本对象负责关闭
+    std::vector<SOCKET> tcpListeners;
+    SOCKET unixListener;
+    std::string unixPath;
+    SOCKET shmListener;
+    std::string shmPath;
+    std::vector<HandoffSession> inheritedSessions;
+
+    bool sendRecord(char type, const std::string& payload, SOCKET fd);
+    bool receiveRecord(char& type, std::string& payload, SOCKET& fd);
+    SOCKET takeLocalListener(SOCKET& listener, const std::string& path, const std::string& configuredPath);
+    void closeInherited();
+
+public:
+    HotRestart(TCPUserSystemServer* owner, const std::string& path);
+    ~HotRestart();                  // 关闭仍持有的描述符，仍在监听时删除套接字文件
+
+    // 新进程
+    bool inherit(bool acceptSessionHandoff, unsigned long long timeoutMs);   // 没有旧进程或移交中断时返回false
+    void takeTcpListeners(std::vector<SOCKET>& target);
+    SOCKET takeUnixListener(const std::string& configuredPath);    // 路径与配置不同时关闭并删除旧路径
+    SOCKET takeShmListener(const std::string& configuredPath);
+    void takeSessions(std::vector<HandoffSession>& target);
+
+    bool listen();                  // 在移交路径上等待下一个进程
+
+    // 旧进程
+    bool waitSuccessor(int timeoutMs);              // 等待新进程连接并完成握手，返回true后应停止服务
+    bool isHandingOff() const { return channel != INVALID_SOCKET; }
+    bool successorAcceptsSessions() const { return acceptsSessions; }
+    void addSession(const HandoffSession& session); // 套接字所有权转交本对象
+    // 送出全部描述符与END - 之后调用方只需关闭自己的副本，不得shutdown或删除套接字文件
+    bool transfer(const std::vector<SOCKET>& tcp, SOCKET unixSocket, const std::string& unixSocketPath,
+                  SOCKET shmSocket, const std::string& shmSocketPath);
+};
+
+#endif // __linux__
+
+#endif
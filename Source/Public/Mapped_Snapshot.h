@@ -0,0 +1,105 @@
+/*
+ * TCP用户系统 - 二进制快照文件头文件
+ *
+ * 文件结构:
+ * 1. SnapshotFileWriter - 按记录写出快照，最后写出哈希索引并回填文件头
+ * 2. MappedUserFile - 映射快照文件，按用户ID查找记录并逐步复制到用户表
+ *
+ * 文件格式(版本1，整数均为小端):
+ * - 文件头64字节: 魔数"TUSRSNAP"、u32版本、u32文件头长度、u64记录数、u64记录区起点、
+ *   u64索引起点、u64索引槽数(2的幂)、u64文件长度，其余补0
+ * - 记录区: 每条记录为u32记录体长度 + 记录体；记录体为u32用户ID长度、用户ID、u32密码长度、密码、
+ *   u32用户字符串长度、用户字符串
+ * - 索引区: 索引槽数个u64，每个为记录在文件中的偏移(0表示空槽)；按用户ID的FNV-1a哈希线性探测，
+ *   装载率不超过一半
+ *
+ * 映射规则:
+ * - 启动时只映射文件并校验文件头，不解析记录；用户表中没有的用户按索引在映射中查找，
+ *   找到后复制到用户表(认领)，之后只在用户表中读写
+ * - 后台线程按记录顺序把其余记录逐块认领到各自的用户表；每条记录只认领一次，已认领的记录不再复制，
+ *   因此先被按需复制、修改或删除的用户不会被映射中的旧内容覆盖
+ * - 认领一条记录时调用者持有该用户所在用户表的锁；不同用户表的记录互不相干
+ *
+ * 技术特点:
+ * - 启动耗时与用户数无关，只读取文件头
+ * - 记录按用户ID顺序写出，后台复制顺序读取映射
+ * - 每条记录与索引在访问时检查边界，损坏的文件不会越界读取
+ */
+
+#ifndef TCP_MAPPED_SNAPSHOT_H
+#define TCP_MAPPED_SNAPSHOT_H
+
+#include "TCP_System.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// 快照文件写出 - 记录先写入，索引在全部记录写出后生成
+class SnapshotFileWriter {
+private:
+    std::ofstream file;
+    unsigned long long offset;      // 下一条记录的文件偏移
+    std::vector<std::pair<unsigned int, unsigned long long> > entries;     // 每条记录的(用户ID哈希, 偏移)
+
+    SnapshotFileWriter(const SnapshotFileWriter&);
+    SnapshotFileWriter& operator=(const SnapshotFileWriter&);
+
+public:
+    SnapshotFileWriter() : offset(0) {}
+
+    bool open(const std::string& path);             // 预留文件头
+    void write(const std::string& records);         // 写出由encode追加的若干条完整记录
+    bool finish();                                  // 写出索引、回填文件头并关闭，有任何写入失败返回false
+    unsigned long long getBytes() const { return offset; }  // finish之后为文件总长度
+
+    static void encode(const User& user, std::string& out);    // 追加一条记录
+};
+
+// 映射的快照文件 - 只读映射，认领状态在内存中
+class MappedUserFile {
+private:
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mapping;
+#endif
+    unsigned long long recordCount;
+    size_t recordsEnd;              // 记录区终点(即索引起点)
+    size_t indexSlots;
+    std::vector<unsigned char> claimed;     // 每个索引槽一个认领标记，由该用户所在用户表的锁保护
+    SimpleAtomicInt remaining;              // 尚未认领的记录数
+    size_t cursor;                  // 后台复制的下一条记录偏移(只由复制线程访问)
+    size_t damaged;                 // 后台复制遇到的越界记录数
+
+    MappedUserFile(const MappedUserFile&);
+    MappedUserFile& operator=(const MappedUserFile&);
+
+    bool readId(size_t recordOffset, const unsigned char*& id, size_t& idLength) const;
+    bool decode(size_t recordOffset, User& user) const;
+    size_t findSlot(const unsigned char* id, size_t idLength, unsigned long long recordOffset) const;  // 未找到返回indexSlots
+    bool claimSlot(size_t slot, User& user);
+    void unmap();
+
+public:
+    MappedUserFile();
+    ~MappedUserFile();
+
+    static bool hasSnapshotHeader(const std::string& path);    // 文件以快照魔数开头(否则按文本格式加载)
+    bool open(const std::string& path);                         // 映射并校验文件头，失败时文件视为损坏
+
+    size_t getRecordCount() const { return static_cast<size_t>(recordCount); }
+    size_t getRemaining() const { return static_cast<size_t>(remaining.load()); }
+    size_t getDamaged() const { return damaged; }
+
+    // 调用者持有该用户所在用户表的锁: 映射中有该用户且尚未认领时认领并复制到user
+    bool claim(const std::string& userId, User& user);
+
+    // 后台复制(同一时刻只有一个线程): 取下一条记录的偏移与用户ID，记录区读完返回false
+    bool nextRecord(size_t& recordOffset, std::string& userId);
+    // 调用者持有该用户所在用户表的锁: 认领nextRecord取得的记录，已被认领过返回false
+    bool claimRecord(size_t recordOffset, const std::string& userId, User& user);
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * TCP用户系统 - 共享内存传输头文件
+ *
+ * 文件结构:
+ * 1. ShmSegmentHeader - 共享段布局: 头部之后依次是请求环(客户端写)与响应环(服务器写)
+ * 2. ShmRing - 单生产者单消费者字节环，服务器与客户端共用
+ * 3. ShmLoop - 服务线程: 轮询所属连接的请求环，交给服务器处理后把响应写入响应环
+ * 4. ShmTransport - 服务器端入口: 在--shm-socket路径上接受握手，管理服务线程
+ * 5. ShmClient - 客户端: 握手、发送请求、等待响应
+ *
+ * 握手:
+ * - 客户端连接Unix域套接字，服务器创建memfd共享段，连同服务线程的eventfd以SCM_RIGHTS传给客户端
+ * - 握手用的套接字保留为会话的控制连接，任一端关闭即结束会话
+ *
+ * 技术特点:
+ * - 环中传输与TCP连接相同的字节流(文本行或二进制帧)，服务器复制进会话接收缓冲后由processSessionInput处理，
+ *   命令处理与其他I/O模型完全共用
+ * - 两端都先自旋等待再睡眠: 服务线程睡在eventfd上(一个线程服务多个连接)，客户端睡在响应环尾指针的futex上
+ * - 生产者发布数据后才检查对端的等待标志，对端仍在自旋时一次请求往返不产生任何系统调用
+ * - 仅Linux可用
+ */
+
+#ifndef TCP_SHM_TRANSPORT_H
+#define TCP_SHM_TRANSPORT_H
+
+#include "TCP_System.h"
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// 共享段中的单个计数器 - 独占一个缓存行，避免两端写不同计数器时互相失效
+struct ShmCounter {
+    volatile uint32_t value;
+    char padding[64 - sizeof(uint32_t)];
+};
+
+// 共享段头部 - 计数器均单调递增，按环容量取模得到下标
+struct ShmSegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ringCapacity;          // 每个环的字节数(2的幂)
+    uint32_t reserved;
+    char padding[64 - 4 * sizeof(uint32_t)];
+    ShmCounter requestTail;         // 客户端写
+    ShmCounter requestHead;         // 服务器写
+    ShmCounter responseTail;        // 服务器写，客户端在其上futex等待
+    ShmCounter responseHead;        // 客户端写
+    ShmCounter serverWaiting;       // 服务线程准备睡眠时置1，客户端发布请求后据此决定是否写eventfd
+    ShmCounter clientWaiting;       // 客户端准备睡眠时置1，服务器发布响应后据此决定是否futex唤醒
+    ShmCounter serverClosed;        // 服务器已结束会话
+};
+
+// 单生产者单消费者字节环 - 各端只写自己一侧的计数器
+// 共享段可被对端任意改写: 本端的位置保存在进程内(共享段中的计数器只用于发布)，对端的计数器每次只读取一次，
+// 与本端位置之差超过环容量即视为段已损坏，此后不再读写环，由调用者关闭连接
+class ShmRing {
+private:
+    char* data;
+    uint32_t capacity;
+    volatile uint32_t* head;
+    volatile uint32_t* tail;
+    uint32_t readPos;           // 消费者一侧: 已读到的位置(本端的head)
+    uint32_t writePos;          // 生产者一侧: 已写到的位置(本端的tail)
+    bool corrupted;
+
+public:
+    ShmRing() : data(0), capacity(0), head(0), tail(0), readPos(0), writePos(0), corrupted(false) {}
+
+    void attach(char* ringData, uint32_t ringCapacity, ShmCounter& headCounter, ShmCounter& tailCounter) {
+        data = ringData;
+        capacity = ringCapacity;
+        head = &headCounter.value;
+        tail = &tailCounter.value;
+        readPos = headCounter.value;
+        writePos = tailCounter.value;
+        corrupted = false;
+    }
+
+    // 对端的计数器曾越界，环已不可用
+    bool isCorrupted() const { return corrupted; }
+
+    // 消费者: 可读字节数(段已损坏时为0)
+    size_t readable() {
+        if (corrupted) {
+            return 0;
+        }
+        uint32_t used = __atomic_load_n(tail, __ATOMIC_ACQUIRE) - readPos;
+        if (used > capacity) {
+            corrupted = true;
+            return 0;
+        }
+        return used;
+    }
+
+    // 生产者: 写入尽可能多的数据并发布，返回写入的字节数(段已损坏时为0)
+    size_t write(const char* source, size_t length) {
+        if (corrupted) {
+            return 0;
+        }
+        uint32_t used = writePos - __atomic_load_n(head, __ATOMIC_ACQUIRE);
+        if (used > capacity) {
+            corrupted = true;
+            return 0;
+        }
+        size_t space = capacity - used;
+        size_t count = length < space ? length : space;
+        size_t offset = writePos & (capacity - 1);
+        size_t first = capacity - offset < count ? capacity - offset : count;
+        memcpy(data + offset, source, first);
+        memcpy(data, source + first, count - first);
+        writePos += static_cast<uint32_t>(count);
+        __atomic_store_n(tail, writePos, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // 消费者: 读出最多length字节并归还空间，返回读出的字节数(段已损坏时为0)
+    size_t read(char* target, size_t length) {
+        size_t available = readable();
+        size_t count = length < available ? length : available;
+        size_t offset = readPos & (capacity - 1);
+        size_t first = capacity - offset < count ? capacity - offset : count;
+        memcpy(target, data + offset, first);
+        memcpy(target + first, data, count - first);
+        readPos += static_cast<uint32_t>(count);
+        __atomic_store_n(head, readPos, __ATOMIC_RELEASE);
+        return count;
+    }
+};
+
+// 共享内存服务线程 - 每个线程独立的epoll实例、唤醒eventfd与连接表
+class ShmLoop : public SessionDriver {
+private:
+    // 单个共享内存连接 - 仅由服务线程访问
+    struct Channel {
+        SimpleSharedPtr<ClientSession> session;
+        SOCKET control;                 // 握手套接字，兼作会话套接字
+        void* segment;
+        size_t segmentSize;
+        ShmSegmentHeader* header;
+        ShmRing requests;
+        ShmRing responses;
+        bool outputPending;             // 响应环已满，发送缓冲中仍有数据
+        bool closing;                   // 等待执行线程执行完剩余命令后关闭，期间不再处理请求
+
+        Channel() : control(INVALID_SOCKET), segment(0), segmentSize(0), header(0), outputPending(false), closing(false) {}
+    };
+
+    TCPUserSystemServer* server;
+    int loopIndex;
+    SOCKET listenSocket;                // 各服务线程共用的握手监听套接字(由ShmTransport创建与关闭)
+    int epollFd;
+    int wakeFd;                         // 客户端与其他线程共用的唤醒eventfd
+    unsigned long long spinNs;          // 睡眠前的自旋时间
+    SimpleAtomicBool running;
+    SimpleAtomicBool draining;          // 排空状态 - 不再接受握手与处理新请求
+    bool listenerRemoved;
+    pthread_t thread;
+    bool threadStarted;
+
+    std::vector<Channel*> channels;     // 以控制套接字描述符为下标
+    std::vector<SOCKET> active;         // 轮询顺序
+    TimerWheel timers;                  // 空闲/登录超时
+    std::vector<TimerNode*> expiredTimers;
+    unsigned long long loopNowMs;
+
+    // 其他线程(命令执行线程、挤占通知)请求的发送与关闭(关闭附带会话ID)
+    std::vector<SOCKET> remoteFlushes;
+    std::vector<std::pair<SOCKET, std::string> > remoteCloses;
+    SimpleMutex remoteMutex;
+    SimpleAtomicInt remotePending;      // 轮询时免加锁判断是否有转交的请求
+
+    // 运行统计(仅服务线程写，线程退出后读取)
+    unsigned long long acceptedCount;
+    unsigned long long sleepCount;      // 服务线程睡眠次数
+    unsigned long long clientWakeCount; // futex唤醒客户端次数
+
+    void run();
+    void wakeup();
+    bool pollChannels();                            // 处理全部连接的请求，返回是否有进展
+    bool serviceChannel(Channel* channel);
+    bool flushChannel(Channel* channel, ClientSession& session);   // 发送缓冲写入响应环，返回是否写入了数据
+    bool anyReadable();                 // 有请求可读或有连接的共享段已损坏(需要关闭)
+    bool closeIfCorrupted(Channel* channel);   // 对端改写计数器使环越界时关闭连接，返回是否已损坏
+    void setWaiting(uint32_t value);
+    void waitEvents(int timeoutMs);
+    void processRemoteRequests();
+    void acceptChannels();
+    Channel* createChannel(SOCKET control);         // 创建共享段并把描述符传给客户端
+    Channel* findChannel(SOCKET socket);
+    SessionTimeout scheduleTimeout(SimpleSharedPtr<ClientSession> session);
+    void processTimeouts();
+    void drainChannels();
+    void closeOrDefer(Channel* channel);
+    void closeChannel(Channel* channel);
+    void closeAllChannels();
+
+public:
+    ShmLoop(TCPUserSystemServer* owner, int index, SOCKET listener, unsigned spinMicroseconds);
+    ~ShmLoop();
+
+    bool start();
+    void beginDrain();
+    void stop();
+
+    unsigned long long getAcceptedCount() const { return acceptedCount; }
+    unsigned long long getSleepCount() const { return sleepCount; }
+    unsigned long long getClientWakeCount() const { return clientWakeCount; }
+
+    // SessionDriver - 服务线程内直接写入响应环，其他线程经eventfd转交
+    virtual void requestFlush(ClientSession* session);
+    virtual void requestClose(ClientSession* session);
+
+    static void* threadProc(void* param);
+};
+
+// 共享内存传输 - 握手监听套接字与服务线程组
+class ShmTransport {
+private:
+    TCPUserSystemServer* server;
+    std::string socketPath;
+    SOCKET listenSocket;
+    std::vector<ShmLoop*> loops;
+
+public:
+    ShmTransport(TCPUserSystemServer* owner, const std::string& path);
+    ~ShmTransport();
+
+    // 创建监听套接字(热重启时沿用旧进程的inherited)并启动服务线程
+    bool start(int threadCount, unsigned spinMicroseconds, SOCKET inherited = INVALID_SOCKET);
+    void beginDrain();                  // 停止接受握手，送完响应的连接关闭
+    SOCKET detachListener();            // 热重启: 取走监听套接字，stop不再关闭它、不删除套接字文件
+    void stop();                        // 停止服务线程，关闭剩余连接并删除套接字文件
+    std::string describeStats();
+};
+
+// 共享内存客户端 - 单线程使用
+class ShmClient {
+private:
+    SOCKET controlSocket;
+    int wakeFd;                         // 服务线程的eventfd
+    void* segment;
+    size_t segmentSize;
+    ShmSegmentHeader* header;
+    ShmRing requests;
+    ShmRing responses;
+    unsigned long long spinNs;
+
+    bool serverGone();                  // 服务器已结束会话或控制连接已断开
+
+public:
+    explicit ShmClient(unsigned spinMicroseconds = 50);
+    ~ShmClient();
+
+    bool connect(const std::string& path);
+    void close();
+    bool isConnected() const { return header != 0; }
+
+    // 发送请求字节流，请求环满时等待服务器消费；会话已结束返回false
+    bool send(const char* data, size_t length);
+    // 接收响应字节流，timeoutMs内没有数据返回0(负数表示一直等待)，会话已结束返回-1
+    int receive(char* buffer, size_t capacity, int timeoutMs);
+};
+
+#endif // __linux__
+
+#endif
@@ -5,19 +5,27 @@
  * 1. 平台兼容性处理 - 跨平台网络编程支持(Windows/Linux)
  * 2. 自定义同步原语 - 替代C++11标准库实现线程安全
  *    - SimpleAtomicBool: 原子布尔操作
+ *    - SimpleAtomicInt: 无锁原子计数
  *    - SimpleMutex: 互斥锁
  *    - SimpleLockGuard: RAII锁管理
+ *    - SimpleCondition: 条件变量
  *    - SimpleSharedPtr: 智能指针实现
+ *    - SimpleStringView: 不拥有内存的只读字符串片段
  * 3. 核心业务类 - 用户管理和网络通信
+ *    - ServerConfig: 服务器运行配置(I/O模型、线程数、超时等)
+ *    - InputRingBuffer: 连接接收环形缓冲，按'\n'分帧
  *    - User: 用户数据模型，支持序列化/反序列化
  *    - ClientSession: 客户端会话管理
  *    - TCPUserSystemServer: 服务器核心类，多线程处理客户端连接
- *    - ProtocolMessage: 协议消息解析
+ *    - ProtocolMessage: 协议消息解析，命令与参数为指向接收缓冲的视图
  * 
  * 技术特点:
  * - 兼容C++11及以上版本
  * - 跨平台网络编程(WinSock2/Linux Socket)
  * - 多线程安全设计
+ * - 可选的Linux epoll事件循环模型(见Event_Loop.h)与io_uring后端(见Uring_Loop.h)
+ * - epoll模型可选每核一分片: 用户表按userId分区到各事件循环，跨分片操作经无锁队列传递(见User_Shard.h)
+ * - 用户修改追加到预写日志，数据文件只在检查点整体重写(见Write_Ahead_Log.h)
  * - 自定义轻量级同步机制
  */
 
@@ -25,15 +33,20 @@
 #define TCP_USER_SYSTEM_H
 
 #include <string>
+#include <cstring>
 #include <map>
 #include <vector>
+#include <deque>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <limits>
 #include <ctime>
+#include <csignal>
 #include <stdexcept>
 
+#include "Timer_Wheel.h"
+
 // 平台兼容性处理 - 统一Windows和Linux的网络编程接口
 #ifdef _WIN32
     #include <winsock2.h>
@@ -48,18 +61,28 @@
     #endif
 #else
     #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/stat.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/uio.h>
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <fcntl.h>
     #include <sys/time.h>
     #include <pthread.h>
+    #include <errno.h>
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
     #define closesocket close
 #endif
 
+// 向已关闭的连接写入时不触发SIGPIPE(仅Linux支持该标志)
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
+#endif
+
 // 原子布尔类 - 替代std::atomic<bool>，确保多线程安全的布尔操作
 class SimpleAtomicBool {
 private:
@@ -116,8 +139,40 @@ public:
     }
 };
 
+// 原子加法 - 返回相加后的新值，供原子计数和引用计数使用
+inline long long simpleAtomicAdd(volatile long long* target, long long delta) {
+#if defined(_MSC_VER)
+    return InterlockedExchangeAdd64(target, delta) + delta;
+#else
+    return __sync_add_and_fetch(target, delta);
+#endif
+}
+
+// 原子整数类 - 基于编译器内建原子指令，适合高频计数场景
+class SimpleAtomicInt {
+private:
+    volatile long long value;
+
+public:
+    SimpleAtomicInt(long long initial = 0) : value(initial) {}
+
+    long long load() const { return simpleAtomicAdd(const_cast<volatile long long*>(&value), 0); }
+    void store(long long newValue) {
+#if defined(_MSC_VER)
+        InterlockedExchange64(&value, newValue);
+#else
+        __sync_lock_test_and_set(&value, newValue);
+        __sync_synchronize();
+#endif
+    }
+    long long add(long long delta) { return simpleAtomicAdd(&value, delta); }
+    long long increment() { return add(1); }
+    long long decrement() { return add(-1); }
+};
+
 // 简单互斥锁类 - 替代std::mutex，提供跨平台锁机制
 class SimpleMutex {
+    friend class SimpleCondition;   // 条件等待需要访问底层锁
 private:
 #ifdef _WIN32
     CRITICAL_SECTION cs;
@@ -173,6 +228,56 @@ public:
     }
 };
 
+// 条件变量类 - 替代std::condition_variable，等待前调用者必须持有关联的SimpleMutex
+class SimpleCondition {
+private:
+#ifdef _WIN32
+    CONDITION_VARIABLE cond;
+#else
+    pthread_cond_t cond;
+#endif
+
+public:
+    SimpleCondition() {
+#ifdef _WIN32
+        InitializeConditionVariable(&cond);
+#else
+        pthread_cond_init(&cond, NULL);
+#endif
+    }
+
+    ~SimpleCondition() {
+#ifndef _WIN32
+        pthread_cond_destroy(&cond);
+#endif
+    }
+
+    // 释放锁并等待通知，返回前重新获得锁(可能虚假唤醒，调用者需循环检查条件)
+    void wait(SimpleMutex& m) {
+#ifdef _WIN32
+        SleepConditionVariableCS(&cond, &m.cs, INFINITE);
+#else
+        pthread_cond_wait(&cond, &m.mutex);
+#endif
+    }
+
+    void notifyOne() {
+#ifdef _WIN32
+        WakeConditionVariable(&cond);
+#else
+        pthread_cond_signal(&cond);
+#endif
+    }
+
+    void notifyAll() {
+#ifdef _WIN32
+        WakeAllConditionVariable(&cond);
+#else
+        pthread_cond_broadcast(&cond);
+#endif
+    }
+};
+
 // 前置声明
 class ClientSession;
 
@@ -200,40 +305,42 @@ private:
 };
 
 // 简单智能指针 - 替代std::shared_ptr，实现引用计数管理
+// 引用计数使用原子操作，允许会话对象在事件循环线程与业务线程之间共享
 template<typename T>
 class SimpleSharedPtr {
 private:
     T* ptr;
-    int* ref_count;
+    volatile long long* ref_count;
+
+    void release() {
+        if (ref_count && simpleAtomicAdd(ref_count, -1) == 0) {
+            delete ptr;
+            delete ref_count;
+        }
+    }
 
 public:
     SimpleSharedPtr() : ptr(0), ref_count(0) {}
     
-    explicit SimpleSharedPtr(T* p) : ptr(p), ref_count(new int(1)) {}
+    explicit SimpleSharedPtr(T* p) : ptr(p), ref_count(new long long(1)) {}
     
     // 拷贝构造 - 增加引用计数
     SimpleSharedPtr(const SimpleSharedPtr& other) : ptr(other.ptr), ref_count(other.ref_count) {
-        if (ref_count) ++(*ref_count);
+        if (ref_count) simpleAtomicAdd(ref_count, 1);
     }
     
     // 析构函数 - 减少引用计数，计数为0时释放资源
     ~SimpleSharedPtr() {
-        if (ref_count && --(*ref_count) == 0) {
-            delete ptr;
-            delete ref_count;
-        }
+        release();
     }
     
     // 赋值操作 - 正确处理引用计数转移
     SimpleSharedPtr& operator=(const SimpleSharedPtr& other) {
         if (this != &other) {
-            if (ref_count && --(*ref_count) == 0) {
-                delete ptr;
-                delete ref_count;
-            }
+            if (other.ref_count) simpleAtomicAdd(other.ref_count, 1);
+            release();
             ptr = other.ptr;
             ref_count = other.ref_count;
-            if (ref_count) ++(*ref_count);
         }
         return *this;
     }
@@ -245,6 +352,33 @@ public:
     operator bool() const { return ptr != 0; }
 };
 
+// 字符串视图 - 指向外部缓冲的只读片段，不拥有也不复制内存，有效期由缓冲所有者决定
+struct SimpleStringView {
+    const char* data;
+    size_t length;
+
+    SimpleStringView() : data(""), length(0) {}
+    SimpleStringView(const char* text, size_t size) : data(text), length(size) {}
+    SimpleStringView(const std::string& text) : data(text.data()), length(text.length()) {}
+
+    bool empty() const { return length == 0; }
+    size_t size() const { return length; }
+
+    bool equals(const char* text, size_t size) const {
+        return length == size && memcmp(data, text, size) == 0;
+    }
+    bool operator==(const SimpleStringView& other) const { return equals(other.data, other.length); }
+    bool operator!=(const SimpleStringView& other) const { return !equals(other.data, other.length); }
+    bool operator==(const char* text) const { return equals(text, strlen(text)); }
+    bool operator!=(const char* text) const { return !equals(text, strlen(text)); }
+
+    // 需要保存内容时才复制为std::string
+    std::string str() const { return std::string(data, length); }
+};
+
+// 转义格式文本数据文件的首行 - 早期版本写出的文本文件没有这一行，其字段未转义
+const char USER_FILE_ESCAPED_MARKER[] = "#tcp-users escaped-csv v1";
+
 // 用户数据模型 - 封装用户信息，支持数据持久化
 class User {
 private:
@@ -265,28 +399,387 @@ public:
     void setPassword(const std::string& pwd) { password = pwd; }
     
     // 密码验证 - 简单明文比较(实际应用应使用哈希)
-    bool verifyPassword(const std::string& pwd) const {
-        return password == pwd;
+    bool verifyPassword(const SimpleStringView& pwd) const {
+        return pwd.equals(password.data(), password.length());
     }
 
-    // 数据序列化 - 转换为CSV格式用于文件存储
+    // 数据序列化 - 转换为CSV格式用于数据日志与带转义标记的文本数据文件
+    // 字段中的反斜杠、逗号、换行与回车以反斜杠转义，二进制协议写入的任意内容也能按行保存
     std::string serialize() const {
-        return userId + "," + password + "," + userString;
+        return escapeField(userId) + "," + escapeField(password) + "," + escapeField(userString);
     }
 
     // 数据反序列化 - 从CSV格式恢复用户对象
     static User deserialize(const std::string& data) {
-        std::istringstream iss(data);
-        std::string id, pwd, str;
-        
-        std::getline(iss, id, ',');
-        std::getline(iss, pwd, ',');
-        std::getline(iss, str);
-        
-        User user(id, pwd);
-        user.setUserString(str);
+        std::string fields[3];
+        size_t index = 0;
+        for (size_t i = 0; i < data.length(); ++i) {
+            char c = data[i];
+            if (c == '\\' && i + 1 < data.length()) {
+                char next = data[++i];
+                if (next == 'n') {
+                    fields[index] += '\n';
+                } else if (next == 'r') {
+                    fields[index] += '\r';
+                } else if (next == '\\' || next == ',') {
+                    fields[index] += next;
+                } else {
+                    fields[index] += c;     // 未知转义按原样保留(兼容转义前写入的数据)
+                    fields[index] += next;
+                }
+            } else if (c == ',' && index < 2) {
+                ++index;
+            } else {
+                fields[index] += c;
+            }
+        }
+
+        User user(fields[0], fields[1]);
+        user.setUserString(fields[2]);
+        return user;
+    }
+
+    // 早期数据文件的反序列化 - 字段未转义: 按前两个逗号切分，其余字节原样保留
+    static User deserializeLegacy(const std::string& data) {
+        size_t first = data.find(',');
+        size_t second = first == std::string::npos ? std::string::npos : data.find(',', first + 1);
+        User user(data.substr(0, first), "");
+        if (first != std::string::npos) {
+            user.setPassword(data.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1));
+        }
+        if (second != std::string::npos) {
+            user.setUserString(data.substr(second + 1));
+        }
         return user;
     }
+
+private:
+    static std::string escapeField(const std::string& field) {
+        std::string escaped;
+        escaped.reserve(field.length());
+        for (size_t i = 0; i < field.length(); ++i) {
+            char c = field[i];
+            if (c == '\\' || c == ',') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else if (c == '\r') {
+                escaped += "\\r";
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+};
+
+// 服务器I/O模型
+enum ServerIOMode {
+    IO_MODE_THREAD = 0,     // 每连接一线程，阻塞收发(全平台可用)
+    IO_MODE_EPOLL = 1,      // epoll边缘触发事件循环，少量线程复用所有连接(仅Linux)
+    IO_MODE_IO_URING = 2    // io_uring完成式事件循环，不可用时回退到epoll(仅Linux)
+};
+
+// 会话超时类型
+enum SessionTimeout {
+    SESSION_TIMEOUT_NONE = 0,
+    SESSION_TIMEOUT_IDLE = 1,       // 超过idleTimeout未收到数据
+    SESSION_TIMEOUT_LOGIN = 2       // 超过loginTimeout仍未登录
+};
+
+// 线程池等待队列满时的处理策略(每连接一线程模型)
+enum PoolOverflowPolicy {
+    POOL_OVERFLOW_QUEUE = 0,    // 阻塞接受线程直到队列有空位，新连接暂留在内核监听队列
+    POOL_OVERFLOW_REJECT = 1,   // 拒绝新连接: 回复繁忙后关闭
+    POOL_OVERFLOW_SHED = 2      // 丢弃等待最久的连接，为新连接腾出位置
+};
+
+// 用户修改的持久化模式 - 修改请求的响应在其日志记录提交后才送出
+enum DurabilityMode {
+    DURABILITY_NONE = 0,        // 日志记录只刷新到内核，进程崩溃不丢失，掉电可能丢失
+    DURABILITY_BATCHED = 1,     // 组提交: 提交线程把同一时段的记录一次写出并同步，再一起送出响应
+    DURABILITY_PER_WRITE = 2    // 每条记录写入后立即同步
+};
+
+// 检查点的快照方式
+enum SnapshotMethod {
+    SNAPSHOT_VERSIONED = 0,     // 后台线程分块写出，修改前为尚未写出的用户保留旧版本
+    SNAPSHOT_FORK = 1           // fork出的子进程写出冻结的用户表(BGSAVE，非Linux退回分块写出)
+};
+
+// 服务器线程类别 - 启用CPU绑定时各类线程按各自的序号轮流绑定到CPU列表
+enum ThreadRole {
+    THREAD_ROLE_ACCEPT = 0,     // thread模型的接受线程
+    THREAD_ROLE_IO = 1,         // epoll/io_uring事件循环线程
+    THREAD_ROLE_SHM = 2,        // 共享内存传输服务线程
+    THREAD_ROLE_WORKER = 3,     // thread模型的工作线程
+    THREAD_ROLE_EXEC = 4        // 命令执行线程
+};
+
+// 服务器运行配置 - 默认值保持原有行为，可通过命令行 --key=value 覆盖
+struct ServerConfig {
+    int port;                   // 监听端口
+    std::string dataFileName;   // 用户数据文件名(存放于users目录)
+    ServerIOMode ioMode;        // I/O模型
+    int ioThreads;              // 事件循环线程数(epoll/io_uring)，0表示按CPU核数
+    int acceptThreads;          // 每连接一线程模型的接受线程数，0表示按CPU核数
+    int listenBacklog;          // 每个监听套接字的连接队列长度
+    int workerThreads;          // 工作线程池大小(thread模型)，即可同时服务的连接数
+    int workerQueue;            // 等待工作线程的连接队列容量
+    int workerStackKb;          // 工作线程栈大小(KB)，0表示系统默认
+    PoolOverflowPolicy workerOverflow;  // 等待队列满时的处理策略
+    int execThreads;            // 命令执行线程数(epoll/io_uring)，0表示在I/O线程内直接执行
+    bool tcpNoDelay;            // 客户端连接是否禁用Nagle算法(响应已按批合并发送)
+    int idleTimeout;            // 连接空闲超时(秒)，0表示不限
+    int loginTimeout;           // 连接后(或登出后)须在该时间内登录(秒)，0表示不限
+    int shutdownTimeout;        // 停止时等待连接送完响应的期限(秒)，到期后强制关闭剩余连接
+    std::string unixSocketPath; // 本机Unix域套接字监听路径，为空表示只监听TCP端口
+    std::string shmSocketPath;  // 共享内存传输的握手套接字路径，为空表示不启用(仅Linux)
+    int shmThreads;             // 共享内存传输的服务线程数
+    int shmSpinUs;              // 共享内存两端睡眠前的自旋时间(微秒)，单核时不自旋
+    std::string handoffSocketPath;  // 热重启移交套接字路径，为空表示不启用(仅Linux)
+    int maxOutputKb;            // 每个会话发送队列的积压上限(KB)，超过时关闭连接，0表示不限
+    int maxConnections;         // 同时存在的连接(会话)上限，超过时回复ERROR|BUSY并关闭新连接，0表示不限
+    int maxInflight;            // 全局已接收未执行完的请求上限，超过时回复ERROR|BUSY，0表示不限
+    int maxQueuedKb;            // 全局已接收未执行完的请求字节上限(KB)，0表示不限
+    bool shardPerCore;          // 每核一分片: 各epoll事件循环独占一部分用户与自己的会话(仅Linux epoll)
+    std::string cpuAffinity;    // 线程CPU绑定: off、auto(进程允许的全部CPU)或CPU列表如0-3,8(仅Linux)
+    int checkpointInterval;     // 检查点间隔(秒): 日志有新记录时按此间隔重写数据文件，0表示只在停止时
+    int checkpointWalKb;        // 日志自上次检查点起超过该大小(KB)时提前做检查点，0表示不限
+    DurabilityMode durability;  // 用户修改的持久化模式
+    int commitIntervalMs;       // 组提交: 提交线程收到记录后再等待的时间(毫秒)以合并更多记录，0表示立即提交
+    int bgsaveMutations;        // 自上次检查点起修改次数达到该值时以fork快照做检查点，0表示不自动触发
+    std::string adminPassword;  // 管理命令(STATS、BGSAVE)的密码，为空表示只接受本机Unix域连接
+
+    ServerConfig();
+
+    // 应用单个配置项，未知配置项或非法取值返回false
+    bool applyOption(const std::string& key, const std::string& value);
+    // 配置项帮助信息
+    static std::string usage();
+};
+
+// 接收环形缓冲 - 每个连接一个，跨多次接收保留不完整的帧
+// 容量固定为2的幂，首次写入时才分配；recv可直接写入空闲区，分帧时只扫描新到达的数据
+// 取出的帧是指向缓冲内部的视图，在下次写入或下次取帧前有效；跨越环尾的帧拼接到线性区后返回
+class InputRingBuffer {
+private:
+    char* data;
+    char* linear;           // 跨越环尾的帧的拼接区，首次需要时才分配
+    size_t capacity;
+    size_t head;            // 读位置(单调递增，取模得到下标)
+    size_t tail;            // 写位置(单调递增)
+    size_t scanned;         // [head, scanned)内确认没有'\n'
+
+    InputRingBuffer(const InputRingBuffer&);
+    InputRingBuffer& operator=(const InputRingBuffer&);
+
+public:
+    explicit InputRingBuffer(size_t ringCapacity = 8192)
+        : data(0), linear(0), capacity(ringCapacity), head(0), tail(0), scanned(0) {}
+    ~InputRingBuffer() {
+        delete[] data;
+        delete[] linear;
+    }
+
+    size_t size() const { return tail - head; }
+    size_t freeSpace() const { return capacity - size(); }
+
+    // 可直接写入的连续空闲区(到环尾为止)，写入后调用commit
+    char* writeSpace(size_t& length) {
+        if (!data) {
+            data = new char[capacity];
+        }
+        size_t offset = tail & (capacity - 1);
+        size_t contiguous = capacity - offset;
+        length = freeSpace() < contiguous ? freeSpace() : contiguous;
+        return data + offset;
+    }
+
+    void commit(size_t length) { tail += length; }
+
+    // 复制数据到缓冲，返回实际写入的字节数(空间不足时截断)
+    size_t append(const char* source, size_t length) {
+        size_t written = 0;
+        while (written < length) {
+            size_t space;
+            char* target = writeSpace(space);
+            if (space == 0) {
+                break;
+            }
+            size_t chunk = length - written < space ? length - written : space;
+            memcpy(target, source + written, chunk);
+            commit(chunk);
+            written += chunk;
+        }
+        return written;
+    }
+
+    // 取出下一个完整帧(不含'\n')，没有完整帧时返回false
+    bool nextFrame(const char*& frame, size_t& frameLength) {
+        while (scanned < tail) {
+            size_t offset = scanned & (capacity - 1);
+            size_t contiguous = capacity - offset;
+            if (contiguous > tail - scanned) {
+                contiguous = tail - scanned;
+            }
+            const char* found = static_cast<const char*>(memchr(data + offset, '\n', contiguous));
+            if (!found) {
+                scanned += contiguous;
+                continue;
+            }
+
+            size_t end = scanned + static_cast<size_t>(found - (data + offset));
+            frameLength = end - head;
+            frame = view(head, frameLength);
+            head = end + 1;
+            scanned = head;
+            return true;
+        }
+        return false;
+    }
+
+    // 取出下一个二进制帧的负载: 1取出一帧, 0数据不完整, -1帧超过maxLength
+    int nextBinaryFrame(const char*& payload, size_t& payloadLength, size_t maxLength) {
+        if (size() < 4) {
+            return 0;
+        }
+        unsigned char header[4];
+        copyOut(head, reinterpret_cast<char*>(header), 4);
+        size_t length = (static_cast<size_t>(header[0]) << 24) | (static_cast<size_t>(header[1]) << 16) |
+                        (static_cast<size_t>(header[2]) << 8) | static_cast<size_t>(header[3]);
+        if (length + 4 > maxLength) {
+            return -1;
+        }
+        if (size() < length + 4) {
+            return 0;
+        }
+        payloadLength = length;
+        payload = view(head + 4, length);
+        head += length + 4;
+        scanned = head;
+        return 1;
+    }
+
+    void clear() { head = tail = scanned = 0; }
+
+    // 取出全部未处理的数据(热重启移交会话时使用)
+    void takeAll(std::string& target) {
+        target.resize(size());
+        if (!target.empty()) {
+            copyOut(head, &target[0], target.length());
+        }
+        head = scanned = tail;
+    }
+
+private:
+    // 绝对位置position起length字节的连续视图 - 不跨越环尾时直接指向缓冲，否则拼接到线性区
+    const char* view(size_t position, size_t length) {
+        size_t start = position & (capacity - 1);
+        if (start + length <= capacity) {
+            return data + start;
+        }
+        if (!linear) {
+            linear = new char[capacity];
+        }
+        copyOut(position, linear, length);
+        return linear;
+    }
+
+    // 从绝对位置position复制length字节(可跨越环尾)
+    void copyOut(size_t position, char* target, size_t length) const {
+        size_t start = position & (capacity - 1);
+        size_t first = capacity - start < length ? capacity - start : length;
+        memcpy(target, data + start, first);
+        memcpy(target + first, data, length - first);
+    }
+};
+
+// 二进制协议 - 客户端在收到WELCOME后发送文本命令"PROTOCOL|BINARY"切换，之后双向均使用二进制帧
+// 帧格式: [4字节负载长度(网络字节序)][负载]
+// 负载:   [1字节操作码][字段]...，每个字段为[2字节长度(网络字节序)][字节内容]
+// 请求操作码对应文本命令，响应操作码对应响应类型；字段内容任意，无需转义
+enum BinaryOpcode {
+    BIN_OP_REGISTER = 0x01,
+    BIN_OP_LOGIN = 0x02,
+    BIN_OP_FORCE_LOGIN = 0x03,
+    BIN_OP_LOGOUT = 0x04,
+    BIN_OP_DELETE = 0x05,
+    BIN_OP_CHANGE_PASSWORD = 0x06,
+    BIN_OP_SET_STRING = 0x07,
+    BIN_OP_GET_STRING = 0x08,
+    BIN_OP_QUIT = 0x09,
+    BIN_OP_STATS = 0x0A,
+    BIN_OP_BGSAVE = 0x0B,
+
+    BIN_RESP_SUCCESS = 0x81,
+    BIN_RESP_ERROR = 0x82,
+    BIN_RESP_CONFLICT = 0x83,
+    BIN_RESP_KICKED = 0x84,
+    BIN_RESP_GOODBYE = 0x85,
+    BIN_RESP_OTHER = 0xFF       // 其他响应，整条文本作为唯一字段
+};
+
+const size_t MAX_FRAME_LENGTH = 4096;           // 单帧上限(文本帧不含'\n'，二进制帧含4字节长度头)
+const size_t BINARY_HEADER_LENGTH = 4;
+const char* const BUSY_RESPONSE = "ERROR|BUSY";   // 超过准入上限时的拒绝回复(连接或请求)
+const char* const PERSIST_FAILED_RESPONSE = "ERROR|数据日志写入失败，修改未保存";  // 日志写出或同步失败后的修改请求
+const unsigned long long COMMIT_SEQ_FAILED = ~0ULL;     // takeCommitSeq: 本次修改的日志记录未能写入
+
+// 协议消息结构 - 定义客户端与服务器通信格式
+// 命令与参数是指向原始帧的视图，解析过程不分配内存；参数存放在定长数组中，超出MAX_PARAMETERS的部分忽略
+// 帧所在缓冲可能被覆盖时(如交给其他线程执行)，先调用retain把帧复制到消息自身
+struct ProtocolMessage {
+    static const size_t MAX_PARAMETERS = 8;
+
+    SimpleStringView command;                       // 命令类型
+    SimpleStringView parameters[MAX_PARAMETERS];    // 命令参数
+    size_t parameterCount;                          // 有效参数个数
+    bool shed;                                      // 超过准入上限被拒绝，执行时只回复ERROR|BUSY(保持响应顺序)
+
+    ProtocolMessage();
+    ProtocolMessage(const ProtocolMessage& other);
+    ProtocolMessage& operator=(const ProtocolMessage& other);
+    void swap(ProtocolMessage& other);
+
+    // 消息解析 - 从"COMMAND|param1|param2"格式解析，结果引用text
+    static void parse(const char* text, size_t length, ProtocolMessage& message);
+    // 消息序列化 - 转换为传输格式
+    std::string serialize() const;
+
+    // 二进制请求解码 - 负载格式错误或操作码未知时返回false，结果引用payload
+    static bool decodeBinary(const char* payload, size_t length, ProtocolMessage& message);
+    // 文本响应编码为二进制帧追加到output - "TYPE|..."中TYPE映射为操作码，
+    // CONFLICT按'|'拆分为多个字段，其余响应的剩余部分作为一个字段(可含任意字符)
+    static void appendBinaryResponse(const std::string& response, std::string& output);
+
+    // 复制所引用的帧到消息内部，之后不再依赖接收缓冲
+    void retain();
+    size_t frameSize() const { return frameLength; }    // 帧字节数(计入排队字节)
+
+private:
+    const char* frame;          // 视图所引用的帧
+    size_t frameLength;
+    bool commandInFrame;        // 二进制消息的命令名指向常量表，不随帧移动
+    bool owned;                 // frame指向storage
+    std::string storage;        // retain后的帧副本
+
+    void rebase(const char* newFrame);  // 视图整体移到newFrame上的相同偏移
+};
+
+class ClientSession;
+class UserShard;
+class ThreadPlacement;
+
+// 会话驱动接口 - 由事件循环类后端(epoll/io_uring)实现
+// sendToSession只写入发送缓冲并通知驱动，由驱动决定在哪个线程写出；跨会话通知(挤占)经requestClose由循环线程送出
+class SessionDriver {
+public:
+    virtual ~SessionDriver() {}
+    virtual void requestFlush(ClientSession* session) = 0;  // 可在任意线程调用
+    virtual void requestClose(ClientSession* session) = 0;  // 可在任意线程调用: 送出剩余响应后关闭连接
+    virtual UserShard* getShard() { return 0; }             // 分片模式下会话所属的分片
 };
 
 // 客户端会话管理 - 维护单个客户端连接状态
@@ -296,85 +789,369 @@ private:
     std::string sessionId;       // 会话唯一标识
     std::string loggedInUser;    // 当前登录用户ID
     bool isActive;              // 会话活跃状态
+    bool nonBlocking;           // 是否由事件循环以非阻塞方式驱动
+    SessionDriver* driver;      // 异步驱动(io_uring)，为空表示直接写套接字
+    bool localConnection;       // 与服务器同一用户的本机进程经Unix域套接字(含共享内存传输的握手套接字)接入，可执行管理命令
+
+    // 超时跟踪(单调时钟毫秒) - 事件循环模式下由所属循环线程的时间轮检查
+    TimerNode timeoutTimer;              // 下一次检查超时的定时器(仅由所属循环线程访问)
+    unsigned long long lastActivityMs;   // 最近一次收到数据
+    unsigned long long anonymousSinceMs; // 最近一次进入未登录状态(连接建立、登出或被挤占)
+
+    // 收发缓冲
+    InputRingBuffer inputBuffer; // 接收数据，跨多次接收保留不完整的帧
+    std::string outputBuffer;    // 尚未写入套接字的发送数据
+    SimpleMutex outputMutex;     // 发送缓冲与套接字写入保护(挤占通知可能来自其他线程)
+    int corkDepth;               // 大于0时响应只写入发送缓冲，解除后一次写出(受outputMutex保护)
+    bool inputBinary;            // 接收方向已切换为二进制帧(仅由分帧线程访问)
+    bool outputBinary;           // 发送方向已切换为二进制帧(受outputMutex保护)
+    bool outputOverflowed;       // 发送队列曾超过上限，之后的消息全部丢弃(受outputMutex保护)
+
+    // 命令调度状态(启用工作窃取调度时) - 同一会话的命令同一时刻只在一个执行线程上按序执行
+    // 分片模式下由所属分片使用(不加锁): commandScheduled表示有请求在其他分片执行，之后的命令在此排队
+    std::deque<ProtocolMessage> pendingCommands;    // 已分帧解析、等待执行的命令
+    bool commandScheduled;       // 会话已在某个执行线程的运行队列中或正在执行
+    bool closeDeferred;          // I/O线程要求关闭，待剩余命令执行完后再关闭
+    SimpleMutex commandMutex;    // 以上调度状态保护
+
+    // 组提交 - 修改请求的日志记录提交前，之后的响应暂存于heldOutput(受outputMutex保护)
+    unsigned long long commitSeq;   // 须等待提交的最大日志序号，0表示没有暂存
+    std::string heldOutput;         // 等待提交的响应(保持顺序)
+    bool closeAfterCommit;          // 连接要求关闭，待暂存的响应送出后再关闭
+    bool commitFailed;              // 等待的修改未能提交，已回复错误，之后的响应不再送出
 
 public:
-    ClientSession(SOCKET socket, const std::string& id) 
-        : clientSocket(socket), sessionId(id), loggedInUser(""), isActive(true) {}
+    ClientSession(SOCKET socket, const std::string& id, bool nonBlockingIO = false, SessionDriver* ioDriver = 0) 
+        : clientSocket(socket), sessionId(id), loggedInUser(""), isActive(true),
+          nonBlocking(nonBlockingIO), driver(ioDriver), localConnection(false), corkDepth(0), inputBinary(false), outputBinary(false), outputOverflowed(false), commandScheduled(false), closeDeferred(false),
+          commitSeq(0), closeAfterCommit(false), commitFailed(false) {
+        lastActivityMs = anonymousSinceMs = TimerWheel::nowMs();
+        timeoutTimer.context = this;
+    }
 
     SOCKET getSocket() const { return clientSocket; }
     std::string getSessionId() const { return sessionId; }
     std::string getLoggedInUser() const { return loggedInUser; }
     bool getIsActive() const { return isActive; }
+    bool isNonBlocking() const { return nonBlocking; }
+    SessionDriver* getDriver() const { return driver; }
 
-    void setLoggedInUser(const std::string& user) { loggedInUser = user; }
+    void setLoggedInUser(const std::string& user) {
+        loggedInUser = user;
+        if (user.empty()) {
+            anonymousSinceMs = TimerWheel::nowMs();     // 登录超时从登出时重新计时
+        }
+    }
     void setInactive() { isActive = false; }
+    void setLocalConnection() { localConnection = true; }
+    bool isLocalConnection() const { return localConnection; }
     bool isLoggedIn() const { return !loggedInUser.empty(); }
+
+    // 套接字关闭后置为无效，防止其他线程向已复用的描述符写入
+    void invalidateSocket() { clientSocket = INVALID_SOCKET; }
+
+    InputRingBuffer& getInputBuffer() { return inputBuffer; }
+    std::string& getOutputBuffer() { return outputBuffer; }
+    SimpleMutex& getOutputMutex() { return outputMutex; }
+    // 以下两个调用者须持有outputMutex
+    void cork() { ++corkDepth; }
+    bool uncork() { return --corkDepth == 0; }    // 返回true表示已完全解除
+    bool isCorked() const { return corkDepth > 0; }
+    void setOutputBinary() { outputBinary = true; }
+    bool isOutputBinary() const { return outputBinary; }
+    void setOutputOverflowed() { outputOverflowed = true; }
+    bool hasOutputOverflowed() const { return outputOverflowed; }
+
+    // 以下调用者须持有outputMutex
+    // 暂存之后的响应直到日志序号seq提交，返回true表示会话此前没有暂存(需登记到等待列表)
+    bool holdOutputUntil(unsigned long long seq) {
+        bool wasHeld = commitSeq != 0;
+        if (seq > commitSeq) {
+            commitSeq = seq;
+        }
+        return !wasHeld;
+    }
+    unsigned long long getCommitSeq() const { return commitSeq; }
+    std::string& getHeldOutput() { return heldOutput; }
+    // 已提交到durableSeq时把暂存的响应移入发送缓冲，仍须等待时返回false
+    bool releaseHeldOutput(unsigned long long durableSeq) {
+        if (commitSeq == 0 || commitSeq > durableSeq) {
+            return commitSeq == 0;
+        }
+        outputBuffer += heldOutput;
+        heldOutput.clear();
+        commitSeq = 0;
+        return true;
+    }
+    // 日志失败，等待的修改不会再提交: 丢弃暂存的响应(其中的SUCCESS不能送出)，连接随后关闭
+    void discardHeldOutput() {
+        heldOutput.clear();
+        commitSeq = 0;
+    }
+    void setCommitFailed() { commitFailed = true; }
+    bool hasCommitFailed() const { return commitFailed; }
+    void setCloseAfterCommit() { closeAfterCommit = true; }
+    bool isCloseAfterCommit() const { return closeAfterCommit; }
+
+    bool isInputBinary() const { return inputBinary; }
+    void setInputBinary() { inputBinary = true; }
+
+    std::deque<ProtocolMessage>& getPendingCommands() { return pendingCommands; }
+    bool isCommandScheduled() const { return commandScheduled; }
+    void setCommandScheduled(bool scheduled) { commandScheduled = scheduled; }
+    bool isCloseDeferred() const { return closeDeferred; }
+    void setCloseDeferred() { closeDeferred = true; }
+
+    TimerNode& getTimeoutTimer() { return timeoutTimer; }
+    void touch(unsigned long long nowMs) { lastActivityMs = nowMs; }
+    unsigned long long getLastActivity() const { return lastActivityMs; }
+    unsigned long long getAnonymousSince() const { return anonymousSinceMs; }
+    SimpleMutex& getCommandMutex() { return commandMutex; }
 };
 
+// 前置声明 - 事件循环定义见Event_Loop.h与Uring_Loop.h
+class EventLoop;
+class UringLoop;
+class WorkerPool;
+class WorkScheduler;
+class ShmTransport;
+class HotRestart;
+class WriteAheadLog;
+class UserTableSnapshot;
+class SnapshotWriter;
+struct SnapshotStats;
+class MappedUserFile;
+struct HandoffSession;
+
 // TCP用户系统服务器核心类 - 多线程网络服务器实现
 class TCPUserSystemServer {
+public:
+    // 命令分发表条目 - 处理函数返回要发送的响应，返回空串表示已自行发送；参数个数已按minParameters检查
+    typedef std::string (TCPUserSystemServer::*CommandHandler)(SimpleSharedPtr<ClientSession> session,
+                                                             const ProtocolMessage& msg);
+    struct CommandEntry {
+        const char* name;           // 命令名
+        size_t minParameters;       // 最少参数个数
+        const char* operation;      // 参数不足时日志中的操作名
+        CommandHandler handler;
+    };
+
 private:
     // 网络相关
-    SOCKET serverSocket;          // 服务器监听套接字
+    std::vector<SOCKET> listenSockets;  // 监听套接字，多个时以SO_REUSEPORT绑定同一端口；末尾可含Unix域监听套接字
+    SOCKET localListenSocket;     // Unix域监听套接字(同时在listenSockets中)，未启用为INVALID_SOCKET
     SimpleAtomicBool running;     // 服务器运行状态标志
+    volatile sig_atomic_t stopRequested;  // 已请求停止(由信号处理函数设置，不能加锁)，由主线程执行停止流程
     int port;                     // 监听端口
-    std::string dataFile;         // 用户数据文件路径
+    std::string dataFile;         // 文本数据文件路径(旧格式输入，只在还没有快照文件时读取)，预写日志以它为前缀
+    std::string snapshotFile;     // 二进制快照文件路径(数据文件名加.snap)，检查点只写这个文件
+    ServerConfig config;          // 运行配置
+    SimpleAtomicInt sessionCounter;  // 会话序号，保证会话ID唯一
+    SimpleAtomicInt idleTimeouts;    // 因空闲超时关闭的连接数
+    SimpleAtomicInt loginTimeouts;   // 因未在限定时间内登录而关闭的连接数
+    SimpleAtomicInt outputOverflows; // 因发送队列积压超过上限而关闭的连接数
+
+    // 准入控制 - 当前量与拒绝计数，由STATS命令与停止日志给出
+    SimpleAtomicInt connectionCount;     // 当前会话数
+    SimpleAtomicInt inflightRequests;    // 已接收未执行完的请求数
+    SimpleAtomicInt queuedRequestBytes;  // 已接收未执行完的请求字节数
+    SimpleAtomicInt rejectedConnections; // 因连接数上限被拒绝的连接数
+    SimpleAtomicInt shedRequests;        // 因在途请求或排队字节上限被拒绝的请求数
     
     // 日志管理
     ServerLogger* logger;         // 日志记录器
     
     // 数据管理 - 使用map确保有序性和查找效率
+    // 分片模式下运行期间用户分布在各分片中，users只在启动前与停止后使用；会话不进入sessions
     std::map<std::string, User> users;                              // 用户数据存储
     std::map<std::string, SimpleSharedPtr<ClientSession> > sessions; // 活跃会话管理
     SimpleMutex usersMutex;       // 用户数据访问保护
+    UserTableSnapshot* usersSnapshot;   // users的检查点快照(受usersMutex保护)
+    // 映射的二进制快照，尚未全部复制到用户表时非空；读取须持有任一用户表的锁，置空时持有全部
+    MappedUserFile* mappedUsers;
+    unsigned long long mappedLoadStartMs;   // 开始映射的时间
+    bool dataLoadFailed;                    // 快照文件无法映射(损坏或版本不符)，拒绝启动以免覆盖
+    SimpleMutex checkpointMutex;  // 检查点串行化(写出快照期间不持有usersMutex)
     SimpleMutex sessionsMutex;    // 会话数据访问保护
     
-    // 线程管理 - 为每个客户端连接创建独立处理线程
+    // 线程管理 - 固定大小的工作线程池处理客户端连接(thread模型)
+    WorkerPool* workerPool;
+
+    // 接受线程 - thread模型下每个监听套接字一个
 #ifdef _WIN32
-    std::vector<HANDLE> clientThreads;      // Windows线程句柄
+    std::vector<HANDLE> acceptThreads;
 #else
-    std::vector<pthread_t> clientThreads;   // Linux线程ID
+    std::vector<pthread_t> acceptThreads;
 #endif
 
+    // 事件循环模式 - 固定数量的循环线程复用所有连接
+    std::vector<EventLoop*> eventLoops;
+    std::vector<UringLoop*> uringLoops;
+    WorkScheduler* scheduler;       // 命令执行线程(工作窃取)，为空表示在I/O线程内执行
+    ShmTransport* shmTransport;     // 共享内存传输，未启用为空
+    HotRestart* hotRestart;         // 热重启移交通道，未启用为空
+    std::vector<UserShard*> userShards; // 分片模式下每个epoll事件循环一个用户分片，下标即分片号
+    ThreadPlacement* placement;     // 线程CPU绑定与NUMA放置，未启用为空
+    WriteAheadLog* userLog;         // 用户修改的预写日志，启动成功后打开
+    SnapshotWriter* snapshotWriter;         // 后台检查点线程，启动成功后创建
+    unsigned long long lastCheckpointMs;    // 上次请求检查点的时间(主线程访问)
+    std::vector<SimpleSharedPtr<ClientSession> > commitWaiters;    // 组提交: 有暂存响应的事件循环会话
+    SimpleMutex commitWaitersMutex;         // 以上与commitWaitersClosed保护，先于会话的outputMutex加锁
+    bool commitWaitersClosed;               // 停止时事件循环退出前置位，之后不再登记或通知驱动
+    int acceptWakeFd;               // 启用热重启时唤醒thread模型接受线程的eventfd(监听套接字要移交，不能shutdown)
+    int spareFd;                    // 预留描述符: 描述符耗尽时释放它，接受并立即关闭一个等待中的连接(仅Linux)
+    SimpleMutex spareFdMutex;       // 保护spareFd，各接受线程与事件循环共用
+    SimpleAtomicInt acceptFailures; // 连续接受失败次数，只记录第一次，恢复时记录次数
+
+    void initialize();              // 构造函数公共初始化
+    int resolveLoopCount() const;   // 事件循环线程数(0表示按CPU核数)
+    int resolveAcceptCount() const; // 接受线程数(0表示按CPU核数，不支持SO_REUSEPORT的平台为1)
+    bool openListenSockets(int count);  // 创建count个绑定同一端口的监听套接字
+    bool openLocalListenSocket();       // 按配置创建Unix域监听套接字(未配置时直接返回true)
+    bool inheritListenSockets();        // 热重启: 接管旧进程的监听套接字并重新加载用户数据，没有旧进程返回false
+    size_t tcpListenerCount() const;    // listenSockets中TCP监听套接字的个数
+    bool startShmTransport();           // 按配置启动共享内存传输(未配置时直接返回true)
+    void closeListenSockets(bool removeFiles = true);   // 热重启移交后不删除Unix域套接字文件
+    bool startAcceptThreads();          // 启动工作线程池与接受线程(thread模型)
+    void acceptLoop(SOCKET listener);   // 阻塞接受连接并提交给工作线程池
+    bool startEventLoops();         // 创建并启动epoll事件循环线程
+    void stopEventLoops();          // 停止并回收事件循环线程(epoll与io_uring)
+    size_t interruptSessions(bool force);   // 对全部会话套接字执行shutdown(只关读端或两端都关)，返回会话数
+    bool waitSessionsClosed(unsigned long long deadlineMs); // 等待全部会话结束，到期仍有会话返回false
+    bool startUringLoops();         // 创建并启动io_uring事件循环线程，内核不支持时返回false
+    void reportPlacement();         // 启动时记录各类线程的CPU绑定与NUMA节点
+
+    // 命令分发表 - 新命令只需在commandTable中增加一行
+    static const CommandEntry commandTable[];
+    static const size_t commandCount;
+    static const CommandEntry* findCommand(const SimpleStringView& command);    // 按命令名查表，常数时间
+
+    std::string executeRegister(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeLogin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeForceLogin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeLogout(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeDelete(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeChangePassword(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeSetString(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeGetString(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeProtocol(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeQuit(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeStats(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    std::string executeBgsave(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+    bool authorizeAdmin(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);   // 管理命令的权限检查
+
+    bool admitRequest(const ProtocolMessage& msg);     // 计入在途请求，超过上限时返回false(不计入)
+    std::map<std::string, User>::iterator findUser(const std::string& userId);     // 调用者持有usersMutex: 未找到时从映射的快照认领
+    void releaseMappedUsers();                          // 映射已全部复制: 持有全部用户表的锁释放映射
+    bool writeUserFile(SnapshotStats& stats);           // 快照写出到临时文件后改名为快照文件(调用者持有checkpointMutex)
+    bool forkUserFile(SnapshotStats& stats);            // 同上，由fork出的子进程写出临时文件
+    bool installUserFile(const std::string& tempFile);  // 已写出(并按需同步)的临时文件改名为快照文件
+    bool openUserLog();                                 // 启动: 日志中有记录时先做一次检查点，再打开日志
+    void checkpointIfDue();                             // 主线程: 到达检查点间隔或日志超过上限时请求后台检查点
+    void submitToShard(UserShard* shard, SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg);
+
 public:
     TCPUserSystemServer(int serverPort = 8080, const std::string& filename = "users.txt");
+    explicit TCPUserSystemServer(const ServerConfig& serverConfig);
     ~TCPUserSystemServer();
 
+    const ServerConfig& getConfig() const { return config; }
+    ServerLogger* getLogger() const { return logger; }
+
     // 服务器生命周期管理
     bool startServer();          // 启动服务器监听
-    void stopServer();           // 停止服务器并清理资源
+    void stopServer();           // 停止服务器并清理资源: 停止接受、排空连接、持久化
+    void requestStop();          // 请求停止 - 只设置标志，可在信号处理函数中调用
     bool isRunning() const { return running.load(); }
 
+    // 线程放置 - 各类线程启动时在自身线程上调用，未启用CPU绑定时不做任何事
+    bool isPlacementEnabled() const { return placement != 0; }
+    void bindCurrentThread(ThreadRole role, int index);
+
     // 客户端连接处理
+    SOCKET acceptClient(SOCKET listener, bool nonBlocking);  // 接受一个连接(新套接字带CLOEXEC)，失败返回INVALID_SOCKET并保留errno
+    bool handleAcceptFailure(SOCKET listener, int error);   // 接受失败(error为errno)，持续性错误返回true，调用者应退避后再接受
+    void noteAcceptSuccess();                               // 接受成功，此前有连续失败时记录恢复
+    SOCKET getLocalListenSocket() const { return localListenSocket; }
+    SOCKET openUnixListener(const std::string& path, int type = SOCK_STREAM);   // 绑定并监听Unix域套接字(清理遗留的套接字文件)，失败返回INVALID_SOCKET
+    std::string describeClientAddress(const sockaddr_storage& address) const;  // 日志用的对端描述(IP:端口或Unix域套接字路径)
     void handleClient(SOCKET clientSocket);        // 单个客户端处理入口
     void processClientMessage(SimpleSharedPtr<ClientSession> session, const std::string& message);
+    void processClientMessage(SimpleSharedPtr<ClientSession> session, const ProtocolMessage& msg);
+
+    // 会话生命周期 - 线程模型与事件循环模型共用
+    SimpleSharedPtr<ClientSession> openSession(SOCKET clientSocket, bool nonBlocking,
+                                               SessionDriver* driver = 0);   // 创建、注册会话并发送欢迎消息
+    bool processSessionInput(SimpleSharedPtr<ClientSession> session);         // 处理接收缓冲中的完整消息，返回false表示应关闭连接
+    bool deferSessionClose(SimpleSharedPtr<ClientSession> session);           // 仍有命令待执行时推迟关闭，之后由驱动requestClose关闭
+    bool deferCloseUntilCommit(SimpleSharedPtr<ClientSession> session);       // 有响应等待提交时推迟关闭(含跨线程的关闭请求)
+    void closeSession(SimpleSharedPtr<ClientSession> session);                // 注销会话并关闭套接字
+    bool hasPendingCommands(SimpleSharedPtr<ClientSession> session);          // 会话是否仍有命令在调度器中
+
+    // 准入控制 - 各I/O模型在接受连接与执行请求时共用
+    bool admitConnection(SOCKET clientSocket, bool reply = true);   // 超过连接数上限时(回复ERROR|BUSY并)关闭套接字，返回false
+    void finishRequest(const ProtocolMessage& msg);    // 请求执行完或被丢弃，释放其在途计数
+    void releaseRequest(size_t frameBytes);            // 同上，用于已不持有原消息的请求(分片模式跨分片执行)
+    std::string describeAdmissionStats();
+
+    // 热重启 - 旧进程移交会话，新进程接管会话
+    bool isExportingSessions() const;                                         // 正在向接管会话的新进程移交
+    bool exportSession(SimpleSharedPtr<ClientSession> session);               // 注销会话并把套接字与状态交给移交通道，不可移交时返回false
+    SimpleSharedPtr<ClientSession> adoptSession(const HandoffSession& record, bool nonBlocking,
+                                                SessionDriver* driver);      // 重建旧进程移交的会话并注册
 
     // 用户管理功能 - 核心业务逻辑
-    std::string registerUser(const std::string& userId, const std::string& password);
-    std::string loginUser(SimpleSharedPtr<ClientSession> session, const std::string& userId, const std::string& password);
+    // 参数为请求帧中的视图，只在需要保存时复制
+    std::string registerUser(const SimpleStringView& userId, const SimpleStringView& password);
+    std::string loginUser(SimpleSharedPtr<ClientSession> session, const SimpleStringView& userId, const SimpleStringView& password);
     std::string logoutUser(SimpleSharedPtr<ClientSession> session);
-    std::string deleteUser(SimpleSharedPtr<ClientSession> session, const std::string& userId, const std::string& password);
-    std::string changePassword(SimpleSharedPtr<ClientSession> session, const std::string& oldPassword, const std::string& newPassword);
+    std::string deleteUser(SimpleSharedPtr<ClientSession> session, const SimpleStringView& userId, const SimpleStringView& password);
+    std::string changePassword(SimpleSharedPtr<ClientSession> session, const SimpleStringView& oldPassword, const SimpleStringView& newPassword);
 
     // 登录冲突处理 - 支持用户挤占下线功能
     std::string handleLoginConflict(SimpleSharedPtr<ClientSession> session, 
-                                   const std::string& userId, 
-                                   const std::string& password,
+                                   const SimpleStringView& userId, 
+                                   const SimpleStringView& password,
                                    bool forceLogin);
     std::string findUserSession(const std::string& userId);
 
     // 用户数据操作
-    std::string setUserString(SimpleSharedPtr<ClientSession> session, const std::string& str);
+    std::string setUserString(SimpleSharedPtr<ClientSession> session, const SimpleStringView& str);
     std::string getUserString(SimpleSharedPtr<ClientSession> session);
 
     // 工具函数
     std::string generateSessionId();              // 生成唯一会话ID
     bool sendMessage(SOCKET socket, const std::string& message);    // 发送消息到客户端
-    std::string receiveMessage(SOCKET socket);   // 接收客户端消息
+    bool sendToSession(SimpleSharedPtr<ClientSession> session, const std::string& message);  // 按会话I/O模式发送消息
+    bool queueSessionOutput(ClientSession& session, const std::string& message, bool& overflowed);  // 调用者持有outputMutex
+    void recordOutputOverflow(SimpleSharedPtr<ClientSession> session);
+    void notifyAndClose(SimpleSharedPtr<ClientSession> session, const std::string& message);  // 跨会话通知，由目标会话的I/O上下文送出后关闭
+    int flushSessionOutput(ClientSession& session);                 // 写出发送缓冲: 1仍有剩余(非阻塞套接字), 0已写完, -1连接错误
+    int flushBlockingOutput(ClientSession& session);                // 阻塞会话在锁外写出，只由所属工作线程调用
+    void corkSession(SimpleSharedPtr<ClientSession> session);       // 开始合并响应: 之后的响应暂存于发送缓冲
+    void uncorkSession(SimpleSharedPtr<ClientSession> session);     // 结束合并并一次写出本批全部响应
+    void configureClientSocket(SOCKET clientSocket);               // 新TCP连接的套接字选项(TCP_NODELAY)，Unix域连接无需设置
+    int receiveInput(ClientSession& session);    // 阻塞接收一次数据到会话接收缓冲，返回字节数，<=0表示断开或超时
+
+    // 会话超时 - 各I/O模型共用的判定，nextDeadlineMs返回下次需要检查的时间(0表示无需检查)
+    SessionTimeout checkSessionTimeout(ClientSession& session, unsigned long long nowMs,
+                                       unsigned long long& nextDeadlineMs);
+    void recordSessionTimeout(SimpleSharedPtr<ClientSession> session, SessionTimeout kind);  // 计数并记录日志
 
     // 数据持久化 - 文件读写操作
-    void saveToFile();          // 保存用户数据到文件
-    void loadFromFile();        // 从文件加载用户数据
+    void saveToFile();          // 在调用线程上做一次检查点(停止时)
+    bool writeCheckpoint(SnapshotStats& stats, SnapshotMethod method);  // 检查点: 轮换日志后把全部用户的快照写入快照文件
+    void loadFromFile();        // 加载快照(没有时加载文本数据文件)并重放预写日志(只读，不修改文件)；没有日志时只映射快照
+    bool claimMappedUser(const std::string& userId, User& user);    // 调用者持有该用户所在用户表的锁: 从映射中认领
+    bool loadMappedUsers(size_t maxRecords);        // 复制一块映射中的用户到所在的用户表，全部复制完(或没有映射)时返回true
+    void logUserUpdate(const User& user);           // 在保护该用户的锁内调用: 记录新增或修改后的用户
+    void logUserDelete(const std::string& userId);  // 同上: 记录删除
+
+    // 组提交 - 修改请求执行后取得其日志序号，响应暂存到序号提交后再送出
+    unsigned long long takeCommitSeq();             // 当前线程最近一次执行产生的日志序号(取后清零)，没有修改返回0
+    bool holdForCommit(SimpleSharedPtr<ClientSession> session, unsigned long long seq);  // 在发送该请求的响应之前调用，记录未能写入时返回false
+    bool acceptsUserWrites();                       // 日志失败后拒绝修改，修改请求回复PERSIST_FAILED_RESPONSE
+    void releaseCommitWaiters(unsigned long long durableSeq);   // 提交线程: 放行已提交的会话并通知其驱动写出
 
     // 网络初始化
     bool initializeNetwork();   // 初始化网络环境
@@ -382,27 +1159,17 @@ public:
     
     // 多线程处理函数
 #ifdef _WIN32
-    static DWORD WINAPI clientThreadProc(LPVOID param);
+    static DWORD WINAPI acceptThreadProc(LPVOID param);
 #else
-    static void* clientThreadProc(void* param);
+    static void* acceptThreadProc(void* param);
 #endif
 };
 
-// 线程参数传递结构
-struct ThreadParam {
+// 接受线程参数
+struct AcceptParam {
     TCPUserSystemServer* server;
-    SOCKET clientSocket;
-};
-
-// 协议消息结构 - 定义客户端与服务器通信格式
-struct ProtocolMessage {
-    std::string command;                    // 命令类型
-    std::vector<std::string> parameters;    // 命令参数列表
-    
-    // 消息解析 - 从"COMMAND|param1|param2"格式解析
-    static ProtocolMessage parse(const std::string& message);
-    // 消息序列化 - 转换为传输格式
-    std::string serialize() const;
+    SOCKET listener;
+    int index;                  // 接受线程序号(CPU绑定)
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+/*
+ * TCP用户系统 - 线程绑定与NUMA放置头文件
+ *
+ * 文件结构:
+ * 1. ThreadPlacement - CPU列表、CPU所属NUMA节点与各类线程的绑定规则
+ *
+ * 绑定规则:
+ * - --cpu-affinity=auto使用进程允许运行的全部CPU，也可给出CPU列表(如0-7,16-23)
+ * - 各类线程(接受线程、I/O循环、共享内存服务线程、工作线程、命令执行线程)按各自的序号
+ *   轮流绑定到列表中的CPU，同序号的I/O循环与命令执行线程位于同一CPU
+ * - 线程启动时自行绑定，并把内存策略设为本地分配(覆盖numactl等设置的进程级策略)；
+ *   之后由该线程分配的会话、收发缓冲与用户分片都位于其所在CPU的NUMA节点
+ *
+ * 技术特点:
+ * - NUMA拓扑读取/sys/devices/system/node，不依赖libnuma
+ * - 仅Linux可用
+ */
+
+#ifndef TCP_THREAD_PLACEMENT_H
+#define TCP_THREAD_PLACEMENT_H
+
+#include "TCP_System.h"
+
+#ifdef __linux__
+
+class ThreadPlacement {
+private:
+    std::vector<int> cpus;              // 可绑定的CPU，按编号升序
+    std::vector<int> cpuNodes;          // 以CPU编号为下标的NUMA节点，未知为-1
+    int nodeCount;
+
+    void loadTopology();
+    static bool parseCpuList(const std::string& text, std::vector<int>& result);
+
+public:
+    ThreadPlacement();
+
+    // 按配置确定CPU列表 - spec为auto或CPU列表；列表格式错误或与进程允许的CPU没有交集时返回false
+    bool configure(const std::string& spec, std::string& error);
+
+    int cpuFor(int index) const { return cpus[static_cast<size_t>(index) % cpus.size()]; }
+    int nodeOf(int cpu) const;
+
+    // 在当前线程上调用: 绑定到第index个位置的CPU并改为本地内存分配，失败时返回false并给出原因
+    bool bindCurrentThread(int index, std::string& error) const;
+
+    // 启动时的放置报告 - CPU与NUMA节点概况，以及某类count个线程的绑定
+    std::string describeTopology() const;
+    std::string describeRole(const char* role, int count) const;
+};
+
+#endif // __linux__
+
+#endif
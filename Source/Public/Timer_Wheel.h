@@ -0,0 +1,74 @@
+/*
+ * TCP用户系统 - 分层时间轮头文件
+ *
+ * 文件结构:
+ * 1. TimerNode - 侵入式定时器节点，嵌入在被计时的对象中(如ClientSession)
+ * 2. TimerWheel - 4层 x 64槽的分层时间轮
+ *    - 第k层每槽跨度为64^k个刻度，到期时间越远所在层越高
+ *    - 刻度推进到高层槽的边界时，该槽节点重新插入(逐层下沉)，最终在第0层到期
+ *
+ * 技术特点:
+ * - 插入、删除O(1)，节点为双向链表成员，不分配内存
+ * - 单线程使用: 每个事件循环拥有自己的时间轮，无需加锁
+ * - nextWaitMs给出距下一个非空槽或下沉边界的等待时间，空闲时不必逐刻度唤醒
+ */
+
+#ifndef TCP_TIMER_WHEEL_H
+#define TCP_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <vector>
+
+// 定时器节点 - 未加入时间轮时prev/next为空
+struct TimerNode {
+    TimerNode* prev;
+    TimerNode* next;
+    unsigned long long expires;     // 到期刻度
+    void* context;                  // 所属对象
+
+    TimerNode() : prev(0), next(0), expires(0), context(0) {}
+    bool isLinked() const { return prev != 0; }
+};
+
+// 分层时间轮
+class TimerWheel {
+private:
+    enum {
+        LEVELS = 4,
+        SLOT_BITS = 6,
+        SLOTS = 1 << SLOT_BITS
+    };
+
+    TimerNode slots[LEVELS][SLOTS];     // 各槽链表的哨兵节点
+    unsigned long long currentTick;     // 已处理到的刻度
+    unsigned long long startMs;         // 第0刻度对应的单调时钟
+    unsigned tickMs;                    // 刻度长度(毫秒)
+    size_t count;                       // 时间轮中的节点数
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    void link(TimerNode* node);         // 按到期刻度放入对应层的槽
+    static void unlink(TimerNode* node);
+    void cascade(int level);            // 下沉第level层当前槽的全部节点
+
+public:
+    explicit TimerWheel(unsigned tickMilliseconds = 100);
+
+    // 在单调时钟deadlineMs到期，已在时间轮中则先移除；过期时间已过时在下一刻度到期
+    void schedule(TimerNode* node, unsigned long long deadlineMs);
+    void cancel(TimerNode* node);
+
+    // 推进到nowMs，到期节点移出时间轮并追加到expired
+    void advance(unsigned long long nowMs, std::vector<TimerNode*>& expired);
+
+    // 距下一次需要推进的毫秒数，时间轮为空时返回-1
+    int nextWaitMs(unsigned long long nowMs) const;
+
+    size_t size() const { return count; }
+
+    // 单调时钟(毫秒)
+    static unsigned long long nowMs();
+};
+
+#endif
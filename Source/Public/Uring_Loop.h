@@ -0,0 +1,171 @@
+/*
+ * TCP用户系统 - io_uring I/O后端头文件
+ *
+ * 文件结构:
+ * 1. UringQueue - io_uring提交/完成队列的最小封装(直接使用系统调用，不依赖liburing)
+ * 2. UringLoop - 基于io_uring的完成式事件循环
+ *    - 多次触发accept(IORING_ACCEPT_MULTISHOT)直接在本循环独占的监听套接字上接受连接，
+ *      启用Unix域套接字时各循环在其上也各提交一个accept，由内核分配新连接；
+ *      持续失败(如描述符耗尽)时以超时请求延后重新提交
+ *    - 多次触发recv + 提供缓冲环(provided buffer ring)，无需为每个连接预留接收缓冲
+ *    - send由循环线程统一提交，跨线程发送通过eventfd唤醒
+ *    - 空闲/登录超时由本循环的分层时间轮跟踪，以IORING_OP_TIMEOUT在最近的检查时间唤醒
+ *    - 服务器停止时先进入排空状态: 不再接受与处理新请求，全部连接送完剩余响应后关闭
+ *    - 热重启时取消在途accept与recv(监听套接字与连接由新进程继续使用)，连接空闲后移交给新进程
+ *
+ * 技术特点:
+ * - 会话与命令分发与epoll/线程模型共用(openSession/processSessionInput/closeSession)
+ * - 内核不支持io_uring或提供缓冲环时，服务器回退到epoll事件循环
+ * - 内核不支持多次触发accept/recv时自动降级为单次提交
+ */
+
+#ifndef TCP_URING_LOOP_H
+#define TCP_URING_LOOP_H
+
+#include "TCP_System.h"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+
+// io_uring队列封装 - 负责映射提交/完成环并提供取SQE、提交、收割CQE操作
+class UringQueue {
+private:
+    int ringFd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqRingPtr;
+    size_t sqRingSize;
+    void* cqRingPtr;
+    size_t cqRingSize;
+    size_t sqesSize;
+    unsigned pendingSubmit;           // 已填充但尚未提交的SQE数量
+
+public:
+    UringQueue();
+    ~UringQueue();
+
+    bool setup(unsigned entries);     // 创建io_uring实例并映射共享内存
+    void destroy();
+    int getFd() const { return ringFd; }
+
+    struct io_uring_sqe* getSqe();    // 获取空闲SQE，队列满时先提交
+    int submitAndWait(unsigned waitCount);
+    struct io_uring_cqe* peekCqe();   // 查看下一个完成事件，无事件返回NULL
+    void advanceCq();                 // 消费一个完成事件
+};
+
+// io_uring事件循环 - 每个实例独占一个线程和一个io_uring实例
+class UringLoop : public SessionDriver {
+private:
+    // 单个连接的异步操作状态 - 仅由循环线程访问
+    struct Connection {
+        SimpleSharedPtr<ClientSession> session;
+        bool recvArmed;          // 是否有recv在途
+        bool sendInflight;       // 是否有send在途
+        bool closing;            // 已请求关闭，等待在途操作完成
+        bool cancelRequested;    // 热重启移交: 已提交取消在途recv
+        std::string sending;     // 在途send引用的数据，完成前保持不变
+        size_t sendOffset;       // 已发送字节数
+
+        Connection() : recvArmed(false), sendInflight(false), closing(false), cancelRequested(false), sendOffset(0) {}
+    };
+
+    TCPUserSystemServer* server;
+    int loopIndex;
+    SOCKET listenSocket;             // 本循环独占的SO_REUSEPORT监听套接字
+    SOCKET localListenSocket;        // 各循环共用的Unix域监听套接字，未启用为INVALID_SOCKET
+    UringQueue ring;
+    int wakeFd;                      // 跨线程唤醒eventfd
+    uint64_t wakeValue;              // eventfd读取目标
+    SimpleAtomicBool running;
+    SimpleAtomicBool draining;       // 排空状态 - 不再接受新连接与处理新请求
+    bool drainStarted;               // 是否已对现有连接发起关闭(仅循环线程访问)
+    SimpleAtomicBool handingOff;     // 热重启排空 - 监听套接字不关闭，连接尽量移交给新进程
+    pthread_t thread;
+    bool threadStarted;
+
+    // 提供缓冲环 - 内核在数据到达时才从中挑选接收缓冲
+    void* bufferRing;
+    size_t bufferRingSize;
+    char* bufferPool;
+    unsigned short bufferTail;
+
+    bool multishotAccept;            // 内核是否支持多次触发accept
+    bool multishotRecv;              // 内核是否支持多次触发recv
+
+    std::vector<Connection*> connections;   // 以套接字描述符为下标
+    std::vector<SOCKET> dirtySockets;       // 本线程产生、待提交send的连接
+
+    // 会话超时 - 同一时刻可能有多个超时请求在途，只有编号最新的一个对应timerArmedMs
+    TimerWheel timers;
+    std::vector<TimerNode*> expiredTimers;
+    unsigned long long loopNowMs;           // 本轮完成事件处理开始时的单调时钟
+    unsigned long long timerArmedMs;        // 在途超时请求的唤醒时间，0表示没有
+    unsigned timerSequence;                 // 超时请求编号(user_data低32位)
+    struct __kernel_timespec timerSpec;     // 超时请求的相对时间，提交时由内核读取
+    struct __kernel_timespec acceptRetrySpec;   // accept持续失败后重新提交前的等待时间
+
+    std::vector<SOCKET> remoteFlushes;      // 其他线程请求发送的连接
+    std::vector<std::pair<SOCKET, std::string> > remoteCloses;  // 其他线程请求关闭的连接(套接字 + 会话ID)
+    SimpleMutex remoteMutex;
+
+    // 热重启接管的会话 - 循环线程启动前由服务器加入，启动后提交recv
+    std::vector<SimpleSharedPtr<ClientSession> > adoptedSessions;
+
+    bool setupBufferRing();
+    void recycleBuffer(unsigned short bufferId);
+    void armAccept(SOCKET listener);
+    void armAcceptRetry(SOCKET listener);   // 描述符耗尽时accept立即失败，等待一段时间再重新提交
+    void armRecv(SOCKET socket);
+    void armWake();
+    void armTimer();                     // 时间轮需要更早唤醒时提交新的超时请求
+    bool cancelRequest(uint64_t userData);  // 取消user_data对应的在途请求
+    SessionTimeout scheduleTimeout(SimpleSharedPtr<ClientSession> session);  // 按下一个超时期限计时，已超时时返回超时类型
+    void processTimeouts();              // 关闭已超时的会话
+    void submitSend(SOCKET socket);
+    void submitDirtySends();
+    void handleCompletion(struct io_uring_cqe* cqe);
+    void handleAccept(SOCKET listener, int result, unsigned flags);
+    void handleRecv(SOCKET socket, int result, unsigned flags);
+    void handleSend(SOCKET socket, int result);
+    void beginClose(SOCKET socket);
+    void closeOrDefer(SOCKET socket);    // 会话仍有命令在执行线程中时推迟关闭
+    void wakeup();
+    void finishCloseIfIdle(SOCKET socket);
+    void drainConnections();             // 排空状态下首次运行时对全部连接发起关闭
+    bool exportingSessions() const;      // 热重启且新进程接管会话
+    void exportConnections();            // 移交已没有在途操作的连接
+    void registerAdoptedSessions();      // 接管的会话提交recv并继续处理
+    void closeAllConnections();
+    void run();
+
+public:
+    UringLoop(TCPUserSystemServer* owner, int index, SOCKET listener, SOCKET localListener = INVALID_SOCKET);
+    ~UringLoop();
+
+    bool initialize();               // 创建io_uring、缓冲环与唤醒描述符
+    bool start();                    // 启动循环线程
+    void adoptSession(SimpleSharedPtr<ClientSession> session);  // 热重启接管的会话，须在start前调用
+    void beginDrain(bool handoff = false);  // 进入排空状态(不等待)，连接全部关闭或移交后由stop回收线程
+    void stop();                     // 请求停止并等待线程退出
+
+    // SessionDriver - 任意线程请求发送会话的发送缓冲
+    virtual void requestFlush(ClientSession* session);
+    virtual void requestClose(ClientSession* session);
+
+    static void* threadProc(void* param);
+};
+
+#endif // __linux__
+
+#endif
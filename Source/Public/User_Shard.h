@@ -0,0 +1,201 @@
+/*
+ * TCP用户系统 - 分片模式(每核一分片)头文件
+ *
+ * 文件结构:
+ * 1. ShardMessage - 分片之间传递的消息: 用户操作请求与结果、挤占通知、登出通知
+ * 2. ShardQueue - 多生产者单消费者无锁队列(侵入式链表，生产者只做一次原子交换)
+ * 3. UserShard - 一个epoll事件循环独占的用户分区与登录表
+ *
+ * 分片规则:
+ * - 分片数等于事件循环数，用户按userId的FNV-1a哈希取模归属某个分片，只由该分片的循环线程读写
+ * - 会话归属接受它的循环(所属分片)；会话的请求若操作其他分片的用户，作为消息发往用户所在分片执行，
+ *   结果发回所属分片后再更新会话登录状态并送出响应
+ * - 用户当前登录的会话记录在用户所在分片的登录表中，挤占与冲突检查不再扫描全局会话表
+ * - 同一会话有请求在其他分片执行时，后续请求在会话上排队，保证响应顺序与请求顺序一致
+ *
+ * 技术特点:
+ * - 请求处理路径上不经过usersMutex与sessionsMutex，分片之间只通过无锁队列与eventfd通信
+ * - 每个分片只有一个消费者线程；唤醒标志合并同一批消息的eventfd写入
+ * - 分片的写锁只在修改用户数据与检查点分块读取快照时持有，写磁盘时不持有
+ * - 映射的数据文件尚未全部复制时，检查点线程也向users写入，查找用户改在写锁内进行
+ * - 启用CPU绑定时分片由所属循环线程在其NUMA节点上重建
+ * - 仅Linux epoll模式可用
+ */
+
+#ifndef TCP_USER_SHARD_H
+#define TCP_USER_SHARD_H
+
+#include "TCP_System.h"
+#include "User_Snapshot.h"
+
+#ifdef __linux__
+
+class EventLoop;
+
+// 分片消息类型
+enum ShardMessageType {
+    SHARD_REQUEST = 0,      // 会话所属分片 -> 用户所在分片: 执行用户操作
+    SHARD_REPLY = 1,        // 用户所在分片 -> 会话所属分片: 操作结果
+    SHARD_KICK = 2,         // 用户所在分片 -> 被挤占会话的所属分片
+    SHARD_LOGOUT = 3        // 会话所属分片 -> 用户所在分片: 会话登出或结束，清除登录表
+};
+
+// 跨分片执行的用户操作
+enum ShardOperation {
+    SHARD_OP_REGISTER = 0,
+    SHARD_OP_LOGIN,
+    SHARD_OP_FORCE_LOGIN,
+    SHARD_OP_DELETE,
+    SHARD_OP_CHANGE_PASSWORD,
+    SHARD_OP_SET_STRING,
+    SHARD_OP_GET_STRING
+};
+
+// 操作结果对会话登录状态的影响，由会话所属分片应用
+enum ShardEffect {
+    SHARD_EFFECT_NONE = 0,
+    SHARD_EFFECT_LOGIN = 1,     // 会话登录为userId
+    SHARD_EFFECT_LOGOUT = 2     // 会话登出(删除了当前登录的用户)
+};
+
+// 分片消息 - 请求与结果复用同一个对象，由最后一个处理它的分片释放
+struct ShardMessage {
+    ShardMessage* next;             // 队列链接(原子访问)
+    ShardMessageType type;
+    ShardOperation operation;
+    int homeShard;                  // 会话所属分片
+    SOCKET socket;                  // 会话标识: 套接字 + 会话ID(防止描述符已被复用)
+    std::string sessionId;
+    std::string userId;             // 操作的用户
+    std::string sessionUser;        // 请求时会话已登录的用户
+    std::string arguments[2];       // 密码、强制登录选择、字符串等参数
+    std::string response;           // 操作结果(SHARD_REPLY)
+    ShardEffect effect;
+    size_t requestBytes;            // 请求帧字节数，执行完后释放准入计数
+    unsigned long long commitSeq;   // 修改的日志序号(SHARD_REPLY)，响应在其提交后送出，0表示没有修改
+
+    ShardMessage() : next(0), type(SHARD_REQUEST), operation(SHARD_OP_REGISTER), homeShard(0),
+                     socket(INVALID_SOCKET), effect(SHARD_EFFECT_NONE), requestBytes(0), commitSeq(0) {}
+};
+
+// 多生产者单消费者无锁队列 - 生产者原子交换队尾后链接前驱；消费者从哨兵节点开始读取，
+// 生产者交换后尚未链接时暂时读不到该消息，由生产者随后的唤醒保证再次读取
+class ShardQueue {
+private:
+    ShardMessage stub;              // 哨兵节点
+    ShardMessage* head;             // 最后入队的节点(生产者原子交换)
+    ShardMessage* tail;             // 下一个出队的节点(仅消费者访问)
+
+    ShardQueue(const ShardQueue&);
+    ShardQueue& operator=(const ShardQueue&);
+
+public:
+    ShardQueue() : head(&stub), tail(&stub) {}
+
+    // 任意线程
+    void push(ShardMessage* message) {
+        __atomic_store_n(&message->next, static_cast<ShardMessage*>(0), __ATOMIC_RELAXED);
+        ShardMessage* previous = __atomic_exchange_n(&head, message, __ATOMIC_ACQ_REL);
+        __atomic_store_n(&previous->next, message, __ATOMIC_RELEASE);
+    }
+
+    // 仅消费者线程 - 队列为空(或最后一个消息尚未链接)时返回空
+    ShardMessage* pop() {
+        ShardMessage* first = tail;
+        ShardMessage* next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+        if (first == &stub) {
+            if (!next) {
+                return 0;
+            }
+            tail = first = next;
+            next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+        }
+        if (next) {
+            tail = next;
+            return first;
+        }
+        if (first != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        push(&stub);    // first是最后一个节点，放回哨兵后才能取出它
+        next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+        if (next) {
+            tail = next;
+            return first;
+        }
+        return 0;
+    }
+};
+
+// 用户分片 - 除标注外只由所属事件循环线程访问
+class UserShard {
+private:
+    // 用户当前登录的会话
+    struct Owner {
+        int shard;
+        SOCKET socket;
+        std::string sessionId;
+    };
+
+    TCPUserSystemServer* server;
+    int index;
+    const std::vector<UserShard*>* peers;   // 全部分片，下标即分片号
+    EventLoop* loop;
+
+    std::map<std::string, User> users;      // 本分片的用户
+    std::map<std::string, Owner> owners;    // 本分片用户的登录表
+    SimpleMutex writeMutex;                 // 修改users时持有；检查点线程持有它分块读取快照或fork
+    UserTableSnapshot snapshot;             // 检查点快照(受writeMutex保护)
+
+    ShardQueue inbox;
+    int wakePending;                        // 已写eventfd、消费者尚未开始读取(原子访问)
+    int mappedPending;                      // 映射的数据文件尚未全部复制到users(原子访问)
+
+    // 运行统计(仅循环线程写，停止后读取)
+    unsigned long long localOperations;     // 在本分片直接执行的用户操作
+    unsigned long long forwardedOperations; // 发往其他分片执行的用户操作
+    unsigned long long servedOperations;    // 替其他分片执行的用户操作
+    unsigned long long kicksSent;           // 发往其他分片的挤占通知
+    unsigned long long wakeups;             // 写eventfd唤醒本分片的次数(原子访问)
+
+    UserShard* shardFor(const std::string& userId) const;
+    void post(ShardMessage* message);                       // 任意线程: 入队并按需唤醒
+    void dispatch(SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg);
+    bool buildRequest(ClientSession& session, const ProtocolMessage& msg, ShardMessage& request,
+                      std::string& response);               // false表示在本地直接回复response
+    void execute(ShardMessage& request);                    // 在用户所在分片执行，结果写回request
+    void applyReply(ShardMessage& reply);                   // 在会话所属分片应用结果并继续执行排队的请求
+    void applyKick(const ShardMessage& kick);
+    void releaseOwner(const std::string& userId, const std::string& sessionId);
+    void notifyLogout(const std::string& userId, const std::string& sessionId);
+    void drainPending(SimpleSharedPtr<ClientSession> session);
+
+public:
+    UserShard(TCPUserSystemServer* owner, int shardIndex, const std::vector<UserShard*>* allShards, EventLoop* ownerLoop);
+    ~UserShard();
+
+    int getIndex() const { return index; }
+    static int shardOf(const std::string& userId, size_t shardCount);
+
+    // 启动前与停止后由服务器调用(循环线程未运行)；运行期间须持有写锁(fork快照)
+    std::map<std::string, User>& getUsers() { return users; }
+    void adoptLogin(const std::string& userId, int homeShard, SOCKET socket, const std::string& sessionId);
+
+    // 所属循环线程
+    void localize();                                        // 在本线程的NUMA节点上重建用户表与登录表
+    std::map<std::string, User>::iterator findUser(const std::string& userId);  // 未找到时从映射的数据文件认领(启动时也可调用)
+    void submit(SimpleSharedPtr<ClientSession> session, ProtocolMessage& msg);  // 按序执行会话的一条请求
+    void processInbox();
+    void sessionClosed(ClientSession& session);            // 会话结束: 释放排队请求，清除登录表
+
+    // 任意线程
+    void beginSnapshot();                                   // 在写锁内开始检查点快照，之后由检查点线程分块读取
+    void setMappedPending(bool pending);                    // 创建时置位；映射全部复制后在写锁内清除
+    UserTableSnapshot& getSnapshot() { return snapshot; }
+    SimpleMutex& getWriteMutex() { return writeMutex; }     // fork快照: 持有期间fork，子进程得到一致的users
+    std::string describeStats();
+};
+
+#endif // __linux__
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * TCP用户系统 - 用户表快照与后台检查点头文件
+ *
+ * 文件结构:
+ * 1. SnapshotStats - 一次快照写出的统计
+ * 2. UserTableSnapshot - 用户表的一致性只读视图(写时保留旧版本)
+ * 3. ForkedSnapshot - fork出的子进程写出冻结的用户表(仅Linux)
+ * 4. SnapshotWriter - 后台检查点线程
+ *
+ * 快照规则:
+ * - begin()在保护用户表的锁内记下快照时刻，不复制任何数据
+ * - 写出线程按用户ID顺序分块读取，每块只在锁内序列化到内存，写磁盘时不持有锁
+ * - 快照期间的修改在改动前调用beforeWrite()：该用户尚未被写出且还没有保留过旧版本时，
+ *   保留其快照时刻的内容(或"不存在")；已写出的用户不再保留
+ * - 读取时保留的旧版本优先于表中的当前内容，快照时刻之后新增的用户被跳过、删除的用户照常写出，
+ *   因此写出的内容恰好是begin()时刻的用户表
+ *
+ * fork快照(BGSAVE):
+ * - 父进程在全部用户表的锁内fork，子进程得到fork时刻的用户表，父进程随即解锁继续服务
+ * - 子进程只有调用fork的线程，不使用日志、锁与套接字: 先关闭继承的其余文件描述符，
+ *   写出临时文件后读取自身的私有脏页量(写时复制增长)，经管道交给父进程
+ * - 父进程修改的页由内核复制，修改请求只在fork期间等待
+ *
+ * 技术特点:
+ * - 额外内存只与快照期间被修改的用户数成正比
+ * - 修改路径上只多一次有序表查找(快照进行中且该用户尚未写出时)
+ * - fork快照不需要保留旧版本，额外内存是被复制的页
+ */
+
+#ifndef TCP_USER_SNAPSHOT_H
+#define TCP_USER_SNAPSHOT_H
+
+#include "TCP_System.h"
+
+// 每次在用户表的锁内编码的用户数 - 决定修改请求最长等待多久；子进程按同样大小分块写出
+const size_t SNAPSHOT_CHUNK_RECORDS = 1024;
+
+// 一次快照写出的统计
+struct SnapshotStats {
+    size_t records;                 // 写出的用户数
+    size_t preserved;               // 快照期间被修改、写出的是保留旧版本的用户数
+    unsigned long long bytes;       // 快照文件字节数
+    bool forked;                    // 由fork出的子进程写出
+    unsigned long long forkMs;      // fork耗时(期间持有全部用户表的锁)
+    unsigned long long cowBytes;    // 子进程结束时的私有脏页字节数(写时复制增长)
+
+    SnapshotStats() : records(0), preserved(0), bytes(0), forked(false), forkMs(0), cowBytes(0) {}
+};
+
+
+// 用户表快照 - 用户表与本对象都由调用者给出的同一把锁保护
+class UserTableSnapshot {
+private:
+    // 快照时刻的用户内容
+    struct PreservedUser {
+        bool existed;               // 快照时刻用户是否存在(否则是快照之后新增的)
+        User user;
+    };
+
+    std::map<std::string, User>* table;
+    SimpleMutex* tableMutex;
+    bool active;
+    bool started;                   // cursor有效(已写出至少一个用户ID)
+    std::string cursor;             // 已写出的最大用户ID，之前的用户不再需要保留旧版本
+    std::map<std::string, PreservedUser> preserved;     // 只含大于cursor的用户ID
+
+    UserTableSnapshot(const UserTableSnapshot&);
+    UserTableSnapshot& operator=(const UserTableSnapshot&);
+
+public:
+    UserTableSnapshot(std::map<std::string, User>* users, SimpleMutex* usersMutex)
+        : table(users), tableMutex(usersMutex), active(false), started(false) {}
+
+    // 以下两个调用者持有tableMutex
+    void begin();
+    void beforeWrite(const std::string& userId);    // 修改、新增或删除该用户之前调用
+
+    // 写出线程: 在锁内把至多maxRecords个用户编码为快照文件记录(SnapshotFileWriter::encode)追加到out，
+    // 快照已全部读完时返回true
+    bool readChunk(std::string& out, size_t maxRecords, SnapshotStats& stats);
+};
+
+#ifdef __linux__
+// fork快照 - 一次使用
+class ForkedSnapshot {
+private:
+    pid_t child;
+    int resultPipe;                 // 父进程读端
+
+    ForkedSnapshot(const ForkedSnapshot&);
+    ForkedSnapshot& operator=(const ForkedSnapshot&);
+
+    static void runChild(const std::vector<const std::map<std::string, User>*>& tables,
+                         const std::string& tempFile, bool durable, int resultFd);
+    static unsigned long long privateDirtyBytes();
+
+public:
+    ForkedSnapshot() : child(-1), resultPipe(-1) {}
+    ~ForkedSnapshot();
+
+    // 调用者持有tables全部的锁: fork后立即返回，子进程把tables依次写入tempFile(durable时同步到磁盘)
+    bool start(const std::vector<const std::map<std::string, User>*>& tables, const std::string& tempFile,
+               bool durable, SnapshotStats& stats);
+    // 不持有锁: 等待子进程退出并取回统计，子进程写出失败返回false
+    bool wait(SnapshotStats& stats);
+};
+#endif
+
+// 后台检查点线程 - 由主线程按检查点条件请求，写出期间请求处理不受影响
+class SnapshotWriter {
+private:
+    TCPUserSystemServer* server;
+
+    SimpleMutex mutex;
+    SimpleCondition condition;
+    bool requested;                 // 有待执行的检查点
+    bool loadRequested;             // 待复制映射的数据文件(启动后一次)
+    SnapshotMethod method;          // 待执行的检查点的快照方式
+    bool busy;                      // 正在执行检查点
+    bool stopping;
+
+    // 统计(受mutex保护)
+    unsigned long long completed;
+    unsigned long long failed;
+    unsigned long long totalMs;
+    unsigned long long lastMs;
+    SnapshotStats last;
+    unsigned long long forkSaves;   // 其中由子进程写出的次数
+    unsigned long long maxCowBytes; // 子进程写时复制增长的最大值
+
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    bool threadStarted;
+
+    SnapshotWriter(const SnapshotWriter&);
+    SnapshotWriter& operator=(const SnapshotWriter&);
+
+    void run();
+    void loadMapped();
+
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID param);
+#else
+    static void* threadProc(void* param);
+#endif
+
+public:
+    explicit SnapshotWriter(TCPUserSystemServer* owner);
+    ~SnapshotWriter();
+
+    bool start();
+    void stop();                    // 等待进行中的检查点完成，尚未开始的请求不再执行
+
+    bool request(SnapshotMethod snapshotMethod);    // 已有检查点待执行或正在执行时返回false
+    void requestLoad();                             // 先于之后的检查点，分块复制映射的数据文件到用户表
+    std::string describeStats();
+    std::string describeCounters();                 // STATS命令用的键值对
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * TCP用户系统 - 工作窃取命令调度器头文件
+ *
+ * 文件结构:
+ * 1. WorkScheduler - 事件循环模式下的命令执行线程组
+ *    - I/O线程分帧后把命令追加到会话的待执行队列，会话首次变为可运行时进入某个执行线程的运行队列
+ *    - 执行线程从自己的运行队列头部取会话，批量执行其命令，未执行完的会话重新排到队尾
+ *    - 空闲执行线程从其他线程运行队列的尾部窃取整个会话
+ *
+ * 技术特点:
+ * - 调度单位是会话而不是单条命令，同一会话同一时刻只在一个线程上执行，命令顺序不变
+ * - 少数高频写入的连接不会独占某个线程: 同队列的其他会话会被空闲线程窃取
+ * - 会话的关闭推迟到其剩余命令执行完毕(见TCPUserSystemServer::deferSessionClose)
+ */
+
+#ifndef TCP_WORK_SCHEDULER_H
+#define TCP_WORK_SCHEDULER_H
+
+#include "TCP_System.h"
+
+// 工作窃取调度器 - 每个执行线程一个运行队列
+class WorkScheduler {
+private:
+    // 单个执行线程的状态
+    struct Worker {
+        WorkScheduler* scheduler;
+        int index;
+        std::deque<SimpleSharedPtr<ClientSession> > runQueue;   // 可运行会话，头部自取、尾部被窃取
+        SimpleMutex mutex;                                       // 运行队列保护
+#ifdef _WIN32
+        HANDLE thread;
+#else
+        pthread_t thread;
+#endif
+        bool threadStarted;
+
+        Worker() : scheduler(0), index(0), threadStarted(false) {}
+    };
+
+    TCPUserSystemServer* server;
+    std::vector<Worker*> workers;
+
+    SimpleAtomicInt readyCount;         // 全部运行队列中的会话数
+    SimpleMutex idleMutex;              // 空闲等待保护
+    SimpleCondition idleCondition;      // 有会话可运行或停止
+    SimpleAtomicBool stopping;
+
+    // 运行统计
+    SimpleAtomicInt executedCount;      // 已执行命令数
+    SimpleAtomicInt stealCount;         // 窃取会话次数
+
+    void enqueue(Worker* worker, SimpleSharedPtr<ClientSession> session);
+    bool takeLocal(Worker* worker, SimpleSharedPtr<ClientSession>& session);
+    bool steal(Worker* thief, SimpleSharedPtr<ClientSession>& session);
+    void runSession(Worker* worker, SimpleSharedPtr<ClientSession> session);
+    void workerLoop(Worker* worker);
+
+public:
+    WorkScheduler(TCPUserSystemServer* owner, int threadCount);
+    ~WorkScheduler();
+
+    bool start();                       // 启动全部执行线程
+    void stop();                        // 执行线程完成当前批次后退出，未执行的命令丢弃
+
+    // 追加会话的待执行命令 - 由I/O线程调用
+    void submit(SimpleSharedPtr<ClientSession> session, std::vector<ProtocolMessage>& commands);
+
+    std::string describeStats();        // 统计摘要(用于日志)
+
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID param);
+#else
+    static void* threadProc(void* param);
+#endif
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * TCP用户系统 - 工作线程池头文件
+ *
+ * 文件结构:
+ * 1. WorkerPoolStats - 线程池运行统计
+ * 2. WorkerPool - 固定数量工作线程 + 有界等待队列
+ *    - 接受线程提交新连接，空闲工作线程取出后执行完整的会话处理
+ *    - 工作线程数量、队列容量、线程栈大小在启动时确定
+ *    - 队列满时的处理策略见TCP_System.h中的PoolOverflowPolicy
+ *
+ * 技术特点:
+ * - 替代每连接创建一个线程的做法，线程数量与内存占用有上限
+ * - 工作线程复用，不再累积待回收的线程句柄
+ * - 运行计数(忙碌线程、排队、拒绝、丢弃等)用于观察线程池利用率
+ */
+
+#ifndef TCP_WORKER_POOL_H
+#define TCP_WORKER_POOL_H
+
+#include "TCP_System.h"
+#include <deque>
+
+// 线程池运行统计
+struct WorkerPoolStats {
+    int threads;                // 工作线程数
+    int busy;                   // 正在处理连接的线程数
+    size_t queued;              // 当前排队连接数
+    size_t capacity;            // 队列容量
+    size_t peakQueued;          // 排队峰值
+    long long submitted;        // 进入队列的连接总数
+    long long completed;        // 处理完毕的连接总数
+    long long rejected;         // 因队列满被拒绝的连接数
+    long long shed;             // 因队列满被丢弃的排队连接数
+    long long blocked;          // 因队列满而等待的提交次数
+};
+
+// 固定大小工作线程池 - 任务为已接受的客户端连接
+class WorkerPool {
+private:
+    TCPUserSystemServer* server;
+    int threadCount;
+    size_t queueCapacity;
+    size_t stackSize;                 // 线程栈大小(字节)，0表示系统默认
+    PoolOverflowPolicy policy;
+
+    std::deque<SOCKET> queue;         // 等待处理的连接
+    SimpleMutex mutex;                // 队列与状态保护
+    SimpleCondition notEmpty;         // 队列非空或停止
+    SimpleCondition notFull;          // 队列有空位或停止
+    bool stopping;
+    int startedThreads;               // 已启动的工作线程数，即下一个线程的序号(CPU绑定)
+
+    // 统计(受mutex保护)
+    int busy;
+    size_t peakQueued;
+    long long submitted;
+    long long completed;
+    long long rejected;
+    long long shed;
+    long long blocked;
+
+#ifdef _WIN32
+    std::vector<HANDLE> threads;
+#else
+    std::vector<pthread_t> threads;
+#endif
+
+    void workerLoop();
+    void refuse(SOCKET socket);       // 回复繁忙并关闭连接
+
+public:
+    WorkerPool(TCPUserSystemServer* owner, int workers, size_t capacity,
+               size_t threadStackSize, PoolOverflowPolicy overflowPolicy);
+    ~WorkerPool();
+
+    bool start();                     // 创建全部工作线程，任一失败返回false
+    void stop();                      // 停止接收，关闭排队连接并等待工作线程退出
+
+    // 提交新连接 - 返回false表示连接已被拒绝并关闭
+    bool submit(SOCKET socket);
+
+    WorkerPoolStats getStats();
+    std::string describeStats();      // 统计摘要(用于日志)
+
+    static const char* policyName(PoolOverflowPolicy overflowPolicy);
+
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID param);
+#else
+    static void* threadProc(void* param);
+#endif
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * TCP用户系统 - 用户数据预写日志头文件
+ *
+ * 文件结构:
+ * 1. WalReplayStats - 启动重放的统计
+ * 2. WriteAheadLog - 追加写入用户修改记录，按持久化模式同步到磁盘，检查点时轮换
+ *
+ * 持久化规则:
+ * - 快照文件(users.txt.snap)是最近一次检查点的快照；之后的每次修改(注册、删除、改密码、设置字符串)
+ *   只向日志(users.txt.wal)追加一条记录，写入代价与记录大小成正比，与用户总数无关
+ * - 记录为一行文本: 类型('+'写入用户，'-'删除用户) + 8位十六进制校验和 + ',' + 用户的CSV序列化
+ *   (删除记录只有用户ID)；同一用户的记录与内存修改在同一把锁内追加，顺序一致
+ * - 每条记录有递增的序号；记录已写入(none)或已同步到磁盘(batched/per-write)后序号成为"已提交"
+ * - 检查点: 先把日志轮换为users.txt.wal.1(之后的修改写入新日志)，再把全部用户写入临时文件并改名为
+ *   快照文件，最后删除轮换出的日志；中途崩溃时快照与两段日志都在，重放仍得到完整数据
+ * - 启动: 加载快照后依次重放users.txt.wal.1与users.txt.wal，记录幂等，重复重放无害；
+ *   遇到未写完(没有换行)或校验和不符的记录即停止，之后的内容视为损坏；
+ *   不清空而继续追加时先把日志截到最后一条完整记录，新记录不会跟在损坏的内容之后
+ * - 写出或同步失败: 已提交序号不再前进，未提交的记录的等待者得到失败结果；此后拒绝追加，
+ *   直到重启(日志末尾可能已有不完整的记录，之后的记录重放时会被丢弃)
+ *
+ * 持久化模式:
+ * - none: 每条记录写入后只刷新到内核，进程崩溃不丢失，掉电可能丢失
+ * - per-write: 每条记录写入后立即同步，调用者在同步完成后才返回
+ * - batched(组提交): 记录先追加到共享缓冲，提交线程一次写出整批并同步一次，
+ *   之后通知服务器放行在此期间暂存的响应；修改请求的响应在其记录提交前不会送出
+ *
+ * 技术特点:
+ * - 追加、提交与轮换分别由缓冲锁与文件锁保护，组提交模式下追加只复制到内存
+ * - 分片模式下各分片可并发追加
+ */
+
+#ifndef TCP_WRITE_AHEAD_LOG_H
+#define TCP_WRITE_AHEAD_LOG_H
+
+#include "TCP_System.h"
+#include <cstdio>
+
+// 启动重放统计
+struct WalReplayStats {
+    size_t records;         // 已应用的记录数
+    size_t damaged;         // 因未写完或校验和不符而停止重放的日志文件数
+
+    WalReplayStats() : records(0), damaged(0) {}
+};
+
+class WriteAheadLog {
+private:
+    TCPUserSystemServer* server;
+    std::string path;               // 当前日志
+    std::string rotatedPath;        // 检查点轮换出的日志，检查点完成后删除
+    std::string directory;          // 日志所在目录(同步新建与改名的目录项)
+    DurabilityMode mode;
+    int commitIntervalMs;           // 组提交: 收到第一条记录后再等待的时间，用于合并更多记录
+
+    FILE* file;
+    SimpleMutex fileMutex;          // 文件写入、同步与轮换
+
+    // 以下受mutex保护
+    SimpleMutex mutex;
+    SimpleCondition pendingCondition;   // 组提交缓冲非空或停止
+    SimpleCondition durableCondition;   // 已提交序号前进
+    std::string pending;                // 组提交: 尚未写出的记录
+    unsigned long long appendedSeq;     // 最后追加的记录序号
+    unsigned long long durableSeq;      // 已提交的记录序号
+    bool failed;                        // 写出或同步失败过，不再接受追加
+    bool stopping;
+
+    // 统计(受mutex保护)
+    unsigned long long pendingBytes;    // 自上次轮换以来追加的字节数(检查点触发条件)
+    unsigned long long pendingRecords;  // 自上次轮换以来追加的记录数(重新打开已有日志时从0计)
+    unsigned long long bytes;
+    unsigned long long failures;        // 写入或同步失败的次数
+    unsigned long long rotations;
+    unsigned long long commits;         // 写出(并同步)的批次数
+    unsigned long long largestBatch;    // 单批最多的记录数
+    unsigned long long syncMs;          // 同步累计耗时(毫秒)
+
+#ifdef _WIN32
+    HANDLE committer;
+#else
+    pthread_t committer;
+#endif
+    bool committerStarted;
+
+    WriteAheadLog(const WriteAheadLog&);
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    unsigned long long appendRecord(char type, const std::string& payload);
+    bool writeOut(const std::string& data, bool sync);      // 调用者持有fileMutex
+    unsigned long long commitPending();                     // 调用者持有fileMutex: 写出组提交缓冲，返回已提交序号(无记录或失败返回0)
+    void publishDurable(unsigned long long seq, unsigned long long batchRecords);
+    void markFailed();
+    void commitLoop();
+    static unsigned int checksum(const std::string& payload);
+    // users为空时只校验；validBytes给出末尾第一条不完整或损坏的记录之前的字节数
+    static bool replayFile(const std::string& logPath, std::map<std::string, User>* users, WalReplayStats& stats,
+                           unsigned long long& validBytes);
+    static bool truncateFile(const std::string& filePath, unsigned long long length);
+    static long fileSize(const std::string& filePath);     // 文件不存在返回-1
+
+#ifdef _WIN32
+    static DWORD WINAPI threadProc(LPVOID param);
+#else
+    static void* threadProc(void* param);
+#endif
+
+public:
+    WriteAheadLog(TCPUserSystemServer* owner, const std::string& dataFile, DurabilityMode durability, int intervalMs);
+    ~WriteAheadLog();
+
+    // 打开当前日志(truncate为true时清空，用于启动检查点之后)，组提交模式同时启动提交线程；
+    // 不清空时先截掉末尾未写完或损坏的记录，否则之后追加的记录在重放时会随之被丢弃，截断失败返回false
+    bool open(bool truncate);
+    // 提交缓冲中剩余的记录并停止提交线程，之后不再追加
+    void close();
+    bool hasRecords() const;        // 当前日志或轮换出的日志中有记录
+    static bool hasLogRecords(const std::string& dataFile);     // 同上，用于打开日志之前(加载数据文件时)
+
+    // 在保护该用户的锁内调用，返回记录序号(写入失败或日志已失败返回0)
+    unsigned long long appendPut(const User& user);
+    unsigned long long appendDelete(const std::string& userId);
+
+    unsigned long long getDurableSeq();
+    bool waitDurable(unsigned long long seq);   // 阻塞到该序号的记录已提交(返回true)或日志失败(返回false)
+    bool hasFailed();
+    DurabilityMode getMode() const { return mode; }
+
+    // 检查点 - 先提交缓冲中的记录；rotate之后的修改写入新日志；
+    // 上一次轮换出的日志仍在(检查点未完成)时不轮换，返回false
+    bool rotate();
+    void removeRotated();           // 快照已写出，轮换出的日志不再需要
+    unsigned long long getPendingBytes();
+    unsigned long long getPendingRecords();
+
+    std::string describeStats();
+
+    static const char* modeName(DurabilityMode durability);
+    static bool syncPath(const std::string& filePath);     // 把文件(非Windows下也可为目录)同步到磁盘
+
+    // 启动时在快照之上重放日志(先轮换出的日志，后当前日志)
+    static void replay(const std::string& dataFile, std::map<std::string, User>& users, WalReplayStats& stats);
+};
+
+#endif
@@ -26,13 +26,16 @@ if %errorlevel% neq 0 (
     exit /b 1
 )
 
+REM 服务器与客户端共用的核心源文件
+set CORE_SOURCES=Source/Private/TCP_System.cpp Source/Private/Event_Loop.cpp Source/Private/Uring_Loop.cpp Source/Private/Worker_Pool.cpp Source/Private/Work_Scheduler.cpp Source/Private/Timer_Wheel.cpp Source/Private/Shm_Transport.cpp Source/Private/Hot_Restart.cpp Source/Private/User_Shard.cpp Source/Private/Thread_Placement.cpp Source/Private/Write_Ahead_Log.cpp Source/Private/User_Snapshot.cpp Source/Private/Mapped_Snapshot.cpp Source/Private/Csv_Loader.cpp
+
 echo 正在编译TCP用户系统...
 echo 使用编译器: 
 g++ --version | findstr "g++"
 
 echo.
 echo 编译服务器...
-g++ -std=c++11 -I. -o bin/tcp_server.exe main.cpp Source/Private/TCP_System.cpp -lws2_32
+g++ -std=c++11 -I. -o bin/tcp_server.exe main.cpp %CORE_SOURCES% -lws2_32
 if %errorlevel% neq 0 (
     echo 服务器编译失败!
     pause
@@ -42,7 +45,7 @@ echo 服务器编译成功!
 
 echo.
 echo 编译客户端...
-g++ -std=c++11 -I. -o bin/tcp_client.exe Source/Private/Client.cpp Source/Private/TCP_System.cpp -lws2_32
+g++ -std=c++11 -I. -o bin/tcp_client.exe Source/Private/Client.cpp %CORE_SOURCES% -lws2_32
 if %errorlevel% neq 0 (
     echo 客户端编译失败!
     pause
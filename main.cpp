@@ -4,15 +4,16 @@
  * 功能说明:
  * 1. 服务器程序启动入口
  * 2. 控制台编码设置 - 确保Windows环境下中文正确显示
- * 3. 用户交互界面 - 端口配置和启动确认
- * 4. 服务器实例创建和生命周期管理
+ * 3. 命令行配置解析 - --key=value 形式的运行配置(见ServerConfig)
+ * 4. 用户交互界面 - 端口配置和启动确认
+ * 5. 服务器实例创建和生命周期管理
  * 
  * 启动流程:
  * 1. 设置控制台编码(Windows)
- * 2. 获取用户输入的端口号
+ * 2. 解析命令行配置，未指定端口时获取用户输入的端口号
  * 3. 创建服务器实例
  * 4. 启动服务器监听
- * 5. 保持运行直到手动停止
+ * 5. 保持运行直到收到停止信号，主线程执行停止流程(排空连接、保存数据)
  */
 
 #include "Source/Public/TCP_System.h"
@@ -29,15 +30,19 @@
 #endif
 
 // 全局服务器指针，用于信号处理
-TCPUserSystemServer* g_server = 0;
+TCPUserSystemServer* volatile g_server = 0;
 
-// 信号处理函数 - 关闭服务器
+// 信号处理函数 - 请求关闭服务器
 #ifdef _WIN32
 BOOL WINAPI consoleHandler(DWORD signal) {
     if (signal == CTRL_C_EVENT || signal == CTRL_CLOSE_EVENT) {
         std::cout << "\n收到关闭信号，正在关闭服务器..." << std::endl;
         if (g_server) {
-            g_server->stopServer();
+            g_server->requestStop();
+        }
+        // 关闭控制台窗口时处理函数返回后进程即被终止，等待主线程完成停止流程
+        while (signal == CTRL_CLOSE_EVENT && g_server) {
+            Sleep(50);
         }
         return TRUE;
     }
@@ -48,13 +53,36 @@ void signalHandler(int signal) {
     if (signal == SIGINT || signal == SIGTERM) {
         std::cout << "\n收到关闭信号，正在关闭服务器..." << std::endl;
         if (g_server) {
-            g_server->stopServer();
+            g_server->requestStop();    // 停止流程由主线程执行，信号处理函数中只设置标志
         }
     }
 }
 #endif
 
-int main() {
+// 解析命令行配置 - 参数格式为 --key=value
+bool parseArguments(int argc, char* argv[], ServerConfig& config, bool& portSpecified) {
+    portSpecified = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            std::cerr << "无法识别的参数: " << arg << std::endl;
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (!config.applyOption(key, value)) {
+            std::cerr << "无效的配置项: " << arg << std::endl;
+            return false;
+        }
+        if (key == "port") {
+            portSpecified = true;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
 #ifdef _WIN32
     // Windows控制台编码设置 - 解决中文乱码问题
     SetConsoleOutputCP(65001);  // 设置输出编码为UTF-8
@@ -77,22 +105,33 @@ int main() {
 #endif
 
     std::cout << "=== TCP 用户系统服务器 ===" << std::endl;
+
+    // 命令行配置
+    ServerConfig config;
+    bool portSpecified = false;
+    if (!parseArguments(argc, argv, config, portSpecified)) {
+        std::cout << "用法: tcp_server [选项]\n" << ServerConfig::usage();
+        return 1;
+    }
     
-    // 端口配置 - 允许用户自定义监听端口
-    int port = 8080;
-    std::cout << "请输入服务器端口 (默认 8080): ";
-    std::string input;
-    std::getline(std::cin, input);
-    if (!input.empty()) {
-        port = atoi(input.c_str());  // 使用atoi兼容老版本编译器
-        if (port <= 0 || port > 65535) {
-            std::cout << "端口号无效，使用默认端口 8080" << std::endl;
-            port = 8080;
+    // 端口配置 - 命令行未指定时允许用户自定义监听端口
+    if (!portSpecified) {
+        int port = 8080;
+        std::cout << "请输入服务器端口 (默认 8080): ";
+        std::string input;
+        std::getline(std::cin, input);
+        if (!input.empty()) {
+            port = atoi(input.c_str());  // 使用atoi兼容老版本编译器
+            if (port <= 0 || port > 65535) {
+                std::cout << "端口号无效，使用默认端口 8080" << std::endl;
+                port = 8080;
+            }
         }
+        config.port = port;
     }
 
     // 创建服务器实例 - 只传递文件名，路径处理由服务器内部完成
-    TCPUserSystemServer server(port, "users.txt");
+    TCPUserSystemServer server(config);
     g_server = &server;  // 设置全局指针用于信号处理
     
     // 启动服务器 - 进入监听状态